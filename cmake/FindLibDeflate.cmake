@@ -0,0 +1,23 @@
+# - Try to find libdeflate
+#
+# Once done this will define
+#
+#  LIBDEFLATE_FOUND - system has libdeflate
+#  LIBDEFLATE_INCLUDE_DIRS - the libdeflate include directory
+#  LIBDEFLATE_LIBRARIES - link these to use libdeflate
+
+find_path(LIBDEFLATE_INCLUDE_DIR NAMES libdeflate.h)
+find_library(LIBDEFLATE_LIBRARY NAMES deflate libdeflate)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibDeflate DEFAULT_MSG LIBDEFLATE_LIBRARY LIBDEFLATE_INCLUDE_DIR)
+
+if(LIBDEFLATE_FOUND)
+	set(LIBDEFLATE_LIBRARIES ${LIBDEFLATE_LIBRARY})
+	set(LIBDEFLATE_INCLUDE_DIRS ${LIBDEFLATE_INCLUDE_DIR})
+else()
+	set(LIBDEFLATE_LIBRARIES)
+	set(LIBDEFLATE_INCLUDE_DIRS)
+endif()
+
+mark_as_advanced(LIBDEFLATE_INCLUDE_DIR LIBDEFLATE_LIBRARY)
@@ -80,6 +80,54 @@ else()
 	message(FATAL_ERROR "Asked for unknown SHA256 backend: ${USE_SHA256}")
 endif()
 
+# processor instructions for SHA1 and SHA256, used when available at
+# runtime for the builtin SHA256 and for checksums
+
+include(CheckCSourceCompiles)
+
+check_c_source_compiles("
+#include <immintrin.h>
+#if defined(__GNUC__)
+# include <cpuid.h>
+__attribute__((target(\"sha,sse4.1,ssse3\")))
+#else
+# include <intrin.h>
+#endif
+static __m128i sha(__m128i a, __m128i b) { return _mm_sha256rnds2_epu32(a, b, _mm_sha1rnds4_epu32(a, b, 0)); }
+int main(void) { __m128i a = _mm_setzero_si128(); return _mm_extract_epi32(sha(a, a), 0); }
+" GIT_HASH_SHANI)
+
+if(GIT_HASH_SHANI)
+	check_c_source_compiles("
+#include <immintrin.h>
+#if defined(__GNUC__)
+# define AVX2 __attribute__((target(\"avx2\")))
+# define AVX512 __attribute__((target(\"avx512f,avx512bw\")))
+#else
+# include <intrin.h>
+# define AVX2
+# define AVX512
+#endif
+static AVX2 int avx2(void) { __m256i a = _mm256_setzero_si256(); return _mm256_extract_epi32(_mm256_shuffle_epi8(_mm256_add_epi32(a, a), a), 0); }
+static AVX512 int avx512(void) { __m512i a = _mm512_setzero_si512(); return _mm_cvtsi128_si32(_mm512_castsi512_si128(_mm512_shuffle_epi8(_mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), a, a, 0x96), a))); }
+int main(void) { return avx2() + avx512(); }
+" GIT_HASH_X86_LANES)
+else()
+	check_c_source_compiles("
+#include <arm_neon.h>
+#if !defined(__aarch64__) || defined(__ARM_BIG_ENDIAN)
+# error unsupported architecture
+#endif
+#if defined(__clang__)
+__attribute__((target(\"crypto\")))
+#else
+__attribute__((target(\"+crypto\")))
+#endif
+static uint32x4_t sha(uint32x4_t a, uint32x4_t b) { return vsha256hq_u32(vsha1cq_u32(a, 0, b), a, b); }
+int main(void) { uint32x4_t a = vdupq_n_u32(0); return (int)vgetq_lane_u32(sha(a, a), 0); }
+" GIT_HASH_ARMV8)
+endif()
+
 # add library requirements
 if(USE_SHA1 STREQUAL "OpenSSL" OR USE_SHA256 STREQUAL "OpenSSL")
 	if(CMAKE_SYSTEM_NAME MATCHES "FreeBSD")
@@ -102,3 +150,13 @@ endif()
 
 add_feature_info(SHA1 ON "using ${USE_SHA1}")
 add_feature_info(SHA256 ON "using ${USE_SHA256}")
+
+if(GIT_HASH_SHANI AND GIT_HASH_X86_LANES)
+	add_feature_info("SHA acceleration" ON "using the x86 SHA extensions, AVX2 and AVX-512")
+elseif(GIT_HASH_SHANI)
+	add_feature_info("SHA acceleration" ON "using the x86 SHA extensions")
+elseif(GIT_HASH_ARMV8)
+	add_feature_info("SHA acceleration" ON "using the ARMv8 cryptography extension")
+else()
+	add_feature_info("SHA acceleration" OFF "SHA instructions are not available")
+endif()
@@ -1,5 +1,6 @@
 # Optional external dependency: zlib
 include(SanitizeBool)
+include(CheckSymbolExists)
 
 SanitizeBool(USE_BUNDLED_ZLIB)
 if(USE_BUNDLED_ZLIB STREQUAL ON)
@@ -16,7 +17,17 @@ if(USE_BUNDLED_ZLIB STREQUAL "OFF")
 		else()
 			list(APPEND LIBGIT2_PC_REQUIRES "zlib")
 		endif()
-		add_feature_info(zlib ON "using system zlib")
+
+		# zlib-ng, built to be compatible, stands in for zlib
+		set(CMAKE_REQUIRED_INCLUDES ${ZLIB_INCLUDE_DIRS})
+		check_symbol_exists(ZLIBNG_VERSION "zlib.h" HAVE_ZLIB_NG)
+		unset(CMAKE_REQUIRED_INCLUDES)
+
+		if(HAVE_ZLIB_NG)
+			add_feature_info(zlib ON "using system zlib-ng")
+		else()
+			add_feature_info(zlib ON "using system zlib")
+		endif()
 	else()
 		message(STATUS "zlib was not found; using bundled 3rd-party sources." )
 	endif()
@@ -32,3 +43,21 @@ elseif(USE_BUNDLED_ZLIB OR NOT ZLIB_FOUND)
 	list(APPEND LIBGIT2_DEPENDENCY_OBJECTS $<TARGET_OBJECTS:zlib>)
 	add_feature_info(zlib ON "using bundled zlib")
 endif()
+
+# Optional external dependency: libdeflate, which inflates whole
+# objects (whose size we know) much faster than zlib streams them
+if(USE_LIBDEFLATE)
+	find_package(LibDeflate)
+
+	if(NOT LIBDEFLATE_FOUND)
+		message(FATAL_ERROR "libdeflate support was requested but not found")
+	endif()
+
+	set(GIT_LIBDEFLATE 1)
+	list(APPEND LIBGIT2_SYSTEM_INCLUDES ${LIBDEFLATE_INCLUDE_DIRS})
+	list(APPEND LIBGIT2_SYSTEM_LIBS ${LIBDEFLATE_LIBRARIES})
+	list(APPEND LIBGIT2_PC_REQUIRES "libdeflate")
+	add_feature_info(libdeflate ON "using libdeflate to inflate objects")
+else()
+	add_feature_info(libdeflate OFF "libdeflate support is disabled")
+endif()
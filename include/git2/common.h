@@ -228,7 +228,17 @@ typedef enum {
 	GIT_OPT_SET_SERVER_CONNECT_TIMEOUT,
 	GIT_OPT_GET_SERVER_CONNECT_TIMEOUT,
 	GIT_OPT_SET_SERVER_TIMEOUT,
-	GIT_OPT_GET_SERVER_TIMEOUT
+	GIT_OPT_GET_SERVER_TIMEOUT,
+	GIT_OPT_GET_PACK_CACHE_SIZE,
+	GIT_OPT_SET_PACK_CACHE_SIZE,
+	GIT_OPT_GET_PACK_CACHE_STATS,
+	GIT_OPT_GET_CACHE_STATS,
+	GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE,
+	GIT_OPT_GET_ODB_REFRESH_INTERVAL,
+	GIT_OPT_SET_ODB_REFRESH_INTERVAL,
+	GIT_OPT_GET_ODB_REFRESH_STATS,
+	GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE,
+	GIT_OPT_ENABLE_PACK_INDEX_READAHEAD
 } git_libgit2_opt_t;
 
 /**
@@ -502,6 +512,78 @@ typedef enum {
  *      > Sets the timeout (in milliseconds) for reading from and writing
  *      > to a remote server. Set to 0 to use the system default.
  *
+ *   opts(GIT_OPT_GET_PACK_CACHE_SIZE, size_t *out)
+ *      > Gets the maximum memory (in bytes) that the delta base cache of
+ *      > each packfile may use.
+ *
+ *   opts(GIT_OPT_SET_PACK_CACHE_SIZE, size_t size)
+ *      > Sets the maximum memory (in bytes) that the delta base cache of
+ *      > each packfile may use.  When a cache is full, its least recently
+ *      > used objects are evicted; lowering the limit takes effect as
+ *      > objects are next added to each cache.  Set to 0 to disable the
+ *      > delta base cache.  The default is 16MB.
+ *
+ *   opts(GIT_OPT_GET_PACK_CACHE_STATS, size_t *hits, size_t *misses, size_t *evictions)
+ *      > Gets the number of lookups in the delta base caches of all
+ *      > packfiles that found an object, the number that did not, and
+ *      > the number of objects that have been evicted to make room for
+ *      > others, since the library was loaded.  Any of the pointers may
+ *      > be `NULL`.
+ *
+ *   opts(GIT_OPT_GET_CACHE_STATS, size_t *hits, size_t *misses, size_t *evictions)
+ *      > Gets the number of lookups in the object caches of all
+ *      > repositories and object databases that found an object, the
+ *      > number that did not, and the number of objects that have been
+ *      > evicted to stay within `GIT_OPT_SET_CACHE_MAX_SIZE`, since the
+ *      > library was loaded.  Any of the pointers may be `NULL`.
+ *
+ *   opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, int enabled)
+ *      > Keep the list of loose objects in each directory of an object
+ *      > database in memory, so that checking whether a loose object
+ *      > exists (or resolving a short object id) does not need to touch
+ *      > the filesystem.  The lists are read when they are first needed
+ *      > and checked again when the object database is refreshed, so
+ *      > loose objects written by other processes may not be seen until
+ *      > then.  This applies to object databases opened after it is
+ *      > set.  This is disabled by default.
+ *
+ *   opts(GIT_OPT_GET_ODB_REFRESH_INTERVAL, int *interval)
+ *      > Gets the minimum time (in milliseconds) between the refreshes
+ *      > of an object database that looking up a missing object causes.
+ *
+ *   opts(GIT_OPT_SET_ODB_REFRESH_INTERVAL, int interval)
+ *      > Sets the minimum time (in milliseconds) between the refreshes
+ *      > of an object database that looking up a missing object causes.
+ *      > A lookup that misses within that time of the last refresh
+ *      > fails without looking for new packfiles.  Independently of
+ *      > this, an object that was still missing after a refresh does
+ *      > not cause another one until the pack directory changes.  The
+ *      > default is 0, which refreshes on every such miss.
+ *
+ *   opts(GIT_OPT_GET_ODB_REFRESH_STATS, size_t *refreshes, size_t *missing_hits, size_t *rate_limited)
+ *      > Gets the number of times that object databases have been
+ *      > refreshed, the number of lookups that did not refresh because
+ *      > the object was known to be missing, and the number that did
+ *      > not refresh because of `GIT_OPT_SET_ODB_REFRESH_INTERVAL`,
+ *      > since the library was loaded.  Any of the pointers may be
+ *      > `NULL`.
+ *
+ *   opts(GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE, int enabled)
+ *      > Map each packfile into memory whole, the first time it is read,
+ *      > instead of in windows of `GIT_OPT_SET_MWINDOW_SIZE`.  Reading
+ *      > from a packfile that is mapped whole needs no locking, which
+ *      > helps when many threads read objects at once.  Such mappings
+ *      > count towards `GIT_OPT_SET_MWINDOW_MAPPED_LIMIT`, but they are
+ *      > only released when the packfile is closed, and the packfile is
+ *      > not closed to stay within `GIT_OPT_SET_MWINDOW_FILE_LIMIT`.
+ *      > This is meant for 64-bit systems, and is disabled by default.
+ *
+ *   opts(GIT_OPT_ENABLE_PACK_INDEX_READAHEAD, int enabled)
+ *      > When a packfile index is opened, ask the system to start reading
+ *      > its fanout and object id tables in the background, so that the
+ *      > first lookups in it do not each wait for the disk.  This is
+ *      > disabled by default.
+ *
  * @param option Option key
  * @param ... value to set the option
  * @return 0 on success, <0 on failure
@@ -83,6 +83,24 @@ typedef struct git_indexer_options {
 
 	/** Do connectivity checks for the received pack */
 	unsigned char verify;
+
+	/**
+	 * The number of threads to resolve deltas with once the whole
+	 * pack has been received.  The default of 0 (or 1) resolves
+	 * them on the calling thread.  This has no effect if libgit2
+	 * was built without thread support.
+	 */
+	unsigned int threads;
+
+	/**
+	 * Parse, inflate and hash the received data on a separate
+	 * thread, so that `git_indexer_append` only needs to queue it
+	 * up and can return to receiving more data right away.  The
+	 * progress callback is still called from the thread that calls
+	 * `git_indexer_append`.  This has no effect if libgit2 was built
+	 * without thread support.
+	 */
+	unsigned char pipeline;
 } git_indexer_options;
 
 #define GIT_INDEXER_OPTIONS_VERSION 1
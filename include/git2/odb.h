@@ -38,6 +38,14 @@ typedef enum {
  */
 typedef int GIT_CALLBACK(git_odb_foreach_cb)(const git_oid *id, void *payload);
 
+/**
+ * Function type for callbacks from git_odb_read_many.
+ *
+ * The object is only valid for the duration of the callback; use
+ * `git_odb_object_dup` to keep a reference to it.
+ */
+typedef int GIT_CALLBACK(git_odb_read_many_cb)(git_odb_object *obj, void *payload);
+
 /** Options for configuring a loose object backend. */
 typedef struct {
 	unsigned int version; /**< version for the struct */
@@ -142,6 +150,36 @@ GIT_EXTERN(void) git_odb_free(git_odb *db);
  */
 GIT_EXTERN(int) git_odb_read(git_odb_object **out, git_odb *db, const git_oid *id);
 
+/**
+ * Read a number of objects from the database.
+ *
+ * This is equivalent to calling `git_odb_read` for each of the given
+ * ids, but allows the backends to read the objects in the order that
+ * suits them best: the packfile backend reads the objects of each
+ * packfile in the order that they are stored, so that delta bases
+ * that are shared by several of the objects are only inflated once.
+ *
+ * The objects are thus delivered to the callback in no particular
+ * order.  Each object is delivered once per occurrence of its id in
+ * `ids`.  Returning a non-zero value from the callback stops the
+ * iteration and that value is returned.
+ *
+ * @param db database to search for the objects in.
+ * @param ids the ids of the objects to read
+ * @param count the number of ids
+ * @param cb the callback to call for each object
+ * @param payload data to pass to the callback
+ * @return 0 if all the objects were read, GIT_ENOTFOUND if an object
+ *         is not in the database (after the ones that were found have
+ *         been delivered), or the value returned by the callback.
+ */
+GIT_EXTERN(int) git_odb_read_many(
+	git_odb *db,
+	const git_oid *ids,
+	size_t count,
+	git_odb_read_many_cb cb,
+	void *payload);
+
 /**
  * Read an object from the database, given a prefix
  * of its identifier.
@@ -466,6 +504,55 @@ GIT_EXTERN(int) git_odb_write_pack(
 GIT_EXTERN(int) git_odb_write_multi_pack_index(
 	git_odb *db);
 
+/**
+ * A bulk-write transaction on an object database.
+ *
+ * @see git_odb_bulk_new
+ */
+typedef struct git_odb_bulk git_odb_bulk;
+
+/**
+ * Begin writing new objects to the ODB in bulk.
+ *
+ * While the transaction is open, the objects written to the ODB (with
+ * `git_odb_write` and everything built on it, like
+ * `git_blob_create_from_buffer`) are appended to a single new packfile,
+ * instead of being written as individual loose objects.  They can be
+ * read back from the ODB as soon as they are written.
+ *
+ * `git_odb_bulk_commit` writes the index for the packfile and moves
+ * both into place; freeing the transaction without committing it
+ * discards the objects written since it began.  Only one transaction
+ * can be open on an ODB at a time, and the ODB needs to have a pack
+ * directory (as a repository's ODB does).
+ *
+ * @param out pointer to the new transaction
+ * @param db object database to write to
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_bulk_new(git_odb_bulk **out, git_odb *db);
+
+/**
+ * Finish the packfile of a bulk-write transaction and make its objects
+ * part of the ODB.  The transaction must still be freed afterwards.
+ *
+ * If the packfile or its index cannot be written, the transaction is
+ * left open: its objects can still be read, and the commit can be
+ * retried.
+ *
+ * @param bulk the transaction to commit
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_bulk_commit(git_odb_bulk *bulk);
+
+/**
+ * Free a bulk-write transaction.  If it was not committed, the objects
+ * written since it began are discarded.
+ *
+ * @param bulk the transaction to free
+ */
+GIT_EXTERN(void) git_odb_bulk_free(git_odb_bulk *bulk);
+
 /**
  * Determine the object-ID (sha1 or sha256 hash) of a data buffer
  *
@@ -86,7 +86,15 @@ GIT_EXTERN(int) git_odb_backend_one_pack(
 #endif
 
 typedef enum {
-	GIT_ODB_BACKEND_LOOSE_FSYNC = (1 << 0)
+	GIT_ODB_BACKEND_LOOSE_FSYNC = (1 << 0),
+
+	/**
+	 * Keep the list of objects in each `objects/xx/` directory in
+	 * memory once it has been read, rather than looking for each
+	 * object on disk.  The lists are checked for changes when the
+	 * backend is refreshed.
+	 */
+	GIT_ODB_BACKEND_LOOSE_CACHE = (1 << 1)
 } git_odb_backend_loose_flag_t;
 
 /** Options for configuring a loose object backend. */
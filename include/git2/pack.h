@@ -69,7 +69,8 @@ GIT_EXTERN(int) git_packbuilder_new(git_packbuilder **out, git_repository *repo)
  *
  * By default, libgit2 won't spawn any threads at all;
  * when set to 0, libgit2 will autodetect the number of
- * CPUs.
+ * CPUs.  The threads are used both to search for deltas
+ * and to compress the objects as the packfile is written.
  *
  * @param pb The packbuilder
  * @param n Number of threads to spawn
@@ -77,6 +78,36 @@ GIT_EXTERN(int) git_packbuilder_new(git_packbuilder **out, git_repository *repo)
  */
 GIT_EXTERN(unsigned int) git_packbuilder_set_threads(git_packbuilder *pb, unsigned int n);
 
+/**
+ * Set whether `git_packbuilder_write` should also write a reachability
+ * bitmap index (a `.bitmap` file) for the packfile.
+ *
+ * Bitmaps are only stored for commits whose entire history is contained
+ * in the packfile, so this is useful when repacking all of the objects
+ * in a repository.  The default is taken from the `pack.writeBitmaps`
+ * configuration option (false if unset).
+ *
+ * @param pb The packbuilder
+ * @param enabled Whether to write a bitmap index
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_packbuilder_set_write_bitmap(git_packbuilder *pb, int enabled);
+
+/**
+ * Set whether deltas in the packfile may refer to their base by its
+ * offset in the packfile ("offset deltas"), instead of by its object ID.
+ *
+ * Offset deltas are smaller and faster to read back, but must be
+ * understood by whoever receives the pack.  They are enabled by
+ * default; when pushing, they are only used if the remote supports them
+ * and the `GIT_OPT_ENABLE_OFS_DELTA` option allows them.
+ *
+ * @param pb The packbuilder
+ * @param enabled Whether to write offset deltas
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_packbuilder_set_ofs_delta(git_packbuilder *pb, int enabled);
+
 /**
  * Insert a single object
  *
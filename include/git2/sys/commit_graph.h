@@ -46,6 +46,28 @@ GIT_EXTERN(int) git_commit_graph_open(
  */
 GIT_EXTERN(void) git_commit_graph_free(git_commit_graph *cgraph);
 
+/**
+ * Check whether a commit may have changed a path, using the changed-path
+ * Bloom filters of the commit-graph.
+ *
+ * The filters are of the paths that differ between a commit and its first
+ * parent (or the empty tree, for a root commit), and of the directories
+ * that they are in. They can give false positives, but not false
+ * negatives: when this returns 0, the tree diff of the commit against its
+ * first parent would not show the path, or anything below it.
+ *
+ * @param cgraph the commit-graph.
+ * @param commit_id the commit to check.
+ * @param path the path, relative to the root of the repository.
+ * @return 0 if the commit did not change the path, 1 if it may have,
+ *         GIT_ENOTFOUND if the commit is not in the commit-graph or has
+ *         no filter, or an error code.
+ */
+GIT_EXTERN(int) git_commit_graph_maybe_changed_path(
+	git_commit_graph *cgraph,
+	const git_oid *commit_id,
+	const char *path);
+
 /**
  * Create a new writer for `commit-graph` files.
  *
@@ -72,6 +94,9 @@ GIT_EXTERN(void) git_commit_graph_writer_free(git_commit_graph_writer *w);
 /**
  * Add an `.idx` file (associated to a packfile) to the writer.
  *
+ * If changed-path Bloom filters are written, they are computed in the
+ * repository, which must not be freed before the writer is.
+ *
  * @param w The writer.
  * @param repo The repository that owns the `.idx` file.
  * @param idx_path The path of an `.idx` file.
@@ -86,6 +111,9 @@ GIT_EXTERN(int) git_commit_graph_writer_add_index_file(
  * Add a revwalk to the writer. This will add all the commits from the revwalk
  * to the commit-graph.
  *
+ * If changed-path Bloom filters are written, they are computed in the
+ * repository of the revwalk, which must not be freed before the writer is.
+ *
  * @param w The writer.
  * @param walk The git_revwalk.
  * @return 0 or an error code
@@ -104,7 +132,27 @@ typedef enum {
 	 * Do not split commit-graph files. The other split strategy-related option
 	 * fields are ignored.
 	 */
-	GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE = 0
+	GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE = 0,
+
+	/**
+	 * Write the commits that are not in the commit-graph yet to a new file in
+	 * the `commit-graphs` chain, merging the files at the top of the chain
+	 * into it as given by `size_multiple` and `max_commits`. A single
+	 * `commit-graph` file becomes the bottom of the chain.
+	 */
+	GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT,
+
+	/**
+	 * Like `GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT`, but never merge the files
+	 * that are already in the chain.
+	 */
+	GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_NO_MERGE,
+
+	/**
+	 * Merge all the files of the chain, along with the new commits, into a
+	 * chain of a single file.
+	 */
+	GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_REPLACE
 } git_commit_graph_split_strategy_t;
 
 /**
@@ -126,14 +174,30 @@ typedef struct {
 	/**
 	 * The number of commits in level N is less than X times the number of
 	 * commits in level N + 1. Default is 2.
+	 *
+	 * When writing a new level, the levels below it are merged into it
+	 * until this holds.
 	 */
 	float size_multiple;
 
 	/**
 	 * The number of commits in level N + 1 is more than C commits.
 	 * Default is 64000.
+	 *
+	 * When writing a new level that would have more commits than this, the
+	 * levels below it are merged into it regardless of `size_multiple`.
 	 */
 	size_t max_commits;
+
+	/**
+	 * Whether to write changed-path Bloom filters, which tell whether a
+	 * commit may have changed a path since its first parent (see
+	 * `git_commit_graph_maybe_changed_path`). Default is 0.
+	 *
+	 * Computing them takes a tree diff of each commit; the commits of the
+	 * files of a chain that are merged keep the filters that they have.
+	 */
+	int changed_paths;
 } git_commit_graph_writer_options;
 
 #define GIT_COMMIT_GRAPH_WRITER_OPTIONS_VERSION 1
@@ -156,7 +220,8 @@ GIT_EXTERN(int) git_commit_graph_writer_options_init(
 	unsigned int version);
 
 /**
- * Write a `commit-graph` file to a file.
+ * Write a `commit-graph` file to a file, or a new file of the chain of
+ * them in `commit-graphs` if the options ask to split it.
  *
  * @param w The writer
  * @param opts Pointer to git_commit_graph_writer_options struct.
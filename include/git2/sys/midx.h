@@ -53,6 +53,40 @@ GIT_EXTERN(int) git_midx_writer_add(
 		git_midx_writer *w,
 		const char *idx_path);
 
+/**
+ * Set whether to also write a reachability bitmap index
+ * (`multi-pack-index-<checksum>.bitmap`) for the `multi-pack-index`,
+ * along with the reverse index (`multi-pack-index-<checksum>.rev`)
+ * that it depends on.
+ *
+ * Bitmaps are only stored for commits whose entire history is
+ * contained in the packfiles that were added to the writer.
+ *
+ * @param w the writer
+ * @param enabled whether to write a bitmap index
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_midx_writer_set_write_bitmap(
+		git_midx_writer *w,
+		int enabled);
+
+/**
+ * Set whether to add a layer to the chain of multi-pack-indexes in
+ * `multi-pack-index.d/` rather than rewrite the `multi-pack-index`.
+ *
+ * The new layer indexes the packfiles that were added to the writer
+ * and are not in the chain yet.  To keep the chain short, the layers
+ * at its top that are less than twice the size of the new one are
+ * merged into it.  Bitmaps cannot be written for a layer.
+ *
+ * @param w the writer
+ * @param enabled whether to write a layer
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_midx_writer_set_incremental(
+		git_midx_writer *w,
+		int enabled);
+
 /**
  * Write a `multi-pack-index` file to a file.
  *
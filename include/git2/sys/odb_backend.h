@@ -21,6 +21,17 @@
  */
 GIT_BEGIN_DECL
 
+/**
+ * Function type for the callback that a backend's `read_many` calls
+ * for each object that it finds.  `idx` is the position of the
+ * object's id in the array given to `read_many`; the `data` buffer
+ * must be allocated with `git_odb_backend_data_alloc` and is owned by
+ * the callee.  A non-zero return value should stop the iteration and
+ * be returned from `read_many`.
+ */
+typedef int GIT_CALLBACK(git_odb_backend_read_many_cb)(
+	size_t idx, void *data, size_t len, git_object_t type, void *payload);
+
 /**
  * An instance for a custom backend
  */
@@ -104,6 +115,16 @@ struct git_odb_backend {
 	 * itself). An odb backend implementation must provide this function.
 	 */
 	void GIT_CALLBACK(free)(git_odb_backend *);
+
+	/**
+	 * Reads a number of objects at once, in whatever order is most
+	 * efficient for the backend, calling the callback for each of them.
+	 * Ids that the backend does not contain are skipped.  This is
+	 * optional; backends without it are read one object at a time.
+	 */
+	int GIT_CALLBACK(read_many)(
+		git_odb_backend *, const git_oid *, size_t,
+		git_odb_backend_read_many_cb, void *);
 };
 
 #define GIT_ODB_BACKEND_VERSION 1
@@ -9,7 +9,10 @@
 
 #include "commit.h"
 #include "blob.h"
+#include "commit_graph.h"
 #include "diff_xdiff.h"
+#include "odb.h"
+#include "repository.h"
 
 /*
  * Origin is refcounted and usually we keep the blob contents to be
@@ -428,6 +431,35 @@ static int paths_on_dup(void **old, void *new)
 	return -1;
 }
 
+/*
+ * Whether the changed-path Bloom filters of the commit-graph say that the
+ * origin's path is the same in the parent, which must then be the first.
+ */
+static bool origin_unchanged_in_parent(
+		git_blame *blame,
+		git_commit *parent,
+		git_blame__origin *origin)
+{
+	git_odb *odb;
+	git_commit_graph_file *cgraph_file = NULL;
+	git_commit_graph_entry e;
+
+	if (git_commit_parentcount(origin->commit) == 0 ||
+	    !git_oid_equal(git_commit_parent_id(origin->commit, 0), git_commit_id(parent)))
+		return false;
+
+	if (git_repository_odb__weakptr(&odb, blame->repository) < 0 ||
+	    git_odb__get_commit_graph_file(&cgraph_file, odb) < 0 ||
+	    git_commit_graph_entry_find(&e, cgraph_file, git_commit_id(origin->commit),
+			git_oid_hexsize(blame->repository->oid_type)) < 0) {
+		git_error_clear();
+		return false;
+	}
+
+	return git_commit_graph_entry_maybe_changed_path(cgraph_file, &e,
+			origin->path, strlen(origin->path)) == 0;
+}
+
 static git_blame__origin *find_origin(
 		git_blame *blame,
 		git_commit *parent,
@@ -438,6 +470,12 @@ static git_blame__origin *find_origin(
 	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
 	git_tree *otree=NULL, *ptree=NULL;
 
+	/* Skip the diffs if the commit-graph knows that the path did not change */
+	if (origin_unchanged_in_parent(blame, parent, origin)) {
+		git_blame__get_origin(&porigin, blame, parent, origin->path);
+		return porigin;
+	}
+
 	/* Get the trees from this commit and its parent */
 	if (0 != git_commit_tree(&otree, origin->commit) ||
 	    0 != git_commit_tree(&ptree, parent))
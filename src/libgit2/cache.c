@@ -41,87 +41,177 @@ int git_cache_set_max_object_size(git_object_t type, size_t size)
 	return 0;
 }
 
+static git_atomic_ssize cache_hits;
+static git_atomic_ssize cache_misses;
+static git_atomic_ssize cache_evictions;
+
+void git_cache__stats(size_t *hits, size_t *misses, size_t *evictions)
+{
+	if (hits)
+		*hits = (size_t)git_atomic_ssize_get(&cache_hits);
+	if (misses)
+		*misses = (size_t)git_atomic_ssize_get(&cache_misses);
+	if (evictions)
+		*evictions = (size_t)git_atomic_ssize_get(&cache_evictions);
+}
+
+GIT_INLINE(git_cache_shard *) cache_shard(git_cache *cache, const git_oid *oid)
+{
+	/*
+	 * The shards' maps hash the leading bytes of the object id, so
+	 * pick the shard with a later one to keep both well distributed.
+	 */
+	return &cache->shards[oid->id[GIT_OID_SHA1_SIZE - 1] % GIT_CACHE_SHARDS];
+}
+
+GIT_INLINE(void) cached_obj_touch(git_cached_obj *entry)
+{
+	git_atomic32_set(&entry->clock,
+		(entry->flags == GIT_CACHE_STORE_PARSED) ?
+		GIT_CACHE_CLOCK_PARSED : GIT_CACHE_CLOCK_RAW);
+}
+
 int git_cache_init(git_cache *cache)
 {
+	git_cache_shard *shard;
+	size_t i;
+
 	memset(cache, 0, sizeof(*cache));
 
-	if ((git_oidmap_new(&cache->map)) < 0)
-		return -1;
+	for (i = 0; i < GIT_CACHE_SHARDS; i++) {
+		shard = &cache->shards[i];
 
-	if (git_rwlock_init(&cache->lock)) {
-		git_error_set(GIT_ERROR_OS, "failed to initialize cache rwlock");
-		return -1;
+		if ((git_oidmap_new(&shard->map)) < 0)
+			goto on_error;
+
+		if (git_rwlock_init(&shard->lock)) {
+			git_error_set(GIT_ERROR_OS, "failed to initialize cache rwlock");
+			git_oidmap_free(shard->map);
+			shard->map = NULL;
+			goto on_error;
+		}
 	}
 
 	return 0;
+
+on_error:
+	git_cache_dispose(cache);
+	return -1;
 }
 
 /* called with lock */
-static void clear_cache(git_cache *cache)
+static void clear_shard(git_cache_shard *shard)
 {
 	git_cached_obj *evict = NULL;
 
-	if (git_cache_size(cache) == 0)
+	if (git_oidmap_size(shard->map) == 0)
 		return;
 
-	git_oidmap_foreach_value(cache->map, evict, {
+	git_oidmap_foreach_value(shard->map, evict, {
 		git_cached_obj_decref(evict);
 	});
 
-	git_oidmap_clear(cache->map);
-	git_atomic_ssize_add(&git_cache__current_storage, -cache->used_memory);
-	cache->used_memory = 0;
+	git_oidmap_clear(shard->map);
+	git_atomic_ssize_add(&git_cache__current_storage, -shard->used_memory);
+	shard->used_memory = 0;
+	shard->clock_hand = 0;
 }
 
 void git_cache_clear(git_cache *cache)
 {
-	if (git_rwlock_wrlock(&cache->lock) < 0)
-		return;
+	git_cache_shard *shard;
+	size_t i;
+
+	for (i = 0; i < GIT_CACHE_SHARDS; i++) {
+		shard = &cache->shards[i];
+
+		if (!shard->map || git_rwlock_wrlock(&shard->lock) < 0)
+			continue;
 
-	clear_cache(cache);
+		clear_shard(shard);
 
-	git_rwlock_wrunlock(&cache->lock);
+		git_rwlock_wrunlock(&shard->lock);
+	}
 }
 
 void git_cache_dispose(git_cache *cache)
 {
+	git_cache_shard *shard;
+	size_t i;
+
 	git_cache_clear(cache);
-	git_oidmap_free(cache->map);
-	git_rwlock_free(&cache->lock);
+
+	for (i = 0; i < GIT_CACHE_SHARDS; i++) {
+		shard = &cache->shards[i];
+
+		if (!shard->map)
+			continue;
+
+		git_oidmap_free(shard->map);
+		git_rwlock_free(&shard->lock);
+	}
+
 	git__memzero(cache, sizeof(*cache));
 }
 
-/* Called with lock */
-static void cache_evict_entries(git_cache *cache)
+/*
+ * Sweep the clock hand over the shard, evicting entries that have not
+ * been used since it last passed them, until `evict_count` entries have
+ * been evicted.  Called with lock.
+ */
+static void cache_evict_entries(git_cache_shard *shard)
 {
-	size_t evict_count = git_cache_size(cache) / 2048, i;
+	size_t size = git_oidmap_size(shard->map);
+	size_t evict_count = size / 2048, max_steps, steps;
 	ssize_t evicted_memory = 0;
+	size_t evicted = 0;
 
 	if (evict_count < 8)
 		evict_count = 8;
 
 	/* do not infinite loop if there's not enough entries to evict  */
-	if (evict_count > git_cache_size(cache)) {
-		clear_cache(cache);
+	if (evict_count > size) {
+		git_atomic_ssize_add(&cache_evictions, (ssize_t)size);
+		clear_shard(shard);
 		return;
 	}
 
-	i = 0;
-	while (evict_count > 0) {
+	/*
+	 * Every entry is evictable after being passed by the hand as many
+	 * times as the most that a use gives it, so this always finishes.
+	 */
+	max_steps = (GIT_CACHE_CLOCK_PARSED + 1) * (size_t)git_oidmap_size(shard->map) + 1;
+
+	for (steps = 0; evicted < evict_count && steps < max_steps; ) {
 		git_cached_obj *evict;
 		const git_oid *key;
+		size_t pos = shard->clock_hand;
 
-		if (git_oidmap_iterate((void **) &evict, cache->map, &i, &key) == GIT_ITEROVER)
-			break;
+		if (git_oidmap_iterate((void **) &evict, shard->map, &shard->clock_hand, &key) == GIT_ITEROVER) {
+			/* wrap around to the beginning */
+			if (pos == 0)
+				break;
+
+			shard->clock_hand = 0;
+			continue;
+		}
+
+		steps++;
 
-		evict_count--;
+		if (git_atomic32_get(&evict->clock) > 0) {
+			git_atomic32_dec(&evict->clock);
+			continue;
+		}
+
+		evicted++;
 		evicted_memory += evict->size;
-		git_oidmap_delete(cache->map, key);
+		git_oidmap_delete(shard->map, key);
 		git_cached_obj_decref(evict);
 	}
 
-	cache->used_memory -= evicted_memory;
+	shard->used_memory -= evicted_memory;
 	git_atomic_ssize_add(&git_cache__current_storage, -evicted_memory);
+	git_atomic_ssize_add(&cache_evictions, (ssize_t)evicted);
 }
 
 static bool cache_should_store(git_object_t object_type, size_t object_size)
@@ -132,31 +222,47 @@ static bool cache_should_store(git_object_t object_type, size_t object_size)
 
 static void *cache_get(git_cache *cache, const git_oid *oid, unsigned int flags)
 {
+	git_cache_shard *shard = cache_shard(cache, oid);
 	git_cached_obj *entry;
 
-	if (!git_cache__enabled || git_rwlock_rdlock(&cache->lock) < 0)
+	if (!git_cache__enabled || git_rwlock_rdlock(&shard->lock) < 0)
 		return NULL;
 
-	if ((entry = git_oidmap_get(cache->map, oid)) != NULL) {
+	if ((entry = git_oidmap_get(shard->map, oid)) != NULL) {
 		if (flags && entry->flags != flags) {
 			entry = NULL;
 		} else {
 			git_cached_obj_incref(entry);
+			cached_obj_touch(entry);
 		}
 	}
 
-	git_rwlock_rdunlock(&cache->lock);
+	git_rwlock_rdunlock(&shard->lock);
 
+	git_atomic_ssize_add(entry ? &cache_hits : &cache_misses, 1);
 	return entry;
 }
 
+static bool cache_is_empty(git_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < GIT_CACHE_SHARDS; i++) {
+		if (cache->shards[i].used_memory > 0)
+			return false;
+	}
+
+	return true;
+}
+
 static void *cache_store(git_cache *cache, git_cached_obj *entry)
 {
+	git_cache_shard *shard = cache_shard(cache, &entry->oid);
 	git_cached_obj *stored_entry;
 
 	git_cached_obj_incref(entry);
 
-	if (!git_cache__enabled && cache->used_memory > 0) {
+	if (!git_cache__enabled && !cache_is_empty(cache)) {
 		git_cache_clear(cache);
 		return entry;
 	}
@@ -164,18 +270,20 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 	if (!cache_should_store(entry->type, entry->size))
 		return entry;
 
-	if (git_rwlock_wrlock(&cache->lock) < 0)
+	if (git_rwlock_wrlock(&shard->lock) < 0)
 		return entry;
 
-	/* soften the load on the cache */
-	if (git_atomic_ssize_get(&git_cache__current_storage) > git_cache__max_storage)
-		cache_evict_entries(cache);
+	/* soften the load on the cache; no shard goes over its share */
+	if (shard->used_memory > git_cache__max_storage / GIT_CACHE_SHARDS ||
+	    git_atomic_ssize_get(&git_cache__current_storage) > git_cache__max_storage)
+		cache_evict_entries(shard);
 
 	/* not found */
-	if ((stored_entry = git_oidmap_get(cache->map, &entry->oid)) == NULL) {
-		if (git_oidmap_set(cache->map, &entry->oid, entry) == 0) {
+	if ((stored_entry = git_oidmap_get(shard->map, &entry->oid)) == NULL) {
+		if (git_oidmap_set(shard->map, &entry->oid, entry) == 0) {
 			git_cached_obj_incref(entry);
-			cache->used_memory += entry->size;
+			cached_obj_touch(entry);
+			shard->used_memory += entry->size;
 			git_atomic_ssize_add(&git_cache__current_storage, (ssize_t)entry->size);
 		}
 	}
@@ -184,12 +292,14 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 		if (stored_entry->flags == entry->flags) {
 			git_cached_obj_decref(entry);
 			git_cached_obj_incref(stored_entry);
+			cached_obj_touch(stored_entry);
 			entry = stored_entry;
 		} else if (stored_entry->flags == GIT_CACHE_STORE_RAW &&
 			   entry->flags == GIT_CACHE_STORE_PARSED) {
-			if (git_oidmap_set(cache->map, &entry->oid, entry) == 0) {
+			if (git_oidmap_set(shard->map, &entry->oid, entry) == 0) {
 				git_cached_obj_decref(stored_entry);
 				git_cached_obj_incref(entry);
+				cached_obj_touch(entry);
 			} else {
 				git_cached_obj_decref(entry);
 				git_cached_obj_incref(stored_entry);
@@ -200,7 +310,7 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 		}
 	}
 
-	git_rwlock_wrunlock(&cache->lock);
+	git_rwlock_wrunlock(&shard->lock);
 	return entry;
 }
 
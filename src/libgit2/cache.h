@@ -28,18 +28,48 @@ typedef struct {
 	uint16_t     flags; /* GIT_CACHE_STORE value */
 	size_t       size;
 	git_atomic32 refcount;
+	git_atomic32 clock; /* recent use; see GIT_CACHE_CLOCK_* */
 } git_cached_obj;
 
+/*
+ * The cache is split into shards (by object id), each with its own lock,
+ * so that threads looking up different objects rarely contend.  As a
+ * shard only evicts entries when something is stored in it, each one is
+ * kept to its share of `git_cache__max_storage`, as well as evicting
+ * when all of the caches together are over it.
+ */
+#define GIT_CACHE_SHARDS 16
+
+/*
+ * Eviction follows a "CLOCK" policy: a hand sweeps over each shard's
+ * entries, evicting those that have not been used since it last passed
+ * them.  A lookup or store gives an entry some more sweeps to live, with
+ * parsed objects (which are the more expensive to recreate) given more
+ * than raw ones.
+ */
+#define GIT_CACHE_CLOCK_RAW    1
+#define GIT_CACHE_CLOCK_PARSED 2
+
 typedef struct {
 	git_oidmap *map;
 	git_rwlock  lock;
 	ssize_t     used_memory;
+	size_t      clock_hand;
+} git_cache_shard;
+
+typedef struct {
+	git_cache_shard shards[GIT_CACHE_SHARDS];
 } git_cache;
 
 extern bool git_cache__enabled;
 extern ssize_t git_cache__max_storage;
 extern git_atomic_ssize git_cache__current_storage;
 
+/*
+ * Statistics about all object caches, for `GIT_OPT_GET_CACHE_STATS`.
+ */
+void git_cache__stats(size_t *hits, size_t *misses, size_t *evictions);
+
 int git_cache_set_max_object_size(git_object_t type, size_t size);
 
 int git_cache_init(git_cache *cache);
@@ -55,7 +85,12 @@ void *git_cache_get_any(git_cache *cache, const git_oid *oid);
 
 GIT_INLINE(size_t) git_cache_size(git_cache *cache)
 {
-	return (size_t)git_oidmap_size(cache->map);
+	size_t i, size = 0;
+
+	for (i = 0; i < GIT_CACHE_SHARDS; i++)
+		size += (size_t)git_oidmap_size(cache->shards[i].map);
+
+	return size;
 }
 
 GIT_INLINE(void) git_cached_obj_incref(void *_obj)
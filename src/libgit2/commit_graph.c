@@ -9,7 +9,9 @@
 
 #include "array.h"
 #include "buf.h"
+#include "diff.h"
 #include "filebuf.h"
+#include "fs_path.h"
 #include "futils.h"
 #include "hash.h"
 #include "oidarray.h"
@@ -39,6 +41,21 @@ struct git_commit_graph_header {
 #define COMMIT_GRAPH_EXTRA_EDGE_LIST_ID 0x45444745    /* "EDGE" */
 #define COMMIT_GRAPH_BLOOM_FILTER_INDEX_ID 0x42494458 /* "BIDX" */
 #define COMMIT_GRAPH_BLOOM_FILTER_DATA_ID 0x42444154  /* "BDAT" */
+#define COMMIT_GRAPH_BASE_GRAPHS_LIST_ID 0x42415345   /* "BASE" */
+#define COMMIT_GRAPH_GENERATION_DATA_ID 0x47444132    /* "GDA2" */
+#define COMMIT_GRAPH_GENERATION_DATA_OVERFLOW_ID 0x47444f32 /* "GDO2" */
+
+/*
+ * Changed-path Bloom filters, as git writes them: version 1 sets 7 bits,
+ * chosen by murmur3 hashes of the path, for each changed path, in a filter
+ * of 10 bits per path.  Commits that change more than 512 paths get a
+ * filter of a single byte with all the bits set.
+ */
+#define COMMIT_GRAPH_BLOOM_FILTER_VERSION 1
+#define COMMIT_GRAPH_BLOOM_FILTER_HEADER_SIZE 12
+#define COMMIT_GRAPH_BLOOM_NUM_HASHES 7
+#define COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY 10
+#define COMMIT_GRAPH_BLOOM_MAX_CHANGED_PATHS 512
 
 struct git_commit_graph_chunk {
 	off64_t offset;
@@ -52,9 +69,14 @@ struct packed_commit {
 	git_oid sha1;
 	git_oid tree_oid;
 	uint32_t generation;
+	/* The largest generation number of the parents in the base graphs. */
+	uint32_t base_generation;
 	git_time_t commit_time;
 	git_array_oid_t parents;
 	parent_index_array_t parent_indices;
+	/* The changed-path Bloom filter, once it is known. */
+	unsigned char *bloom_filter;
+	size_t bloom_filter_len;
 };
 
 static void packed_commit_free(struct packed_commit *p)
@@ -64,6 +86,7 @@ static void packed_commit_free(struct packed_commit *p)
 
 	git_array_clear(p->parents);
 	git_array_clear(p->parent_indices);
+	git__free(p->bloom_filter);
 	git__free(p);
 }
 
@@ -99,6 +122,49 @@ cleanup:
 	return NULL;
 }
 
+/* Read a commit back from a commit-graph, to write it to another one. */
+static int packed_commit_from_entry(
+		struct packed_commit **out,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *e)
+{
+	struct packed_commit *p;
+	git_commit_graph_entry parent;
+	git_oid *parent_id;
+	size_t i;
+	int error = -1;
+
+	p = git__calloc(1, sizeof(struct packed_commit));
+	GIT_ERROR_CHECK_ALLOC(p);
+
+	git_array_init_to_size(p->parents, e->parent_count);
+	if (e->parent_count && !p->parents.ptr)
+		goto cleanup;
+
+	git_oid_cpy(&p->sha1, &e->sha1);
+	git_oid_cpy(&p->tree_oid, &e->tree_oid);
+	p->commit_time = e->commit_time;
+
+	for (i = 0; i < e->parent_count; i++) {
+		if ((error = git_commit_graph_entry_parent(&parent, file, e, i)) < 0)
+			goto cleanup;
+
+		if ((parent_id = git_array_alloc(p->parents)) == NULL) {
+			error = -1;
+			goto cleanup;
+		}
+
+		git_oid_cpy(parent_id, &parent.sha1);
+	}
+
+	*out = p;
+	return 0;
+
+cleanup:
+	packed_commit_free(p);
+	return error;
+}
+
 typedef int (*commit_graph_write_cb)(const char *buf, size_t size, void *cb_data);
 
 static int commit_graph_error(const char *message)
@@ -196,6 +262,69 @@ static int commit_graph_parse_extra_edge_list(
 	return 0;
 }
 
+static int commit_graph_parse_base_graphs_list(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct git_commit_graph_chunk *chunk_base_graphs_list,
+		size_t num_base_graphs)
+{
+	size_t oid_size = git_oid_size(file->oid_type);
+
+	if (num_base_graphs == 0)
+		return 0;
+	if (chunk_base_graphs_list->offset == 0)
+		return commit_graph_error("missing Base Graphs List chunk");
+	if (chunk_base_graphs_list->length != num_base_graphs * oid_size)
+		return commit_graph_error("Base Graphs List chunk has wrong length");
+
+	file->base_graphs = data + chunk_base_graphs_list->offset;
+	file->num_base_graphs = num_base_graphs;
+
+	return 0;
+}
+
+static int commit_graph_parse_bloom_filters(
+		git_commit_graph_file *file,
+		const unsigned char *data,
+		struct git_commit_graph_chunk *chunk_bloom_filter_index,
+		struct git_commit_graph_chunk *chunk_bloom_filter_data)
+{
+	const unsigned char *header;
+	uint32_t i, end, prev_end = 0;
+
+	/* The filters are optional, and of no use without their index */
+	if (chunk_bloom_filter_index->offset == 0 || chunk_bloom_filter_data->offset == 0)
+		return 0;
+	if (chunk_bloom_filter_index->length != file->num_commits * 4)
+		return commit_graph_error("Bloom Filter Index chunk has wrong length");
+	if (chunk_bloom_filter_data->length < COMMIT_GRAPH_BLOOM_FILTER_HEADER_SIZE)
+		return commit_graph_error("Bloom Filter Data chunk is too short");
+
+	header = data + chunk_bloom_filter_data->offset;
+
+	/* Other versions hash the paths differently; ignore them */
+	if (ntohl(*((uint32_t *)header)) != COMMIT_GRAPH_BLOOM_FILTER_VERSION)
+		return 0;
+
+	file->bloom_filter_index = data + chunk_bloom_filter_index->offset;
+	file->bloom_filter_data = header + COMMIT_GRAPH_BLOOM_FILTER_HEADER_SIZE;
+	file->bloom_filter_data_len = chunk_bloom_filter_data->length
+			- COMMIT_GRAPH_BLOOM_FILTER_HEADER_SIZE;
+	file->bloom_num_hashes = ntohl(*((uint32_t *)(header + 4)));
+	file->bloom_bits_per_entry = ntohl(*((uint32_t *)(header + 8)));
+
+	for (i = 0; i < file->num_commits; ++i) {
+		end = ntohl(*((uint32_t *)(file->bloom_filter_index + i * 4)));
+		if (end < prev_end)
+			return commit_graph_error("Bloom Filter Index is non-monotonic");
+		prev_end = end;
+	}
+	if (prev_end > file->bloom_filter_data_len)
+		return commit_graph_error("Bloom filters extend beyond their chunk");
+
+	return 0;
+}
+
 int git_commit_graph_file_parse(
 		git_commit_graph_file *file,
 		const unsigned char *data,
@@ -210,7 +339,8 @@ int git_commit_graph_file_parse(
 	int error;
 	struct git_commit_graph_chunk chunk_oid_fanout = {0}, chunk_oid_lookup = {0},
 				      chunk_commit_data = {0}, chunk_extra_edge_list = {0},
-				      chunk_unsupported = {0};
+				      chunk_base_graphs_list = {0}, chunk_bloom_filter_index = {0},
+				      chunk_bloom_filter_data = {0}, chunk_unsupported = {0};
 
 	GIT_ASSERT_ARG(file);
 
@@ -273,8 +403,27 @@ int git_commit_graph_file_parse(
 			last_chunk = &chunk_extra_edge_list;
 			break;
 
+		case COMMIT_GRAPH_BASE_GRAPHS_LIST_ID:
+			chunk_base_graphs_list.offset = last_chunk_offset;
+			last_chunk = &chunk_base_graphs_list;
+			break;
+
 		case COMMIT_GRAPH_BLOOM_FILTER_INDEX_ID:
+			chunk_bloom_filter_index.offset = last_chunk_offset;
+			last_chunk = &chunk_bloom_filter_index;
+			break;
+
 		case COMMIT_GRAPH_BLOOM_FILTER_DATA_ID:
+			chunk_bloom_filter_data.offset = last_chunk_offset;
+			last_chunk = &chunk_bloom_filter_data;
+			break;
+
+		/*
+		 * The generation numbers of the commits are also in the Commit
+		 * Data, as git writes the topological levels there.
+		 */
+		case COMMIT_GRAPH_GENERATION_DATA_ID:
+		case COMMIT_GRAPH_GENERATION_DATA_OVERFLOW_ID:
 			chunk_unsupported.offset = last_chunk_offset;
 			last_chunk = &chunk_unsupported;
 			break;
@@ -297,10 +446,35 @@ int git_commit_graph_file_parse(
 	error = commit_graph_parse_extra_edge_list(file, data, &chunk_extra_edge_list);
 	if (error < 0)
 		return error;
+	error = commit_graph_parse_base_graphs_list(file, data, &chunk_base_graphs_list,
+			hdr->base_graph_files);
+	if (error < 0)
+		return error;
+	error = commit_graph_parse_bloom_filters(file, data, &chunk_bloom_filter_index,
+			&chunk_bloom_filter_data);
+	if (error < 0)
+		return error;
 
 	return 0;
 }
 
+/*
+ * Open the single commit-graph file if there is one, or else the chain of
+ * them.
+ */
+static int commit_graph_load(
+	git_commit_graph_file **file_out,
+	git_commit_graph *cgraph)
+{
+	if (!git_fs_path_exists(git_str_cstr(&cgraph->filename)) &&
+	    git_fs_path_isfile(git_str_cstr(&cgraph->chain_filename)))
+		return git_commit_graph_chain_open(file_out,
+				git_str_cstr(&cgraph->chain_filename), cgraph->oid_type);
+
+	return git_commit_graph_file_open(file_out,
+			git_str_cstr(&cgraph->filename), cgraph->oid_type);
+}
+
 int git_commit_graph_new(
 	git_commit_graph **cgraph_out,
 	const char *objects_dir,
@@ -323,9 +497,13 @@ int git_commit_graph_new(
 	if (error < 0)
 		goto error;
 
+	error = git_str_joinpath(&cgraph->chain_filename, objects_dir,
+			"info/" GIT_COMMIT_GRAPH_CHAIN_FILE);
+	if (error < 0)
+		goto error;
+
 	if (open_file) {
-		error = git_commit_graph_file_open(&cgraph->file,
-				git_str_cstr(&cgraph->filename), oid_type);
+		error = commit_graph_load(&cgraph->file, cgraph);
 
 		if (error < 0)
 			goto error;
@@ -344,19 +522,23 @@ error:
 int git_commit_graph_validate(git_commit_graph *cgraph) {
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 	git_hash_algorithm_t checksum_type;
+	git_commit_graph_file *file;
 	size_t checksum_size, trailer_offset;
 
-	checksum_type = git_oid_algorithm(cgraph->oid_type);
+	checksum_type = git_hash_checksum_algorithm(git_oid_algorithm(cgraph->oid_type));
 	checksum_size = git_hash_size(checksum_type);
-	trailer_offset = cgraph->file->graph_map.len - checksum_size;
 
-	if (cgraph->file->graph_map.len < checksum_size)
-		return commit_graph_error("map length too small");
+	for (file = cgraph->file; file; file = file->base) {
+		if (file->graph_map.len < checksum_size)
+			return commit_graph_error("map length too small");
 
-	if (git_hash_buf(checksum, cgraph->file->graph_map.data, trailer_offset, checksum_type) < 0)
-		return commit_graph_error("could not calculate signature");
-	if (memcmp(checksum, cgraph->file->checksum, checksum_size) != 0)
-		return commit_graph_error("index signature mismatch");
+		trailer_offset = file->graph_map.len - checksum_size;
+
+		if (git_hash_buf(checksum, file->graph_map.data, trailer_offset, checksum_type) < 0)
+			return commit_graph_error("could not calculate signature");
+		if (memcmp(checksum, file->checksum, checksum_size) != 0)
+			return commit_graph_error("index signature mismatch");
+	}
 
 	return 0;
 }
@@ -383,7 +565,7 @@ int git_commit_graph_open(
 	return error;
 }
 
-int git_commit_graph_file_open(
+static int commit_graph_file_open(
 	git_commit_graph_file **file_out,
 	const char *path,
 	git_oid_t oid_type)
@@ -433,6 +615,149 @@ int git_commit_graph_file_open(
 	return 0;
 }
 
+/*
+ * Check that the layers below the file are the ones that its Base Graphs
+ * List names, and count their commits.
+ */
+static int commit_graph_link_base(git_commit_graph_file *file)
+{
+	const git_commit_graph_file *base;
+	size_t oid_size = git_oid_size(file->oid_type);
+	size_t i = file->num_base_graphs;
+
+	for (base = file->base; base; base = base->base) {
+		if (i == 0 || memcmp(file->base_graphs + --i * oid_size, base->checksum, oid_size) != 0)
+			return commit_graph_error("base graphs do not match the chain");
+	}
+
+	if (i != 0)
+		return commit_graph_error("base graphs are missing");
+
+	if (file->base) {
+		file->num_commits_in_base = file->base->num_commits_in_base + file->base->num_commits;
+
+		if (file->num_commits > GIT_COMMIT_GRAPH_MISSING_PARENT - file->num_commits_in_base)
+			return commit_graph_error("too many commits in chain");
+	}
+
+	return 0;
+}
+
+int git_commit_graph_file_open(
+	git_commit_graph_file **file_out,
+	const char *path,
+	git_oid_t oid_type)
+{
+	git_commit_graph_file *file;
+	int error;
+
+	if ((error = commit_graph_file_open(&file, path, oid_type)) < 0)
+		return error;
+
+	if ((error = commit_graph_link_base(file)) < 0) {
+		git_commit_graph_file_free(file);
+		return error;
+	}
+
+	*file_out = file;
+	return 0;
+}
+
+/*
+ * Read the checksums of the files in a chain file, one per line, oldest
+ * first.
+ */
+static int commit_graph_read_chain(
+	git_vector *out,
+	git_str *contents,
+	const char *chain_path,
+	git_oid_t oid_type)
+{
+	size_t hexsize = git_oid_hexsize(oid_type);
+	char *line, *end;
+	int error;
+
+	if ((error = git_futils_readbuffer(contents, chain_path)) < 0 ||
+	    (error = git_vector_init(out, 4, NULL)) < 0)
+		return error;
+
+	for (line = contents->ptr; *line; line = end + 1) {
+		if ((end = strchr(line, '\n')) == NULL)
+			goto invalid;
+
+		*end = '\0';
+
+		if ((size_t)(end - line) != hexsize || !git__ishex(line))
+			goto invalid;
+
+		if ((error = git_vector_insert(out, line)) < 0)
+			return error;
+	}
+
+	if (git_vector_length(out) == 0)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	git_error_set(GIT_ERROR_ODB, "invalid commit-graph chain '%s'", chain_path);
+	return -1;
+}
+
+int git_commit_graph_chain_open(
+	git_commit_graph_file **file_out,
+	const char *chain_path,
+	git_oid_t oid_type)
+{
+	git_commit_graph_file *file = NULL, *layer;
+	git_str contents = GIT_STR_INIT, path = GIT_STR_INIT;
+	git_vector checksums = GIT_VECTOR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	const char *hex;
+	size_t i, dir_len;
+	int error;
+
+	GIT_ASSERT_ARG(file_out && chain_path && oid_type);
+
+	if ((error = commit_graph_read_chain(&checksums, &contents, chain_path, oid_type)) < 0 ||
+	    (error = git_fs_path_dirname_r(&path, chain_path)) < 0)
+		goto done;
+
+	dir_len = git_str_len(&path);
+
+	git_vector_foreach (&checksums, i, hex) {
+		git_str_truncate(&path, dir_len);
+
+		if ((error = git_str_printf(&path, "/graph-%s.graph", hex)) < 0 ||
+		    (error = commit_graph_file_open(&layer, git_str_cstr(&path), oid_type)) < 0)
+			goto done;
+
+		layer->base = file;
+		layer->chained = true;
+		file = layer;
+
+		git_hash_fmt(checksum_hex, file->checksum, git_oid_size(oid_type));
+
+		if (strcmp(checksum_hex, hex) != 0) {
+			error = commit_graph_error("file does not match its name");
+			goto done;
+		}
+
+		if ((error = commit_graph_link_base(file)) < 0)
+			goto done;
+	}
+
+	*file_out = file;
+	file = NULL;
+
+done:
+	git_commit_graph_file_free(file);
+	git_vector_free(&checksums);
+	git_str_dispose(&contents);
+	git_str_dispose(&path);
+	return error;
+}
+
 int git_commit_graph_get_file(
 	git_commit_graph_file **file_out,
 	git_commit_graph *cgraph)
@@ -445,8 +770,7 @@ int git_commit_graph_get_file(
 		cgraph->checked = 1;
 
 		/* Best effort */
-		error = git_commit_graph_file_open(&result,
-			git_str_cstr(&cgraph->filename), cgraph->oid_type);
+		error = commit_graph_load(&result, cgraph);
 
 		if (error < 0)
 			return error;
@@ -460,13 +784,22 @@ int git_commit_graph_get_file(
 	return 0;
 }
 
+static bool commit_graph_needs_refresh(git_commit_graph *cgraph)
+{
+	if (cgraph->file->chained && !git_fs_path_exists(git_str_cstr(&cgraph->filename)))
+		return git_commit_graph_chain_needs_refresh(cgraph->file,
+				git_str_cstr(&cgraph->chain_filename));
+
+	return git_commit_graph_file_needs_refresh(cgraph->file,
+			git_str_cstr(&cgraph->filename));
+}
+
 void git_commit_graph_refresh(git_commit_graph *cgraph)
 {
 	if (!cgraph->checked)
 		return;
 
-	if (cgraph->file
-	    && git_commit_graph_file_needs_refresh(cgraph->file, git_str_cstr(&cgraph->filename))) {
+	if (cgraph->file && commit_graph_needs_refresh(cgraph)) {
 		/* We just free the commit graph. The next time it is requested, it will be
 		 * re-loaded. */
 		git_commit_graph_file_free(cgraph->file);
@@ -476,6 +809,23 @@ void git_commit_graph_refresh(git_commit_graph *cgraph)
 	cgraph->checked = 0;
 }
 
+/*
+ * Find the layer that has the commit at the given position, and make the
+ * position relative to it.
+ */
+static const git_commit_graph_file *commit_graph_layer(
+		const git_commit_graph_file *file,
+		size_t *pos)
+{
+	while (file && *pos < file->num_commits_in_base)
+		file = file->base;
+
+	if (file)
+		*pos -= file->num_commits_in_base;
+
+	return file;
+}
+
 static int git_commit_graph_entry_get_byindex(
 		git_commit_graph_entry *e,
 		const git_commit_graph_file *file,
@@ -487,11 +837,15 @@ static int git_commit_graph_entry_get_byindex(
 	GIT_ASSERT_ARG(e);
 	GIT_ASSERT_ARG(file);
 
-	if (pos >= file->num_commits) {
+	if (pos >= (size_t)file->num_commits_in_base + file->num_commits) {
 		git_error_set(GIT_ERROR_INVALID, "commit index %zu does not exist", pos);
 		return GIT_ENOTFOUND;
 	}
 
+	e->position = pos;
+	file = commit_graph_layer(file, &pos);
+	GIT_ASSERT(file);
+
 	commit_data = file->commit_data + pos * (oid_size + 4 * sizeof(uint32_t));
 	git_oid__fromraw(&e->tree_oid, commit_data, file->oid_type);
 	e->parent_indices[0] = ntohl(*((uint32_t *)(commit_data + oid_size)));
@@ -539,6 +893,9 @@ bool git_commit_graph_file_needs_refresh(const git_commit_graph_file *file, cons
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 	size_t checksum_size = git_oid_size(file->oid_type);
 
+	if (file->chained)
+		return true;
+
 	/* TODO: properly open the file without access time using O_NOATIME */
 	fd = git_futils_open_ro(path);
 	if (fd < 0)
@@ -563,7 +920,43 @@ bool git_commit_graph_file_needs_refresh(const git_commit_graph_file *file, cons
 	return (memcmp(checksum, file->checksum, checksum_size) != 0);
 }
 
-int git_commit_graph_entry_find(
+bool git_commit_graph_chain_needs_refresh(
+		const git_commit_graph_file *file,
+		const char *chain_path)
+{
+	git_str contents = GIT_STR_INIT;
+	git_vector checksums = GIT_VECTOR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	size_t i;
+	bool refresh = true;
+
+	if (!file->chained ||
+	    commit_graph_read_chain(&checksums, &contents, chain_path, file->oid_type) < 0) {
+		git_error_clear();
+		goto done;
+	}
+
+	/* The files must be the same, from the top down */
+	for (i = git_vector_length(&checksums); i > 0 && file; i--, file = file->base) {
+		git_hash_fmt(checksum_hex, (unsigned char *)file->checksum, git_oid_size(file->oid_type));
+
+		if (strcmp(checksum_hex, git_vector_get(&checksums, i - 1)) != 0)
+			goto done;
+	}
+
+	refresh = (i > 0 || file != NULL);
+
+done:
+	git_vector_free(&checksums);
+	git_str_dispose(&contents);
+	return refresh;
+}
+
+/*
+ * Find a commit in one layer; returns `GIT_ENOTFOUND` without setting an
+ * error if it is not there.
+ */
+static int commit_graph_layer_entry_find(
 		git_commit_graph_entry *e,
 		const git_commit_graph_file *file,
 		const git_oid *short_oid,
@@ -574,10 +967,6 @@ int git_commit_graph_entry_find(
 	const unsigned char *current = NULL;
 	size_t oid_size, oid_hexsize;
 
-	GIT_ASSERT_ARG(e);
-	GIT_ASSERT_ARG(file);
-	GIT_ASSERT_ARG(short_oid);
-
 	oid_size = git_oid_size(file->oid_type);
 	oid_hexsize = git_oid_hexsize(file->oid_type);
 
@@ -612,13 +1001,53 @@ int git_commit_graph_entry_find(
 	}
 
 	if (!found)
-		return git_odb__error_notfound(
-				"failed to find offset for commit-graph index entry", short_oid, len);
+		return GIT_ENOTFOUND;
 	if (found > 1)
 		return git_odb__error_ambiguous(
 				"found multiple offsets for commit-graph index entry");
 
-	return git_commit_graph_entry_get_byindex(e, file, pos);
+	return git_commit_graph_entry_get_byindex(e, file,
+			(size_t)file->num_commits_in_base + pos);
+}
+
+int git_commit_graph_entry_find(
+		git_commit_graph_entry *e,
+		const git_commit_graph_file *file,
+		const git_oid *short_oid,
+		size_t len)
+{
+	git_commit_graph_entry other;
+	bool found = false;
+	int error;
+
+	GIT_ASSERT_ARG(e);
+	GIT_ASSERT_ARG(file);
+	GIT_ASSERT_ARG(short_oid);
+
+	/* Each commit is in one layer only, so a full id is found once */
+	for (; file; file = file->base) {
+		error = commit_graph_layer_entry_find(found ? &other : e, file, short_oid, len);
+
+		if (error == GIT_ENOTFOUND)
+			continue;
+		else if (error < 0)
+			return error;
+
+		if (len == git_oid_hexsize(file->oid_type))
+			return 0;
+
+		if (found && !git_oid_equal(&e->sha1, &other.sha1))
+			return git_odb__error_ambiguous(
+					"found multiple offsets for commit-graph index entry");
+
+		found = true;
+	}
+
+	if (!found)
+		return git_odb__error_notfound(
+				"failed to find offset for commit-graph index entry", short_oid, len);
+
+	return 0;
 }
 
 int git_commit_graph_entry_parent(
@@ -627,6 +1056,9 @@ int git_commit_graph_entry_parent(
 		const git_commit_graph_entry *entry,
 		size_t n)
 {
+	const git_commit_graph_file *layer;
+	size_t pos = entry->position;
+
 	GIT_ASSERT_ARG(parent);
 	GIT_ASSERT_ARG(file);
 
@@ -638,16 +1070,240 @@ int git_commit_graph_entry_parent(
 	if (n == 0 || (n == 1 && entry->parent_count == 2))
 		return git_commit_graph_entry_get_byindex(parent, file, entry->parent_indices[n]);
 
+	/* The other parents are in the Extra Edge List of the commit's layer */
+	layer = commit_graph_layer(file, &pos);
+	GIT_ASSERT(layer);
+
 	return git_commit_graph_entry_get_byindex(
 			parent,
 			file,
 			ntohl(
-					*(uint32_t *)(file->extra_edge_list
+					*(uint32_t *)(layer->extra_edge_list
 						      + (entry->extra_parents_index + n - 1)
 								      * sizeof(uint32_t)))
 					& 0x7fffffff);
 }
 
+/*
+ * The murmur3 hash of git's version 1 changed-path Bloom filters, which
+ * sign-extends the bytes of the data, as it did on the platforms where
+ * `char` is signed.
+ */
+static uint32_t bloom_murmur3_seeded(uint32_t seed, const char *data, size_t len)
+{
+	const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593, m = 5, n = 0xe6546b64;
+	const signed char *tail;
+	uint32_t k;
+	size_t i;
+
+#define BLOOM_ROTL(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		k = (uint32_t)(signed char)data[i]
+				| ((uint32_t)(signed char)data[i + 1] << 8)
+				| ((uint32_t)(signed char)data[i + 2] << 16)
+				| ((uint32_t)(signed char)data[i + 3] << 24);
+
+		k *= c1;
+		k = BLOOM_ROTL(k, 15);
+		k *= c2;
+
+		seed ^= k;
+		seed = BLOOM_ROTL(seed, 13) * m + n;
+	}
+
+	tail = (const signed char *)data + i;
+	k = 0;
+
+	switch (len & 3) {
+	case 3:
+		k ^= (uint32_t)tail[2] << 16;
+		/* fall through */
+	case 2:
+		k ^= (uint32_t)tail[1] << 8;
+		/* fall through */
+	case 1:
+		k ^= (uint32_t)tail[0];
+		k *= c1;
+		k = BLOOM_ROTL(k, 15);
+		k *= c2;
+		seed ^= k;
+		break;
+	}
+
+#undef BLOOM_ROTL
+
+	seed ^= (uint32_t)len;
+	seed ^= seed >> 16;
+	seed *= 0x85ebca6b;
+	seed ^= seed >> 13;
+	seed *= 0xc2b2ae35;
+	seed ^= seed >> 16;
+
+	return seed;
+}
+
+/*
+ * The i-th hash of a path is `hash0 + i * hash1`, so the two of them are
+ * all that is needed to look it up in filters with any number of hashes.
+ */
+struct bloom_key {
+	uint32_t hash0;
+	uint32_t hash1;
+};
+
+static void bloom_key_init(struct bloom_key *key, const char *path, size_t len)
+{
+	key->hash0 = bloom_murmur3_seeded(0x293ae76f, path, len);
+	key->hash1 = bloom_murmur3_seeded(0x7e646e2c, path, len);
+}
+
+static void bloom_filter_add(
+		unsigned char *filter,
+		size_t filter_len,
+		uint32_t num_hashes,
+		const struct bloom_key *key)
+{
+	uint64_t bit, bits = (uint64_t)filter_len * 8;
+	uint32_t i;
+
+	for (i = 0; i < num_hashes; i++) {
+		bit = (uint32_t)(key->hash0 + i * key->hash1) % bits;
+		filter[bit / 8] |= (unsigned char)(1 << (bit & 7));
+	}
+}
+
+static bool bloom_filter_contains(
+		const unsigned char *filter,
+		size_t filter_len,
+		uint32_t num_hashes,
+		const struct bloom_key *key)
+{
+	uint64_t bit, bits = (uint64_t)filter_len * 8;
+	uint32_t i;
+
+	/* An empty filter says nothing */
+	if (!bits)
+		return true;
+
+	for (i = 0; i < num_hashes; i++) {
+		bit = (uint32_t)(key->hash0 + i * key->hash1) % bits;
+		if (!(filter[bit / 8] & (1 << (bit & 7))))
+			return false;
+	}
+
+	return true;
+}
+
+/* Find the filter of a commit, and the layer that it is in. */
+static const git_commit_graph_file *commit_graph_entry_bloom_filter(
+		const unsigned char **filter,
+		size_t *filter_len,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry)
+{
+	size_t pos = entry->position;
+	uint32_t start = 0, end;
+
+	file = commit_graph_layer(file, &pos);
+
+	if (!file || !file->bloom_filter_index)
+		return NULL;
+
+	end = ntohl(*((uint32_t *)(file->bloom_filter_index + pos * 4)));
+	if (pos > 0)
+		start = ntohl(*((uint32_t *)(file->bloom_filter_index + (pos - 1) * 4)));
+
+	*filter = file->bloom_filter_data + start;
+	*filter_len = end - start;
+	return file;
+}
+
+int git_commit_graph_entry_bloom_filter(
+		const unsigned char **filter,
+		size_t *filter_len,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry)
+{
+	GIT_ASSERT_ARG(filter);
+	GIT_ASSERT_ARG(filter_len);
+	GIT_ASSERT_ARG(file);
+	GIT_ASSERT_ARG(entry);
+
+	if (!commit_graph_entry_bloom_filter(filter, filter_len, file, entry))
+		return GIT_ENOTFOUND;
+
+	return 0;
+}
+
+int git_commit_graph_entry_maybe_changed_path(
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry,
+		const char *path,
+		size_t path_len)
+{
+	const git_commit_graph_file *layer;
+	const unsigned char *filter;
+	struct bloom_key key;
+	size_t filter_len, len;
+
+	GIT_ASSERT_ARG(file);
+	GIT_ASSERT_ARG(entry);
+	GIT_ASSERT_ARG(path);
+
+	if ((layer = commit_graph_entry_bloom_filter(&filter, &filter_len, file, entry)) == NULL)
+		return GIT_ENOTFOUND;
+
+	while (path_len > 0 && path[path_len - 1] == '/')
+		path_len--;
+
+	if (path_len == 0)
+		return 1;
+
+	/*
+	 * The directories that the changed paths are in were added to the
+	 * filter, too, so a path can only have changed if they all may have.
+	 */
+	for (len = 1; len <= path_len; len++) {
+		if (len < path_len && path[len] != '/')
+			continue;
+
+		bloom_key_init(&key, path, len);
+
+		if (!bloom_filter_contains(filter, filter_len, layer->bloom_num_hashes, &key))
+			return 0;
+	}
+
+	return 1;
+}
+
+int git_commit_graph_maybe_changed_path(
+	git_commit_graph *cgraph,
+	const git_oid *commit_id,
+	const char *path)
+{
+	git_commit_graph_file *file;
+	git_commit_graph_entry e;
+	int error;
+
+	GIT_ASSERT_ARG(cgraph);
+	GIT_ASSERT_ARG(commit_id);
+	GIT_ASSERT_ARG(path);
+
+	if ((error = git_commit_graph_get_file(&file, cgraph)) < 0 ||
+	    (error = git_commit_graph_entry_find(&e, file, commit_id,
+			git_oid_hexsize(cgraph->oid_type))) < 0)
+		return error;
+
+	error = git_commit_graph_entry_maybe_changed_path(file, &e, path, strlen(path));
+
+	if (error == GIT_ENOTFOUND)
+		git_error_set(GIT_ERROR_ODB, "commit %s has no changed-path Bloom filter",
+			git_oid_tostr_s(commit_id));
+
+	return error;
+}
+
 int git_commit_graph_file_close(git_commit_graph_file *file)
 {
 	GIT_ASSERT_ARG(file);
@@ -664,17 +1320,23 @@ void git_commit_graph_free(git_commit_graph *cgraph)
 		return;
 
 	git_str_dispose(&cgraph->filename);
+	git_str_dispose(&cgraph->chain_filename);
 	git_commit_graph_file_free(cgraph->file);
 	git__free(cgraph);
 }
 
 void git_commit_graph_file_free(git_commit_graph_file *file)
 {
-	if (!file)
-		return;
+	git_commit_graph_file *base;
+
+	while (file) {
+		base = file->base;
 
-	git_commit_graph_file_close(file);
-	git__free(file);
+		git_commit_graph_file_close(file);
+		git__free(file);
+
+		file = base;
+	}
 }
 
 static int packed_commit__cmp(const void *a_, const void *b_)
@@ -784,6 +1446,7 @@ int git_commit_graph_writer_add_index_file(
 	struct object_entry_cb_state state = {0};
 	state.repo = repo;
 	state.commits = &w->commits;
+	w->repo = repo;
 
 	error = git_repository_odb(&state.db, repo);
 	if (error < 0)
@@ -813,6 +1476,8 @@ int git_commit_graph_writer_add_revwalk(git_commit_graph_writer *w, git_revwalk
 	git_commit *commit;
 	struct packed_commit *packed_commit;
 
+	w->repo = repo;
+
 	while ((git_revwalk_next(&id, walk)) == 0) {
 		error = git_commit_lookup(&commit, repo, &id);
 		if (error < 0)
@@ -832,6 +1497,120 @@ int git_commit_graph_writer_add_revwalk(git_commit_graph_writer *w, git_revwalk
 	return 0;
 }
 
+struct bloom_path {
+	const char *path;
+	size_t len;
+};
+
+static int bloom_path_cmp(const void *a_, const void *b_, void *payload)
+{
+	const struct bloom_path *a = a_, *b = b_;
+	int cmp;
+
+	GIT_UNUSED(payload);
+
+	cmp = memcmp(a->path, b->path, min(a->len, b->len));
+
+	return cmp ? cmp : (a->len > b->len) - (a->len < b->len);
+}
+
+/*
+ * Compute the changed-path Bloom filter of a commit from the tree diff
+ * against its first parent, like git does: of the paths in the diff (but
+ * without looking for renames) and the directories that they are in.
+ * Without a repository to diff in, the commit gets the filter that says
+ * that it may have changed everything.
+ */
+static int packed_commit_compute_bloom_filter(
+		struct packed_commit *p,
+		git_repository *repo)
+{
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff = NULL;
+	git_commit *parent = NULL;
+	git_tree *tree = NULL, *parent_tree = NULL;
+	git_array_t(struct bloom_path) paths = GIT_ARRAY_INIT;
+	struct bloom_path *path;
+	struct bloom_key key;
+	size_t i, j, num_deltas, num_paths = 0;
+	int error = 0;
+
+	if (repo) {
+		diffopts.flags = GIT_DIFF_INCLUDE_TYPECHANGE | GIT_DIFF_SKIP_BINARY_CHECK;
+
+		if ((error = git_tree_lookup(&tree, repo, &p->tree_oid)) < 0 ||
+		    (git_array_size(p->parents) > 0 &&
+		     ((error = git_commit_lookup(&parent, repo, git_array_get(p->parents, 0))) < 0 ||
+		      (error = git_commit_tree(&parent_tree, parent)) < 0)) ||
+		    (error = git_diff_tree_to_tree(&diff, repo, parent_tree, tree, &diffopts)) < 0)
+			goto done;
+	}
+
+	num_deltas = diff ? git_diff_num_deltas(diff) : SIZE_MAX;
+
+	if (num_deltas > COMMIT_GRAPH_BLOOM_MAX_CHANGED_PATHS) {
+		if ((p->bloom_filter = git__malloc(1)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		p->bloom_filter[0] = 0xff;
+		p->bloom_filter_len = 1;
+		goto done;
+	}
+
+	for (i = 0; i < num_deltas; i++) {
+		const char *delta_path = git_diff_get_delta(diff, i)->new_file.path;
+		size_t len = strlen(delta_path);
+
+		for (j = 1; j <= len; j++) {
+			if (j < len && delta_path[j] != '/')
+				continue;
+
+			if ((path = git_array_alloc(paths)) == NULL) {
+				error = -1;
+				goto done;
+			}
+
+			path->path = delta_path;
+			path->len = j;
+		}
+	}
+
+	git__qsort_r(paths.ptr, paths.size, sizeof(struct bloom_path), bloom_path_cmp, NULL);
+
+	for (i = 0; i < paths.size; i++)
+		num_paths += (i == 0 || bloom_path_cmp(&paths.ptr[i - 1], &paths.ptr[i], NULL) != 0);
+
+	p->bloom_filter_len = (num_paths * COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY + 7) / 8;
+
+	/* A filter of no paths still needs a byte, or it would say nothing */
+	if (!p->bloom_filter_len)
+		p->bloom_filter_len = 1;
+
+	if ((p->bloom_filter = git__calloc(p->bloom_filter_len, 1)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < paths.size; i++) {
+		if (i > 0 && bloom_path_cmp(&paths.ptr[i - 1], &paths.ptr[i], NULL) == 0)
+			continue;
+
+		bloom_key_init(&key, paths.ptr[i].path, paths.ptr[i].len);
+		bloom_filter_add(p->bloom_filter, p->bloom_filter_len,
+				COMMIT_GRAPH_BLOOM_NUM_HASHES, &key);
+	}
+
+done:
+	git_array_clear(paths);
+	git_diff_free(diff);
+	git_tree_free(parent_tree);
+	git_tree_free(tree);
+	git_commit_free(parent);
+	return error;
+}
+
 enum generation_number_commit_state {
 	GENERATION_NUMBER_COMMIT_STATE_UNVISITED = 0,
 	GENERATION_NUMBER_COMMIT_STATE_ADDED = 1,
@@ -839,16 +1618,27 @@ enum generation_number_commit_state {
 	GENERATION_NUMBER_COMMIT_STATE_VISITED = 3
 };
 
-static int compute_generation_numbers(git_vector *commits)
+/*
+ * Parents are referred to by their position in the graph, so the commits
+ * that are written after base graphs come after all of theirs.  Parents
+ * that are in the base graphs have their generation numbers there.
+ */
+static int compute_generation_numbers(
+		git_vector *commits,
+		const git_commit_graph_file *base)
 {
 	git_array_t(size_t) index_stack = GIT_ARRAY_INIT;
-	size_t i, j;
+	size_t i, j, num_commits_in_base = 0;
 	size_t *parent_idx;
 	enum generation_number_commit_state *commit_states = NULL;
 	struct packed_commit *child_packed_commit;
 	git_oidmap *packed_commit_map = NULL;
+	git_commit_graph_entry base_entry;
 	int error = 0;
 
+	if (base)
+		num_commits_in_base = (size_t)base->num_commits_in_base + base->num_commits;
+
 	/* First populate the parent indices fields */
 	error = git_oidmap_new(&packed_commit_map);
 	if (error < 0)
@@ -873,21 +1663,32 @@ static int compute_generation_numbers(git_vector *commits)
 			error = -1;
 			goto cleanup;
 		}
+		child_packed_commit->base_generation = 0;
 		git_array_foreach (child_packed_commit->parents, parent_i, parent_id) {
+			parent_idx_ptr = git_array_alloc(child_packed_commit->parent_indices);
+			if (!parent_idx_ptr) {
+				error = -1;
+				goto cleanup;
+			}
+
 			parent_packed_commit = git_oidmap_get(packed_commit_map, parent_id);
-			if (!parent_packed_commit) {
+			if (parent_packed_commit) {
+				*parent_idx_ptr = num_commits_in_base + parent_packed_commit->index;
+				continue;
+			}
+
+			if (!base || git_commit_graph_entry_find(&base_entry, base,
+					parent_id, git_oid_hexsize(base->oid_type)) < 0) {
 				git_error_set(GIT_ERROR_ODB,
 					      "parent commit %s not found in commit graph",
 					      git_oid_tostr_s(parent_id));
 				error = GIT_ENOTFOUND;
 				goto cleanup;
 			}
-			parent_idx_ptr = git_array_alloc(child_packed_commit->parent_indices);
-			if (!parent_idx_ptr) {
-				error = -1;
-				goto cleanup;
-			}
-			*parent_idx_ptr = parent_packed_commit->index;
+
+			*parent_idx_ptr = base_entry.position;
+			if (child_packed_commit->base_generation < base_entry.generation)
+				child_packed_commit->base_generation = (uint32_t)base_entry.generation;
 		}
 	}
 
@@ -926,9 +1727,12 @@ static int compute_generation_numbers(git_vector *commits)
 		}
 		if (commit_states[i] == GENERATION_NUMBER_COMMIT_STATE_EXPANDED) {
 			/* All of the commits parents have been visited. */
-			child_packed_commit->generation = 0;
+			child_packed_commit->generation = child_packed_commit->base_generation;
 			git_array_foreach (child_packed_commit->parent_indices, j, parent_idx) {
-				struct packed_commit *parent = git_vector_get(commits, *parent_idx);
+				struct packed_commit *parent;
+				if (*parent_idx < num_commits_in_base)
+					continue;
+				parent = git_vector_get(commits, *parent_idx - num_commits_in_base);
 				if (child_packed_commit->generation < parent->generation)
 					child_packed_commit->generation = parent->generation;
 			}
@@ -962,14 +1766,20 @@ static int compute_generation_numbers(git_vector *commits)
 		 */
 		*(size_t *)git_array_alloc(index_stack) = i;
 		git_array_foreach (child_packed_commit->parent_indices, j, parent_idx) {
-			if (commit_states[*parent_idx]
+			size_t parent_i;
+			if (*parent_idx < num_commits_in_base) {
+				/* This commit is in the base graphs. */
+				continue;
+			}
+			parent_i = *parent_idx - num_commits_in_base;
+			if (commit_states[parent_i]
 			    != GENERATION_NUMBER_COMMIT_STATE_UNVISITED) {
 				/* This commit has already been considered. */
 				continue;
 			}
 
-			commit_states[*parent_idx] = GENERATION_NUMBER_COMMIT_STATE_ADDED;
-			*(size_t *)git_array_alloc(index_stack) = *parent_idx;
+			commit_states[parent_i] = GENERATION_NUMBER_COMMIT_STATE_ADDED;
+			*(size_t *)git_array_alloc(index_stack) = parent_i;
 		}
 		commit_states[i] = GENERATION_NUMBER_COMMIT_STATE_EXPANDED;
 	}
@@ -1041,13 +1851,41 @@ static void packed_commit_free_dup(void *packed_commit)
 	packed_commit_free(packed_commit);
 }
 
+/* Append the checksums of the layers of a chain, oldest first. */
+static int commit_graph_chain_checksums(
+		git_str *out,
+		const git_commit_graph_file *file,
+		bool hex)
+{
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	size_t oid_size;
+	int error;
+
+	if (!file)
+		return 0;
+
+	if ((error = commit_graph_chain_checksums(out, file->base, hex)) < 0)
+		return error;
+
+	oid_size = git_oid_size(file->oid_type);
+
+	if (!hex)
+		return git_str_put(out, (const char *)file->checksum, oid_size);
+
+	git_hash_fmt(checksum_hex, (unsigned char *)file->checksum, oid_size);
+	return git_str_printf(out, "%s\n", checksum_hex);
+}
+
 static int commit_graph_write(
 		git_commit_graph_writer *w,
+		const git_commit_graph_file *base,
+		bool changed_paths,
 		commit_graph_write_cb write_cb,
-		void *cb_data)
+		void *cb_data,
+		unsigned char *checksum_out)
 {
 	int error = 0;
-	size_t i;
+	size_t i, num_commits_in_base = 0;
 	struct packed_commit *packed_commit;
 	struct git_commit_graph_header hdr = {0};
 	uint32_t oid_fanout_count;
@@ -1055,7 +1893,8 @@ static int commit_graph_write(
 	uint32_t oid_fanout[256];
 	off64_t offset;
 	git_str oid_lookup = GIT_STR_INIT, commit_data = GIT_STR_INIT,
-		extra_edge_list = GIT_STR_INIT;
+		extra_edge_list = GIT_STR_INIT, base_graphs_list = GIT_STR_INIT,
+		bloom_filter_index = GIT_STR_INIT, bloom_filter_data = GIT_STR_INIT;
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 	git_hash_algorithm_t checksum_type;
 	size_t checksum_size, oid_size;
@@ -1072,7 +1911,7 @@ static int commit_graph_write(
 	hash_cb_data.ctx = &ctx;
 
 	oid_size = git_oid_size(w->oid_type);
-	checksum_type = git_oid_algorithm(w->oid_type);
+	checksum_type = git_hash_checksum_algorithm(git_oid_algorithm(w->oid_type));
 	checksum_size = git_hash_size(checksum_type);
 
 	error = git_hash_ctx_init(&ctx, checksum_type);
@@ -1084,7 +1923,30 @@ static int commit_graph_write(
 	/* Sort the commits. */
 	git_vector_sort(&w->commits);
 	git_vector_uniq(&w->commits, packed_commit_free_dup);
-	error = compute_generation_numbers(&w->commits);
+
+	/* The layers below this one, which its commits are numbered after. */
+	if (base) {
+		num_commits_in_base = (size_t)base->num_commits_in_base + base->num_commits;
+
+		if ((error = commit_graph_chain_checksums(&base_graphs_list, base, false)) < 0)
+			goto cleanup;
+
+		if (git_str_len(&base_graphs_list) / oid_size > UINT8_MAX) {
+			git_error_set(GIT_ERROR_INVALID, "too many commit-graphs in the chain");
+			error = -1;
+			goto cleanup;
+		}
+
+		hdr.base_graph_files = (uint8_t)(git_str_len(&base_graphs_list) / oid_size);
+	}
+
+	if (git_vector_length(&w->commits) > GIT_COMMIT_GRAPH_MISSING_PARENT - num_commits_in_base) {
+		git_error_set(GIT_ERROR_INVALID, "too many commits for the commit-graph");
+		error = -1;
+		goto cleanup;
+	}
+
+	error = compute_generation_numbers(&w->commits, base);
 	if (error < 0)
 		goto cleanup;
 
@@ -1176,10 +2038,52 @@ static int commit_graph_write(
 			goto cleanup;
 	}
 
+	/* Fill the Bloom Filter Index and Data tables. */
+	if (changed_paths) {
+		uint32_t header[3];
+
+		header[0] = htonl(COMMIT_GRAPH_BLOOM_FILTER_VERSION);
+		header[1] = htonl(COMMIT_GRAPH_BLOOM_NUM_HASHES);
+		header[2] = htonl(COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY);
+
+		error = git_str_put(&bloom_filter_data, (const char *)header, sizeof(header));
+		if (error < 0)
+			goto cleanup;
+
+		git_vector_foreach (&w->commits, i, packed_commit) {
+			uint32_t word;
+
+			if (!packed_commit->bloom_filter &&
+			    (error = packed_commit_compute_bloom_filter(packed_commit, w->repo)) < 0)
+				goto cleanup;
+
+			error = git_str_put(&bloom_filter_data,
+				(const char *)packed_commit->bloom_filter,
+				packed_commit->bloom_filter_len);
+			if (error < 0)
+				goto cleanup;
+
+			if (!git__is_uint32(git_str_len(&bloom_filter_data) - sizeof(header))) {
+				git_error_set(GIT_ERROR_INVALID, "too many changed paths for the commit-graph");
+				error = -1;
+				goto cleanup;
+			}
+
+			word = htonl((uint32_t)(git_str_len(&bloom_filter_data) - sizeof(header)));
+			error = git_str_put(&bloom_filter_index, (const char *)&word, sizeof(word));
+			if (error < 0)
+				goto cleanup;
+		}
+	}
+
 	/* Write the header. */
 	hdr.chunks = 3;
 	if (git_str_len(&extra_edge_list) > 0)
 		hdr.chunks++;
+	if (changed_paths)
+		hdr.chunks += 2;
+	if (git_str_len(&base_graphs_list) > 0)
+		hdr.chunks++;
 	error = write_cb((const char *)&hdr, sizeof(hdr), cb_data);
 	if (error < 0)
 		goto cleanup;
@@ -1205,6 +2109,25 @@ static int commit_graph_write(
 			goto cleanup;
 		offset += git_str_len(&extra_edge_list);
 	}
+	if (changed_paths) {
+		error = write_chunk_header(
+				COMMIT_GRAPH_BLOOM_FILTER_INDEX_ID, offset, write_cb, cb_data);
+		if (error < 0)
+			goto cleanup;
+		offset += git_str_len(&bloom_filter_index);
+		error = write_chunk_header(
+				COMMIT_GRAPH_BLOOM_FILTER_DATA_ID, offset, write_cb, cb_data);
+		if (error < 0)
+			goto cleanup;
+		offset += git_str_len(&bloom_filter_data);
+	}
+	if (git_str_len(&base_graphs_list) > 0) {
+		error = write_chunk_header(
+				COMMIT_GRAPH_BASE_GRAPHS_LIST_ID, offset, write_cb, cb_data);
+		if (error < 0)
+			goto cleanup;
+		offset += git_str_len(&base_graphs_list);
+	}
 	error = write_chunk_header(0, offset, write_cb, cb_data);
 	if (error < 0)
 		goto cleanup;
@@ -1220,6 +2143,15 @@ static int commit_graph_write(
 	if (error < 0)
 		goto cleanup;
 	error = write_cb(git_str_cstr(&extra_edge_list), git_str_len(&extra_edge_list), cb_data);
+	if (error < 0)
+		goto cleanup;
+	error = write_cb(git_str_cstr(&bloom_filter_index), git_str_len(&bloom_filter_index), cb_data);
+	if (error < 0)
+		goto cleanup;
+	error = write_cb(git_str_cstr(&bloom_filter_data), git_str_len(&bloom_filter_data), cb_data);
+	if (error < 0)
+		goto cleanup;
+	error = write_cb(git_str_cstr(&base_graphs_list), git_str_len(&base_graphs_list), cb_data);
 	if (error < 0)
 		goto cleanup;
 
@@ -1231,10 +2163,16 @@ static int commit_graph_write(
 	if (error < 0)
 		goto cleanup;
 
+	if (checksum_out)
+		memcpy(checksum_out, checksum, checksum_size);
+
 cleanup:
 	git_str_dispose(&oid_lookup);
 	git_str_dispose(&commit_data);
 	git_str_dispose(&extra_edge_list);
+	git_str_dispose(&base_graphs_list);
+	git_str_dispose(&bloom_filter_index);
+	git_str_dispose(&bloom_filter_data);
 	git_hash_ctx_cleanup(&ctx);
 	return error;
 }
@@ -1257,6 +2195,263 @@ int git_commit_graph_writer_options_init(
 	return 0;
 }
 
+/* Add the commits of one layer of a chain to the writer, to merge it. */
+static int commit_graph_writer_add_layer(
+		git_commit_graph_writer *w,
+		const git_commit_graph_file *layer)
+{
+	git_commit_graph_entry e;
+	struct packed_commit *packed_commit;
+	const unsigned char *filter;
+	size_t i, filter_len;
+	int error;
+
+	for (i = 0; i < layer->num_commits; i++) {
+		if ((error = git_commit_graph_entry_get_byindex(&e, layer,
+				(size_t)layer->num_commits_in_base + i)) < 0 ||
+		    (error = packed_commit_from_entry(&packed_commit, layer, &e)) < 0)
+			return error;
+
+		/* Keep the changed-path Bloom filter, if it is one that we write */
+		if (layer->bloom_num_hashes == COMMIT_GRAPH_BLOOM_NUM_HASHES &&
+		    layer->bloom_bits_per_entry == COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY &&
+		    commit_graph_entry_bloom_filter(&filter, &filter_len, layer, &e) &&
+		    filter_len > 0) {
+			packed_commit->bloom_filter = git__malloc(filter_len);
+
+			if (!packed_commit->bloom_filter) {
+				packed_commit_free(packed_commit);
+				return -1;
+			}
+
+			memcpy(packed_commit->bloom_filter, filter, filter_len);
+			packed_commit->bloom_filter_len = filter_len;
+		}
+
+		if ((error = git_vector_insert(&w->commits, packed_commit)) < 0) {
+			packed_commit_free(packed_commit);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+/* Leave out the commits that the chain already has. */
+static int commit_graph_writer_exclude(
+		git_commit_graph_writer *w,
+		const git_commit_graph_file *chain)
+{
+	git_commit_graph_entry e;
+	struct packed_commit *packed_commit;
+	size_t i, j = 0;
+	int error;
+
+	git_vector_foreach (&w->commits, i, packed_commit) {
+		error = git_commit_graph_entry_find(&e, chain, &packed_commit->sha1,
+				git_oid_hexsize(w->oid_type));
+
+		if (error == 0) {
+			packed_commit_free(packed_commit);
+			continue;
+		} else if (error != GIT_ENOTFOUND) {
+			return error;
+		}
+
+		w->commits.contents[j++] = packed_commit;
+	}
+
+	git_error_clear();
+	w->commits.length = j;
+	return 0;
+}
+
+struct remove_stale_layer_data {
+	const char *chain;
+	size_t hexsize;
+};
+
+static int remove_stale_layer_cb(void *payload, git_str *path)
+{
+	struct remove_stale_layer_data *data = payload;
+	const char *filename, *line;
+	size_t prefix_len = strlen("graph-");
+	int error = 0;
+
+	filename = git_fs_path_basename(path->ptr);
+	GIT_ERROR_CHECK_ALLOC(filename);
+
+	if (git__prefixcmp(filename, "graph-") != 0 ||
+	    strlen(filename) != prefix_len + data->hexsize + strlen(".graph") ||
+	    git__suffixcmp(filename, ".graph") != 0)
+		goto done;
+
+	for (line = data->chain; *line; line += data->hexsize + 1) {
+		if (strncmp(line, filename + prefix_len, data->hexsize) == 0)
+			goto done;
+	}
+
+	if (p_unlink(path->ptr) < 0 && errno != ENOENT) {
+		git_error_set(GIT_ERROR_OS, "failed to remove stale commit-graph '%s'", path->ptr);
+		error = -1;
+	}
+
+done:
+	git__free((char *)filename);
+	return error;
+}
+
+static int commit_graph_writer_commit_split(
+		git_commit_graph_writer *w,
+		const git_commit_graph_writer_options *opts)
+{
+	git_commit_graph_file *chain = NULL, *base;
+	git_str graph_path = GIT_STR_INIT, path = GIT_STR_INIT, chain_contents = GIT_STR_INIT;
+	git_filebuf output = GIT_FILEBUF_INIT;
+	struct remove_stale_layer_data stale = {0};
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	double size_multiple = opts->size_multiple > 0 ? opts->size_multiple : 2;
+	size_t max_commits = opts->max_commits ? opts->max_commits : 64000;
+	size_t num_commits, dir_len;
+	bool single_file;
+	int filebuf_flags = GIT_FILEBUF_DO_NOT_BUFFER | GIT_FILEBUF_CREATE_LEADING_DIRS;
+	int error;
+
+	if (git_repository__fsync_gitdir)
+		filebuf_flags |= GIT_FILEBUF_FSYNC;
+
+	if ((error = git_str_joinpath(&graph_path, git_str_cstr(&w->objects_info_dir), "commit-graph")) < 0 ||
+	    (error = git_str_joinpath(&path, git_str_cstr(&w->objects_info_dir), GIT_COMMIT_GRAPH_CHAIN_FILE)) < 0)
+		goto done;
+
+	dir_len = git_str_len(&path) - strlen("/commit-graph-chain");
+
+	/* A single commit-graph file becomes the bottom of the chain */
+	single_file = git_fs_path_exists(git_str_cstr(&graph_path));
+
+	if (single_file)
+		error = git_commit_graph_file_open(&chain, git_str_cstr(&graph_path), w->oid_type);
+	else if (git_fs_path_isfile(git_str_cstr(&path)))
+		error = git_commit_graph_chain_open(&chain, git_str_cstr(&path), w->oid_type);
+
+	if (error < 0 || (chain && (error = commit_graph_writer_exclude(w, chain)) < 0))
+		goto done;
+
+	num_commits = git_vector_length(&w->commits);
+
+	if (chain && num_commits == 0 &&
+	    opts->split_strategy != GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_REPLACE)
+		goto done;
+
+	/*
+	 * Merge the files at the top of the chain into the new one while they
+	 * are not more than `size_multiple` times as large as it, or it is
+	 * too large itself, so that the chain stays short.
+	 */
+	for (base = chain; base; base = base->base) {
+		if (opts->split_strategy == GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_NO_MERGE)
+			break;
+
+		if (opts->split_strategy == GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT &&
+		    base->num_commits > size_multiple * num_commits &&
+		    num_commits <= max_commits)
+			break;
+
+		if ((error = commit_graph_writer_add_layer(w, base)) < 0)
+			goto done;
+
+		num_commits += base->num_commits;
+	}
+
+	/* Write the new file, then the chain that ends with it */
+	git_str_truncate(&path, dir_len);
+
+	if ((error = git_str_puts(&path, "/graph")) < 0 ||
+	    (error = git_filebuf_open(&output, git_str_cstr(&path), filebuf_flags, 0644)) < 0 ||
+	    (error = commit_graph_write(w, base, !!opts->changed_paths,
+			commit_graph_write_filebuf, &output, checksum)) < 0)
+		goto done;
+
+	git_hash_fmt(checksum_hex, checksum, git_oid_size(w->oid_type));
+
+	if ((error = git_str_printf(&path, "-%s.graph", checksum_hex)) < 0 ||
+	    (error = git_filebuf_commit_at(&output, git_str_cstr(&path))) < 0)
+		goto done;
+
+	if ((error = commit_graph_chain_checksums(&chain_contents, base, true)) < 0 ||
+	    (error = git_str_printf(&chain_contents, "%s\n", checksum_hex)) < 0)
+		goto done;
+
+	/* Move the single file into the chain, if it was not merged */
+	if (single_file && base) {
+		git_hash_fmt(checksum_hex, base->checksum, git_oid_size(w->oid_type));
+		git_str_truncate(&path, dir_len);
+
+		if ((error = git_str_printf(&path, "/graph-%s.graph", checksum_hex)) < 0)
+			goto done;
+	}
+
+	git_commit_graph_file_free(chain);
+	chain = NULL;
+
+	if (single_file && base &&
+	    p_rename(git_str_cstr(&graph_path), git_str_cstr(&path)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to move '%s' to '%s'",
+			git_str_cstr(&graph_path), git_str_cstr(&path));
+		error = -1;
+		goto done;
+	}
+
+	git_str_truncate(&path, dir_len);
+
+	if ((error = git_str_puts(&path, "/commit-graph-chain")) < 0 ||
+	    (error = git_filebuf_open(&output, git_str_cstr(&path), filebuf_flags, 0644)) < 0 ||
+	    (error = git_filebuf_write(&output, git_str_cstr(&chain_contents), git_str_len(&chain_contents))) < 0 ||
+	    (error = git_filebuf_commit(&output)) < 0)
+		goto done;
+
+	/*
+	 * Now that the chain does not list them, remove the files that were
+	 * merged, and the single file if that was merged, too.
+	 */
+	if (single_file && p_unlink(git_str_cstr(&graph_path)) < 0 && errno != ENOENT) {
+		git_error_set(GIT_ERROR_OS, "failed to remove '%s'", git_str_cstr(&graph_path));
+		error = -1;
+		goto done;
+	}
+
+	stale.chain = git_str_cstr(&chain_contents);
+	stale.hexsize = git_oid_hexsize(w->oid_type);
+	git_str_truncate(&path, dir_len);
+
+	error = git_fs_path_direach(&path, 0, remove_stale_layer_cb, &stale);
+
+done:
+	git_filebuf_cleanup(&output);
+	git_commit_graph_file_free(chain);
+	git_str_dispose(&chain_contents);
+	git_str_dispose(&graph_path);
+	git_str_dispose(&path);
+	return error;
+}
+
+/* A single commit-graph file replaces any chain of them. */
+static int commit_graph_remove_chain(git_commit_graph_writer *w)
+{
+	git_str path = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_str_joinpath(&path, git_str_cstr(&w->objects_info_dir), "commit-graphs")) < 0)
+		return error;
+
+	if (git_fs_path_isdir(git_str_cstr(&path)))
+		error = git_futils_rmdir_r(git_str_cstr(&path), NULL, GIT_RMDIR_REMOVE_FILES);
+
+	git_str_dispose(&path);
+	return error;
+}
+
 int git_commit_graph_writer_commit(
 		git_commit_graph_writer *w,
 		git_commit_graph_writer_options *opts)
@@ -1266,8 +2461,14 @@ int git_commit_graph_writer_commit(
 	git_str commit_graph_path = GIT_STR_INIT;
 	git_filebuf output = GIT_FILEBUF_INIT;
 
-	/* TODO: support options and fill in defaults. */
-	GIT_UNUSED(opts);
+	if (opts) {
+		GIT_ERROR_CHECK_VERSION(opts,
+			GIT_COMMIT_GRAPH_WRITER_OPTIONS_VERSION,
+			"git_commit_graph_writer_options");
+
+		if (opts->split_strategy != GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE)
+			return commit_graph_writer_commit_split(w, opts);
+	}
 
 	error = git_str_joinpath(
 			&commit_graph_path, git_str_cstr(&w->objects_info_dir), "commit-graph");
@@ -1281,13 +2482,17 @@ int git_commit_graph_writer_commit(
 	if (error < 0)
 		return error;
 
-	error = commit_graph_write(w, commit_graph_write_filebuf, &output);
+	error = commit_graph_write(w, NULL, opts && opts->changed_paths,
+			commit_graph_write_filebuf, &output, NULL);
 	if (error < 0) {
 		git_filebuf_cleanup(&output);
 		return error;
 	}
 
-	return git_filebuf_commit(&output);
+	if ((error = git_filebuf_commit(&output)) < 0)
+		return error;
+
+	return commit_graph_remove_chain(w);
 }
 
 int git_commit_graph_writer_dump(
@@ -1303,7 +2508,12 @@ int git_commit_graph__writer_dump(
 	git_commit_graph_writer *w,
 	git_commit_graph_writer_options *opts)
 {
-	/* TODO: support options. */
-	GIT_UNUSED(opts);
-	return commit_graph_write(w, commit_graph_write_buf, cgraph);
+	if (opts)
+		GIT_ERROR_CHECK_VERSION(opts,
+			GIT_COMMIT_GRAPH_WRITER_OPTIONS_VERSION,
+			"git_commit_graph_writer_options");
+
+	/* The dump is always of a single file. */
+	return commit_graph_write(w, NULL, opts && opts->changed_paths,
+			commit_graph_write_buf, cgraph, NULL);
 }
@@ -26,10 +26,27 @@
  * requiring a full graph traversal.
  *
  * Support for this feature was added in git 2.19.
+ *
+ * The commit-graph may also be split in a chain of files, listed (oldest
+ * first) in `commit-graphs/commit-graph-chain`, where each layer holds
+ * the commits that are not in the layers below it.  The positions of the
+ * commits, which are what parents are referred to by, count the commits
+ * of the layers below, too.  Support for this was added in git 2.25.
+ *
+ * Each commit may also have a changed-path Bloom filter, of the paths that
+ * differ between it and its first parent.  Support for this was added in
+ * git 2.27.
  */
 typedef struct git_commit_graph_file {
 	git_map graph_map;
 
+	/* The layer below this one in a chain, or NULL. */
+	struct git_commit_graph_file *base;
+	/* The number of commits in the layers below this one. */
+	uint32_t num_commits_in_base;
+	/* Whether this was opened as (the top layer of) a chain. */
+	bool chained;
+
 	/* The type of object IDs in the commit graph file. */
 	git_oid_t oid_type;
 
@@ -59,8 +76,30 @@ typedef struct git_commit_graph_file {
 	/* The number of entries in the Extra Edge List table. Each entry is 4 bytes wide. */
 	size_t num_extra_edge_list;
 
-	/* The trailer of the file. Contains the SHA1-checksum of the whole file. */
-	unsigned char checksum[GIT_HASH_SHA1_SIZE];
+	/*
+	 * The Base Graphs List. The checksums of the layers below this one in a
+	 * chain, oldest first.
+	 */
+	const unsigned char *base_graphs;
+	/* The number of entries in the Base Graphs List. */
+	size_t num_base_graphs;
+
+	/*
+	 * The Bloom Filter Index. Each 4-byte entry is the network byte order
+	 * offset in the Bloom Filter Data of the end of the changed-path Bloom
+	 * filter of the i-th commit. NULL if the file has no filters, or they
+	 * are of a version that we do not read.
+	 */
+	const unsigned char *bloom_filter_index;
+	/* The Bloom Filter Data, after its header. */
+	const unsigned char *bloom_filter_data;
+	size_t bloom_filter_data_len;
+	/* The number of hashes, and bits per changed path, of the filters. */
+	uint32_t bloom_num_hashes;
+	uint32_t bloom_bits_per_entry;
+
+	/* The trailer of the file. Contains the checksum of the whole file. */
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
 } git_commit_graph_file;
 
 /**
@@ -92,6 +131,9 @@ typedef struct git_commit_graph_entry {
 
 	/* The object ID hash of the requested commit. */
 	git_oid sha1;
+
+	/* The position of the commit in the graph, across all its layers. */
+	size_t position;
 } git_commit_graph_entry;
 
 /* A wrapper for git_commit_graph_file to enable lazy loading in the ODB. */
@@ -99,7 +141,13 @@ struct git_commit_graph {
 	/* The path to the commit-graph file. Something like ".git/objects/info/commit-graph". */
 	git_str filename;
 
-	/* The underlying commit-graph file. */
+	/*
+	 * The path to the chain of commit-graph files, which is used when there is
+	 * no single commit-graph file.
+	 */
+	git_str chain_filename;
+
+	/* The underlying commit-graph file, or the top layer of the chain. */
 	git_commit_graph_file *file;
 
 	/* The object ID types in the commit graph. */
@@ -125,6 +173,18 @@ int git_commit_graph_file_open(
 	const char *path,
 	git_oid_t oid_type);
 
+/* The name of the chain of commit-graph files, relative to `objects/info`. */
+#define GIT_COMMIT_GRAPH_CHAIN_FILE "commit-graphs/commit-graph-chain"
+
+/*
+ * Open and validate the chain of commit-graph files listed in the given chain
+ * file. The result is the top layer, whose `base` leads to the others.
+ */
+int git_commit_graph_chain_open(
+	git_commit_graph_file **file_out,
+	const char *chain_path,
+	git_oid_t oid_type);
+
 /*
  * Attempt to get the git_commit_graph's commit-graph file. This object is
  * still owned by the git_commit_graph. If the repository does not contain a commit graph,
@@ -152,6 +212,13 @@ struct git_commit_graph_writer {
 
 	/* The list of packed commits. */
 	git_vector commits;
+
+	/*
+	 * The repository that the commits were added from, in which the
+	 * changed-path Bloom filters are computed. It is not owned by the
+	 * writer.
+	 */
+	git_repository *repo;
 };
 
 int git_commit_graph__writer_dump(
@@ -165,7 +232,13 @@ int git_commit_graph__writer_dump(
  */
 bool git_commit_graph_file_needs_refresh(
 		const git_commit_graph_file *file, const char *path);
+bool git_commit_graph_chain_needs_refresh(
+		const git_commit_graph_file *file, const char *chain_path);
 
+/*
+ * Find a commit in the commit-graph and all the layers below it. Parents
+ * are looked up in the same `file`.
+ */
 int git_commit_graph_entry_find(
 		git_commit_graph_entry *e,
 		const git_commit_graph_file *file,
@@ -176,6 +249,30 @@ int git_commit_graph_entry_parent(
 		const git_commit_graph_file *file,
 		const git_commit_graph_entry *entry,
 		size_t n);
+
+/*
+ * Get the changed-path Bloom filter of a commit, which points into the
+ * commit-graph. Returns `GIT_ENOTFOUND` without setting an error if the
+ * layer that has the commit has no filters.
+ */
+int git_commit_graph_entry_bloom_filter(
+		const unsigned char **filter,
+		size_t *filter_len,
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry);
+
+/*
+ * Check whether a commit may have changed the given path (or anything
+ * below it) since its first parent, according to its changed-path Bloom
+ * filter. Returns 0 if it definitely did not, 1 if it may have, or
+ * `GIT_ENOTFOUND` without setting an error if there is no filter for it.
+ */
+int git_commit_graph_entry_maybe_changed_path(
+		const git_commit_graph_file *file,
+		const git_commit_graph_entry *entry,
+		const char *path,
+		size_t path_len);
+
 int git_commit_graph_file_close(git_commit_graph_file *cgraph);
 void git_commit_graph_file_free(git_commit_graph_file *cgraph);
 
@@ -531,6 +531,192 @@ int git_delta_read_header_fromstream(
 	return 0;
 }
 
+/*
+ * Make sure that at least `need` bytes of the delta are buffered, unless
+ * the delta ends before that.
+ */
+static int delta_stream_fill(git_delta_stream *stream, size_t need)
+{
+	while (stream->in_len - stream->in_pos < need && !stream->delta->done) {
+		off64_t curpos = stream->delta->curpos;
+		ssize_t read;
+
+		if (stream->in_pos) {
+			stream->in_len -= stream->in_pos;
+			memmove(stream->in, stream->in + stream->in_pos, stream->in_len);
+			stream->in_pos = 0;
+		}
+
+		read = git_packfile_stream_read(stream->delta,
+			stream->in + stream->in_len,
+			sizeof(stream->in) - stream->in_len);
+
+		if (read == GIT_EBUFS) {
+			/* zlib wanted more input, but there is none */
+			if (stream->delta->curpos == curpos) {
+				git_error_set(GIT_ERROR_INVALID, "truncated delta");
+				return -1;
+			}
+
+			continue;
+		}
+
+		if (read < 0)
+			return (int)read;
+
+		stream->in_len += (size_t)read;
+	}
+
+	return 0;
+}
+
+int git_delta_stream_init(
+	git_delta_stream *out,
+	size_t *result_len,
+	git_packfile_stream *delta,
+	const unsigned char *base,
+	size_t base_len)
+{
+	const unsigned char *hdr, *hdr_end;
+	size_t base_sz;
+	int error;
+
+	memset(out, 0, sizeof(git_delta_stream));
+	out->delta = delta;
+	out->base = base;
+	out->base_len = base_len;
+
+	/* each of the two sizes takes up at most ten bytes */
+	if ((error = delta_stream_fill(out, 20)) < 0)
+		return error;
+
+	hdr = out->in;
+	hdr_end = out->in + out->in_len;
+
+	if (hdr_sz(&base_sz, &hdr, hdr_end) < 0 || base_sz != base_len) {
+		git_error_set(GIT_ERROR_INVALID, "failed to apply delta: base size does not match given data");
+		return -1;
+	}
+
+	if (hdr_sz(&out->res_remain, &hdr, hdr_end) < 0)
+		return -1;
+
+	out->in_pos = hdr - out->in;
+	*result_len = out->res_remain;
+	return 0;
+}
+
+static int delta_stream_next_op(git_delta_stream *stream)
+{
+	const unsigned char *delta, *delta_end;
+	unsigned char cmd;
+	int error;
+
+	/* an instruction takes up at most eight bytes */
+	if ((error = delta_stream_fill(stream, 8)) < 0)
+		return error;
+
+	delta = stream->in + stream->in_pos;
+	delta_end = stream->in + stream->in_len;
+
+	if (delta == delta_end)
+		goto fail;
+
+	cmd = *delta++;
+
+	if (cmd & 0x80) {
+		size_t off = 0, len = 0, end;
+
+#define ADD_DELTA(o, shift) { if (delta < delta_end) (o) |= ((unsigned) *delta++ << shift); else goto fail; }
+		if (cmd & 0x01) ADD_DELTA(off, 0UL);
+		if (cmd & 0x02) ADD_DELTA(off, 8UL);
+		if (cmd & 0x04) ADD_DELTA(off, 16UL);
+		if (cmd & 0x08) ADD_DELTA(off, 24UL);
+
+		if (cmd & 0x10) ADD_DELTA(len, 0UL);
+		if (cmd & 0x20) ADD_DELTA(len, 8UL);
+		if (cmd & 0x40) ADD_DELTA(len, 16UL);
+		if (!len)       len = 0x10000;
+#undef ADD_DELTA
+
+		if (GIT_ADD_SIZET_OVERFLOW(&end, off, len) ||
+		    stream->base_len < end || stream->res_remain < len)
+			goto fail;
+
+		stream->copy_from = stream->base + off;
+		stream->op_remain = len;
+		stream->op_insert = 0;
+	} else if (cmd) {
+		if (stream->res_remain < cmd)
+			goto fail;
+
+		stream->op_remain = cmd;
+		stream->op_insert = 1;
+	} else {
+		/* cmd == 0 is reserved for future encodings. */
+		goto fail;
+	}
+
+	stream->in_pos = delta - stream->in;
+	return 0;
+
+fail:
+	git_error_set(GIT_ERROR_INVALID, "failed to apply delta");
+	return -1;
+}
+
+ssize_t git_delta_stream_read(
+	git_delta_stream *stream,
+	char *buffer,
+	size_t len)
+{
+	size_t total = 0, chunk;
+	int error;
+
+	while (total < len && (stream->op_remain || stream->res_remain)) {
+		if (!stream->op_remain &&
+		    (error = delta_stream_next_op(stream)) < 0)
+			return error;
+
+		chunk = min(len - total, stream->op_remain);
+
+		if (stream->op_insert) {
+			if ((error = delta_stream_fill(stream, 1)) < 0)
+				return error;
+
+			chunk = min(chunk, stream->in_len - stream->in_pos);
+
+			if (!chunk) {
+				git_error_set(GIT_ERROR_INVALID, "truncated delta");
+				return -1;
+			}
+
+			memcpy(buffer + total, stream->in + stream->in_pos, chunk);
+			stream->in_pos += chunk;
+		} else {
+			memcpy(buffer + total, stream->copy_from, chunk);
+			stream->copy_from += chunk;
+		}
+
+		stream->op_remain -= chunk;
+		stream->res_remain -= chunk;
+		total += chunk;
+	}
+
+	/* once the result is complete, there must be nothing left over */
+	if (!stream->op_remain && !stream->res_remain) {
+		if ((error = delta_stream_fill(stream, 1)) < 0)
+			return error;
+
+		if (stream->in_pos != stream->in_len) {
+			git_error_set(GIT_ERROR_INVALID, "failed to apply delta");
+			return -1;
+		}
+	}
+
+	return (ssize_t)total;
+}
+
 int git_delta_apply(
 	void **out,
 	size_t *out_len,
@@ -133,4 +133,57 @@ extern int git_delta_read_header_fromstream(
 	size_t *result_out,
 	git_packfile_stream *stream);
 
+#define GIT_DELTA_STREAM_BUFFER_LEN 4096
+
+/**
+ * A delta that is applied to its base as the delta is inflated from
+ * the packfile, so that neither the delta nor the result ever need to
+ * be held in memory in their entirety; only the base does.
+ */
+typedef struct {
+	git_packfile_stream *delta;
+	const unsigned char *base;
+	size_t base_len;
+
+	/* bytes of the result that are still to be produced */
+	size_t res_remain;
+
+	/* the instruction that is being executed */
+	const unsigned char *copy_from;
+	size_t op_remain;
+	unsigned int op_insert : 1;
+
+	unsigned char in[GIT_DELTA_STREAM_BUFFER_LEN];
+	size_t in_pos;
+	size_t in_len;
+} git_delta_stream;
+
+/**
+ * Start applying the delta that is read from `delta` to the given
+ * base, which must outlive the delta stream.
+ *
+ * @param out the delta stream to initialize
+ * @param result_len pointer to store the size of the result
+ * @param delta the stream of the (inflated) delta
+ * @param base the base to copy from during copy instructions
+ * @param base_len number of bytes available at base
+ * @return 0 on success or an error code
+ */
+extern int git_delta_stream_init(
+	git_delta_stream *out,
+	size_t *result_len,
+	git_packfile_stream *delta,
+	const unsigned char *base,
+	size_t base_len);
+
+/**
+ * Read up to `len` bytes of the result of the delta.  Returns the
+ * number of bytes read, 0 once the whole result has been read, or an
+ * error code.
+ */
+extern ssize_t git_delta_stream_read(
+	git_delta_stream *stream,
+	char *buffer,
+	size_t len);
+
 #endif
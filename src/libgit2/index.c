@@ -2781,7 +2781,7 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	 * it to the provided checksum in the footer.
 	 */
 	git_hash_buf(checksum, buffer, buffer_size - checksum_size,
-		git_oid_algorithm(index->oid_type));
+		git_hash_checksum_algorithm(git_oid_algorithm(index->oid_type)));
 
 	/* Parse header */
 	if ((error = read_header(&header, buffer)) < 0)
@@ -23,26 +23,22 @@
 #include "oidmap.h"
 #include "zstream.h"
 #include "object.h"
+#include "pool.h"
 
 size_t git_indexer__max_objects = UINT32_MAX;
 
 #define UINT31_MAX (0x7FFFFFFF)
 
-struct entry {
-	git_oid oid;
-	uint32_t crc;
-	uint32_t offset;
-	uint64_t offset_long;
-};
-
 struct git_indexer {
 	unsigned int parsed_header :1,
 		pack_committed :1,
 		have_stream :1,
 		have_delta :1,
 		do_fsync :1,
-		do_verify :1;
+		do_verify :1,
+		progress_deferred :1;
 	git_oid_t oid_type;
+	unsigned int nr_threads;
 	struct git_pack_header hdr;
 	struct git_pack_file *pack;
 	unsigned int mode;
@@ -52,8 +48,20 @@ struct git_indexer {
 	git_str entry_data;
 	git_packfile_stream stream;
 	size_t nr_objects;
-	git_vector objects;
 	git_vector deltas;
+
+	/*
+	 * The objects of the pack are kept column-wise, in the order that
+	 * they were indexed, so that even huge packs only need a handful
+	 * of large allocations.  `entry_order` is their index order.
+	 */
+	git_array_t(git_oid) entry_ids;
+	git_array_t(off64_t) entry_offsets;
+	git_array_t(uint32_t) entry_crcs;
+	uint32_t *entry_order;
+
+	/* The `git_pack_entry` values of the pack's `idx_cache` */
+	git_pool pentry_pool;
 	unsigned int fanout[256];
 	git_hash_ctx hash_ctx;
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
@@ -72,12 +80,23 @@ struct git_indexer {
 	char inbuf[GIT_HASH_MAX_SIZE];
 	size_t inbuf_len;
 	git_hash_ctx trailer;
+
+#ifdef GIT_THREADS
+	/* Set when the received data is processed on a separate thread */
+	struct indexer_pipeline *pipeline;
+#endif
 };
 
 struct delta_info {
 	off64_t delta_off;
+	off64_t delta_end;
 };
 
+#ifdef GIT_THREADS
+static int pipeline_new(struct indexer_pipeline **out);
+static void pipeline_free(git_indexer *idx);
+#endif
+
 #ifndef GIT_DEPRECATE_HARD
 const git_oid *git_indexer_hash(const git_indexer *idx)
 {
@@ -115,14 +134,6 @@ static int parse_header(struct git_pack_header *hdr, struct git_pack_file *pack)
 	return 0;
 }
 
-static int objects_cmp(const void *a, const void *b)
-{
-	const struct entry *entrya = a;
-	const struct entry *entryb = b;
-
-	return git_oid__cmp(&entrya->oid, &entryb->oid);
-}
-
 int git_indexer_options_init(git_indexer_options *opts, unsigned int version)
 {
 	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
@@ -181,11 +192,18 @@ static int indexer_new(
 	checksum_type = indexer_hash_algorithm(idx);
 
 	if ((error = git_hash_ctx_init(&idx->hash_ctx, checksum_type)) < 0 ||
-	    (error = git_hash_ctx_init(&idx->trailer, checksum_type)) < 0 ||
-	    (error = git_oidmap_new(&idx->expected_oids)) < 0)
+	    (error = git_hash_ctx_init(&idx->trailer, git_hash_checksum_algorithm(checksum_type))) < 0 ||
+	    (error = git_oidmap_new(&idx->expected_oids)) < 0 ||
+	    (error = git_pool_init(&idx->pentry_pool, sizeof(struct git_pack_entry))) < 0)
 		goto cleanup;
 
 	idx->do_verify = opts.verify;
+	idx->nr_threads = opts.threads;
+
+#ifdef GIT_THREADS
+	if (opts.pipeline && (error = pipeline_new(&idx->pipeline)) < 0)
+		goto cleanup;
+#endif
 
 	if (git_repository__fsync_gitdir)
 		idx->do_fsync = 1;
@@ -206,7 +224,8 @@ static int indexer_new(
 		goto cleanup;
 
 	idx->pack->mwf.fd = fd;
-	if ((error = git_mwindow_file_register(&idx->pack->mwf)) < 0)
+	if ((error = git_mwindow_file_register(&idx->pack->mwf)) < 0 ||
+	    (error = git_mwindow_file_advise(&idx->pack->mwf, GIT_MAP_ADVICE_SEQUENTIAL)) < 0)
 		goto cleanup;
 
 	*out = idx;
@@ -224,6 +243,9 @@ cleanup:
 
 	git_str_dispose(&path);
 	git_str_dispose(&tmp_path);
+#ifdef GIT_THREADS
+	pipeline_free(idx);
+#endif
 	git__free(idx);
 	return -1;
 }
@@ -268,6 +290,7 @@ static int store_delta(git_indexer *idx)
 	delta = git__calloc(1, sizeof(struct delta_info));
 	GIT_ERROR_CHECK_ALLOC(delta);
 	delta->delta_off = idx->entry_start;
+	delta->delta_end = idx->off;
 
 	if (git_vector_insert(&idx->deltas, delta) < 0)
 		return -1;
@@ -472,37 +495,61 @@ out:
 	return error;
 }
 
-static int store_object(git_indexer *idx)
+static int add_entry(git_indexer *idx, const git_oid *id, off64_t offset, uint32_t crc)
 {
-	int i, error;
-	git_oid oid;
-	struct entry *entry;
-	off64_t entry_size;
 	struct git_pack_entry *pentry;
-	off64_t entry_start = idx->entry_start;
-
-	entry = git__calloc(1, sizeof(*entry));
-	GIT_ERROR_CHECK_ALLOC(entry);
+	git_oid *entry_id;
+	off64_t *entry_offset;
+	uint32_t *entry_crc;
+	int i;
 
-	pentry = git__calloc(1, sizeof(struct git_pack_entry));
+	pentry = git_pool_mallocz(&idx->pentry_pool, 1);
 	GIT_ERROR_CHECK_ALLOC(pentry);
 
-	if (git_hash_final(oid.id, &idx->hash_ctx)) {
-		git__free(pentry);
-		goto on_error;
+	git_oid_cpy(&pentry->id, id);
+	pentry->offset = offset;
+
+	if (git_oidmap_exists(idx->pack->idx_cache, &pentry->id) ||
+	    git_oidmap_set(idx->pack->idx_cache, &pentry->id, pentry) < 0) {
+		git_error_set(GIT_ERROR_INDEXER, "cannot insert object into pack");
+		return -1;
+	}
+
+	/* Add the object to the list */
+	entry_id = git_array_alloc(idx->entry_ids);
+	entry_offset = git_array_alloc(idx->entry_offsets);
+	entry_crc = git_array_alloc(idx->entry_crcs);
+
+	if (!entry_id || !entry_offset || !entry_crc)
+		return -1;
+
+	git_oid_cpy(entry_id, id);
+	*entry_offset = offset;
+	*entry_crc = crc;
+
+	for (i = id->id[0]; i < 256; ++i) {
+		idx->fanout[i]++;
 	}
 
+	return 0;
+}
+
+static int store_object(git_indexer *idx)
+{
+	int error;
+	git_oid oid;
+	uint32_t crc;
+	off64_t entry_size;
+	off64_t entry_start = idx->entry_start;
+
+	if (git_hash_final(oid.id, &idx->hash_ctx))
+		return -1;
+
 #ifdef GIT_EXPERIMENTAL_SHA256
 	oid.type = idx->oid_type;
 #endif
 
 	entry_size = idx->off - entry_start;
-	if (entry_start > UINT31_MAX) {
-		entry->offset = UINT32_MAX;
-		entry->offset_long = entry_start;
-	} else {
-		entry->offset = (uint32_t)entry_start;
-	}
 
 	if (idx->do_verify) {
 		git_rawobj rawobj = {
@@ -512,49 +559,24 @@ static int store_object(git_indexer *idx)
 		};
 
 		if ((error = check_object_connectivity(idx, &rawobj)) < 0)
-			goto on_error;
+			return error;
 	}
 
-	git_oid_cpy(&pentry->id, &oid);
-	pentry->offset = entry_start;
-
-	if (git_oidmap_exists(idx->pack->idx_cache, &pentry->id)) {
-		const char *idstr = git_oid_tostr_s(&pentry->id);
+	if (git_oidmap_exists(idx->pack->idx_cache, &oid)) {
+		const char *idstr = git_oid_tostr_s(&oid);
 
 		if (!idstr)
 			git_error_set(GIT_ERROR_INDEXER, "failed to parse object id");
 		else
 			git_error_set(GIT_ERROR_INDEXER, "duplicate object %s found in pack", idstr);
 
-		git__free(pentry);
-		goto on_error;
-	}
-
-	if ((error = git_oidmap_set(idx->pack->idx_cache, &pentry->id, pentry)) < 0) {
-		git__free(pentry);
-		git_error_set_oom();
-		goto on_error;
-	}
-
-	git_oid_cpy(&entry->oid, &oid);
-
-	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
-		goto on_error;
-
-	/* Add the object to the list */
-	if (git_vector_insert(&idx->objects, entry) < 0)
-		goto on_error;
-
-	for (i = oid.id[0]; i < 256; ++i) {
-		idx->fanout[i]++;
+		return -1;
 	}
 
-	return 0;
-
-on_error:
-	git__free(entry);
+	if (crc_object(&crc, &idx->pack->mwf, entry_start, entry_size) < 0)
+		return -1;
 
-	return -1;
+	return add_entry(idx, &oid, entry_start, crc);
 }
 
 GIT_INLINE(bool) has_entry(git_indexer *idx, git_oid *id)
@@ -562,74 +584,32 @@ GIT_INLINE(bool) has_entry(git_indexer *idx, git_oid *id)
 	return git_oidmap_exists(idx->pack->idx_cache, id);
 }
 
-static int save_entry(git_indexer *idx, struct entry *entry, struct git_pack_entry *pentry, off64_t entry_start)
-{
-	int i;
-
-	if (entry_start > UINT31_MAX) {
-		entry->offset = UINT32_MAX;
-		entry->offset_long = entry_start;
-	} else {
-		entry->offset = (uint32_t)entry_start;
-	}
-
-	pentry->offset = entry_start;
-
-	if (git_oidmap_exists(idx->pack->idx_cache, &pentry->id) ||
-	    git_oidmap_set(idx->pack->idx_cache, &pentry->id, pentry) < 0) {
-		git_error_set(GIT_ERROR_INDEXER, "cannot insert object into pack");
-		return -1;
-	}
-
-	/* Add the object to the list */
-	if (git_vector_insert(&idx->objects, entry) < 0)
-		return -1;
-
-	for (i = entry->oid.id[0]; i < 256; ++i) {
-		idx->fanout[i]++;
-	}
-
-	return 0;
-}
-
 static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
 {
 	git_oid oid;
+	uint32_t crc;
 	size_t entry_size;
-	struct entry *entry;
-	struct git_pack_entry *pentry = NULL;
-
-	entry = git__calloc(1, sizeof(*entry));
-	GIT_ERROR_CHECK_ALLOC(entry);
 
 	if (git_odb__hashobj(&oid, obj, idx->oid_type) < 0) {
 		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
 		goto on_error;
 	}
 
-	pentry = git__calloc(1, sizeof(struct git_pack_entry));
-	GIT_ERROR_CHECK_ALLOC(pentry);
-
-	git_oid_cpy(&pentry->id, &oid);
-	git_oid_cpy(&entry->oid, &oid);
-	entry->crc = crc32(0L, Z_NULL, 0);
-
 	entry_size = (size_t)(idx->off - entry_start);
-	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
+	if (crc_object(&crc, &idx->pack->mwf, entry_start, entry_size) < 0)
 		goto on_error;
 
-	return save_entry(idx, entry, pentry, entry_start);
+	return add_entry(idx, &oid, entry_start, crc);
 
 on_error:
-	git__free(pentry);
-	git__free(entry);
 	git__free(obj->data);
 	return -1;
 }
 
 static int do_progress_callback(git_indexer *idx, git_indexer_progress *stats)
 {
-	if (idx->progress_cb)
+	/* When pipelined, progress is reported from the caller's thread */
+	if (idx->progress_cb && !idx->progress_deferred)
 		return git_error_set_after_callback_function(
 			idx->progress_cb(stats, idx->progress_payload),
 			"indexer progress");
@@ -873,16 +853,12 @@ static int read_stream_object(git_indexer *idx, git_indexer_progress *stats)
 	return 0;
 }
 
-int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_indexer_progress *stats)
+static int indexer_append(git_indexer *idx, const void *data, size_t size, git_indexer_progress *stats)
 {
 	int error = -1;
 	struct git_pack_header *hdr = &idx->hdr;
 	git_mwindow_file *mwf = &idx->pack->mwf;
 
-	GIT_ASSERT_ARG(idx);
-	GIT_ASSERT_ARG(data);
-	GIT_ASSERT_ARG(stats);
-
 	if ((error = append_to_pack(idx, data, size)) < 0)
 		return error;
 
@@ -915,8 +891,15 @@ int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_inde
 			return -1;
 
 		idx->pack->has_cache = 1;
-		if (git_vector_init(&idx->objects, total_objects, objects_cmp) < 0)
+		git_array_init_to_size(idx->entry_ids, total_objects);
+		git_array_init_to_size(idx->entry_offsets, total_objects);
+		git_array_init_to_size(idx->entry_crcs, total_objects);
+
+		if (total_objects &&
+		    (!idx->entry_ids.ptr || !idx->entry_offsets.ptr || !idx->entry_crcs.ptr)) {
+			git_error_set_oom();
 			return -1;
+		}
 
 		if (git_vector_init(&idx->deltas, total_objects / 2, NULL) < 0)
 			return -1;
@@ -954,6 +937,304 @@ on_error:
 	return error;
 }
 
+#ifdef GIT_THREADS
+
+/* The most received data that is queued up before appending blocks */
+#define INDEXER_PIPELINE_BUFFER (32 * 1024 * 1024)
+
+struct indexer_pipeline_chunk {
+	struct indexer_pipeline_chunk *next;
+	size_t len;
+	char data[GIT_FLEX_ARRAY];
+};
+
+struct indexer_pipeline {
+	git_thread thread;
+	git_mutex lock;
+	git_cond cond;
+
+	struct indexer_pipeline_chunk *head;
+	struct indexer_pipeline_chunk *tail;
+	size_t queued;
+
+	/* The worker's own statistics, and the latest snapshot of them */
+	git_indexer_progress worker_stats;
+	git_indexer_progress stats;
+	git_indexer_progress reported;
+
+	int error;
+	git_error *error_info;
+
+	unsigned int running : 1,
+		finished : 1;
+};
+
+static int pipeline_new(struct indexer_pipeline **out)
+{
+	struct indexer_pipeline *pipeline;
+
+	pipeline = git__calloc(1, sizeof(struct indexer_pipeline));
+	GIT_ERROR_CHECK_ALLOC(pipeline);
+
+	if (git_mutex_init(&pipeline->lock) < 0 ||
+	    git_cond_init(&pipeline->cond) < 0) {
+		git_error_set(GIT_ERROR_THREAD, "unable to initialize indexer pipeline");
+		git__free(pipeline);
+		return -1;
+	}
+
+	*out = pipeline;
+	return 0;
+}
+
+static void *pipeline_thread(void *arg)
+{
+	git_indexer *idx = arg;
+	struct indexer_pipeline *pipeline = idx->pipeline;
+	struct indexer_pipeline_chunk *chunk;
+	int error;
+
+	while (true) {
+		if (git_mutex_lock(&pipeline->lock) < 0)
+			return NULL;
+
+		while (!pipeline->head && !pipeline->finished)
+			git_cond_wait(&pipeline->cond, &pipeline->lock);
+
+		if ((chunk = pipeline->head) == NULL) {
+			git_mutex_unlock(&pipeline->lock);
+			break;
+		}
+
+		if ((pipeline->head = chunk->next) == NULL)
+			pipeline->tail = NULL;
+
+		git_mutex_unlock(&pipeline->lock);
+
+		error = indexer_append(idx, chunk->data, chunk->len, &pipeline->worker_stats);
+
+		if (git_mutex_lock(&pipeline->lock) < 0) {
+			git__free(chunk);
+			return NULL;
+		}
+
+		pipeline->queued -= chunk->len;
+		memcpy(&pipeline->stats, &pipeline->worker_stats, sizeof(git_indexer_progress));
+
+		if (error < 0) {
+			pipeline->error = error;
+			git_error_save(&pipeline->error_info);
+		}
+
+		git_cond_broadcast(&pipeline->cond);
+		git_mutex_unlock(&pipeline->lock);
+
+		git__free(chunk);
+
+		if (error < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/* Must be called with the pipeline locked */
+static int pipeline_error(struct indexer_pipeline *pipeline)
+{
+	if (pipeline->error_info) {
+		git_error_restore(pipeline->error_info);
+		pipeline->error_info = NULL;
+	} else {
+		git_error_set(GIT_ERROR_INDEXER, "failed to index the received data");
+	}
+
+	return pipeline->error;
+}
+
+static int pipeline_progress(git_indexer *idx, git_indexer_progress *stats)
+{
+	struct indexer_pipeline *pipeline = idx->pipeline;
+
+	if (!idx->progress_cb ||
+	    !memcmp(&pipeline->reported, stats, sizeof(git_indexer_progress)))
+		return 0;
+
+	memcpy(&pipeline->reported, stats, sizeof(git_indexer_progress));
+
+	return git_error_set_after_callback_function(
+		idx->progress_cb(stats, idx->progress_payload),
+		"indexer progress");
+}
+
+/*
+ * Hand over the counts that the worker keeps; the rest of the caller's
+ * progress (like the transport's `received_bytes`) is theirs.
+ */
+static void pipeline_stats(
+	git_indexer_progress *stats,
+	const git_indexer_progress *worker_stats)
+{
+	stats->total_objects = worker_stats->total_objects;
+	stats->indexed_objects = worker_stats->indexed_objects;
+	stats->received_objects = worker_stats->received_objects;
+	stats->local_objects = worker_stats->local_objects;
+	stats->total_deltas = worker_stats->total_deltas;
+	stats->indexed_deltas = worker_stats->indexed_deltas;
+}
+
+static int pipeline_append(git_indexer *idx, const void *data, size_t size, git_indexer_progress *stats)
+{
+	struct indexer_pipeline *pipeline = idx->pipeline;
+	struct indexer_pipeline_chunk *chunk;
+	size_t alloclen;
+	int error = 0;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct indexer_pipeline_chunk), size);
+	chunk = git__malloc(alloclen);
+	GIT_ERROR_CHECK_ALLOC(chunk);
+
+	chunk->next = NULL;
+	chunk->len = size;
+	memcpy(chunk->data, data, size);
+
+	if (pipeline->finished) {
+		git_error_set(GIT_ERROR_INDEXER, "cannot append to a committed indexer");
+		git__free(chunk);
+		return -1;
+	}
+
+	if (!pipeline->running) {
+		idx->progress_deferred = 1;
+
+		if (git_thread_create(&pipeline->thread, pipeline_thread, idx) != 0) {
+			git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+			idx->progress_deferred = 0;
+			git__free(chunk);
+			return -1;
+		}
+
+		pipeline->running = 1;
+	}
+
+	if (git_mutex_lock(&pipeline->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock indexer pipeline");
+		git__free(chunk);
+		return -1;
+	}
+
+	while (pipeline->queued >= INDEXER_PIPELINE_BUFFER && !pipeline->error)
+		git_cond_wait(&pipeline->cond, &pipeline->lock);
+
+	if (pipeline->error) {
+		error = pipeline_error(pipeline);
+		git__free(chunk);
+	} else {
+		if (pipeline->tail)
+			pipeline->tail->next = chunk;
+		else
+			pipeline->head = chunk;
+
+		pipeline->tail = chunk;
+		pipeline->queued += size;
+
+		git_cond_broadcast(&pipeline->cond);
+	}
+
+	pipeline_stats(stats, &pipeline->stats);
+	git_mutex_unlock(&pipeline->lock);
+
+	if (!error)
+		error = pipeline_progress(idx, stats);
+
+	return error;
+}
+
+/*
+ * Wait for the worker to process everything that was queued up, and
+ * hand the indexer back to the calling thread.
+ */
+static int pipeline_stop(git_indexer *idx)
+{
+	struct indexer_pipeline *pipeline = idx->pipeline;
+	struct indexer_pipeline_chunk *chunk;
+
+	if (git_mutex_lock(&pipeline->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock indexer pipeline");
+		return -1;
+	}
+
+	pipeline->finished = 1;
+	git_cond_broadcast(&pipeline->cond);
+	git_mutex_unlock(&pipeline->lock);
+
+	if (pipeline->running) {
+		git_thread_join(&pipeline->thread, NULL);
+		pipeline->running = 0;
+	}
+
+	idx->progress_deferred = 0;
+
+	/* Anything left over was queued after the worker failed */
+	while ((chunk = pipeline->head) != NULL) {
+		pipeline->head = chunk->next;
+		git__free(chunk);
+	}
+
+	pipeline->tail = NULL;
+	pipeline->queued = 0;
+
+	return 0;
+}
+
+static int pipeline_finish(git_indexer *idx, git_indexer_progress *stats)
+{
+	struct indexer_pipeline *pipeline = idx->pipeline;
+	int error;
+
+	if ((error = pipeline_stop(idx)) < 0)
+		return error;
+
+	pipeline_stats(stats, &pipeline->stats);
+
+	if (pipeline->error)
+		return pipeline_error(pipeline);
+
+	return pipeline_progress(idx, stats);
+}
+
+static void pipeline_free(git_indexer *idx)
+{
+	struct indexer_pipeline *pipeline = idx->pipeline;
+
+	if (!pipeline)
+		return;
+
+	pipeline_stop(idx);
+
+	git_error_free(pipeline->error_info);
+	git_cond_free(&pipeline->cond);
+	git_mutex_free(&pipeline->lock);
+	git__free(pipeline);
+
+	idx->pipeline = NULL;
+}
+
+#endif
+
+int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_indexer_progress *stats)
+{
+	GIT_ASSERT_ARG(idx);
+	GIT_ASSERT_ARG(data);
+	GIT_ASSERT_ARG(stats);
+
+#ifdef GIT_THREADS
+	if (idx->pipeline)
+		return pipeline_append(idx, data, size, stats);
+#endif
+
+	return indexer_append(idx, data, size, stats);
+}
+
 static int index_path(git_str *path, git_indexer *idx, const char *suffix)
 {
 	const char prefix[] = "pack-";
@@ -988,8 +1269,7 @@ static int seek_back_trailer(git_indexer *idx)
 static int inject_object(git_indexer *idx, git_oid *id)
 {
 	git_odb_object *obj = NULL;
-	struct entry *entry = NULL;
-	struct git_pack_entry *pentry = NULL;
+	uint32_t crc;
 	unsigned char empty_checksum[GIT_HASH_MAX_SIZE] = {0};
 	unsigned char hdr[64];
 	git_str buf = GIT_STR_INIT;
@@ -1014,10 +1294,7 @@ static int inject_object(git_indexer *idx, git_oid *id)
 	data = git_odb_object_data(obj);
 	len = git_odb_object_size(obj);
 
-	entry = git__calloc(1, sizeof(*entry));
-	GIT_ERROR_CHECK_ALLOC(entry);
-
-	entry->crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(0L, Z_NULL, 0);
 
 	/* Write out the object header */
 	if ((error = git_packfile__object_header(&hdr_len, hdr, len, git_odb_object_type(obj))) < 0 ||
@@ -1025,7 +1302,7 @@ static int inject_object(git_indexer *idx, git_oid *id)
 		goto cleanup;
 
 	idx->pack->mwf.size += hdr_len;
-	entry->crc = crc32(entry->crc, hdr, (uInt)hdr_len);
+	crc = crc32(crc, hdr, (uInt)hdr_len);
 
 	if ((error = git_zstream_deflatebuf(&buf, data, len)) < 0)
 		goto cleanup;
@@ -1035,7 +1312,7 @@ static int inject_object(git_indexer *idx, git_oid *id)
 		goto cleanup;
 
 	idx->pack->mwf.size += buf.size;
-	entry->crc = htonl(crc32(entry->crc, (unsigned char *)buf.ptr, (uInt)buf.size));
+	crc = htonl(crc32(crc, (unsigned char *)buf.ptr, (uInt)buf.size));
 	git_str_dispose(&buf);
 
 	/* Write a fake trailer so the pack functions play ball */
@@ -1045,21 +1322,12 @@ static int inject_object(git_indexer *idx, git_oid *id)
 
 	idx->pack->mwf.size += git_oid_size(idx->oid_type);
 
-	pentry = git__calloc(1, sizeof(struct git_pack_entry));
-	GIT_ERROR_CHECK_ALLOC(pentry);
-
-	git_oid_cpy(&pentry->id, id);
-	git_oid_cpy(&entry->oid, id);
 	idx->off = entry_start + hdr_len + len;
 
-	error = save_entry(idx, entry, pentry, entry_start);
+	error = add_entry(idx, id, entry_start, crc);
 
 cleanup:
-	if (error) {
-		git__free(entry);
-		git__free(pentry);
-	}
-
+	git_str_dispose(&buf);
 	git_odb_object_free(obj);
 	return error;
 }
@@ -1126,51 +1394,295 @@ static int fix_thin_pack(git_indexer *idx, git_indexer_progress *stats)
 	return 0;
 }
 
-static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
+#ifdef GIT_THREADS
+
+/* The number of deltas that each thread resolves between progress updates */
+#define RESOLVE_BATCH_PER_THREAD 1024
+
+struct resolve_result {
+	size_t pos;
+	git_rawobj obj;
+	git_oid oid;
+	uint32_t crc;
+	int error;
+	git_error *error_info;
+};
+
+struct resolve_batch {
+	git_indexer *idx;
+	struct resolve_result *results;
+	size_t len;
+	git_atomic32 next;
+};
+
+/*
+ * The number of deltas that a thread claims at a time; their objects
+ * are hashed together.
+ */
+#define RESOLVE_CHUNK GIT_HASH_LANES_MAX
+
+static void resolve_error(struct resolve_result *result)
 {
-	unsigned int i;
+	git__free(result->obj.data);
+	result->obj.data = NULL;
+
+	if (result->error != GIT_PASSTHROUGH)
+		git_error_save(&result->error_info);
+}
+
+/*
+ * Unpack, hash and checksum a chunk of deltas.  This only reads from
+ * the indexer and its packfile, so that it may run on any thread; the
+ * results get saved by the main thread.
+ */
+static void resolve_chunk(
+	git_indexer *idx,
+	struct resolve_result *results,
+	size_t len)
+{
+	struct resolve_result *unpacked[RESOLVE_CHUNK];
+	git_rawobj objs[RESOLVE_CHUNK];
+	git_oid oids[RESOLVE_CHUNK];
+	struct delta_info *delta;
+	size_t i, n = 0;
 	int error;
+
+	for (i = 0; i < len; i++) {
+		struct resolve_result *result = &results[i];
+		off64_t off;
+
+		delta = git_vector_get(&idx->deltas, result->pos);
+		off = delta->delta_off;
+
+		if ((result->error = git_packfile_unpack(&result->obj, idx->pack, &off)) < 0) {
+			resolve_error(result);
+			continue;
+		}
+
+		unpacked[n] = result;
+		objs[n++] = result->obj;
+	}
+
+	if ((error = git_odb__hashobj_many(oids, objs, n, idx->oid_type)) < 0)
+		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
+
+	for (i = 0; i < n; i++) {
+		struct resolve_result *result = unpacked[i];
+
+		delta = git_vector_get(&idx->deltas, result->pos);
+
+		if ((result->error = error) < 0 ||
+		    (result->error = crc_object(&result->crc, &idx->pack->mwf,
+				delta->delta_off, delta->delta_end - delta->delta_off)) < 0) {
+			resolve_error(result);
+			continue;
+		}
+
+		git_oid_cpy(&result->oid, &oids[i]);
+
+		/* Connectivity checks need the data, everything else is done with it */
+		if (!idx->do_verify) {
+			git__free(result->obj.data);
+			result->obj.data = NULL;
+		}
+	}
+}
+
+static void *resolve_thread(void *arg)
+{
+	struct resolve_batch *batch = arg;
+	size_t i;
+
+	while ((i = (size_t)git_atomic32_add(&batch->next, RESOLVE_CHUNK) - RESOLVE_CHUNK) < batch->len)
+		resolve_chunk(batch->idx, &batch->results[i],
+			min(RESOLVE_CHUNK, batch->len - i));
+
+	return NULL;
+}
+
+/*
+ * Resolve the deltas in batches, in the order that they appear in the
+ * pack.  The threads of a batch share the packfile's delta base cache,
+ * so the bases that neighbouring deltas have in common are only
+ * inflated once.  Since the objects are only added to the index at the
+ * end of each batch, a delta whose base is resolved in the same batch
+ * is retried on the next pass, just like a delta whose base comes
+ * later in the pack.
+ */
+static int resolve_deltas_threaded(
+	git_indexer *idx,
+	git_indexer_progress *stats,
+	int *progressed,
+	int *non_null)
+{
+	struct resolve_batch batch = {0};
+	git_thread *threads;
 	struct delta_info *delta;
-	int progressed = 0, non_null = 0, progress_cb_result;
+	size_t batch_size, pos = 0, i, n;
+	int error = 0;
 
-	while (idx->deltas.length > 0) {
-		progressed = 0;
-		non_null = 0;
-		git_vector_foreach(&idx->deltas, i, delta) {
-			git_rawobj obj = {0};
+	batch_size = RESOLVE_BATCH_PER_THREAD * idx->nr_threads;
+
+	threads = git__calloc(idx->nr_threads - 1, sizeof(git_thread));
+	batch.idx = idx;
+	batch.results = git__calloc(batch_size, sizeof(struct resolve_result));
+
+	if (!threads || !batch.results) {
+		error = -1;
+		goto done;
+	}
 
-			if (!delta)
+	while (pos < idx->deltas.length) {
+		batch.len = 0;
+		git_atomic32_set(&batch.next, 0);
+
+		for (; pos < idx->deltas.length && batch.len < batch_size; pos++) {
+			if (git_vector_get(&idx->deltas, pos) == NULL)
 				continue;
 
-			non_null = 1;
-			idx->off = delta->delta_off;
-			if ((error = git_packfile_unpack(&obj, idx->pack, &idx->off)) < 0) {
-				if (error == GIT_PASSTHROUGH) {
-					/* We have not seen the base object, we'll try again later. */
-					continue;
-				}
-				return -1;
+			memset(&batch.results[batch.len], 0, sizeof(struct resolve_result));
+			batch.results[batch.len++].pos = pos;
+		}
+
+		if (!batch.len)
+			break;
+
+		*non_null = 1;
+
+		for (n = 0; n < idx->nr_threads - 1; n++) {
+			if (git_thread_create(&threads[n], resolve_thread, &batch) != 0) {
+				git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+				error = -1;
+				break;
 			}
+		}
+
+		/* This thread works on the batch too */
+		resolve_thread(&batch);
 
-			if (idx->do_verify && check_object_connectivity(idx, &obj) < 0)
-				/* TODO: error? continue? */
+		for (i = 0; i < n; i++)
+			git_thread_join(&threads[i], NULL);
+
+		for (i = 0; i < batch.len && !error; i++) {
+			struct resolve_result *result = &batch.results[i];
+
+			if (result->error == GIT_PASSTHROUGH)
 				continue;
 
-			if (hash_and_save(idx, &obj, delta->delta_off) < 0)
+			if (result->error < 0) {
+				git_error_restore(result->error_info);
+				result->error_info = NULL;
+				error = -1;
+				break;
+			}
+
+			if (idx->do_verify && check_object_connectivity(idx, &result->obj) < 0)
+				continue;
+
+			delta = git_vector_get(&idx->deltas, result->pos);
+
+			if (add_entry(idx, &result->oid, delta->delta_off, result->crc) < 0)
 				continue;
 
-			git__free(obj.data);
 			stats->indexed_objects++;
 			stats->indexed_deltas++;
-			progressed = 1;
-			if ((progress_cb_result = do_progress_callback(idx, stats)) < 0)
-				return progress_cb_result;
+			*progressed = 1;
+			if ((error = do_progress_callback(idx, stats)) < 0)
+				break;
 
 			/* remove from the list */
-			git_vector_set(NULL, &idx->deltas, i, NULL);
+			git_vector_set(NULL, &idx->deltas, result->pos, NULL);
 			git__free(delta);
 		}
 
+		for (i = 0; i < batch.len; i++) {
+			git__free(batch.results[i].obj.data);
+			git_error_free(batch.results[i].error_info);
+		}
+
+		if (error < 0)
+			break;
+	}
+
+done:
+	git__free(batch.results);
+	git__free(threads);
+	return error;
+}
+
+#endif
+
+static int resolve_deltas_pass(
+	git_indexer *idx,
+	git_indexer_progress *stats,
+	int *progressed,
+	int *non_null)
+{
+	unsigned int i;
+	int error;
+	struct delta_info *delta;
+	int progress_cb_result;
+
+	git_vector_foreach(&idx->deltas, i, delta) {
+		git_rawobj obj = {0};
+
+		if (!delta)
+			continue;
+
+		*non_null = 1;
+		idx->off = delta->delta_off;
+		if ((error = git_packfile_unpack(&obj, idx->pack, &idx->off)) < 0) {
+			if (error == GIT_PASSTHROUGH) {
+				/* We have not seen the base object, we'll try again later. */
+				continue;
+			}
+			return -1;
+		}
+
+		/* The delta may have come from the base cache, without its end */
+		idx->off = delta->delta_end;
+
+		if (idx->do_verify && check_object_connectivity(idx, &obj) < 0)
+			/* TODO: error? continue? */
+			continue;
+
+		if (hash_and_save(idx, &obj, delta->delta_off) < 0)
+			continue;
+
+		git__free(obj.data);
+		stats->indexed_objects++;
+		stats->indexed_deltas++;
+		*progressed = 1;
+		if ((progress_cb_result = do_progress_callback(idx, stats)) < 0)
+			return progress_cb_result;
+
+		/* remove from the list */
+		git_vector_set(NULL, &idx->deltas, i, NULL);
+		git__free(delta);
+	}
+
+	return 0;
+}
+
+static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
+{
+	int error;
+	int progressed = 0, non_null = 0;
+
+	while (idx->deltas.length > 0) {
+		progressed = 0;
+		non_null = 0;
+
+#ifdef GIT_THREADS
+		if (idx->nr_threads > 1)
+			error = resolve_deltas_threaded(idx, stats, &progressed, &non_null);
+		else
+#endif
+			error = resolve_deltas_pass(idx, stats, &progressed, &non_null);
+
+		if (error < 0)
+			return error;
+
 		/* if none were actually set, we're done */
 		if (!non_null)
 			break;
@@ -1226,6 +1738,111 @@ static int update_header_and_rehash(git_indexer *idx, git_indexer_progress *stat
 	return 0;
 }
 
+static int entry_id_cmp(const void *a_, const void *b_, void *payload)
+{
+	git_indexer *idx = payload;
+	const git_oid *a = git_array_get(idx->entry_ids, *(const uint32_t *)a_);
+	const git_oid *b = git_array_get(idx->entry_ids, *(const uint32_t *)b_);
+
+	/* The leading bytes were already sorted on */
+	return memcmp(a->id + 2, b->id + 2, git_oid_size(idx->oid_type) - 2);
+}
+
+/*
+ * Sort the objects into index order.  This is a radix sort on the first
+ * two bytes of the object ids, which spreads the objects evenly over the
+ * buckets; the few objects that land in each bucket are then sorted on
+ * the remaining bytes.
+ */
+static int sort_entries(git_indexer *idx)
+{
+	uint32_t *order, *bucket_pos, i, count;
+	size_t b;
+
+	count = (uint32_t)git_array_size(idx->entry_ids);
+
+	order = git__mallocarray(count ? count : 1, sizeof(uint32_t));
+	GIT_ERROR_CHECK_ALLOC(order);
+
+	bucket_pos = git__calloc(0x10000 + 1, sizeof(uint32_t));
+	if (!bucket_pos) {
+		git__free(order);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		const unsigned char *id = idx->entry_ids.ptr[i].id;
+		bucket_pos[((id[0] << 8) | id[1]) + 1]++;
+	}
+
+	for (b = 1; b <= 0x10000; b++)
+		bucket_pos[b] += bucket_pos[b - 1];
+
+	for (i = 0; i < count; i++) {
+		const unsigned char *id = idx->entry_ids.ptr[i].id;
+		order[bucket_pos[(id[0] << 8) | id[1]]++] = i;
+	}
+
+	/* Each bucket now ends where the next one starts */
+	for (b = 0; b < 0x10000; b++) {
+		uint32_t start = b ? bucket_pos[b - 1] : 0;
+
+		if (bucket_pos[b] - start > 1)
+			git__qsort_r(order + start, bucket_pos[b] - start,
+				sizeof(uint32_t), entry_id_cmp, idx);
+	}
+
+	git__free(bucket_pos);
+	git__free(idx->entry_order);
+	idx->entry_order = order;
+	return 0;
+}
+
+static int pack_order_cmp(const void *a_, const void *b_, void *payload)
+{
+	git_indexer *idx = payload;
+	uint32_t a = idx->entry_order[*(const uint32_t *)a_];
+	uint32_t b = idx->entry_order[*(const uint32_t *)b_];
+	off64_t a_offset = idx->entry_offsets.ptr[a];
+	off64_t b_offset = idx->entry_offsets.ptr[b];
+
+	return (a_offset > b_offset) - (a_offset < b_offset);
+}
+
+/*
+ * Write the reverse index for the pack, so that readers can map pack
+ * offsets to objects without sorting the index themselves.  This must
+ * be called once the objects are sorted into index order.
+ */
+static int write_reverse_index(git_indexer *idx, const unsigned char *checksum)
+{
+	git_str filename = GIT_STR_INIT;
+	uint32_t *order, i, count;
+	int error;
+
+	count = (uint32_t)git_array_size(idx->entry_ids);
+
+	order = git__mallocarray(count ? count : 1, sizeof(uint32_t));
+	GIT_ERROR_CHECK_ALLOC(order);
+
+	for (i = 0; i < count; i++)
+		order[i] = i;
+
+	git__qsort_r(order, count, sizeof(uint32_t), pack_order_cmp, idx);
+
+	if ((error = git_str_sets(&filename, idx->pack->pack_name)) < 0 ||
+	    (error = index_path(&filename, idx, ".rev")) < 0)
+		goto cleanup;
+
+	error = git_pack__revindex_write(filename.ptr, order, count,
+		checksum, idx->oid_type, idx->mode, idx->do_fsync);
+
+cleanup:
+	git_str_dispose(&filename);
+	git__free(order);
+	return error;
+}
+
 int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 {
 	git_mwindow *w = NULL;
@@ -1233,7 +1850,9 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 	int error;
 	struct git_pack_idx_header hdr;
 	git_str filename = GIT_STR_INIT;
-	struct entry *entry;
+	const git_oid *id;
+	off64_t offset;
+	uint32_t count;
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 	git_filebuf index_file = {0};
 	void *packfile_trailer;
@@ -1241,6 +1860,11 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 	int filebuf_hash;
 	bool mismatch;
 
+#ifdef GIT_THREADS
+	if (idx->pipeline && (error = pipeline_finish(idx, stats)) < 0)
+		return error;
+#endif
+
 	if (!idx->parsed_header) {
 		git_error_set(GIT_ERROR_INDEXER, "incomplete pack header");
 		return -1;
@@ -1307,7 +1931,10 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 		return -1;
 	}
 
-	git_vector_sort(&idx->objects);
+	if (sort_entries(idx) < 0)
+		return -1;
+
+	count = (uint32_t)git_array_size(idx->entry_ids);
 
 	/* Use the trailer hash as the pack file name to ensure
 	 * files with different contents have different names */
@@ -1338,36 +1965,43 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 	}
 
 	/* Write out the object names (SHA-1 hashes) */
-	git_vector_foreach(&idx->objects, i, entry) {
-		git_filebuf_write(&index_file, &entry->oid.id, git_oid_size(idx->oid_type));
+	for (i = 0; i < count; i++) {
+		id = git_array_get(idx->entry_ids, idx->entry_order[i]);
+		git_filebuf_write(&index_file, id->id, git_oid_size(idx->oid_type));
 	}
 
 	/* Write out the CRC32 values */
-	git_vector_foreach(&idx->objects, i, entry) {
-		git_filebuf_write(&index_file, &entry->crc, sizeof(uint32_t));
+	for (i = 0; i < count; i++) {
+		git_filebuf_write(&index_file,
+			git_array_get(idx->entry_crcs, idx->entry_order[i]),
+			sizeof(uint32_t));
 	}
 
 	/* Write out the offsets */
-	git_vector_foreach(&idx->objects, i, entry) {
+	for (i = 0; i < count; i++) {
 		uint32_t n;
 
-		if (entry->offset == UINT32_MAX)
+		offset = idx->entry_offsets.ptr[idx->entry_order[i]];
+
+		if (offset > UINT31_MAX)
 			n = htonl(0x80000000 | long_offsets++);
 		else
-			n = htonl(entry->offset);
+			n = htonl((uint32_t)offset);
 
 		git_filebuf_write(&index_file, &n, sizeof(uint32_t));
 	}
 
 	/* Write out the long offsets */
-	git_vector_foreach(&idx->objects, i, entry) {
+	for (i = 0; i < count; i++) {
 		uint32_t split[2];
 
-		if (entry->offset != UINT32_MAX)
+		offset = idx->entry_offsets.ptr[idx->entry_order[i]];
+
+		if (offset <= UINT31_MAX)
 			continue;
 
-		split[0] = htonl(entry->offset_long >> 32);
-		split[1] = htonl(entry->offset_long & 0xffffffff);
+		split[0] = htonl((uint32_t)(offset >> 32));
+		split[1] = htonl((uint32_t)(offset & 0xffffffff));
 
 		git_filebuf_write(&index_file, &split, sizeof(uint32_t) * 2);
 	}
@@ -1382,6 +2016,10 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 
 	git_filebuf_write(&index_file, checksum, checksum_size);
 
+	/* The reverse index must be in place before the index appears */
+	if (write_reverse_index(idx, idx->checksum) < 0)
+		goto on_error;
+
 	/* Figure out what the final name should be */
 	if (index_path(&filename, idx, ".idx") < 0)
 		goto on_error;
@@ -1453,19 +2091,21 @@ void git_indexer_free(git_indexer *idx)
 	if (idx == NULL)
 		return;
 
+#ifdef GIT_THREADS
+	pipeline_free(idx);
+#endif
+
 	if (idx->have_stream)
 		git_packfile_stream_dispose(&idx->stream);
 
-	git_vector_free_deep(&idx->objects);
-
-	if (idx->pack->idx_cache) {
-		struct git_pack_entry *pentry;
-		git_oidmap_foreach_value(idx->pack->idx_cache, pentry, {
-			git__free(pentry);
-		});
+	git_array_clear(idx->entry_ids);
+	git_array_clear(idx->entry_offsets);
+	git_array_clear(idx->entry_crcs);
+	git__free(idx->entry_order);
 
-		git_oidmap_free(idx->pack->idx_cache);
-	}
+	/* The entries themselves are in the pool */
+	git_oidmap_free(idx->pack->idx_cache);
+	git_pool_clear(&idx->pentry_pool);
 
 	git_vector_free_deep(&idx->deltas);
 
@@ -21,6 +21,7 @@
 #include "mwindow.h"
 #include "object.h"
 #include "odb.h"
+#include "pack.h"
 #include "rand.h"
 #include "refs.h"
 #include "runtime.h"
@@ -34,6 +35,7 @@
 #include "transports/smart.h"
 #include "transports/http.h"
 #include "transports/ssh_libssh2.h"
+#include "zstream.h"
 
 #ifdef GIT_WIN32
 # include "win32/w32_leakcheck.h"
@@ -43,6 +45,8 @@
 extern size_t git_mwindow__window_size;
 extern size_t git_mwindow__mapped_limit;
 extern size_t git_mwindow__file_limit;
+extern bool git_mwindow__map_whole;
+extern bool git_pack__index_readahead;
 extern size_t git_indexer__max_objects;
 extern bool git_disable_pack_keep_file_checks;
 extern int git_odb__packed_priority;
@@ -87,6 +91,7 @@ int git_libgit2_init(void)
 		git_mbedtls_stream_global_init,
 		git_mwindow_global_init,
 		git_pool_global_init,
+		git_zstream_global_init,
 		git_libgit2_settings_global_init
 	};
 
@@ -472,6 +477,73 @@ int git_libgit2_opts(int key, ...)
 		}
 		break;
 
+	case GIT_OPT_GET_PACK_CACHE_SIZE:
+		*(va_arg(ap, size_t *)) = git_pack__cache_memory_limit;
+		break;
+
+	case GIT_OPT_SET_PACK_CACHE_SIZE:
+		git_pack__cache_memory_limit = va_arg(ap, size_t);
+		break;
+
+	case GIT_OPT_GET_PACK_CACHE_STATS:
+		{
+			size_t *hits = va_arg(ap, size_t *);
+			size_t *misses = va_arg(ap, size_t *);
+			size_t *evictions = va_arg(ap, size_t *);
+
+			git_pack__cache_stats(hits, misses, evictions);
+		}
+		break;
+
+	case GIT_OPT_GET_CACHE_STATS:
+		{
+			size_t *hits = va_arg(ap, size_t *);
+			size_t *misses = va_arg(ap, size_t *);
+			size_t *evictions = va_arg(ap, size_t *);
+
+			git_cache__stats(hits, misses, evictions);
+		}
+		break;
+
+	case GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE:
+		git_odb__loose_object_cache = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_GET_ODB_REFRESH_INTERVAL:
+		*(va_arg(ap, int *)) = (int)git_odb__refresh_interval;
+		break;
+
+	case GIT_OPT_SET_ODB_REFRESH_INTERVAL:
+		{
+			int interval = va_arg(ap, int);
+
+			if (interval < 0) {
+				git_error_set(GIT_ERROR_INVALID, "invalid refresh interval");
+				error = -1;
+			} else {
+				git_odb__refresh_interval = (uint64_t)interval;
+			}
+		}
+		break;
+
+	case GIT_OPT_GET_ODB_REFRESH_STATS:
+		{
+			size_t *refreshes = va_arg(ap, size_t *);
+			size_t *missing_hits = va_arg(ap, size_t *);
+			size_t *rate_limited = va_arg(ap, size_t *);
+
+			git_odb__refresh_stats(refreshes, missing_hits, rate_limited);
+		}
+		break;
+
+	case GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE:
+		git_mwindow__map_whole = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_ENABLE_PACK_INDEX_READAHEAD:
+		git_pack__index_readahead = (va_arg(ap, int) != 0);
+		break;
+
 	default:
 		git_error_set(GIT_ERROR_INVALID, "invalid option key");
 		error = -1;
@@ -14,6 +14,7 @@
 #include "hash.h"
 #include "odb.h"
 #include "pack.h"
+#include "pack_bitmap.h"
 #include "fs_path.h"
 #include "repository.h"
 #include "str.h"
@@ -35,6 +36,7 @@ struct git_midx_header {
 #define MIDX_OID_LOOKUP_ID 0x4f49444c	   /* "OIDL" */
 #define MIDX_OBJECT_OFFSETS_ID 0x4f4f4646	   /* "OOFF" */
 #define MIDX_OBJECT_LARGE_OFFSETS_ID 0x4c4f4646 /* "LOFF" */
+#define MIDX_REVERSE_INDEX_ID 0x52494458	   /* "RIDX" */
 
 struct git_midx_chunk {
 	off64_t offset;
@@ -145,6 +147,21 @@ static int midx_parse_object_offsets(
 	return 0;
 }
 
+static int midx_parse_reverse_index(
+		git_midx_file *idx,
+		const unsigned char *data,
+		struct git_midx_chunk *chunk_reverse_index)
+{
+	if (chunk_reverse_index->offset == 0)
+		return 0;
+	if (chunk_reverse_index->length != idx->num_objects * 4)
+		return midx_error("Reverse Index chunk has wrong length");
+
+	idx->revindex = data + chunk_reverse_index->offset;
+
+	return 0;
+}
+
 static int midx_parse_object_large_offsets(
 		git_midx_file *idx,
 		const unsigned char *data,
@@ -178,6 +195,7 @@ int git_midx_parse(
 					 chunk_oid_lookup = {0},
 					 chunk_object_offsets = {0},
 					 chunk_object_large_offsets = {0},
+					 chunk_reverse_index = {0},
 					 chunk_unknown = {0};
 
 	GIT_ASSERT_ARG(idx);
@@ -256,6 +274,11 @@ int git_midx_parse(
 			last_chunk = &chunk_object_large_offsets;
 			break;
 
+		case MIDX_REVERSE_INDEX_ID:
+			chunk_reverse_index.offset = last_chunk_offset;
+			last_chunk = &chunk_reverse_index;
+			break;
+
 		default:
 			chunk_unknown.offset = last_chunk_offset;
 			last_chunk = &chunk_unknown;
@@ -280,7 +303,46 @@ int git_midx_parse(
 	error = midx_parse_object_large_offsets(idx, data, &chunk_object_large_offsets);
 	if (error < 0)
 		return error;
+	error = midx_parse_reverse_index(idx, data, &chunk_reverse_index);
+	if (error < 0)
+		return error;
+
+	return 0;
+}
+
+/*
+ * Older versions of git write the reverse index of a multi-pack-index
+ * to a separate `multi-pack-index-<checksum>.rev` file instead of a
+ * chunk; use it when there is no chunk.  It is only a cache of what
+ * the midx says, so a file that cannot be read is ignored.
+ *
+ * Run with the midx lock held.
+ */
+static int midx_open_reverse_index_locked(git_midx_file *idx)
+{
+	git_str rev_path = GIT_STR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	int error;
+
+	if (idx->revindex || idx->rev_checked)
+		return 0;
+
+	git_hash_fmt(checksum_hex, idx->checksum, git_oid_size(idx->oid_type));
+
+	if ((error = git_str_printf(&rev_path, "%s-%s.rev",
+			git_str_cstr(&idx->filename), checksum_hex)) < 0)
+		return error;
 
+	idx->rev_checked = true;
+
+	if (git_pack__revindex_open(&idx->rev_map, rev_path.ptr,
+			idx->num_objects, idx->checksum, idx->oid_type) == 0)
+		idx->revindex = (const unsigned char *)idx->rev_map.data +
+			sizeof(struct git_pack_revindex_header);
+	else
+		git_error_clear();
+
+	git_str_dispose(&rev_path);
 	return 0;
 }
 
@@ -320,6 +382,13 @@ int git_midx_open(
 
 	idx->oid_type = oid_type;
 
+	if (git_mutex_init(&idx->lock) < 0) {
+		p_close(fd);
+		git__free(idx);
+		git_error_set(GIT_ERROR_OS, "failed to initialize multi-pack-index mutex");
+		return -1;
+	}
+
 	error = git_str_sets(&idx->filename, path);
 	if (error < 0)
 		return error;
@@ -331,6 +400,8 @@ int git_midx_open(
 		return error;
 	}
 
+	p_madvise(&idx->index_map, 0, idx_size, GIT_MAP_ADVICE_RANDOM);
+
 	if ((error = git_midx_parse(idx, idx->index_map.data, idx_size)) < 0) {
 		git_midx_free(idx);
 		return error;
@@ -350,6 +421,9 @@ bool git_midx_needs_refresh(
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 	size_t checksum_size;
 
+	if (idx->chained)
+		return true;
+
 	/* TODO: properly open the file without access time using O_NOATIME */
 	fd = git_futils_open_ro(path);
 	if (fd < 0)
@@ -377,20 +451,191 @@ bool git_midx_needs_refresh(
 	return (memcmp(checksum, idx->checksum, checksum_size) != 0);
 }
 
-int git_midx_entry_find(
+/*
+ * Read the checksums of the layers in a chain file, one per line,
+ * oldest first.
+ */
+static int midx_read_chain(
+		git_vector *out,
+		git_str *contents,
+		const char *chain_path,
+		git_oid_t oid_type)
+{
+	size_t hexsize = git_oid_hexsize(oid_type);
+	char *line, *end;
+	int error;
+
+	if ((error = git_futils_readbuffer(contents, chain_path)) < 0 ||
+	    (error = git_vector_init(out, 4, NULL)) < 0)
+		return error;
+
+	for (line = contents->ptr; *line; line = end + 1) {
+		if ((end = strchr(line, '\n')) == NULL)
+			goto invalid;
+
+		*end = '\0';
+
+		if ((size_t)(end - line) != hexsize || !git__ishex(line))
+			goto invalid;
+
+		if ((error = git_vector_insert(out, line)) < 0)
+			return error;
+	}
+
+	if (git_vector_length(out) == 0)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	git_error_set(GIT_ERROR_ODB, "invalid multi-pack-index chain '%s'", chain_path);
+	return -1;
+}
+
+int git_midx_open_chain(
+		git_midx_file **idx_out,
+		const char *chain_path,
+		git_oid_t oid_type)
+{
+	git_midx_file *idx = NULL, *layer;
+	git_str contents = GIT_STR_INIT, path = GIT_STR_INIT;
+	git_vector checksums = GIT_VECTOR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	const char *hex;
+	size_t i, dir_len;
+	int error;
+
+	GIT_ASSERT_ARG(idx_out && chain_path && oid_type);
+
+	if ((error = midx_read_chain(&checksums, &contents, chain_path, oid_type)) < 0 ||
+	    (error = git_fs_path_dirname_r(&path, chain_path)) < 0)
+		goto done;
+
+	dir_len = git_str_len(&path);
+
+	git_vector_foreach(&checksums, i, hex) {
+		git_str_truncate(&path, dir_len);
+
+		if ((error = git_str_printf(&path, "/multi-pack-index-%s.midx", hex)) < 0 ||
+		    (error = git_midx_open(&layer, path.ptr, oid_type)) < 0)
+			goto done;
+
+		layer->base = idx;
+		layer->chained = true;
+		idx = layer;
+
+		git_hash_fmt(checksum_hex, idx->checksum, git_oid_size(oid_type));
+
+		if (strcmp(checksum_hex, hex) != 0) {
+			error = midx_error("layer does not match its name");
+			goto done;
+		}
+
+		if (idx->base) {
+			if (idx->base->num_objects > UINT32_MAX - idx->base->num_objects_in_base ||
+			    idx->num_objects > UINT32_MAX - idx->base->num_objects_in_base - idx->base->num_objects) {
+				error = midx_error("too many objects in chain");
+				goto done;
+			}
+
+			idx->num_objects_in_base = idx->base->num_objects_in_base + idx->base->num_objects;
+			idx->num_packs_in_base = idx->base->num_packs_in_base +
+				(uint32_t)git_vector_length(&idx->base->packfile_names);
+		}
+	}
+
+	*idx_out = idx;
+	idx = NULL;
+
+done:
+	git_midx_free(idx);
+	git_vector_free(&checksums);
+	git_str_dispose(&contents);
+	git_str_dispose(&path);
+	return error;
+}
+
+bool git_midx_chain_needs_refresh(
+		const git_midx_file *idx,
+		const char *chain_path)
+{
+	git_str contents = GIT_STR_INIT;
+	git_vector checksums = GIT_VECTOR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	size_t i;
+	bool refresh = true;
+
+	if (!idx->chained ||
+	    midx_read_chain(&checksums, &contents, chain_path, idx->oid_type) < 0) {
+		git_error_clear();
+		goto done;
+	}
+
+	/* The layers must be the same, from the top down */
+	for (i = git_vector_length(&checksums); i > 0 && idx; i--, idx = idx->base) {
+		git_hash_fmt(checksum_hex, (unsigned char *)idx->checksum, git_oid_size(idx->oid_type));
+
+		if (strcmp(checksum_hex, git_vector_get(&checksums, i - 1)) != 0)
+			goto done;
+	}
+
+	refresh = (i > 0 || idx != NULL);
+
+done:
+	git_vector_free(&checksums);
+	git_str_dispose(&contents);
+	return refresh;
+}
+
+/* Fill in the entry for the object at the given position in the layer */
+static int midx_layer_entry_at(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		size_t pos)
+{
+	size_t pack_index;
+	const unsigned char *object_offset;
+	off64_t offset;
+
+	object_offset = idx->object_offsets + pos * 8;
+	offset = ntohl(*((uint32_t *)(object_offset + 4)));
+	if (idx->object_large_offsets && offset & 0x80000000) {
+		uint32_t object_large_offsets_pos = (uint32_t) (offset ^ 0x80000000);
+		const unsigned char *object_large_offsets_index = idx->object_large_offsets;
+
+		/* Make sure we're not being sent out of bounds */
+		if (object_large_offsets_pos >= idx->num_object_large_offsets)
+			return midx_error("invalid index into the object large offsets table");
+
+		object_large_offsets_index += 8 * object_large_offsets_pos;
+
+		offset = (((uint64_t)ntohl(*((uint32_t *)(object_large_offsets_index + 0)))) << 32) |
+				ntohl(*((uint32_t *)(object_large_offsets_index + 4)));
+	}
+	pack_index = ntohl(*((uint32_t *)(object_offset + 0)));
+	if (pack_index >= git_vector_length(&idx->packfile_names))
+		return midx_error("invalid index into the packfile names table");
+	e->pack_index = idx->num_packs_in_base + pack_index;
+	e->offset = offset;
+	e->position = idx->num_objects_in_base + (uint32_t)pos;
+	git_oid__fromraw(&e->sha1, idx->oid_lookup + (pos * git_oid_size(idx->oid_type)), idx->oid_type);
+	return 0;
+}
+
+/*
+ * Find an object in one layer; returns `GIT_ENOTFOUND` without setting
+ * an error if it is not there.
+ */
+static int midx_layer_entry_find(
 		git_midx_entry *e,
 		git_midx_file *idx,
 		const git_oid *short_oid,
 		size_t len)
 {
 	int pos, found = 0;
-	size_t pack_index, oid_size, oid_hexsize;
+	size_t oid_size, oid_hexsize;
 	uint32_t hi, lo;
 	unsigned char *current = NULL;
-	const unsigned char *object_offset;
-	off64_t offset;
-
-	GIT_ASSERT_ARG(idx);
 
 	oid_size = git_oid_size(idx->oid_type);
 	oid_hexsize = git_oid_hexsize(idx->oid_type);
@@ -425,34 +670,82 @@ int git_midx_entry_find(
 	}
 
 	if (!found)
-		return git_odb__error_notfound("failed to find offset for multi-pack index entry", short_oid, len);
+		return GIT_ENOTFOUND;
 	if (found > 1)
 		return git_odb__error_ambiguous("found multiple offsets for multi-pack index entry");
 
-	object_offset = idx->object_offsets + pos * 8;
-	offset = ntohl(*((uint32_t *)(object_offset + 4)));
-	if (idx->object_large_offsets && offset & 0x80000000) {
-		uint32_t object_large_offsets_pos = (uint32_t) (offset ^ 0x80000000);
-		const unsigned char *object_large_offsets_index = idx->object_large_offsets;
+	return midx_layer_entry_at(e, idx, (size_t)pos);
+}
 
-		/* Make sure we're not being sent out of bounds */
-		if (object_large_offsets_pos >= idx->num_object_large_offsets)
-			return git_odb__error_notfound("invalid index into the object large offsets table", short_oid, len);
+int git_midx_entry_find(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		const git_oid *short_oid,
+		size_t len)
+{
+	git_midx_entry other;
+	bool found = false;
+	int error;
 
-		object_large_offsets_index += 8 * object_large_offsets_pos;
+	GIT_ASSERT_ARG(idx);
 
-		offset = (((uint64_t)ntohl(*((uint32_t *)(object_large_offsets_index + 0)))) << 32) |
-				ntohl(*((uint32_t *)(object_large_offsets_index + 4)));
+	/* Each object is in one layer only, so a full id is found once */
+	for (; idx; idx = idx->base) {
+		error = midx_layer_entry_find(found ? &other : e, idx, short_oid, len);
+
+		if (error == GIT_ENOTFOUND)
+			continue;
+		else if (error < 0)
+			return error;
+
+		if (len == git_oid_hexsize(idx->oid_type))
+			return 0;
+
+		if (found && !git_oid_equal(&e->sha1, &other.sha1))
+			return git_odb__error_ambiguous("found multiple offsets for multi-pack index entry");
+
+		found = true;
 	}
-	pack_index = ntohl(*((uint32_t *)(object_offset + 0)));
-	if (pack_index >= git_vector_length(&idx->packfile_names))
-		return midx_error("invalid index into the packfile names table");
-	e->pack_index = pack_index;
-	e->offset = offset;
-	git_oid__fromraw(&e->sha1, current, idx->oid_type);
+
+	if (!found)
+		return git_odb__error_notfound("failed to find offset for multi-pack index entry", short_oid, len);
+
 	return 0;
 }
 
+int git_midx_nth_entry(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		uint32_t n)
+{
+	GIT_ASSERT_ARG(e);
+	GIT_ASSERT_ARG(idx);
+
+	while (idx && n < idx->num_objects_in_base)
+		idx = idx->base;
+
+	if (!idx || n - idx->num_objects_in_base >= idx->num_objects) {
+		git_error_set(GIT_ERROR_ODB, "multi-pack-index position %u is out of range", n);
+		return -1;
+	}
+
+	return midx_layer_entry_at(e, idx, n - idx->num_objects_in_base);
+}
+
+/*
+ * Start loading the parts of the lookup table that finding each of the
+ * given (full) ids will look at first.
+ */
+void git_midx_entry_prefetch(
+		git_midx_file *idx,
+		const git_oid *ids,
+		size_t count)
+{
+	for (; idx; idx = idx->base)
+		git_pack__lookup_id_prefetch(idx->oid_lookup,
+			git_oid_size(idx->oid_type), idx->oid_fanout, ids, count);
+}
+
 int git_midx_foreach_entry(
 		git_midx_file *idx,
 		git_odb_foreach_cb cb,
@@ -466,6 +759,9 @@ int git_midx_foreach_entry(
 
 	oid_size = git_oid_size(idx->oid_type);
 
+	if (idx->base && (error = git_midx_foreach_entry(idx->base, cb, data)) != 0)
+		return error;
+
 	for (i = 0; i < idx->num_objects; ++i) {
 		if ((error = git_oid__fromraw(&oid, &idx->oid_lookup[i * oid_size], idx->oid_type)) < 0)
 			return error;
@@ -474,7 +770,48 @@ int git_midx_foreach_entry(
 			return git_error_set_after_callback(error);
 	}
 
-	return error;
+	return 0;
+}
+
+int git_midx_pos_to_index(
+		uint32_t *index_pos_out,
+		git_midx_file *idx,
+		uint32_t pack_pos)
+{
+	uint32_t index_pos;
+	int error;
+
+	GIT_ASSERT_ARG(index_pos_out);
+	GIT_ASSERT_ARG(idx);
+
+	if (git_mutex_lock(&idx->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock multi-pack-index");
+		return -1;
+	}
+
+	error = midx_open_reverse_index_locked(idx);
+	git_mutex_unlock(&idx->lock);
+
+	if (error < 0)
+		return error;
+
+	if (!idx->revindex) {
+		git_error_set(GIT_ERROR_ODB, "multi-pack-index has no reverse index");
+		return GIT_ENOTFOUND;
+	}
+
+	if (pack_pos >= idx->num_objects) {
+		git_error_set(GIT_ERROR_ODB, "pack position %u is out of range", pack_pos);
+		return -1;
+	}
+
+	index_pos = ntohl(((const uint32_t *)idx->revindex)[pack_pos]);
+
+	if (index_pos >= idx->num_objects)
+		return midx_error("reverse index is corrupt");
+
+	*index_pos_out = index_pos;
+	return 0;
 }
 
 int git_midx_close(git_midx_file *idx)
@@ -484,6 +821,11 @@ int git_midx_close(git_midx_file *idx)
 	if (idx->index_map.data)
 		git_futils_mmap_free(&idx->index_map);
 
+	if (idx->rev_map.data)
+		git_futils_mmap_free(&idx->rev_map);
+
+	idx->revindex = NULL;
+
 	git_vector_free(&idx->packfile_names);
 
 	return 0;
@@ -491,12 +833,16 @@ int git_midx_close(git_midx_file *idx)
 
 void git_midx_free(git_midx_file *idx)
 {
-	if (!idx)
-		return;
+	git_midx_file *base;
 
-	git_str_dispose(&idx->filename);
-	git_midx_close(idx);
-	git__free(idx);
+	for (; idx; idx = base) {
+		base = idx->base;
+
+		git_str_dispose(&idx->filename);
+		git_midx_close(idx);
+		git_mutex_free(&idx->lock);
+		git__free(idx);
+	}
 }
 
 static int packfile__cmp(const void *a_, const void *b_)
@@ -544,6 +890,26 @@ int git_midx_writer_new(
 	return 0;
 }
 
+int git_midx_writer_set_write_bitmap(
+		git_midx_writer *w,
+		int enabled)
+{
+	GIT_ASSERT_ARG(w);
+
+	w->write_bitmap = !!enabled;
+	return 0;
+}
+
+int git_midx_writer_set_incremental(
+		git_midx_writer *w,
+		int enabled)
+{
+	GIT_ASSERT_ARG(w);
+
+	w->incremental = !!enabled;
+	return 0;
+}
+
 void git_midx_writer_free(git_midx_writer *w)
 {
 	struct git_pack_file *p;
@@ -615,6 +981,290 @@ static int object_entry__cmp(const void *a_, const void *b_)
 	return git_oid_cmp(&a->sha1, &b->sha1);
 }
 
+/*
+ * Pick the pack whose copy of an object is used when several packs
+ * contain it: when writing a bitmap, the objects of the "preferred"
+ * pack must all be selected (as git relies on this to reuse that pack
+ * verbatim); otherwise the most recent pack wins, as in git.
+ */
+static size_t midx_preferred_pack(git_midx_writer *w)
+{
+	struct git_pack_file *p, *oldest = NULL;
+	size_t i, preferred = 0;
+
+	git_vector_foreach (&w->packs, i, p) {
+		if (p->num_objects && (!oldest || p->mtime < oldest->mtime)) {
+			oldest = p;
+			preferred = i;
+		}
+	}
+
+	return preferred;
+}
+
+static bool midx_entry_preferred(
+		git_midx_writer *w,
+		const git_midx_entry *a,
+		const git_midx_entry *b,
+		size_t preferred_pack)
+{
+	struct git_pack_file *pa, *pb;
+
+	if (w->write_bitmap && a->pack_index != b->pack_index) {
+		if (a->pack_index == preferred_pack)
+			return true;
+		if (b->pack_index == preferred_pack)
+			return false;
+	}
+
+	pa = git_vector_get(&w->packs, a->pack_index);
+	pb = git_vector_get(&w->packs, b->pack_index);
+
+	if (pa->mtime != pb->mtime)
+		return pa->mtime > pb->mtime;
+
+	return a->pack_index < b->pack_index;
+}
+
+static void midx_entries_uniq(
+		git_midx_writer *w,
+		git_vector *entries,
+		size_t preferred_pack)
+{
+	git_midx_entry *entry, *last = NULL;
+	size_t i, j = 0;
+
+	git_vector_foreach (entries, i, entry) {
+		if (last && git_oid_equal(&last->sha1, &entry->sha1)) {
+			if (midx_entry_preferred(w, entry, last, preferred_pack))
+				entries->contents[j - 1] = last = entry;
+			continue;
+		}
+
+		entries->contents[j++] = last = entry;
+	}
+
+	entries->length = j;
+}
+
+/*
+ * Leave out the objects that the layers below the one being written
+ * already have.
+ */
+static int midx_entries_exclude(
+		git_vector *entries,
+		git_midx_file *base,
+		git_oid_t oid_type)
+{
+	git_midx_entry *entry, found;
+	size_t i, j = 0;
+	int error;
+
+	git_vector_foreach (entries, i, entry) {
+		error = git_midx_entry_find(&found, base, &entry->sha1, git_oid_hexsize(oid_type));
+
+		if (error == 0)
+			continue;
+		else if (error != GIT_ENOTFOUND)
+			return error;
+
+		entries->contents[j++] = entry;
+	}
+
+	git_error_clear();
+	entries->length = j;
+	return 0;
+}
+
+struct midx_pack_order_ctx {
+	git_vector *entries;
+	size_t preferred_pack;
+};
+
+static int midx_pack_order_cmp(const void *a_, const void *b_, void *payload)
+{
+	struct midx_pack_order_ctx *ctx = payload;
+	const git_midx_entry *a = git_vector_get(ctx->entries, *(const uint32_t *)a_);
+	const git_midx_entry *b = git_vector_get(ctx->entries, *(const uint32_t *)b_);
+	bool a_preferred = (a->pack_index == ctx->preferred_pack);
+	bool b_preferred = (b->pack_index == ctx->preferred_pack);
+
+	if (a_preferred != b_preferred)
+		return a_preferred ? -1 : 1;
+	if (a->pack_index != b->pack_index)
+		return a->pack_index < b->pack_index ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Compute the "pseudo-pack" order of the objects, which is the order
+ * that the bits of a multi-pack-index bitmap refer to: the objects of
+ * the preferred pack first, then those of the other packs in order,
+ * each sorted by offset.  Each element is the object's position in
+ * the (sorted by object id) multi-pack-index.
+ */
+static int midx_pack_order(
+		uint32_t **out,
+		git_vector *entries,
+		size_t preferred_pack)
+{
+	struct midx_pack_order_ctx ctx;
+	uint32_t *order;
+	size_t i;
+
+	*out = NULL;
+
+	if (!git_vector_length(entries))
+		return 0;
+
+	order = git__mallocarray(git_vector_length(entries), sizeof(uint32_t));
+	GIT_ERROR_CHECK_ALLOC(order);
+
+	for (i = 0; i < git_vector_length(entries); i++)
+		order[i] = (uint32_t)i;
+
+	ctx.entries = entries;
+	ctx.preferred_pack = preferred_pack;
+
+	git__qsort_r(order, git_vector_length(entries), sizeof(uint32_t),
+		midx_pack_order_cmp, &ctx);
+
+	*out = order;
+	return 0;
+}
+
+static int remove_stale_bitmap_cb(void *payload, git_str *path)
+{
+	const char *checksum_hex = payload;
+	const char *filename, *suffix;
+	size_t prefix_len = strlen("multi-pack-index-");
+	int error = 0;
+
+	filename = git_fs_path_basename(path->ptr);
+	GIT_ERROR_CHECK_ALLOC(filename);
+
+	if (git__prefixcmp(filename, "multi-pack-index-") != 0)
+		goto done;
+
+	suffix = strrchr(filename, '.');
+
+	if (!suffix || (strcmp(suffix, ".bitmap") != 0 && strcmp(suffix, ".rev") != 0))
+		goto done;
+
+	if ((size_t)(suffix - filename) == prefix_len + strlen(checksum_hex) &&
+	    strncmp(filename + prefix_len, checksum_hex, strlen(checksum_hex)) == 0)
+		goto done;
+
+	if (p_unlink(path->ptr) < 0 && errno != ENOENT) {
+		git_error_set(GIT_ERROR_OS, "failed to remove stale bitmap '%s'", path->ptr);
+		error = -1;
+	}
+
+done:
+	git__free((char *)filename);
+	return error;
+}
+
+/*
+ * Bitmaps and reverse indexes for a `multi-pack-index` are named after
+ * its checksum, so the ones for any previous `multi-pack-index` are now
+ * useless.
+ */
+static int midx_remove_stale_bitmaps(
+		git_midx_writer *w,
+		const char *checksum_hex)
+{
+	git_str pack_dir = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_str_sets(&pack_dir, git_str_cstr(&w->pack_dir))) < 0)
+		goto cleanup;
+
+	error = git_fs_path_direach(&pack_dir, 0, remove_stale_bitmap_cb, (void *)checksum_hex);
+
+cleanup:
+	git_str_dispose(&pack_dir);
+	return error;
+}
+
+static int midx_write_reverse_index(
+		git_midx_writer *w,
+		git_vector *entries,
+		const uint32_t *pack_order,
+		const char *checksum_hex,
+		const unsigned char *checksum)
+{
+	git_str rev_path = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_str_joinpath(&rev_path, git_str_cstr(&w->pack_dir), "multi-pack-index-")) < 0 ||
+	    (error = git_str_puts(&rev_path, checksum_hex)) < 0 ||
+	    (error = git_str_puts(&rev_path, ".rev")) < 0)
+		goto cleanup;
+
+	error = git_pack__revindex_write(git_str_cstr(&rev_path),
+		pack_order, (uint32_t)git_vector_length(entries), checksum,
+		w->oid_type, GIT_PACK_FILE_MODE, git_repository__fsync_gitdir);
+
+cleanup:
+	git_str_dispose(&rev_path);
+	return error;
+}
+
+static int midx_write_bitmap(
+		git_midx_writer *w,
+		git_vector *entries,
+		const uint32_t *pack_order,
+		const char *checksum_hex,
+		const unsigned char *checksum)
+{
+	git_str objects_dir = GIT_STR_INIT, bitmap_path = GIT_STR_INIT;
+	git_odb_options odb_opts = GIT_ODB_OPTIONS_INIT;
+	git_pack_bitmap_writer *writer = NULL;
+	git_repository *repo = NULL;
+	git_odb *odb = NULL;
+	struct git_pack_file *p;
+	git_midx_entry *entry;
+	git_object_t type;
+	size_t i, size;
+	int error;
+
+	odb_opts.oid_type = w->oid_type;
+
+	if ((error = git_fs_path_dirname_r(&objects_dir, git_str_cstr(&w->pack_dir))) < 0 ||
+	    (error = git_odb__open(&odb, git_str_cstr(&objects_dir), &odb_opts)) < 0 ||
+	    (error = git_repository__wrap_odb(&repo, odb, w->oid_type)) < 0 ||
+	    (error = git_pack_bitmap_writer_new(&writer, repo, git_vector_length(entries))) < 0)
+		goto cleanup;
+
+	for (i = 0; i < git_vector_length(entries); i++) {
+		entry = git_vector_get(entries, pack_order[i]);
+		p = git_vector_get(&w->packs, entry->pack_index);
+
+		if ((error = git_packfile_resolve_header(&size, &type, p, entry->offset)) < 0 ||
+		    (error = git_pack_bitmap_writer_add(writer, &entry->sha1, type, pack_order[i], 0)) < 0)
+			goto cleanup;
+	}
+
+	if ((error = git_str_joinpath(&bitmap_path, git_str_cstr(&w->pack_dir), "multi-pack-index-")) < 0 ||
+	    (error = git_str_puts(&bitmap_path, checksum_hex)) < 0 ||
+	    (error = git_str_puts(&bitmap_path, ".bitmap")) < 0)
+		goto cleanup;
+
+	error = git_pack_bitmap_writer_commit(writer, git_str_cstr(&bitmap_path), checksum);
+
+cleanup:
+	git_pack_bitmap_writer_free(writer);
+	git_repository_free(repo);
+	git_odb_free(odb);
+	git_str_dispose(&objects_dir);
+	git_str_dispose(&bitmap_path);
+	return error;
+}
+
 static int write_offset(off64_t offset, midx_write_cb write_cb, void *cb_data)
 {
 	int error;
@@ -667,10 +1317,46 @@ static int midx_write_hash(const char *buf, size_t size, void *data)
 	return ctx->write_cb(buf, size, ctx->cb_data);
 }
 
+/*
+ * Append the name of the packfile's index, relative to the pack
+ * directory, as it is listed in a multi-pack-index.
+ */
+static int midx_pack_name(
+		git_str *out,
+		git_midx_writer *w,
+		struct git_pack_file *p)
+{
+	git_str relative_index = GIT_STR_INIT;
+	size_t path_len;
+	int error;
+
+	if ((error = git_str_sets(&relative_index, p->pack_name)) < 0 ||
+	    (error = git_fs_path_make_relative(&relative_index, git_str_cstr(&w->pack_dir))) < 0)
+		goto done;
+
+	path_len = git_str_len(&relative_index);
+	if (path_len <= strlen(".pack") || git__suffixcmp(git_str_cstr(&relative_index), ".pack") != 0) {
+		git_error_set(GIT_ERROR_INVALID, "invalid packfile name: '%s'", p->pack_name);
+		error = -1;
+		goto done;
+	}
+	path_len -= strlen(".pack");
+
+	git_str_put(out, git_str_cstr(&relative_index), path_len);
+	error = git_str_puts(out, ".idx");
+
+done:
+	git_str_dispose(&relative_index);
+	return error;
+}
+
 static int midx_write(
 		git_midx_writer *w,
+		git_midx_file *base,
 		midx_write_cb write_cb,
-		void *cb_data)
+		void *cb_data,
+		bool write_bitmap_file,
+		unsigned char *checksum_out)
 {
 	int error = 0;
 	size_t i;
@@ -683,8 +1369,12 @@ static int midx_write(
 	git_str packfile_names = GIT_STR_INIT,
 		oid_lookup = GIT_STR_INIT,
 		object_offsets = GIT_STR_INIT,
-		object_large_offsets = GIT_STR_INIT;
+		object_large_offsets = GIT_STR_INIT,
+		reverse_index = GIT_STR_INIT;
+	uint32_t *pack_order = NULL;
+	size_t preferred_pack;
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
 	size_t checksum_size, oid_size;
 	git_midx_entry *entry;
 	object_entry_array_t object_entries_array = GIT_ARRAY_INIT;
@@ -703,7 +1393,7 @@ static int midx_write(
 	hash_cb_data.ctx = &ctx;
 
 	oid_size = git_oid_size(w->oid_type);
-	checksum_type = git_oid_algorithm(w->oid_type);
+	checksum_type = git_hash_checksum_algorithm(git_oid_algorithm(w->oid_type));
 	checksum_size = git_hash_size(checksum_type);
 	GIT_ASSERT(oid_size && checksum_type && checksum_size);
 
@@ -715,34 +1405,15 @@ static int midx_write(
 
 	git_vector_sort(&w->packs);
 	git_vector_foreach (&w->packs, i, p) {
-		git_str relative_index = GIT_STR_INIT;
 		struct object_entry_cb_state state = {0};
-		size_t path_len;
 
 		state.pack_index = (uint32_t)i;
 		state.object_entries_array = &object_entries_array;
 
-		error = git_str_sets(&relative_index, p->pack_name);
-		if (error < 0)
+		if ((error = midx_pack_name(&packfile_names, w, p)) < 0)
 			goto cleanup;
-		error = git_fs_path_make_relative(&relative_index, git_str_cstr(&w->pack_dir));
-		if (error < 0) {
-			git_str_dispose(&relative_index);
-			goto cleanup;
-		}
-		path_len = git_str_len(&relative_index);
-		if (path_len <= strlen(".pack") || git__suffixcmp(git_str_cstr(&relative_index), ".pack") != 0) {
-			git_str_dispose(&relative_index);
-			git_error_set(GIT_ERROR_INVALID, "invalid packfile name: '%s'", p->pack_name);
-			error = -1;
-			goto cleanup;
-		}
-		path_len -= strlen(".pack");
 
-		git_str_put(&packfile_names, git_str_cstr(&relative_index), path_len);
-		git_str_puts(&packfile_names, ".idx");
 		git_str_putc(&packfile_names, '\0');
-		git_str_dispose(&relative_index);
 
 		error = git_pack_foreach_entry_offset(p, object_entry__cb, &state);
 		if (error < 0)
@@ -759,7 +1430,25 @@ static int midx_write(
 	}
 	git_vector_set_sorted(&object_entries, 0);
 	git_vector_sort(&object_entries);
-	git_vector_uniq(&object_entries, NULL);
+
+	preferred_pack = midx_preferred_pack(w);
+	midx_entries_uniq(w, &object_entries, preferred_pack);
+
+	if (base && (error = midx_entries_exclude(&object_entries, base, w->oid_type)) < 0)
+		goto cleanup;
+
+	/* Fill the Reverse Index table, which bitmaps require. */
+	if (w->write_bitmap) {
+		if ((error = midx_pack_order(&pack_order, &object_entries, preferred_pack)) < 0)
+			goto cleanup;
+
+		for (i = 0; i < git_vector_length(&object_entries); i++) {
+			uint32_t word = htonl(pack_order[i]);
+
+			if ((error = git_str_put(&reverse_index, (const char *)&word, sizeof(word))) < 0)
+				goto cleanup;
+		}
+	}
 
 	/* Pad the packfile names so it is a multiple of four. */
 	while (git_str_len(&packfile_names) & 3)
@@ -810,6 +1499,8 @@ static int midx_write(
 	hdr.chunks = 4;
 	if (git_str_len(&object_large_offsets) > 0)
 		hdr.chunks++;
+	if (git_str_len(&reverse_index) > 0)
+		hdr.chunks++;
 	error = write_cb((const char *)&hdr, sizeof(hdr), cb_data);
 	if (error < 0)
 		goto cleanup;
@@ -838,6 +1529,12 @@ static int midx_write(
 			goto cleanup;
 		offset += git_str_len(&object_large_offsets);
 	}
+	if (git_str_len(&reverse_index) > 0) {
+		error = write_chunk_header(MIDX_REVERSE_INDEX_ID, offset, write_cb, cb_data);
+		if (error < 0)
+			goto cleanup;
+		offset += git_str_len(&reverse_index);
+	}
 	error = write_chunk_header(0, offset, write_cb, cb_data);
 	if (error < 0)
 		goto cleanup;
@@ -856,6 +1553,9 @@ static int midx_write(
 	if (error < 0)
 		goto cleanup;
 	error = write_cb(git_str_cstr(&object_large_offsets), git_str_len(&object_large_offsets), cb_data);
+	if (error < 0)
+		goto cleanup;
+	error = write_cb(git_str_cstr(&reverse_index), git_str_len(&reverse_index), cb_data);
 	if (error < 0)
 		goto cleanup;
 
@@ -867,7 +1567,23 @@ static int midx_write(
 	if (error < 0)
 		goto cleanup;
 
+	if (checksum_out)
+		memcpy(checksum_out, checksum, checksum_size);
+
+	if (write_bitmap_file) {
+		git_hash_fmt(checksum_hex, checksum, checksum_size);
+
+		if (w->write_bitmap &&
+		    (error = midx_write_reverse_index(w, &object_entries, pack_order, checksum_hex, checksum)) < 0)
+			goto cleanup;
+
+		if (w->write_bitmap)
+			error = midx_write_bitmap(w, &object_entries, pack_order, checksum_hex, checksum);
+	}
+
 cleanup:
+	git__free(pack_order);
+	git_str_dispose(&reverse_index);
 	git_array_clear(object_entries_array);
 	git_vector_free(&object_entries);
 	git_str_dispose(&packfile_names);
@@ -884,6 +1600,206 @@ static int midx_write_filebuf(const char *buf, size_t size, void *data)
 	return git_filebuf_write(f, buf, size);
 }
 
+static bool midx_chain_has_pack(git_midx_file *chain, const char *name)
+{
+	const char *packfile_name;
+	size_t i;
+
+	for (; chain; chain = chain->base) {
+		git_vector_foreach (&chain->packfile_names, i, packfile_name) {
+			if (strcmp(packfile_name, name) == 0)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static int midx_count_cb(const git_oid *oid, off64_t offset, void *data)
+{
+	GIT_UNUSED(oid);
+	GIT_UNUSED(offset);
+
+	(*(uint64_t *)data)++;
+	return 0;
+}
+
+static int midx_write_chain(git_filebuf *output, git_midx_file *layer)
+{
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	int error;
+
+	if (!layer)
+		return 0;
+
+	if ((error = midx_write_chain(output, layer->base)) < 0)
+		return error;
+
+	git_hash_fmt(checksum_hex, layer->checksum, git_oid_size(layer->oid_type));
+	return git_filebuf_printf(output, "%s\n", checksum_hex);
+}
+
+static int midx_remove_file(const char *path)
+{
+	if (p_unlink(path) < 0 && errno != ENOENT) {
+		git_error_set(GIT_ERROR_OS, "failed to remove '%s'", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int midx_writer_commit_layer(git_midx_writer *w)
+{
+	git_midx_file *chain = NULL, *base;
+	git_str path = GIT_STR_INIT, name = GIT_STR_INIT;
+	git_filebuf output = GIT_FILEBUF_INIT;
+	git_vector merged = GIT_VECTOR_INIT;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	struct git_pack_file *p;
+	const char *packfile_name;
+	char *merged_path;
+	uint64_t num_objects = 0;
+	size_t i, dir_len;
+	int filebuf_flags = GIT_FILEBUF_DO_NOT_BUFFER | GIT_FILEBUF_CREATE_LEADING_DIRS;
+	int error;
+
+	if (w->write_bitmap) {
+		git_error_set(GIT_ERROR_INVALID, "bitmaps cannot be written for a multi-pack-index layer");
+		return -1;
+	}
+
+	if (git_repository__fsync_gitdir)
+		filebuf_flags |= GIT_FILEBUF_FSYNC;
+
+	if ((error = git_str_joinpath(&path, git_str_cstr(&w->pack_dir), GIT_MIDX_CHAIN_FILE)) < 0)
+		goto done;
+
+	if (git_fs_path_isfile(path.ptr) &&
+	    (error = git_midx_open_chain(&chain, path.ptr, w->oid_type)) < 0)
+		goto done;
+
+	/* Only the packfiles that the chain does not have yet go in the new layer */
+	for (i = git_vector_length(&w->packs); i > 0; i--) {
+		p = git_vector_get(&w->packs, i - 1);
+
+		git_str_clear(&name);
+		if ((error = midx_pack_name(&name, w, p)) < 0)
+			goto done;
+
+		if (midx_chain_has_pack(chain, name.ptr)) {
+			git_vector_remove(&w->packs, i - 1);
+			git_mwindow_put_pack(p);
+		}
+	}
+
+	if (git_vector_length(&w->packs) == 0)
+		goto done;
+
+	git_vector_foreach (&w->packs, i, p) {
+		if ((error = git_pack_foreach_entry_offset(p, midx_count_cb, &num_objects)) < 0)
+			goto done;
+	}
+
+	/*
+	 * Merge the layers at the top of the chain into the new one as long
+	 * as they are not at least twice its size, so that the chain stays
+	 * logarithmic in the number of objects.
+	 */
+	if ((error = git_fs_path_dirname_r(&path, path.ptr)) < 0)
+		goto done;
+
+	dir_len = git_str_len(&path);
+
+	for (base = chain; base && base->num_objects < 2 * num_objects; base = base->base) {
+		git_vector_foreach (&base->packfile_names, i, packfile_name) {
+			if ((error = git_midx_writer_add(w, packfile_name)) < 0)
+				goto done;
+		}
+
+		num_objects += base->num_objects;
+
+		git_hash_fmt(checksum_hex, base->checksum, git_oid_size(w->oid_type));
+		git_str_clear(&name);
+
+		if ((error = git_str_printf(&name, "%s/multi-pack-index-%s.midx", path.ptr, checksum_hex)) < 0)
+			goto done;
+
+		merged_path = git_str_detach(&name);
+
+		if ((error = git_vector_insert(&merged, merged_path)) < 0) {
+			git__free(merged_path);
+			goto done;
+		}
+	}
+
+	/* Write the new layer, then the chain that ends with it */
+	if ((error = git_str_puts(&path, "/multi-pack-index")) < 0 ||
+	    (error = git_filebuf_open(&output, path.ptr, filebuf_flags, 0644)) < 0 ||
+	    (error = midx_write(w, base, midx_write_filebuf, &output, false, checksum)) < 0)
+		goto done;
+
+	git_hash_fmt(checksum_hex, checksum, git_oid_size(w->oid_type));
+
+	if ((error = git_str_printf(&path, "-%s.midx", checksum_hex)) < 0 ||
+	    (error = git_filebuf_commit_at(&output, path.ptr)) < 0)
+		goto done;
+
+	git_str_truncate(&path, dir_len);
+
+	if ((error = git_str_puts(&path, "/multi-pack-index-chain")) < 0 ||
+	    (error = git_filebuf_open(&output, path.ptr, filebuf_flags & ~GIT_FILEBUF_DO_NOT_BUFFER, 0644)) < 0 ||
+	    (error = midx_write_chain(&output, base)) < 0 ||
+	    (error = git_filebuf_printf(&output, "%s\n", checksum_hex)) < 0 ||
+	    (error = git_filebuf_commit(&output)) < 0)
+		goto done;
+
+	/*
+	 * The layers that were merged, and any `multi-pack-index` that was
+	 * written before the chain, are not needed anymore.
+	 */
+	git_midx_free(chain);
+	chain = NULL;
+
+	git_vector_foreach (&merged, i, merged_path) {
+		if ((error = midx_remove_file(merged_path)) < 0)
+			goto done;
+	}
+
+	if ((error = git_str_joinpath(&path, git_str_cstr(&w->pack_dir), "multi-pack-index")) < 0 ||
+	    (error = midx_remove_file(path.ptr)) < 0)
+		goto done;
+
+	error = midx_remove_stale_bitmaps(w, checksum_hex);
+
+done:
+	git_filebuf_cleanup(&output);
+	git_midx_free(chain);
+	git_vector_foreach (&merged, i, merged_path)
+		git__free(merged_path);
+	git_vector_free(&merged);
+	git_str_dispose(&path);
+	git_str_dispose(&name);
+	return error;
+}
+
+/* A `multi-pack-index` replaces any chain of layers. */
+static int midx_remove_chain(git_midx_writer *w)
+{
+	git_str path = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_str_joinpath(&path, git_str_cstr(&w->pack_dir), "multi-pack-index.d")) < 0)
+		return error;
+
+	if (git_fs_path_isdir(path.ptr))
+		error = git_futils_rmdir_r(path.ptr, NULL, GIT_RMDIR_REMOVE_FILES);
+
+	git_str_dispose(&path);
+	return error;
+}
+
 int git_midx_writer_commit(
 		git_midx_writer *w)
 {
@@ -891,6 +1807,11 @@ int git_midx_writer_commit(
 	int filebuf_flags = GIT_FILEBUF_DO_NOT_BUFFER;
 	git_str midx_path = GIT_STR_INIT;
 	git_filebuf output = GIT_FILEBUF_INIT;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+
+	if (w->incremental)
+		return midx_writer_commit_layer(w);
 
 	error = git_str_joinpath(&midx_path, git_str_cstr(&w->pack_dir), "multi-pack-index");
 	if (error < 0)
@@ -903,13 +1824,22 @@ int git_midx_writer_commit(
 	if (error < 0)
 		return error;
 
-	error = midx_write(w, midx_write_filebuf, &output);
+	error = midx_write(w, NULL, midx_write_filebuf, &output, true, checksum);
 	if (error < 0) {
 		git_filebuf_cleanup(&output);
 		return error;
 	}
 
-	return git_filebuf_commit(&output);
+	if ((error = git_filebuf_commit(&output)) < 0)
+		return error;
+
+	/* The old bitmaps stay usable until the new one is in place */
+	git_hash_fmt(checksum_hex, checksum, git_oid_size(w->oid_type));
+
+	if ((error = midx_remove_stale_bitmaps(w, checksum_hex)) < 0)
+		return error;
+
+	return midx_remove_chain(w);
 }
 
 int git_midx_writer_dump(
@@ -920,7 +1850,7 @@ int git_midx_writer_dump(
 	int error;
 
 	if ((error = git_buf_tostr(&str, midx)) < 0 ||
-	    (error = midx_write(w, midx_write_buf, &str)) == 0)
+	    (error = midx_write(w, NULL, midx_write_buf, &str, false, NULL)) == 0)
 		error = git_buf_fromstr(midx, &str);
 
 	git_str_dispose(&str);
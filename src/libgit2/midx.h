@@ -28,10 +28,24 @@
  *
  * Support for this feature was added in git 2.21, and requires the
  * `core.multiPackIndex` config option to be set.
+ *
+ * A multi-pack-index may also be a chain of layers, listed (oldest
+ * first) in `multi-pack-index.d/multi-pack-index-chain`, where each
+ * layer indexes some more packfiles and only the objects that are not
+ * in the layers below it.  Packfiles are numbered across the whole
+ * chain, starting with those of the bottom layer.
  */
 typedef struct git_midx_file {
 	git_map index_map;
 
+	/* The layer below this one in a chain, or NULL. */
+	struct git_midx_file *base;
+	/* The number of objects and packfiles in the layers below. */
+	uint32_t num_objects_in_base;
+	uint32_t num_packs_in_base;
+	/* Whether this was opened as (the top layer of) a chain. */
+	bool chained;
+
 	/* The table of Packfile Names. */
 	git_vector packfile_names;
 
@@ -57,6 +71,19 @@ typedef struct git_midx_file {
 	 */
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 
+	/*
+	 * The reverse index: the position in the midx of each object in
+	 * "pseudo-pack" order, in network byte order.  This is either the
+	 * RIDX chunk or a `multi-pack-index-<checksum>.rev` file (held in
+	 * `rev_map`), or NULL if the midx has neither.  The file is only
+	 * looked for, under `lock`, the first time that it is needed; one
+	 * that cannot be read is taken to be missing.
+	 */
+	const unsigned char *revindex;
+	git_map rev_map;
+	bool rev_checked;
+	git_mutex lock;
+
 	/* The type of object IDs in the midx. */
 	git_oid_t oid_type;
 
@@ -74,6 +101,11 @@ typedef struct git_midx_entry {
 	off64_t offset;
 	/* The SHA-1 hash of the requested object. */
 	git_oid sha1;
+	/*
+	 * The position of the object in the multi-pack-index (ie in object
+	 * id order), counting the objects of the layers below it.
+	 */
+	uint32_t position;
 } git_midx_entry;
 
 /*
@@ -91,8 +123,17 @@ struct git_midx_writer {
 
 	/* The object ID type of the writer. */
 	git_oid_t oid_type;
+
+	/* Whether to write a reachability bitmap index. */
+	bool write_bitmap;
+
+	/* Whether to add a layer to the chain rather than rewrite it all. */
+	bool incremental;
 };
 
+/* The name of the chain of layers, relative to the pack directory. */
+#define GIT_MIDX_CHAIN_FILE "multi-pack-index.d/multi-pack-index-chain"
+
 int git_midx_open(
 		git_midx_file **idx_out,
 		const char *path,
@@ -100,15 +141,56 @@ int git_midx_open(
 bool git_midx_needs_refresh(
 		const git_midx_file *idx,
 		const char *path);
+
+/*
+ * Open the chain of layers listed in the given chain file.  The result
+ * is the top layer, whose `base` leads to the others.
+ */
+int git_midx_open_chain(
+		git_midx_file **idx_out,
+		const char *chain_path,
+		git_oid_t oid_type);
+bool git_midx_chain_needs_refresh(
+		const git_midx_file *idx,
+		const char *chain_path);
+
+/*
+ * Find an object in the multi-pack-index and all the layers below it.
+ * The `pack_index` of the entry counts the packfiles of the whole chain.
+ */
 int git_midx_entry_find(
 		git_midx_entry *e,
 		git_midx_file *idx,
 		const git_oid *short_oid,
 		size_t len);
+
+/*
+ * Get the entry of the object at the given position in the
+ * multi-pack-index, counting the objects of the layers below it.
+ */
+int git_midx_nth_entry(
+		git_midx_entry *e,
+		git_midx_file *idx,
+		uint32_t n);
+void git_midx_entry_prefetch(
+		git_midx_file *idx,
+		const git_oid *ids,
+		size_t count);
 int git_midx_foreach_entry(
 		git_midx_file *idx,
 		git_odb_foreach_cb cb,
 		void *data);
+
+/*
+ * Translate a position in "pseudo-pack" order (the preferred pack's
+ * objects first, then those of each other pack, each sorted by offset)
+ * to the position in the midx.  Returns `GIT_ENOTFOUND` if the midx
+ * has no reverse index.  For a chain, this is about the top layer only.
+ */
+int git_midx_pos_to_index(
+		uint32_t *index_pos_out,
+		git_midx_file *idx,
+		uint32_t pack_pos);
 int git_midx_close(git_midx_file *idx);
 void git_midx_free(git_midx_file *idx);
 
@@ -28,6 +28,7 @@
 size_t git_mwindow__window_size = DEFAULT_WINDOW_SIZE;
 size_t git_mwindow__mapped_limit = DEFAULT_MAPPED_LIMIT;
 size_t git_mwindow__file_limit = DEFAULT_FILE_LIMIT;
+bool git_mwindow__map_whole = false;
 
 /* Mutex to control access to `git_mwindow__mem_ctl` and `git__pack_cache`. */
 git_mutex git__mwindow_mutex;
@@ -169,6 +170,19 @@ static int git_mwindow_free_all_locked(git_mwindow_file *mwf)
 		git__free(w);
 	}
 
+	/* Nobody may be reading the file now, so the whole map can go too */
+	if (mwf->whole) {
+		git_mwindow *w = git_atomic_swap(mwf->whole, NULL);
+
+		ctl->mapped -= w->window_map.len;
+		ctl->open_windows--;
+
+		git_futils_mmap_free(&w->window_map);
+		git__free(w);
+	}
+
+	mwf->whole_failed = false;
+
 	return 0;
 }
 
@@ -312,6 +326,11 @@ static int git_mwindow_find_lru_file_locked(git_mwindow_file **out)
 
 	git_vector_foreach(&ctl->windowfiles, i, current_file) {
 		git_mwindow *mru_window = NULL;
+
+		/* Files that are mapped whole may be in use without our knowing */
+		if (current_file->whole)
+			continue;
+
 		if (!git_mwindow_scan_recently_used(
 				current_file, &mru_window, NULL, true, GIT_MWINDOW__MRU)) {
 			continue;
@@ -335,7 +354,8 @@ static int git_mwindow_find_lru_file_locked(git_mwindow_file **out)
 static git_mwindow *new_window_locked(
 	git_file fd,
 	off64_t size,
-	off64_t offset)
+	off64_t offset,
+	git_map_advice_t advice)
 {
 	git_mwindow_ctl *ctl = &git_mwindow__mem_ctl;
 	size_t walign = git_mwindow__window_size / 2;
@@ -379,6 +399,9 @@ static git_mwindow *new_window_locked(
 		}
 	}
 
+	if (advice != GIT_MAP_ADVICE_NORMAL)
+		p_madvise(&w->window_map, 0, w->window_map.len, advice);
+
 	ctl->mmap_calls++;
 	ctl->open_windows++;
 
@@ -391,6 +414,84 @@ static git_mwindow *new_window_locked(
 	return w;
 }
 
+/*
+ * Map the whole file, closing the least recently used windows of other
+ * files until we have enough space.  Called under lock from
+ * git_mwindow_open; if the file cannot be mapped, it is remembered and
+ * the file is read in windows instead.
+ */
+static void map_whole_locked(git_mwindow_file *mwf)
+{
+	git_mwindow_ctl *ctl = &git_mwindow__mem_ctl;
+	git_mwindow *w;
+
+	if (mwf->size <= 0 || (uint64_t)mwf->size > SIZE_MAX ||
+	    (w = git__calloc(1, sizeof(*w))) == NULL)
+		goto failed;
+
+	w->whole = true;
+	ctl->mapped += (size_t)mwf->size;
+
+	while (git_mwindow__mapped_limit < ctl->mapped &&
+			git_mwindow_close_lru_window_locked() == 0) /* nop */;
+
+	if (git_futils_mmap_ro(&w->window_map, mwf->fd, 0, (size_t)mwf->size) < 0) {
+		while (git_mwindow_close_lru_window_locked() == 0)
+			/* nop */;
+
+		if (git_futils_mmap_ro(&w->window_map, mwf->fd, 0, (size_t)mwf->size) < 0) {
+			ctl->mapped -= (size_t)mwf->size;
+			git__free(w);
+			goto failed;
+		}
+	}
+
+	if (mwf->advice != GIT_MAP_ADVICE_NORMAL)
+		p_madvise(&w->window_map, 0, w->window_map.len, mwf->advice);
+
+	ctl->mmap_calls++;
+	ctl->open_windows++;
+
+	if (ctl->mapped > ctl->peak_mapped)
+		ctl->peak_mapped = ctl->mapped;
+
+	if (ctl->open_windows > ctl->peak_open_windows)
+		ctl->peak_open_windows = ctl->open_windows;
+
+	git_atomic_swap(mwf->whole, w);
+	return;
+
+failed:
+	git_error_clear();
+	mwf->whole_failed = true;
+}
+
+unsigned char *git_mwindow_open_whole(
+	git_mwindow_file *mwf,
+	git_mwindow **cursor,
+	off64_t offset,
+	size_t extra,
+	unsigned int *left)
+{
+	git_mwindow *w = git_atomic_load(mwf->whole);
+	size_t remaining;
+
+	if (!w || !git_mwindow_contains(w, offset, extra))
+		return NULL;
+
+	if (*cursor != w) {
+		git_mwindow_close(cursor);
+		*cursor = w;
+	}
+
+	if (left) {
+		remaining = w->window_map.len - (size_t)offset;
+		*left = remaining > UINT_MAX ? UINT_MAX : (unsigned int)remaining;
+	}
+
+	return (unsigned char *)w->window_map.data + offset;
+}
+
 /*
  * Open a new window, closing the least recenty used until we have
  * enough space. Don't forget to add it to your list
@@ -403,13 +504,33 @@ unsigned char *git_mwindow_open(
 	unsigned int *left)
 {
 	git_mwindow_ctl *ctl = &git_mwindow__mem_ctl;
-	git_mwindow *w = *cursor;
+	git_mwindow *w;
+	unsigned char *data;
+
+	if ((data = git_mwindow_open_whole(mwf, cursor, offset, extra, left)) != NULL)
+		return data;
 
 	if (git_mutex_lock(&git__mwindow_mutex)) {
 		git_error_set(GIT_ERROR_THREAD, "unable to lock mwindow mutex");
 		return NULL;
 	}
 
+	if (git_mwindow__map_whole && !mwf->whole && !mwf->whole_failed) {
+		map_whole_locked(mwf);
+
+		if (mwf->whole && git_mwindow_contains(mwf->whole, offset, extra)) {
+			git_mutex_unlock(&git__mwindow_mutex);
+			return git_mwindow_open_whole(mwf, cursor, offset, extra, left);
+		}
+	}
+
+	w = *cursor;
+
+	if (w && w->whole) {
+		/* The cursor is not ours to keep count of */
+		*cursor = w = NULL;
+	}
+
 	if (!w || !(git_mwindow_contains(w, offset, extra))) {
 		if (w) {
 			w->inuse_cnt--;
@@ -425,7 +546,7 @@ unsigned char *git_mwindow_open(
 		 * one.
 		 */
 		if (!w) {
-			w = new_window_locked(mwf->fd, mwf->size, offset);
+			w = new_window_locked(mwf->fd, mwf->size, offset, mwf->advice);
 			if (w == NULL) {
 				git_mutex_unlock(&git__mwindow_mutex);
 				return NULL;
@@ -528,10 +649,35 @@ void git_mwindow_file_deregister(git_mwindow_file *mwf)
 	git_mutex_unlock(&git__mwindow_mutex);
 }
 
+int git_mwindow_file_advise(git_mwindow_file *mwf, git_map_advice_t advice)
+{
+	git_mwindow *w;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		git_error_set(GIT_ERROR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	if (advice != GIT_MAP_ADVICE_WILLNEED && advice != GIT_MAP_ADVICE_DONTNEED)
+		mwf->advice = advice;
+
+	for (w = mwf->windows; w; w = w->next)
+		p_madvise(&w->window_map, 0, w->window_map.len, advice);
+
+	if (mwf->whole)
+		p_madvise(&mwf->whole->window_map, 0, mwf->whole->window_map.len, advice);
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
+
 void git_mwindow_close(git_mwindow **window)
 {
 	git_mwindow *w = *window;
-	if (w) {
+
+	if (w && w->whole) {
+		*window = NULL;
+	} else if (w) {
 		if (git_mutex_lock(&git__mwindow_mutex)) {
 			git_error_set(GIT_ERROR_THREAD, "unable to lock mwindow mutex");
 			return;
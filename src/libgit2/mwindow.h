@@ -19,11 +19,25 @@ typedef struct git_mwindow {
 	off64_t offset;
 	size_t last_used;
 	size_t inuse_cnt;
+	bool whole;
 } git_mwindow;
 
 typedef struct git_mwindow_file {
 	git_mutex lock; /* protects updates to fd */
 	git_mwindow *windows;
+
+	/*
+	 * When `git_mwindow__map_whole` is set, the whole file is mapped
+	 * in this one window instead.  It is published atomically and stays
+	 * mapped until `git_mwindow_free_all`, so readers can use it
+	 * without locking or keeping count of their use.
+	 */
+	git_mwindow *whole;
+	bool whole_failed;
+
+	/* How the windows are going to be read; see git_mwindow_file_advise */
+	git_map_advice_t advice;
+
 	int fd;
 	off64_t size;
 } git_mwindow_file;
@@ -41,10 +55,25 @@ typedef struct git_mwindow_ctl {
 int git_mwindow_contains(git_mwindow *win, off64_t offset, off64_t extra);
 int git_mwindow_free_all(git_mwindow_file *mwf); /* locks */
 unsigned char *git_mwindow_open(git_mwindow_file *mwf, git_mwindow **cursor, off64_t offset, size_t extra, unsigned int *left);
+
+/*
+ * Like `git_mwindow_open`, but only if the file is mapped whole, in
+ * which case this does not lock.  Returns NULL, without setting an
+ * error, if it is not (or if the range is outside of it).
+ */
+unsigned char *git_mwindow_open_whole(git_mwindow_file *mwf, git_mwindow **cursor, off64_t offset, size_t extra, unsigned int *left);
 int git_mwindow_file_register(git_mwindow_file *mwf);
 void git_mwindow_file_deregister(git_mwindow_file *mwf);
 void git_mwindow_close(git_mwindow **w_cursor);
 
+/*
+ * Tell the system how the file is going to be read.  A sequential,
+ * random or normal pattern applies to the windows that are open and to
+ * those that are opened later; `GIT_MAP_ADVICE_WILLNEED` and
+ * `GIT_MAP_ADVICE_DONTNEED` only apply to the windows that are open.
+ */
+int git_mwindow_file_advise(git_mwindow_file *mwf, git_map_advice_t advice); /* locks */
+
 extern int git_mwindow_global_init(void);
 
 struct git_pack_file; /* just declaration to avoid cyclical includes */
@@ -17,6 +17,7 @@
 #include "repository.h"
 #include "blob.h"
 #include "oid.h"
+#include "array.h"
 
 #include "git2/odb_backend.h"
 #include "git2/oid.h"
@@ -34,6 +35,23 @@ int git_odb__loose_priority = GIT_ODB_DEFAULT_LOOSE_PRIORITY;
 int git_odb__packed_priority = GIT_ODB_DEFAULT_PACKED_PRIORITY;
 
 bool git_odb__strict_hash_verification = true;
+bool git_odb__loose_object_cache = false;
+
+/* The minimum time (in milliseconds) between refreshes on a lookup miss */
+uint64_t git_odb__refresh_interval = 0;
+
+/*
+ * The filter of missing objects is made of 512-bit blocks; each id sets
+ * GIT_ODB_MISSING_HASHES bits in the block that it selects.  Once it
+ * holds GIT_ODB_MISSING_MAX ids (16 bits per id) it is emptied.
+ */
+#define GIT_ODB_MISSING_BLOCKS 1024
+#define GIT_ODB_MISSING_HASHES 6
+#define GIT_ODB_MISSING_MAX (GIT_ODB_MISSING_BLOCKS * 32)
+
+static git_atomic_ssize refresh_count;
+static git_atomic_ssize missing_hits;
+static git_atomic_ssize rate_limited_count;
 
 typedef struct
 {
@@ -105,34 +123,28 @@ int git_odb__format_object_header(
 	return 0;
 }
 
-int git_odb__hashobj(git_oid *id, git_rawobj *obj, git_oid_t oid_type)
+/* The header and the data of an object, as they get hashed */
+static int hashobj_vec(
+	git_str_vec vec[2],
+	char *header,
+	size_t header_size,
+	git_rawobj *obj)
 {
-	git_str_vec vec[2];
-	char header[64];
 	size_t hdrlen;
-	git_hash_algorithm_t algorithm;
 	int error;
 
-	GIT_ASSERT_ARG(id);
-	GIT_ASSERT_ARG(obj);
-
 	if (!git_object_typeisloose(obj->type)) {
 		git_error_set(GIT_ERROR_INVALID, "invalid object type");
 		return -1;
 	}
 
-	if (!(algorithm = git_oid_algorithm(oid_type))) {
-		git_error_set(GIT_ERROR_INVALID, "unknown oid type");
-		return -1;
-	}
-
 	if (!obj->data && obj->len != 0) {
 		git_error_set(GIT_ERROR_INVALID, "invalid object");
 		return -1;
 	}
 
 	if ((error = git_odb__format_object_header(&hdrlen,
-		header, sizeof(header), obj->len, obj->type)) < 0)
+		header, header_size, obj->len, obj->type)) < 0)
 		return error;
 
 	vec[0].data = header;
@@ -140,6 +152,27 @@ int git_odb__hashobj(git_oid *id, git_rawobj *obj, git_oid_t oid_type)
 	vec[1].data = obj->data;
 	vec[1].len = obj->len;
 
+	return 0;
+}
+
+int git_odb__hashobj(git_oid *id, git_rawobj *obj, git_oid_t oid_type)
+{
+	git_str_vec vec[2];
+	char header[64];
+	git_hash_algorithm_t algorithm;
+	int error;
+
+	GIT_ASSERT_ARG(id);
+	GIT_ASSERT_ARG(obj);
+
+	if (!(algorithm = git_oid_algorithm(oid_type))) {
+		git_error_set(GIT_ERROR_INVALID, "unknown oid type");
+		return -1;
+	}
+
+	if ((error = hashobj_vec(vec, header, sizeof(header), obj)) < 0)
+		return error;
+
 #ifdef GIT_EXPERIMENTAL_SHA256
 	id->type = oid_type;
 #endif
@@ -147,6 +180,54 @@ int git_odb__hashobj(git_oid *id, git_rawobj *obj, git_oid_t oid_type)
 	return git_hash_vec(id->id, vec, 2, algorithm);
 }
 
+/* The number of objects that are handed to the hash at a time */
+#define HASHOBJ_BATCH GIT_HASH_LANES_MAX
+
+int git_odb__hashobj_many(
+	git_oid *ids,
+	git_rawobj *objs,
+	size_t count,
+	git_oid_t oid_type)
+{
+	git_hash_batch_entry entries[HASHOBJ_BATCH];
+	git_str_vec vecs[HASHOBJ_BATCH][2];
+	char headers[HASHOBJ_BATCH][64];
+	git_hash_algorithm_t algorithm;
+	size_t i, j, n;
+	int error;
+
+	GIT_ASSERT_ARG(ids || !count);
+	GIT_ASSERT_ARG(objs || !count);
+
+	if (!(algorithm = git_oid_algorithm(oid_type))) {
+		git_error_set(GIT_ERROR_INVALID, "unknown oid type");
+		return -1;
+	}
+
+	for (i = 0; i < count; i += n) {
+		n = min(count - i, HASHOBJ_BATCH);
+
+		for (j = 0; j < n; j++) {
+			if ((error = hashobj_vec(vecs[j], headers[j],
+					sizeof(headers[j]), &objs[i + j])) < 0)
+				return error;
+
+			entries[j].vec = vecs[j];
+			entries[j].vec_len = 2;
+			entries[j].out = ids[i + j].id;
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+			ids[i + j].type = oid_type;
+#endif
+		}
+
+		if ((error = git_hash_batch(entries, n, algorithm)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
 
 static git_odb_object *odb_object__alloc(const git_oid *oid, git_rawobj *source)
 {
@@ -722,6 +803,9 @@ int git_odb__add_default_backends(
 	if (db->do_fsync)
 		loose_opts.flags |= GIT_ODB_BACKEND_LOOSE_FSYNC;
 
+	if (git_odb__loose_object_cache)
+		loose_opts.flags |= GIT_ODB_BACKEND_LOOSE_CACHE;
+
 	loose_opts.oid_type = db->options.oid_type;
 	pack_opts.oid_type = db->options.oid_type;
 
@@ -894,6 +978,224 @@ int git_odb__set_caps(git_odb *odb, int caps)
 	return 0;
 }
 
+void git_odb__refresh_stats(size_t *refreshes, size_t *hits, size_t *rate_limited)
+{
+	if (refreshes)
+		*refreshes = (size_t)git_atomic_ssize_get(&refresh_count);
+	if (hits)
+		*hits = (size_t)git_atomic_ssize_get(&missing_hits);
+	if (rate_limited)
+		*rate_limited = (size_t)git_atomic_ssize_get(&rate_limited_count);
+}
+
+/*
+ * Object ids are already uniformly distributed, so the bytes of the id
+ * are used directly: the first two select the block and the next eight
+ * supply the bits to set within it.
+ */
+static uint64_t *missing_block(
+	uint64_t *hash_out,
+	git_odb_missing *missing,
+	const git_oid *id)
+{
+	size_t block = ((id->id[0] << 8) | id->id[1]) % GIT_ODB_MISSING_BLOCKS;
+	uint64_t hash = 0;
+	int i;
+
+	for (i = 2; i < 10; i++)
+		hash = (hash << 8) | id->id[i];
+
+	*hash_out = hash;
+	return &missing->bits[block * 8];
+}
+
+static bool missing_contains(git_odb_missing *missing, const git_oid *id)
+{
+	uint64_t *block, hash;
+	int i;
+
+	if (!missing->count)
+		return false;
+
+	block = missing_block(&hash, missing, id);
+
+	for (i = 0; i < GIT_ODB_MISSING_HASHES; i++, hash >>= 9) {
+		if (!(block[(hash & 0x1ff) >> 6] & ((uint64_t)1 << (hash & 0x3f))))
+			return false;
+	}
+
+	return true;
+}
+
+static void missing_clear(git_odb_missing *missing)
+{
+	if (missing->count)
+		memset(missing->bits, 0, GIT_ODB_MISSING_BLOCKS * 64);
+
+	missing->count = 0;
+}
+
+static int missing_add(git_odb_missing *missing, const git_oid *id)
+{
+	uint64_t *block, hash;
+	int i;
+
+	if (!missing->bits) {
+		missing->bits = git__calloc(GIT_ODB_MISSING_BLOCKS, 64);
+		GIT_ERROR_CHECK_ALLOC(missing->bits);
+	}
+
+	if (missing->count >= GIT_ODB_MISSING_MAX)
+		missing_clear(missing);
+
+	block = missing_block(&hash, missing, id);
+
+	for (i = 0; i < GIT_ODB_MISSING_HASHES; i++, hash >>= 9)
+		block[(hash & 0x1ff) >> 6] |= ((uint64_t)1 << (hash & 0x3f));
+
+	missing->count++;
+	return 0;
+}
+
+static void missing_dirs_clear(git_odb_missing *missing)
+{
+	git_odb_missing_dir *dir;
+	size_t i;
+
+	git_array_foreach(missing->pack_dirs, i, dir)
+		git__free(dir->path);
+
+	git_array_clear(missing->pack_dirs);
+}
+
+/*
+ * Note the state of the pack directories of all the backends, those of
+ * the alternates included.  Must be called with the odb lock held.
+ */
+static int missing_dirs_stamp(git_odb *db)
+{
+	git_odb_missing_dir *dir;
+	const char *folder;
+	size_t i;
+
+	missing_dirs_clear(&db->missing);
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		if (git_odb_backend__pack_folder(&folder, internal->backend) != 0)
+			continue;
+
+		dir = git_array_alloc(db->missing.pack_dirs);
+		GIT_ERROR_CHECK_ALLOC(dir);
+
+		memset(dir, 0, sizeof(*dir));
+		dir->path = git__strdup(folder);
+		GIT_ERROR_CHECK_ALLOC(dir->path);
+
+		if (git_futils_filestamp_check(&dir->stamp, dir->path) < 0)
+			git_futils_filestamp_set(&dir->stamp, NULL);
+	}
+
+	return 0;
+}
+
+/*
+ * Refresh the backends, or only those without a pack directory (like
+ * the loose backend, which just marks its cached listings as stale).
+ * Must be called with the odb lock held.
+ */
+static int odb_refresh_backends(git_odb *db, bool packs)
+{
+	const char *folder;
+	size_t i;
+	int error;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		if (b->refresh == NULL ||
+		    (!packs && git_odb_backend__pack_folder(&folder, b) == 0))
+			continue;
+
+		if ((error = b->refresh(b)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+/*
+ * A lookup missed: decide whether to refresh the ODB and look again.
+ * Returns 0 if the ODB was refreshed, or GIT_ENOTFOUND without
+ * refreshing it if it was refreshed too recently.
+ *
+ * If the object (when given an `id`) is known to be missing, and the
+ * pack directories are unchanged, only the backends without one are
+ * refreshed before looking again: loose objects do not change the pack
+ * directories.  A packfile that arrives without changing the stamp of
+ * its directory (as with a coarse or cached mtime) is not noticed until
+ * the next full refresh, as with the packs' own refreshing.
+ */
+static int odb_refresh_missing(git_odb *db, const git_oid *id)
+{
+	git_futils_filestamp stamp;
+	git_odb_missing_dir *dir;
+	bool known = false, limited = false;
+	size_t i;
+	int error = 0;
+
+	if (git_mutex_lock(&db->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return -1;
+	}
+
+	if (id && missing_contains(&db->missing, id)) {
+		known = true;
+
+		/* New packfiles, in any of the directories, invalidate what we know */
+		git_array_foreach(db->missing.pack_dirs, i, dir) {
+			memcpy(&stamp, &dir->stamp, sizeof(stamp));
+
+			if (git_futils_filestamp_check(&stamp, dir->path) != 0) {
+				known = false;
+				break;
+			}
+		}
+	}
+
+	if (known)
+		error = odb_refresh_backends(db, false);
+	else if (git_odb__refresh_interval && db->missing.last_refresh &&
+	         git_time_monotonic() - db->missing.last_refresh < git_odb__refresh_interval)
+		limited = true;
+
+	git_mutex_unlock(&db->lock);
+
+	if (known) {
+		git_atomic_ssize_add(&missing_hits, 1);
+		return error;
+	} else if (limited) {
+		git_atomic_ssize_add(&rate_limited_count, 1);
+		return GIT_ENOTFOUND;
+	}
+
+	return git_odb_refresh(db);
+}
+
+/* Remember an object that was missing even after a refresh */
+static void odb_remember_missing(git_odb *db, const git_oid *id)
+{
+	if (git_mutex_lock(&db->lock) < 0)
+		return;
+
+	if (missing_add(&db->missing, id) < 0)
+		git_error_clear();
+
+	git_mutex_unlock(&db->lock);
+}
+
 static void odb_free(git_odb *db)
 {
 	size_t i;
@@ -917,6 +1219,8 @@ static void odb_free(git_odb *db)
 	git_commit_graph_free(db->cgraph);
 	git_vector_free(&db->backends);
 	git_cache_dispose(&db->own_cache);
+	git__free(db->missing.bits);
+	missing_dirs_clear(&db->missing);
 	git_mutex_free(&db->lock);
 
 	git__memzero(db, sizeof(*db));
@@ -1020,13 +1324,118 @@ int git_odb__freshen(git_odb *db, const git_oid *id)
 	if (odb_freshen_1(db, id, false))
 		return 1;
 
-	if (!git_odb_refresh(db))
-		return odb_freshen_1(db, id, true);
+	if (!odb_refresh_missing(db, id)) {
+		if (odb_freshen_1(db, id, true))
+			return 1;
+
+		odb_remember_missing(db, id);
+	}
 
 	/* Failed to refresh, hence not found */
 	return 0;
 }
 
+int git_odb__find_pack_entry(
+	struct git_pack_entry *out, git_odb *db, const git_oid *id)
+{
+	size_t i;
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(id);
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return error;
+	}
+
+	error = GIT_PASSTHROUGH;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		error = git_odb_backend__pack_entry(out, internal->backend, id);
+
+		if (error != GIT_PASSTHROUGH && error != GIT_ENOTFOUND)
+			break;
+	}
+
+	git_mutex_unlock(&db->lock);
+
+	if (error == GIT_PASSTHROUGH || error == GIT_ENOTFOUND) {
+		git_error_clear();
+		return git_odb__error_notfound("object is not packed", id, git_oid_hexsize(db->options.oid_type));
+	}
+
+	return error;
+}
+
+int git_odb__pack_folder(git_str *out, git_odb *db)
+{
+	const char *folder = NULL;
+	size_t i;
+	int error;
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return error;
+	}
+
+	for (i = 0, error = GIT_PASSTHROUGH; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		if (internal->is_alternate)
+			continue;
+
+		if ((error = git_odb_backend__pack_folder(&folder, internal->backend)) != GIT_PASSTHROUGH)
+			break;
+	}
+
+	if (!error)
+		error = git_str_sets(out, folder);
+
+	git_mutex_unlock(&db->lock);
+
+	if (error == GIT_PASSTHROUGH) {
+		git_error_set(GIT_ERROR_ODB, "the object database has no pack directory");
+		return GIT_ENOTFOUND;
+	}
+
+	return error;
+}
+
+int git_odb__remove_backend(git_odb *db, git_odb_backend *backend)
+{
+	backend_internal *internal;
+	size_t i;
+	int error = GIT_ENOTFOUND;
+
+	if (git_mutex_lock(&db->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return -1;
+	}
+
+	git_vector_foreach(&db->backends, i, internal) {
+		if (internal->backend != backend)
+			continue;
+
+		git_vector_remove(&db->backends, i);
+		git__free(internal);
+
+		backend->odb = NULL;
+		error = 0;
+		break;
+	}
+
+	git_mutex_unlock(&db->lock);
+
+	if (error)
+		git_error_set(GIT_ERROR_ODB, "backend is not part of the object database");
+
+	return error;
+}
+
 int git_odb_exists(git_odb *db, const git_oid *id)
 {
     return git_odb_exists_ext(db, id, 0);
@@ -1050,8 +1459,12 @@ int git_odb_exists_ext(git_odb *db, const git_oid *id, unsigned int flags)
 	if (odb_exists_1(db, id, false))
 		return 1;
 
-	if (!(flags & GIT_ODB_LOOKUP_NO_REFRESH) && !git_odb_refresh(db))
-		return odb_exists_1(db, id, true);
+	if (!(flags & GIT_ODB_LOOKUP_NO_REFRESH) && !odb_refresh_missing(db, id)) {
+		if (odb_exists_1(db, id, true))
+			return 1;
+
+		odb_remember_missing(db, id);
+	}
 
 	/* Failed to refresh, hence not found */
 	return 0;
@@ -1136,7 +1549,7 @@ int git_odb_exists_prefix(
 
 	error = odb_exists_prefix_1(out, db, &key, len, false);
 
-	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
+	if (error == GIT_ENOTFOUND && !odb_refresh_missing(db, NULL))
 		error = odb_exists_prefix_1(out, db, &key, len, true);
 
 	if (error == GIT_ENOTFOUND)
@@ -1303,9 +1716,13 @@ int git_odb__read_header_or_object(
 
 	error = odb_read_header_1(len_p, type_p, db, id, false);
 
-	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
+	if (error == GIT_ENOTFOUND && !odb_refresh_missing(db, id)) {
 		error = odb_read_header_1(len_p, type_p, db, id, true);
 
+		if (error == GIT_ENOTFOUND)
+			odb_remember_missing(db, id);
+	}
+
 	if (error == GIT_ENOTFOUND)
 		return git_odb__error_notfound("cannot read header for", id, git_oid_hexsize(db->options.oid_type));
 
@@ -1417,15 +1834,277 @@ int git_odb_read(git_odb_object **out, git_odb *db, const git_oid *id)
 
 	error = odb_read_1(out, db, id, false);
 
-	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
+	if (error == GIT_ENOTFOUND && !odb_refresh_missing(db, id)) {
 		error = odb_read_1(out, db, id, true);
 
+		if (error == GIT_ENOTFOUND)
+			odb_remember_missing(db, id);
+	}
+
 	if (error == GIT_ENOTFOUND)
 		return git_odb__error_notfound("no match for id", id, git_oid_hexsize(git_oid_type(id)));
 
 	return error;
 }
 
+/* The number of objects that are read from the backends at a time */
+#define ODB_READ_MANY_BATCH 256
+
+typedef struct {
+	size_t idx;
+	git_rawobj raw;
+} odb_read_many_entry;
+
+typedef struct {
+	git_array_t(odb_read_many_entry) found;
+	bool *done;
+	size_t *indices;
+} odb_read_many_batch;
+
+static int odb_read_many__collect(
+	size_t idx, void *data, size_t len, git_object_t type, void *payload)
+{
+	odb_read_many_batch *batch = payload;
+	odb_read_many_entry *entry;
+
+	if ((entry = git_array_alloc(batch->found)) == NULL) {
+		git__free(data);
+		return -1;
+	}
+
+	entry->idx = batch->indices[idx];
+	entry->raw.data = data;
+	entry->raw.len = len;
+	entry->raw.type = type;
+
+	batch->done[entry->idx] = true;
+	return 0;
+}
+
+/*
+ * Hash the objects that were found, all together, to verify them
+ * before they are delivered.
+ */
+static int odb_read_many__hash(
+	git_oid **out,
+	git_odb *db,
+	odb_read_many_batch *batch)
+{
+	odb_read_many_entry *entry;
+	git_rawobj *objs;
+	size_t i, count = git_array_size(batch->found);
+	int error;
+
+	*out = NULL;
+
+	if (!count)
+		return 0;
+
+	objs = git__calloc(count, sizeof(git_rawobj));
+	*out = git__calloc(count, sizeof(git_oid));
+
+	if (!objs || !*out) {
+		git__free(objs);
+		return -1;
+	}
+
+	git_array_foreach(batch->found, i, entry)
+		objs[i] = entry->raw;
+
+	error = git_odb__hashobj_many(*out, objs, count, db->options.oid_type);
+
+	git__free(objs);
+	return error;
+}
+
+static int odb_read_many__deliver(
+	git_odb *db,
+	const git_oid *id,
+	git_rawobj *raw,
+	const git_oid *hashed,
+	git_odb_read_many_cb cb,
+	void *payload)
+{
+	git_odb_object *object;
+	int error;
+
+	if (hashed && !git_oid_equal(id, hashed)) {
+		error = git_odb__error_mismatch(id, hashed);
+		goto on_error;
+	}
+
+	if ((object = odb_object__alloc(id, raw)) == NULL) {
+		error = -1;
+		goto on_error;
+	}
+
+	object = git_cache_store_raw(odb_cache(db), object);
+
+	error = cb(object, payload);
+	git_odb_object_free(object);
+
+	return git_error_set_after_callback_function(error, "git_odb_read_many");
+
+on_error:
+	git__free(raw->data);
+	return error;
+}
+
+static int odb_read_many__backends(
+	git_odb *db,
+	const git_oid *ids,
+	size_t *pending,
+	size_t pending_len,
+	bool *done,
+	git_odb_read_many_cb cb,
+	void *payload)
+{
+	odb_read_many_batch batch = { GIT_ARRAY_INIT };
+	odb_read_many_entry *entry;
+	git_oid *hashed = NULL;
+	git_oid batch_ids[ODB_READ_MANY_BATCH];
+	size_t batch_indices[ODB_READ_MANY_BATCH];
+	size_t i, j, n;
+	int error = 0;
+
+	batch.done = done;
+	batch.indices = batch_indices;
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return error;
+	}
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		if (b->read_many == NULL)
+			continue;
+
+		for (j = 0, n = 0; j < pending_len; j++) {
+			if (done[pending[j]])
+				continue;
+
+			git_oid_cpy(&batch_ids[n], &ids[pending[j]]);
+			batch_indices[n++] = pending[j];
+		}
+
+		if (!n)
+			break;
+
+		error = b->read_many(b, batch_ids, n, odb_read_many__collect, &batch);
+
+		if (error == GIT_PASSTHROUGH || error == GIT_ENOTFOUND)
+			error = 0;
+		else if (error < 0)
+			break;
+	}
+
+	git_mutex_unlock(&db->lock);
+
+	if (error == 0 && git_odb__strict_hash_verification)
+		error = odb_read_many__hash(&hashed, db, &batch);
+
+	/* Deliver outside of the lock, so that the callback may use the odb */
+	git_array_foreach(batch.found, i, entry) {
+		if (error == 0)
+			error = odb_read_many__deliver(db, &ids[entry->idx], &entry->raw,
+				hashed ? &hashed[i] : NULL, cb, payload);
+		else
+			git__free(entry->raw.data);
+	}
+
+	git__free(hashed);
+	git_array_clear(batch.found);
+	return error;
+}
+
+int git_odb_read_many(
+	git_odb *db,
+	const git_oid *ids,
+	size_t count,
+	git_odb_read_many_cb cb,
+	void *payload)
+{
+	git_odb_object *object;
+	size_t pending[ODB_READ_MANY_BATCH];
+	size_t i, pending_len = 0, missing = SIZE_MAX;
+	bool *done;
+	int error = 0;
+
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(ids || !count);
+	GIT_ASSERT_ARG(cb);
+
+	if (!count)
+		return 0;
+
+	done = git__calloc(count, sizeof(bool));
+	GIT_ERROR_CHECK_ALLOC(done);
+
+	/* Serve what we can from the cache, and batch up the rest */
+	for (i = 0; i < count; i++) {
+		if (git_oid_is_zero(&ids[i]))
+			continue;
+
+		if ((object = git_cache_get_raw(odb_cache(db), &ids[i])) != NULL) {
+			done[i] = true;
+
+			error = cb(object, payload);
+			git_odb_object_free(object);
+
+			if ((error = git_error_set_after_callback_function(error, "git_odb_read_many")) != 0)
+				goto done;
+
+			continue;
+		}
+
+		pending[pending_len++] = i;
+
+		if (pending_len == ODB_READ_MANY_BATCH) {
+			if ((error = odb_read_many__backends(db, ids, pending, pending_len, done, cb, payload)) != 0)
+				goto done;
+
+			pending_len = 0;
+		}
+	}
+
+	if (pending_len &&
+	    (error = odb_read_many__backends(db, ids, pending, pending_len, done, cb, payload)) != 0)
+		goto done;
+
+	/*
+	 * Anything that is left is either in a backend that cannot read
+	 * many objects at once, or needs a refresh; or it is missing.
+	 */
+	for (i = 0; i < count; i++) {
+		if (done[i])
+			continue;
+
+		if ((error = git_odb_read(&object, db, &ids[i])) == GIT_ENOTFOUND) {
+			missing = i;
+			continue;
+		} else if (error < 0) {
+			goto done;
+		}
+
+		error = cb(object, payload);
+		git_odb_object_free(object);
+
+		if ((error = git_error_set_after_callback_function(error, "git_odb_read_many")) != 0)
+			goto done;
+	}
+
+	if (missing < count)
+		error = git_odb__error_notfound("no match for id",
+			&ids[missing], git_oid_hexsize(git_oid_type(&ids[missing])));
+
+done:
+	git__free(done);
+	return error;
+}
+
 static int odb_otype_fast(git_object_t *type_p, git_odb *db, const git_oid *id)
 {
 	git_odb_object *object;
@@ -1574,7 +2253,7 @@ int git_odb_read_prefix(
 
 	error = read_prefix_1(out, db, &key, len, false);
 
-	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
+	if (error == GIT_ENOTFOUND && !odb_refresh_missing(db, NULL))
 		error = read_prefix_1(out, db, &key, len, true);
 
 	if (error == GIT_ENOTFOUND)
@@ -1924,7 +2603,6 @@ void git_odb_backend_data_free(git_odb_backend *backend, void *data)
 
 int git_odb_refresh(struct git_odb *db)
 {
-	size_t i;
 	int error;
 
 	GIT_ASSERT_ARG(db);
@@ -1933,18 +2611,25 @@ int git_odb_refresh(struct git_odb *db)
 		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
 		return error;
 	}
-	for (i = 0; i < db->backends.length; ++i) {
-		backend_internal *internal = git_vector_get(&db->backends, i);
-		git_odb_backend *b = internal->backend;
 
-		if (b->refresh != NULL) {
-			int error = b->refresh(b);
-			if (error < 0) {
-				git_mutex_unlock(&db->lock);
-				return error;
-			}
-		}
+	/*
+	 * Note the state of the pack directories before looking at them,
+	 * so that any packfile that arrives during the refresh is noticed.
+	 */
+	if (missing_dirs_stamp(db) < 0) {
+		git_mutex_unlock(&db->lock);
+		return -1;
 	}
+
+	missing_clear(&db->missing);
+	db->missing.last_refresh = git_time_monotonic();
+	git_atomic_ssize_add(&refresh_count, 1);
+
+	if ((error = odb_refresh_backends(db, true)) < 0) {
+		git_mutex_unlock(&db->lock);
+		return error;
+	}
+
 	if (db->cgraph)
 		git_commit_graph_refresh(db->cgraph);
 	git_mutex_unlock(&db->lock);
@@ -15,9 +15,11 @@
 #include "git2/types.h"
 #include "git2/sys/commit_graph.h"
 
+#include "array.h"
 #include "cache.h"
 #include "commit_graph.h"
 #include "filter.h"
+#include "futils.h"
 #include "posix.h"
 #include "vector.h"
 
@@ -29,6 +31,8 @@
 #define GIT_ODB_DEFAULT_PACKED_PRIORITY 2
 
 extern bool git_odb__strict_hash_verification;
+extern bool git_odb__loose_object_cache;
+extern uint64_t git_odb__refresh_interval;
 
 /* DO NOT EXPORT */
 typedef struct {
@@ -43,6 +47,30 @@ struct git_odb_object {
 	void *buffer;
 };
 
+/* A pack directory, as it was when the ODB was last refreshed */
+typedef struct {
+	char *path;
+	git_futils_filestamp stamp;
+} git_odb_missing_dir;
+
+/*
+ * A Bloom filter of the object ids that could not be found in the ODB
+ * even after it was refreshed, so that looking for them again does not
+ * refresh it again.  It is emptied whenever the ODB is refreshed, and
+ * is only trusted while the pack directories (those of the alternates
+ * included) are unchanged; the backends without one, like the loose
+ * backend, are still refreshed when it is.
+ */
+typedef struct {
+	uint64_t *bits;
+	size_t count;
+
+	/* When the ODB was last refreshed, for rate limiting */
+	uint64_t last_refresh;
+
+	git_array_t(git_odb_missing_dir) pack_dirs;
+} git_odb_missing;
+
 /* EXPORT */
 struct git_odb {
 	git_refcount rc;
@@ -51,6 +79,8 @@ struct git_odb {
 	git_vector backends;
 	git_cache own_cache;
 	git_commit_graph *cgraph;
+	git_odb_bulk *bulk; /* the open bulk-write transaction, if any */
+	git_odb_missing missing; /* protected by the lock */
 	unsigned int do_fsync :1;
 };
 
@@ -76,6 +106,12 @@ int git_odb__add_default_backends(
  */
 int git_odb__hashobj(git_oid *id, git_rawobj *obj, git_oid_t oid_type);
 
+/*
+ * Hash many `git_rawobj`s, writing the id of each into `ids`.  This
+ * hashes several of them at once where the processor allows it.
+ */
+int git_odb__hashobj_many(git_oid *ids, git_rawobj *objs, size_t count, git_oid_t oid_type);
+
 /*
  * Format the object header such as it would appear in the on-disk object
  */
@@ -152,6 +188,49 @@ int git_odb__read_header_or_object(
  */
 int git_odb__get_commit_graph_file(git_commit_graph_file **out, git_odb *odb);
 
+struct git_pack_entry;
+
+/*
+ * Find where the given object is stored in one of the packfiles of the
+ * ODB's pack backends.  The packfile is still owned by its backend.
+ * Returns GIT_ENOTFOUND if the object is not in any of them.
+ */
+int git_odb__find_pack_entry(
+	struct git_pack_entry *out, git_odb *db, const git_oid *id);
+
+/*
+ * Find the packfile entry for the given object, if `backend` is a pack
+ * backend.  Returns GIT_PASSTHROUGH for any other kind of backend.
+ */
+int git_odb_backend__pack_entry(
+	struct git_pack_entry *out, git_odb_backend *backend, const git_oid *id);
+
+/*
+ * Find the directory that the packfiles of the ODB's (non-alternate)
+ * pack backend are stored in.  Returns GIT_ENOTFOUND if there is none.
+ */
+int git_odb__pack_folder(git_str *out, git_odb *db);
+
+/*
+ * The folder that a pack backend stores its packfiles in.  Returns
+ * GIT_PASSTHROUGH for any other kind of backend.
+ */
+int git_odb_backend__pack_folder(const char **out, git_odb_backend *backend);
+
+/*
+ * Remove a backend from the ODB, handing it back to the caller (which
+ * becomes responsible for freeing it).
+ */
+int git_odb__remove_backend(git_odb *db, git_odb_backend *backend);
+
+/*
+ * The number of times that object databases were refreshed, the number
+ * of lookups for missing objects that did not need to refresh because
+ * the object was known to be missing, and the number that did not
+ * because the last refresh was too recent.
+ */
+void git_odb__refresh_stats(size_t *refreshes, size_t *missing_hits, size_t *rate_limited);
+
 /* freshen an entry in the object database */
 int git_odb__freshen(git_odb *db, const git_oid *id);
 
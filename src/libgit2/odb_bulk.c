@@ -0,0 +1,749 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+
+#include <zlib.h>
+
+#include "git2/odb.h"
+#include "git2/sys/odb_backend.h"
+#include "filebuf.h"
+#include "futils.h"
+#include "hash.h"
+#include "odb.h"
+#include "oidmap.h"
+#include "pack.h"
+#include "pool.h"
+#include "vector.h"
+#include "zstream.h"
+
+/*
+ * The bulk backend is consulted before the ODB's own backends, so
+ * that it is the one that `git_odb_write` writes to.
+ */
+#define GIT_ODB_BULK_PRIORITY 1000
+
+#define BULK_READ_BUFFER_SIZE (64 * 1024)
+
+#define UINT31_MAX (0x7FFFFFFF)
+
+struct bulk_entry {
+	git_oid id;
+	off64_t offset;      /* start of the entry's header */
+	off64_t data_offset; /* start of its compressed data */
+	off64_t end;
+	size_t size;
+	git_object_t type;
+	uint32_t crc;
+};
+
+/*
+ * A bulk-write transaction.  It acts as an ODB backend while it is
+ * open, appending each object that is written to a temporary packfile
+ * (undeltified) and reading them back from there; the index is only
+ * written when the transaction is committed.
+ */
+struct git_odb_bulk {
+	git_odb_backend parent;
+
+	git_odb *odb;
+	git_oid_t oid_type;
+	git_mutex lock; /* protects everything below */
+
+	git_str pack_dir;
+	git_str tmp_path;
+	int fd;
+	off64_t size;
+
+	git_pool entry_pool;
+	git_vector entries;
+	git_oidmap *entry_map;
+	git_str compressed;
+
+	unsigned int added : 1,
+	             committed : 1;
+};
+
+static int bulk_write_at(
+	git_odb_bulk *bulk,
+	const void *data,
+	size_t len,
+	off64_t offset)
+{
+	const unsigned char *ptr = data;
+	ssize_t written;
+
+	while (len > 0) {
+		if ((written = p_pwrite(bulk->fd, ptr, len, offset)) < 0) {
+			git_error_set(GIT_ERROR_OS, "failed to write to packfile '%s'",
+				bulk->tmp_path.ptr);
+			return -1;
+		}
+
+		ptr += written;
+		len -= written;
+		offset += written;
+	}
+
+	return 0;
+}
+
+static int bulk_read_at(
+	git_odb_bulk *bulk,
+	void *data,
+	size_t len,
+	off64_t offset)
+{
+	unsigned char *ptr = data;
+	ssize_t read_len;
+
+	while (len > 0) {
+		if ((read_len = p_pread(bulk->fd, ptr, len, offset)) <= 0) {
+			git_error_set(GIT_ERROR_OS, "failed to read from packfile '%s'",
+				bulk->tmp_path.ptr);
+			return -1;
+		}
+
+		ptr += read_len;
+		len -= read_len;
+		offset += read_len;
+	}
+
+	return 0;
+}
+
+static int bulk_entry_find(
+	struct bulk_entry **out,
+	git_odb_bulk *bulk,
+	const git_oid *id)
+{
+	/* Once committed, the objects are read from the new pack */
+	if (bulk->committed ||
+	    (*out = git_oidmap_get(bulk->entry_map, id)) == NULL)
+		return git_odb__error_notfound(
+			"object not found in bulk-write packfile", id,
+			git_oid_hexsize(bulk->oid_type));
+
+	return 0;
+}
+
+static int bulk_backend__read(
+	void **buffer_p,
+	size_t *len_p,
+	git_object_t *type_p,
+	git_odb_backend *backend,
+	const git_oid *id)
+{
+	git_odb_bulk *bulk = (git_odb_bulk *)backend;
+	struct bulk_entry *entry;
+	git_str compressed = GIT_STR_INIT, data = GIT_STR_INIT;
+	size_t len;
+	int error;
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	if ((error = bulk_entry_find(&entry, bulk, id)) < 0)
+		goto done;
+
+	len = (size_t)(entry->end - entry->data_offset);
+
+	if ((error = git_str_grow(&compressed, len)) < 0 ||
+	    (error = bulk_read_at(bulk, compressed.ptr, len, entry->data_offset)) < 0 ||
+	    (error = git_zstream_inflatebuf(&data, compressed.ptr, len)) < 0)
+		goto done;
+
+	if (data.size != entry->size) {
+		git_error_set(GIT_ERROR_ODB, "corrupt object in bulk-write packfile");
+		error = -1;
+		goto done;
+	}
+
+	*len_p = data.size;
+	*type_p = entry->type;
+	*buffer_p = git_str_detach(&data);
+
+done:
+	git_mutex_unlock(&bulk->lock);
+	git_str_dispose(&compressed);
+	git_str_dispose(&data);
+	return error;
+}
+
+static int bulk_backend__read_header(
+	size_t *len_p,
+	git_object_t *type_p,
+	git_odb_backend *backend,
+	const git_oid *id)
+{
+	git_odb_bulk *bulk = (git_odb_bulk *)backend;
+	struct bulk_entry *entry;
+	int error;
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	if ((error = bulk_entry_find(&entry, bulk, id)) == 0) {
+		*len_p = entry->size;
+		*type_p = entry->type;
+	}
+
+	git_mutex_unlock(&bulk->lock);
+	return error;
+}
+
+static int bulk_backend__exists(git_odb_backend *backend, const git_oid *id)
+{
+	git_odb_bulk *bulk = (git_odb_bulk *)backend;
+	int found;
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	found = !bulk->committed && git_oidmap_exists(bulk->entry_map, id);
+
+	git_mutex_unlock(&bulk->lock);
+	return found;
+}
+
+/* zlib takes the length as a uInt, so feed it larger objects in parts */
+static uint32_t bulk_crc32(uint32_t crc, const unsigned char *data, size_t len)
+{
+	while (len) {
+		uInt chunk = (uInt)min(len, UINT_MAX);
+
+		crc = crc32(crc, data, chunk);
+		data += chunk;
+		len -= chunk;
+	}
+
+	return crc;
+}
+
+static int bulk_backend__write(
+	git_odb_backend *backend,
+	const git_oid *id,
+	const void *data,
+	size_t len,
+	git_object_t type)
+{
+	git_odb_bulk *bulk = (git_odb_bulk *)backend;
+	struct bulk_entry *entry;
+	unsigned char hdr[64];
+	size_t hdr_len;
+	uint32_t crc;
+	int error;
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	/* Once the packfile is finished, leave writes to the others */
+	if (bulk->committed) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	if (git_oidmap_exists(bulk->entry_map, id)) {
+		error = 0;
+		goto done;
+	}
+
+	if (bulk->entries.length >= UINT32_MAX) {
+		git_error_set(GIT_ERROR_ODB, "too many objects in bulk-write transaction");
+		error = -1;
+		goto done;
+	}
+
+	git_str_clear(&bulk->compressed);
+
+	if ((error = git_packfile__object_header(&hdr_len, hdr, len, type)) < 0 ||
+	    (error = git_zstream_deflatebuf(&bulk->compressed, data, len)) < 0)
+		goto done;
+
+	crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, hdr, (uInt)hdr_len);
+	crc = bulk_crc32(crc, (const unsigned char *)bulk->compressed.ptr,
+		bulk->compressed.size);
+
+	if ((error = bulk_write_at(bulk, hdr, hdr_len, bulk->size)) < 0 ||
+	    (error = bulk_write_at(bulk, bulk->compressed.ptr,
+			bulk->compressed.size, bulk->size + hdr_len)) < 0)
+		goto done;
+
+	if ((entry = git_pool_mallocz(&bulk->entry_pool, 1)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	git_oid_cpy(&entry->id, id);
+	entry->offset = bulk->size;
+	entry->data_offset = bulk->size + hdr_len;
+	entry->end = entry->data_offset + bulk->compressed.size;
+	entry->size = len;
+	entry->type = type;
+	entry->crc = crc;
+
+	if ((error = git_vector_insert(&bulk->entries, entry)) < 0 ||
+	    (error = git_oidmap_set(bulk->entry_map, &entry->id, entry)) < 0)
+		goto done;
+
+	bulk->size = entry->end;
+
+done:
+	git_mutex_unlock(&bulk->lock);
+	return error;
+}
+
+static int bulk_backend__foreach(
+	git_odb_backend *backend,
+	git_odb_foreach_cb cb,
+	void *payload)
+{
+	git_odb_bulk *bulk = (git_odb_bulk *)backend;
+	git_array_t(git_oid) ids = GIT_ARRAY_INIT;
+	struct bulk_entry *entry;
+	git_oid *id;
+	size_t i;
+	int error = 0;
+
+	/* Don't hold the lock while calling back, in case they write */
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		if (bulk->committed)
+			break;
+
+		if ((id = git_array_alloc(ids)) == NULL) {
+			error = -1;
+			break;
+		}
+
+		git_oid_cpy(id, &entry->id);
+	}
+
+	git_mutex_unlock(&bulk->lock);
+
+	if (error < 0)
+		goto done;
+
+	git_array_foreach(ids, i, id) {
+		if ((error = cb(id, payload)) != 0) {
+			git_error_set_after_callback(error);
+			break;
+		}
+	}
+
+done:
+	git_array_clear(ids);
+	return error;
+}
+
+static void bulk_backend__free(git_odb_backend *backend)
+{
+	/* The transaction owns itself; see `git_odb_bulk_free` */
+	GIT_UNUSED(backend);
+}
+
+int git_odb_bulk_new(git_odb_bulk **out, git_odb *db)
+{
+	git_odb_bulk *bulk;
+	git_str pack_prefix = GIT_STR_INIT;
+	struct git_pack_header hdr = {0};
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(db);
+
+	bulk = git__calloc(1, sizeof(git_odb_bulk));
+	GIT_ERROR_CHECK_ALLOC(bulk);
+
+	bulk->fd = -1;
+	bulk->oid_type = db->options.oid_type;
+
+	if ((error = git_mutex_init(&bulk->lock)) < 0 ||
+	    (error = git_pool_init(&bulk->entry_pool, sizeof(struct bulk_entry))) < 0 ||
+	    (error = git_vector_init(&bulk->entries, 0, NULL)) < 0 ||
+	    (error = git_oidmap_new(&bulk->entry_map)) < 0)
+		goto on_error;
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		goto on_error;
+	}
+
+	if (db->bulk) {
+		git_error_set(GIT_ERROR_ODB, "a bulk-write transaction is already open");
+		error = GIT_ELOCKED;
+	} else {
+		db->bulk = bulk;
+	}
+
+	git_mutex_unlock(&db->lock);
+
+	if (error < 0)
+		goto on_error;
+
+	GIT_REFCOUNT_INC(db);
+	bulk->odb = db;
+
+	if ((error = git_odb__pack_folder(&bulk->pack_dir, db)) < 0 ||
+	    (error = git_str_joinpath(&pack_prefix, bulk->pack_dir.ptr, "pack")) < 0)
+		goto on_error;
+
+	if ((bulk->fd = git_futils_mktmp(&bulk->tmp_path,
+			pack_prefix.ptr, GIT_PACK_FILE_MODE)) < 0) {
+		error = -1;
+		goto on_error;
+	}
+
+	/* A placeholder until the number of objects is known */
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(PACK_VERSION);
+
+	if ((error = bulk_write_at(bulk, &hdr, sizeof(hdr), 0)) < 0)
+		goto on_error;
+
+	bulk->size = sizeof(hdr);
+
+	bulk->parent.version = GIT_ODB_BACKEND_VERSION;
+	bulk->parent.read = &bulk_backend__read;
+	bulk->parent.read_header = &bulk_backend__read_header;
+	bulk->parent.write = &bulk_backend__write;
+	bulk->parent.exists = &bulk_backend__exists;
+	bulk->parent.foreach = &bulk_backend__foreach;
+	bulk->parent.free = &bulk_backend__free;
+
+	if ((error = git_odb_add_backend(db, &bulk->parent, GIT_ODB_BULK_PRIORITY)) < 0)
+		goto on_error;
+
+	bulk->added = 1;
+
+	*out = bulk;
+	git_str_dispose(&pack_prefix);
+	return 0;
+
+on_error:
+	git_str_dispose(&pack_prefix);
+	git_odb_bulk_free(bulk);
+	return error;
+}
+
+static int bulk_entry_cmp(const void *a, const void *b)
+{
+	const struct bulk_entry *entry_a = a, *entry_b = b;
+
+	return git_oid_cmp(&entry_a->id, &entry_b->id);
+}
+
+static int bulk_write_trailer(unsigned char *checksum, git_odb_bulk *bulk)
+{
+	git_hash_ctx ctx;
+	struct git_pack_header hdr;
+	unsigned char *buf;
+	off64_t offset = 0;
+	size_t len;
+	int error;
+
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(PACK_VERSION);
+	hdr.hdr_entries = htonl((uint32_t)bulk->entries.length);
+
+	if ((error = bulk_write_at(bulk, &hdr, sizeof(hdr), 0)) < 0)
+		return error;
+
+	buf = git__malloc(BULK_READ_BUFFER_SIZE);
+	GIT_ERROR_CHECK_ALLOC(buf);
+
+	if ((error = git_hash_ctx_init(&ctx,
+			git_hash_checksum_algorithm(git_oid_algorithm(bulk->oid_type)))) < 0) {
+		git__free(buf);
+		return error;
+	}
+
+	while (offset < bulk->size) {
+		len = (size_t)min(BULK_READ_BUFFER_SIZE, bulk->size - offset);
+
+		if ((error = bulk_read_at(bulk, buf, len, offset)) < 0 ||
+		    (error = git_hash_update(&ctx, buf, len)) < 0)
+			goto done;
+
+		offset += len;
+	}
+
+	if ((error = git_hash_final(checksum, &ctx)) < 0)
+		goto done;
+
+	error = bulk_write_at(bulk, checksum,
+		git_oid_size(bulk->oid_type), bulk->size);
+
+done:
+	git__free(buf);
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
+static int bulk_write_index(
+	git_odb_bulk *bulk,
+	const char *path,
+	const unsigned char *checksum)
+{
+	git_filebuf index_file = GIT_FILEBUF_INIT;
+	struct git_pack_idx_header hdr;
+	struct bulk_entry *entry;
+	uint32_t fanout[256] = {0}, long_offsets = 0, n;
+	unsigned char idx_checksum[GIT_HASH_MAX_SIZE];
+	size_t checksum_size = git_oid_size(bulk->oid_type), i;
+	int flags = git_filebuf_hash_flags(git_oid_algorithm(bulk->oid_type));
+
+	if (bulk->odb->do_fsync)
+		flags |= GIT_FILEBUF_FSYNC;
+
+	git_vector_set_cmp(&bulk->entries, bulk_entry_cmp);
+	git_vector_sort(&bulk->entries);
+
+	git_vector_foreach(&bulk->entries, i, entry)
+		fanout[entry->id.id[0]]++;
+
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+
+	if (git_filebuf_open(&index_file, path, flags, GIT_PACK_FILE_MODE) < 0)
+		return -1;
+
+	hdr.idx_signature = htonl(PACK_IDX_SIGNATURE);
+	hdr.idx_version = htonl(2);
+	git_filebuf_write(&index_file, &hdr, sizeof(hdr));
+
+	for (i = 0; i < 256; i++) {
+		n = htonl(fanout[i]);
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry)
+		git_filebuf_write(&index_file, entry->id.id, checksum_size);
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		n = htonl(entry->crc);
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		if (entry->offset > UINT31_MAX)
+			n = htonl(0x80000000 | long_offsets++);
+		else
+			n = htonl((uint32_t)entry->offset);
+
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		uint32_t split[2];
+
+		if (entry->offset <= UINT31_MAX)
+			continue;
+
+		split[0] = htonl((uint32_t)(entry->offset >> 32));
+		split[1] = htonl((uint32_t)(entry->offset & 0xffffffff));
+
+		git_filebuf_write(&index_file, &split, sizeof(split));
+	}
+
+	git_filebuf_write(&index_file, checksum, checksum_size);
+
+	if (git_filebuf_hash(idx_checksum, &index_file) < 0)
+		goto on_error;
+
+	git_filebuf_write(&index_file, idx_checksum, checksum_size);
+
+	if (git_filebuf_commit(&index_file) < 0)
+		goto on_error;
+
+	return 0;
+
+on_error:
+	git_filebuf_cleanup(&index_file);
+	return -1;
+}
+
+static int bulk_detach(git_odb_bulk *bulk)
+{
+	int error = 0;
+
+	if (bulk->added) {
+		error = git_odb__remove_backend(bulk->odb, &bulk->parent);
+		bulk->added = 0;
+	}
+
+	if (bulk->odb && git_mutex_lock(&bulk->odb->lock) == 0) {
+		if (bulk->odb->bulk == bulk)
+			bulk->odb->bulk = NULL;
+
+		git_mutex_unlock(&bulk->odb->lock);
+	}
+
+	return error;
+}
+
+static int bulk_reopen(git_odb_bulk *bulk)
+{
+	if (bulk->fd >= 0)
+		return 0;
+
+	if ((bulk->fd = p_open(bulk->tmp_path.ptr, O_RDWR | O_BINARY | O_CLOEXEC)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to reopen packfile '%s'",
+			bulk->tmp_path.ptr);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bulk_finish(git_odb_bulk *bulk)
+{
+	git_str pack_path = GIT_STR_INIT, index_path = GIT_STR_INIT;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char name[GIT_HASH_MAX_SIZE * 2 + 1];
+	int error;
+
+	if (bulk->entries.length == 0) {
+		p_close(bulk->fd);
+		bulk->fd = -1;
+
+		p_unlink(bulk->tmp_path.ptr);
+		bulk->committed = 1;
+		return 0;
+	}
+
+	if ((error = bulk_write_trailer(checksum, bulk)) < 0)
+		goto done;
+
+	if (bulk->odb->do_fsync && p_fsync(bulk->fd) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to fsync packfile");
+		error = -1;
+		goto done;
+	}
+
+	if (p_close(bulk->fd) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to close packfile");
+		bulk->fd = -1;
+		error = -1;
+		goto done;
+	}
+
+	bulk->fd = -1;
+
+	if ((error = git_hash_fmt(name, checksum, git_oid_size(bulk->oid_type))) < 0 ||
+	    (error = git_str_printf(&pack_path, "%s/pack-%s.pack", bulk->pack_dir.ptr, name)) < 0 ||
+	    (error = git_str_printf(&index_path, "%s/pack-%s.idx", bulk->pack_dir.ptr, name)) < 0)
+		goto done;
+
+	/*
+	 * The index must not appear before the packfile that it describes;
+	 * nor may the packfile stay without one if it cannot be written,
+	 * so it goes back to where it was.
+	 */
+	if ((error = p_rename(bulk->tmp_path.ptr, pack_path.ptr)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to rename packfile to '%s'", pack_path.ptr);
+		goto done;
+	}
+
+	if ((error = bulk_write_index(bulk, index_path.ptr, checksum)) < 0) {
+		if (p_rename(pack_path.ptr, bulk->tmp_path.ptr) < 0)
+			p_unlink(pack_path.ptr);
+
+		goto done;
+	}
+
+	bulk->committed = 1;
+
+	if (bulk->odb->do_fsync)
+		error = git_futils_fsync_parent(pack_path.ptr);
+
+done:
+	/* Keep the objects readable if the transaction stays open */
+	if (error < 0 && !bulk->committed && bulk_reopen(bulk) < 0)
+		git_error_set(GIT_ERROR_ODB,
+			"failed to commit bulk-write transaction; its objects were lost");
+
+	git_str_dispose(&pack_path);
+	git_str_dispose(&index_path);
+	return error;
+}
+
+int git_odb_bulk_commit(git_odb_bulk *bulk)
+{
+	int error, detach_error;
+
+	GIT_ASSERT_ARG(bulk);
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk-write transaction");
+		return -1;
+	}
+
+	if (bulk->committed) {
+		git_error_set(GIT_ERROR_ODB, "the bulk-write transaction was already committed");
+		git_mutex_unlock(&bulk->lock);
+		return -1;
+	}
+
+	/*
+	 * The transaction stays in the ODB until its objects can be read
+	 * from the new pack (the lock keeps it from being read or written
+	 * while the packfile is finished).  If it cannot be finished, the
+	 * transaction stays open, with all of its objects.
+	 */
+	error = bulk_finish(bulk);
+	git_mutex_unlock(&bulk->lock);
+
+	if (!bulk->committed)
+		return error;
+
+	if (!error && bulk->entries.length > 0)
+		error = git_odb_refresh(bulk->odb);
+
+	if ((detach_error = bulk_detach(bulk)) < 0 && !error)
+		error = detach_error;
+
+	return error;
+}
+
+void git_odb_bulk_free(git_odb_bulk *bulk)
+{
+	if (!bulk)
+		return;
+
+	bulk_detach(bulk);
+
+	if (bulk->fd >= 0)
+		p_close(bulk->fd);
+
+	if (!bulk->committed && bulk->tmp_path.size)
+		p_unlink(bulk->tmp_path.ptr);
+
+	git_odb_free(bulk->odb);
+
+	git_str_dispose(&bulk->pack_dir);
+	git_str_dispose(&bulk->tmp_path);
+	git_str_dispose(&bulk->compressed);
+	git_oidmap_free(bulk->entry_map);
+	git_vector_free(&bulk->entries);
+	git_pool_clear(&bulk->entry_pool);
+	git_mutex_free(&bulk->lock);
+	git__free(bulk);
+}
@@ -16,6 +16,7 @@
 #include "delta.h"
 #include "filebuf.h"
 #include "object.h"
+#include "array.h"
 #include "zstream.h"
 
 #include "git2/odb_backend.h"
@@ -43,12 +44,29 @@ typedef struct {
 	git_zstream zstream;
 } loose_readstream;
 
+/*
+ * The cached listing of one `objects/xx/` fanout directory, kept as a
+ * sorted array of object ids.  A listing is marked stale when the
+ * backend is refreshed, and is read again only if the directory has
+ * changed since.
+ */
+typedef struct {
+	git_futils_filestamp stamp;
+	git_array_t(git_oid) ids;
+	unsigned int loaded : 1,
+	             stale : 1;
+} loose_cache_dir;
+
 typedef struct loose_backend {
 	git_odb_backend parent;
 
 	git_odb_backend_loose_options options;
 	size_t oid_hexsize;
 
+	/* The directory listings, when GIT_ODB_BACKEND_LOOSE_CACHE is set */
+	loose_cache_dir *cache;
+	git_mutex cache_lock;
+
 	size_t objects_dirlen;
 	char objects_dir[GIT_FLEX_ARRAY];
 } loose_backend;
@@ -273,6 +291,41 @@ done:
 	return error;
 }
 
+/*
+ * Inflate a whole loose object, whose header we have parsed, in one go.
+ * Returns `GIT_EBUFS` if it has to be streamed instead.
+ */
+static int read_loose_known(
+	git_rawobj *out,
+	git_str *obj,
+	obj_hdr *hdr,
+	size_t head_len)
+{
+	unsigned char *data;
+	size_t alloc_size, used;
+	int error;
+
+	GIT_ERROR_CHECK_ALLOC_ADD3(&alloc_size, head_len, hdr->size, 1);
+	data = git__malloc(alloc_size);
+	GIT_ERROR_CHECK_ALLOC(data);
+
+	if ((error = git_zstream_inflate_known(&used, data,
+			head_len + hdr->size,
+			git_str_cstr(obj), git_str_len(obj))) < 0) {
+		git__free(data);
+		return error;
+	}
+
+	memmove(data, data + head_len, hdr->size);
+	data[hdr->size] = '\0';
+
+	out->data = data;
+	out->len = hdr->size;
+	out->type = hdr->type;
+
+	return 0;
+}
+
 static int read_loose_standard(git_rawobj *out, git_str *obj)
 {
 	git_zstream zstream = GIT_ZSTREAM_INIT;
@@ -302,6 +355,9 @@ static int read_loose_standard(git_rawobj *out, git_str *obj)
 		goto done;
 	}
 
+	if ((error = read_loose_known(out, obj, &hdr, head_len)) != GIT_EBUFS)
+		goto done;
+
 	/*
 	 * allocate a buffer and inflate the object data into it
 	 * (including the initial sequence in the head buffer).
@@ -448,6 +504,234 @@ done:
 	return error;
 }
 
+/***********************************************************
+ *
+ * DIRECTORY LISTING CACHE
+ *
+ ***********************************************************/
+
+struct cache_load_state {
+	loose_backend *backend;
+	loose_cache_dir *dir;
+	size_t dir_len;
+	char hex[GIT_OID_MAX_HEXSIZE];
+};
+
+static int cache_load_cb(void *payload, git_str *path)
+{
+	struct cache_load_state *state = payload;
+	size_t hex_size = state->backend->oid_hexsize;
+	git_oid *id;
+
+	/* Skip anything that cannot be an object, like temporary files */
+	if (git_str_len(path) - state->dir_len != hex_size - 2)
+		return 0;
+
+	memcpy(state->hex + 2, path->ptr + state->dir_len, hex_size - 2);
+
+	id = git_array_alloc(state->dir->ids);
+	GIT_ERROR_CHECK_ALLOC(id);
+
+	if (git_oid__fromstrn(id, state->hex, hex_size, state->backend->options.oid_type) < 0) {
+		git_error_clear();
+		state->dir->ids.size--;
+	}
+
+	return 0;
+}
+
+static int cache_id_cmp(const void *a, const void *b, void *payload)
+{
+	GIT_UNUSED(payload);
+	return git_oid_cmp(a, b);
+}
+
+/* Must be called with the cache lock held */
+static int cache_dir_load(
+	loose_cache_dir **out,
+	loose_backend *backend,
+	const git_oid *id)
+{
+	struct cache_load_state state;
+	loose_cache_dir *dir = &backend->cache[id->id[0]];
+	git_str path = GIT_STR_INIT;
+	int error;
+
+	*out = dir;
+
+	if (dir->loaded && !dir->stale)
+		return 0;
+
+	git_oid_fmt(state.hex, id);
+
+	if (git_str_set(&path, backend->objects_dir, backend->objects_dirlen) < 0 ||
+	    git_str_put(&path, state.hex, 2) < 0 ||
+	    git_str_putc(&path, '/') < 0) {
+		error = -1;
+		goto done;
+	}
+
+	/*
+	 * Only read the directory again if it has changed since it was
+	 * last read; a directory that does not exist has no objects.
+	 */
+	error = git_futils_filestamp_check(&dir->stamp, path.ptr);
+
+	if (error == GIT_ENOTFOUND) {
+		git_futils_filestamp_set(&dir->stamp, NULL);
+		git_array_clear(dir->ids);
+	} else if (error == 1 || !dir->loaded) {
+		state.backend = backend;
+		state.dir = dir;
+		state.dir_len = git_str_len(&path);
+
+		dir->ids.size = 0;
+
+		if ((error = git_fs_path_direach(&path, 0, cache_load_cb, &state)) < 0) {
+			git_futils_filestamp_set(&dir->stamp, NULL);
+			git_array_clear(dir->ids);
+			dir->loaded = 0;
+			goto done;
+		}
+
+		git__qsort_r(dir->ids.ptr, dir->ids.size, sizeof(git_oid), cache_id_cmp, NULL);
+	}
+
+	dir->loaded = 1;
+	dir->stale = 0;
+	error = 0;
+
+done:
+	git_str_dispose(&path);
+	return error;
+}
+
+/* Order two ids by their first `len` hex digits */
+static int cache_id_ncmp(const git_oid *a, const git_oid *b, size_t len)
+{
+	int cmp;
+
+	if ((cmp = memcmp(a->id, b->id, len / 2)) != 0 || !(len & 1))
+		return cmp;
+
+	return (int)(a->id[len / 2] & 0xf0) - (int)(b->id[len / 2] & 0xf0);
+}
+
+/*
+ * Find the position of the first id in the listing that is not less
+ * than the first `len` hex digits of `id`.
+ */
+static size_t cache_dir_search(
+	loose_cache_dir *dir,
+	const git_oid *id,
+	size_t len)
+{
+	size_t lo = 0, hi = dir->ids.size, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (cache_id_ncmp(&dir->ids.ptr[mid], id, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Look up the (possibly abbreviated) id in the cached listings.
+ * Returns 0 and the full id if there is exactly one match.
+ */
+static int cache_lookup(
+	git_oid *out,
+	loose_backend *backend,
+	const git_oid *id,
+	size_t len)
+{
+	loose_cache_dir *dir;
+	size_t pos;
+	int error;
+
+	if (git_mutex_lock(&backend->cache_lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock loose object cache");
+		return -1;
+	}
+
+	if ((error = cache_dir_load(&dir, backend, id)) < 0)
+		goto done;
+
+	pos = cache_dir_search(dir, id, len);
+
+	if (pos >= dir->ids.size ||
+	    cache_id_ncmp(&dir->ids.ptr[pos], id, len) != 0) {
+		error = git_odb__error_notfound("no matching loose object",
+			id, len);
+	} else if (pos + 1 < dir->ids.size &&
+	           cache_id_ncmp(&dir->ids.ptr[pos + 1], id, len) == 0) {
+		error = git_odb__error_ambiguous("multiple matches in loose objects");
+	} else {
+		git_oid_cpy(out, &dir->ids.ptr[pos]);
+	}
+
+done:
+	git_mutex_unlock(&backend->cache_lock);
+	return error;
+}
+
+/* Add an object that we have just written to its cached listing */
+static int cache_insert(loose_backend *backend, const git_oid *id)
+{
+	loose_cache_dir *dir;
+	git_oid *slot;
+	size_t pos;
+	int error = 0;
+
+	if (git_mutex_lock(&backend->cache_lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock loose object cache");
+		return -1;
+	}
+
+	dir = &backend->cache[id->id[0]];
+
+	/* A listing that hasn't been read yet will include it anyway */
+	if (!dir->loaded)
+		goto done;
+
+	pos = cache_dir_search(dir, id, backend->oid_hexsize);
+
+	if (pos < dir->ids.size && git_oid_equal(&dir->ids.ptr[pos], id))
+		goto done;
+
+	if ((slot = git_array_alloc(dir->ids)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	memmove(&dir->ids.ptr[pos + 1], &dir->ids.ptr[pos],
+		(dir->ids.size - 1 - pos) * sizeof(git_oid));
+	git_oid_cpy(&dir->ids.ptr[pos], id);
+
+done:
+	git_mutex_unlock(&backend->cache_lock);
+	return error;
+}
+
+static void cache_free(loose_backend *backend)
+{
+	size_t i;
+
+	if (!backend->cache)
+		return;
+
+	for (i = 0; i < 256; i++)
+		git_array_clear(backend->cache[i].ids);
+
+	git__free(backend->cache);
+	git_mutex_free(&backend->cache_lock);
+}
+
 static int locate_object(
 	git_str *object_location,
 	loose_backend *backend,
@@ -455,6 +739,15 @@ static int locate_object(
 {
 	int error = object_file_name(object_location, backend, oid);
 
+	if (!error && backend->cache) {
+		git_oid found;
+
+		if ((error = cache_lookup(&found, backend, oid, backend->oid_hexsize)) < 0)
+			git_error_clear();
+
+		return error;
+	}
+
 	if (!error && !git_fs_path_exists(object_location->ptr))
 		return GIT_ENOTFOUND;
 
@@ -520,6 +813,13 @@ static int locate_object_short_oid(
 	/* save adjusted position at end of dir so it can be restored later */
 	dir_len = git_str_len(object_location);
 
+	if (backend->cache) {
+		if ((error = cache_lookup(res_oid, backend, short_oid, len)) < 0)
+			return error;
+
+		goto found;
+	}
+
 	/* Convert raw oid to hex formatted oid */
 	git_oid_fmt((char *)state.short_oid, short_oid);
 
@@ -556,6 +856,7 @@ static int locate_object_short_oid(
 	if (error)
 		return error;
 
+found:
 	/* Update the location according to the oid obtained */
 	GIT_ERROR_CHECK_ALLOC_ADD(&alloc_len, dir_len, backend->oid_hexsize);
 	GIT_ERROR_CHECK_ALLOC_ADD(&alloc_len, alloc_len, 2);
@@ -812,6 +1113,9 @@ static int loose_backend__writestream_finalize(git_odb_stream *_stream, const gi
 		error = git_filebuf_commit_at(
 			&stream->fbuf, final_path.ptr);
 
+	if (!error && backend->cache)
+		error = cache_insert(backend, oid);
+
 	git_str_dispose(&final_path);
 
 	return error;
@@ -1107,6 +1411,8 @@ static int loose_backend__write(git_odb_backend *_backend, const git_oid *oid, c
 		object_mkdir(&final_path, backend) < 0 ||
 		git_filebuf_commit_at(&fbuf, final_path.ptr) < 0)
 		error = -1;
+	else if (backend->cache)
+		error = cache_insert(backend, oid);
 
 cleanup:
 	if (error < 0)
@@ -1132,8 +1438,26 @@ static int loose_backend__freshen(
 	return error;
 }
 
+static int loose_backend__refresh(git_odb_backend *_backend)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	size_t i;
+
+	if (git_mutex_lock(&backend->cache_lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock loose object cache");
+		return -1;
+	}
+
+	for (i = 0; i < 256; i++)
+		backend->cache[i].stale = 1;
+
+	git_mutex_unlock(&backend->cache_lock);
+	return 0;
+}
+
 static void loose_backend__free(git_odb_backend *_backend)
 {
+	cache_free((loose_backend *)_backend);
 	git__free(_backend);
 }
 
@@ -1189,6 +1513,18 @@ int git_odb__backend_loose(
 	normalize_options(&backend->options, opts);
 	backend->oid_hexsize = git_oid_hexsize(backend->options.oid_type);
 
+	if (backend->options.flags & GIT_ODB_BACKEND_LOOSE_CACHE) {
+		backend->cache = git__calloc(256, sizeof(loose_cache_dir));
+
+		if (!backend->cache || git_mutex_init(&backend->cache_lock) < 0) {
+			git__free(backend->cache);
+			git__free(backend);
+			return -1;
+		}
+
+		backend->parent.refresh = &loose_backend__refresh;
+	}
+
 	backend->parent.read = &loose_backend__read;
 	backend->parent.write = &loose_backend__write;
 	backend->parent.read_prefix = &loose_backend__read_prefix;
@@ -65,10 +65,11 @@ struct pack_writepack {
  *   | then sorted according to a sorting callback.
  *   |
  *   |-# refresh_multi_pack_index
- *   |   Detect the presence of the `multi-pack-index` file. If it needs to be
- *   |   refreshed, frees the old copy and tries to load the new one, together
- *   |   with all the packfiles it indexes. If the process fails, fall back to
- *   |   the old behavior, as if the `multi-pack-index` file was not there.
+ *   |   Detect the presence of the `multi-pack-index` file, or of a chain of
+ *   |   them in `multi-pack-index.d`. If it needs to be refreshed, frees the
+ *   |   old copy and tries to load the new one, together with all the
+ *   |   packfiles it indexes. If the process fails, fall back to the old
+ *   |   behavior, as if the `multi-pack-index` file was not there.
  *   |
  *   |-# packfile_load__cb
  *   | | This callback is called from `dirent` with every single file
@@ -446,21 +447,60 @@ static int process_multi_pack_index_pack(
 }
 
 /*
- * Reads the multi-pack-index. If this fails for whatever reason, the
- * multi-pack-index object is freed, and all the packfiles that are related to
- * it are moved to the unindexed packfiles vector.
+ * Loads the .pack files referred to by a layer of the multi-pack-index, after
+ * those of the layers below it, so that they are numbered across the chain.
+ */
+static int process_multi_pack_index_layer(
+		struct pack_backend *backend,
+		git_midx_file *layer,
+		size_t *processed)
+{
+	const char *packfile_name;
+	size_t i;
+	int error;
+
+	if (layer->base &&
+	    (error = process_multi_pack_index_layer(backend, layer->base, processed)) < 0)
+		return error;
+
+	git_vector_foreach(&layer->packfile_names, i, packfile_name) {
+		error = process_multi_pack_index_pack(backend, *processed, packfile_name);
+		if (error < 0)
+			return error;
+
+		(*processed)++;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads the multi-pack-index, or the chain of them in `multi-pack-index.d` if
+ * there is one. If this fails for whatever reason, the multi-pack-index object
+ * is freed, and all the packfiles that are related to it are moved to the
+ * unindexed packfiles vector.
  */
 static int refresh_multi_pack_index(struct pack_backend *backend)
 {
 	int error;
 	git_str midx_path = GIT_STR_INIT;
-	const char *packfile_name;
-	size_t i;
+	size_t processed = 0;
+	bool chained;
 
-	error = git_str_joinpath(&midx_path, backend->pack_folder, "multi-pack-index");
+	error = git_str_joinpath(&midx_path, backend->pack_folder, GIT_MIDX_CHAIN_FILE);
 	if (error < 0)
 		return error;
 
+	chained = git_fs_path_isfile(git_str_cstr(&midx_path));
+
+	if (!chained) {
+		error = git_str_joinpath(&midx_path, backend->pack_folder, "multi-pack-index");
+		if (error < 0) {
+			git_str_dispose(&midx_path);
+			return error;
+		}
+	}
+
 	/*
 	 * Check whether the multi-pack-index has changed. If it has, close any
 	 * old multi-pack-index and move all the packfiles to the unindexed
@@ -468,7 +508,9 @@ static int refresh_multi_pack_index(struct pack_backend *backend)
 	 * refreshing the new multi-pack-index fails, or the file is deleted.
 	 */
 	if (backend->midx) {
-		if (!git_midx_needs_refresh(backend->midx, git_str_cstr(&midx_path))) {
+		if (chained ?
+		    !git_midx_chain_needs_refresh(backend->midx, git_str_cstr(&midx_path)) :
+		    !git_midx_needs_refresh(backend->midx, git_str_cstr(&midx_path))) {
 			git_str_dispose(&midx_path);
 			return 0;
 		}
@@ -479,29 +521,33 @@ static int refresh_multi_pack_index(struct pack_backend *backend)
 		}
 	}
 
-	error = git_midx_open(&backend->midx, git_str_cstr(&midx_path),
-		backend->opts.oid_type);
+	if (chained)
+		error = git_midx_open_chain(&backend->midx, git_str_cstr(&midx_path),
+			backend->opts.oid_type);
+	else
+		error = git_midx_open(&backend->midx, git_str_cstr(&midx_path),
+			backend->opts.oid_type);
 
 	git_str_dispose(&midx_path);
 	if (error < 0)
 		return error;
 
-	git_vector_resize_to(&backend->midx_packs, git_vector_length(&backend->midx->packfile_names));
+	git_vector_resize_to(&backend->midx_packs,
+		backend->midx->num_packs_in_base +
+		git_vector_length(&backend->midx->packfile_names));
 
-	git_vector_foreach(&backend->midx->packfile_names, i, packfile_name) {
-		error = process_multi_pack_index_pack(backend, i, packfile_name);
-		if (error < 0) {
-			/*
-			 * Something failed during reading multi-pack-index.
-			 * Restore the state of backend as if the
-			 * multi-pack-index was never there, and move all
-			 * packfiles that have been processed so far to the
-			 * unindexed packs.
-			 */
-			git_vector_resize_to(&backend->midx_packs, i);
-			remove_multi_pack_index(backend);
-			return error;
-		}
+	error = process_multi_pack_index_layer(backend, backend->midx, &processed);
+	if (error < 0) {
+		/*
+		 * Something failed during reading multi-pack-index.
+		 * Restore the state of backend as if the
+		 * multi-pack-index was never there, and move all
+		 * packfiles that have been processed so far to the
+		 * unindexed packs.
+		 */
+		git_vector_resize_to(&backend->midx_packs, processed);
+		remove_multi_pack_index(backend);
+		return error;
 	}
 
 	return 0;
@@ -604,6 +650,303 @@ static int pack_backend__read(
 	return 0;
 }
 
+int git_odb_backend__pack_entry(
+	struct git_pack_entry *out,
+	git_odb_backend *backend,
+	const git_oid *id)
+{
+	if (backend->read != &pack_backend__read)
+		return GIT_PASSTHROUGH;
+
+	return pack_entry_find(out, (struct pack_backend *)backend, id);
+}
+
+int git_odb_backend__pack_folder(const char **out, git_odb_backend *backend)
+{
+	if (backend->read != &pack_backend__read ||
+	    !((struct pack_backend *)backend)->pack_folder)
+		return GIT_PASSTHROUGH;
+
+	*out = ((struct pack_backend *)backend)->pack_folder;
+	return 0;
+}
+
+typedef struct {
+	git_odb_stream stream;
+	git_packfile_stream packstream;
+	git_delta_stream delta;
+	git_rawobj base;
+	size_t remaining;
+	unsigned int is_delta : 1;
+} pack_readstream;
+
+static int pack_backend__readstream_read(
+	git_odb_stream *_stream,
+	char *buffer,
+	size_t buffer_len)
+{
+	pack_readstream *stream = (pack_readstream *)_stream;
+	ssize_t read = 0;
+
+	buffer_len = min(buffer_len, INT_MAX);
+	buffer_len = min(buffer_len, stream->remaining);
+
+	if (stream->is_delta) {
+		read = git_delta_stream_read(&stream->delta, buffer, buffer_len);
+	} else {
+		while (buffer_len && !stream->packstream.done) {
+			off64_t curpos = stream->packstream.curpos;
+
+			read = git_packfile_stream_read(&stream->packstream, buffer, buffer_len);
+
+			if (read != GIT_EBUFS)
+				break;
+
+			/* zlib wanted more input, but there is none */
+			if (stream->packstream.curpos == curpos) {
+				git_error_set(GIT_ERROR_ZLIB, "truncated packed object");
+				return -1;
+			}
+
+			read = 0;
+		}
+	}
+
+	if (read < 0)
+		return (int)read;
+
+	stream->remaining -= (size_t)read;
+
+	if (!read && stream->remaining) {
+		git_error_set(GIT_ERROR_ODB, "packed object is shorter than expected");
+		return -1;
+	}
+
+	return (int)read;
+}
+
+static void pack_backend__readstream_free(git_odb_stream *_stream)
+{
+	pack_readstream *stream = (pack_readstream *)_stream;
+
+	git_packfile_stream_dispose(&stream->packstream);
+	git__free(stream->base.data);
+	git__free(stream);
+}
+
+/*
+ * Undeltified objects are inflated as they are read.  For deltas, the
+ * base is unpacked (from the delta base cache where possible) and the
+ * delta is applied to it while it is being inflated, so that neither
+ * the delta nor the (possibly large) result are held in memory.
+ */
+static int pack_backend__readstream(
+	git_odb_stream **stream_out,
+	size_t *len_out,
+	git_object_t *type_out,
+	git_odb_backend *_backend,
+	const git_oid *oid)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	pack_readstream *stream = NULL;
+	git_hash_ctx *hash_ctx = NULL;
+	git_mwindow *w_curs = NULL;
+	struct git_pack_entry e;
+	off64_t curpos, base_offset;
+	git_object_t type, obj_type;
+	size_t size, obj_size, delta_size;
+	int error;
+
+	GIT_ASSERT_ARG(stream_out);
+	GIT_ASSERT_ARG(len_out);
+	GIT_ASSERT_ARG(type_out);
+	GIT_ASSERT_ARG(_backend);
+	GIT_ASSERT_ARG(oid);
+
+	*stream_out = NULL;
+
+	if ((error = pack_entry_find(&e, backend, oid)) < 0 ||
+	    (error = git_packfile_resolve_header(&obj_size, &obj_type, e.p, e.offset)) < 0)
+		return error;
+
+	stream = git__calloc(1, sizeof(pack_readstream));
+	hash_ctx = git__calloc(1, sizeof(git_hash_ctx));
+
+	if (!stream || !hash_ctx) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_hash_ctx_init(hash_ctx, git_oid_algorithm(backend->opts.oid_type))) < 0)
+		goto done;
+
+	curpos = e.offset;
+
+	if ((error = git_packfile_unpack_header(&size, &type, e.p, &w_curs, &curpos)) < 0)
+		goto done;
+
+	if (type == GIT_OBJECT_OFS_DELTA || type == GIT_OBJECT_REF_DELTA) {
+		error = get_delta_base(&base_offset, e.p, &w_curs, &curpos, type, e.offset);
+		git_mwindow_close(&w_curs);
+
+		if (error < 0 ||
+		    (error = git_packfile_unpack(&stream->base, e.p, &base_offset)) < 0 ||
+		    (error = git_packfile_stream_open(&stream->packstream, e.p, curpos)) < 0 ||
+		    (error = git_delta_stream_init(&stream->delta, &delta_size,
+				&stream->packstream, stream->base.data, stream->base.len)) < 0)
+			goto done;
+
+		if (delta_size != obj_size) {
+			git_error_set(GIT_ERROR_ODB, "delta result size does not match object header");
+			error = -1;
+			goto done;
+		}
+
+		stream->is_delta = 1;
+	} else {
+		git_mwindow_close(&w_curs);
+
+		if ((error = git_packfile_stream_open(&stream->packstream, e.p, curpos)) < 0)
+			goto done;
+	}
+
+	stream->remaining = obj_size;
+	stream->stream.backend = _backend;
+	stream->stream.hash_ctx = hash_ctx;
+	stream->stream.mode = GIT_STREAM_RDONLY;
+	stream->stream.read = &pack_backend__readstream_read;
+	stream->stream.free = &pack_backend__readstream_free;
+
+	*stream_out = (git_odb_stream *)stream;
+	*len_out = obj_size;
+	*type_out = obj_type;
+
+done:
+	if (error < 0) {
+		if (stream) {
+			git_packfile_stream_dispose(&stream->packstream);
+			git__free(stream->base.data);
+			git__free(stream);
+		}
+
+		if (hash_ctx) {
+			git_hash_ctx_cleanup(hash_ctx);
+			git__free(hash_ctx);
+		}
+	}
+
+	return error;
+}
+
+struct pack_read_many_entry {
+	size_t idx;
+	struct git_pack_file *p;
+	off64_t offset;
+};
+
+static int pack_read_many_entry_cmp(const void *a, const void *b, void *payload)
+{
+	const struct pack_read_many_entry *ea = a, *eb = b;
+
+	GIT_UNUSED(payload);
+
+	if (ea->p != eb->p)
+		return (ea->p < eb->p) ? -1 : 1;
+
+	if (ea->offset != eb->offset)
+		return (ea->offset < eb->offset) ? -1 : 1;
+
+	return 0;
+}
+
+#define READ_MANY_PREFETCH 16
+
+static void pack_prefetch(
+	struct pack_backend *backend,
+	const git_oid *ids,
+	size_t count)
+{
+	struct git_pack_file *p = backend->last_found;
+
+	if (backend->midx) {
+		git_midx_entry_prefetch(backend->midx, ids, count);
+		return;
+	}
+
+	if (!p && git_vector_length(&backend->packs) > 0)
+		p = git_vector_get(&backend->packs, 0);
+
+	/* This is only a hint; a failure will show up in the lookup */
+	if (p && git_pack_index_prefetch(p, ids, count) < 0)
+		git_error_clear();
+}
+
+/*
+ * Read the objects of each packfile in the order that they are stored,
+ * rather than in the order that they were asked for: this makes better
+ * use of the mapped windows, and means that the bases that are shared
+ * by several deltas tend to still be in the delta base cache.
+ */
+static int pack_backend__read_many(
+	git_odb_backend *_backend,
+	const git_oid *ids,
+	size_t count,
+	git_odb_backend_read_many_cb cb,
+	void *payload)
+{
+	struct pack_backend *backend = (struct pack_backend *)_backend;
+	struct pack_read_many_entry *entries;
+	struct git_pack_entry e;
+	git_rawobj raw;
+	size_t i, found = 0;
+	int error = 0;
+
+	entries = git__calloc(count, sizeof(struct pack_read_many_entry));
+	GIT_ERROR_CHECK_ALLOC(entries);
+
+	for (i = 0; i < count; i++) {
+		/*
+		 * Get the index pages for the next batch of lookups in
+		 * flight at once, rather than waiting on each in turn.
+		 */
+		if (i % READ_MANY_PREFETCH == 0)
+			pack_prefetch(backend, &ids[i],
+				min(count - i, READ_MANY_PREFETCH));
+
+		if ((error = pack_entry_find(&e, backend, &ids[i])) < 0) {
+			if (error != GIT_ENOTFOUND)
+				goto done;
+
+			error = 0;
+			continue;
+		}
+
+		entries[found].idx = i;
+		entries[found].p = e.p;
+		entries[found].offset = e.offset;
+		found++;
+	}
+
+	git_error_clear();
+
+	git__qsort_r(entries, found, sizeof(struct pack_read_many_entry),
+		pack_read_many_entry_cmp, NULL);
+
+	for (i = 0; i < found; i++) {
+		off64_t offset = entries[i].offset;
+
+		if ((error = git_packfile_unpack(&raw, entries[i].p, &offset)) < 0)
+			goto done;
+
+		if ((error = cb(entries[i].idx, raw.data, raw.len, raw.type, payload)) != 0)
+			goto done;
+	}
+
+done:
+	git__free(entries);
+	return error;
+}
+
 static int pack_backend__read_prefix(
 	git_oid *out_oid,
 	void **buffer_p,
@@ -736,6 +1079,10 @@ static int pack_backend__writepack(struct git_odb_writepack **out,
 	opts.progress_cb = progress_cb;
 	opts.progress_cb_payload = progress_payload;
 
+	/* Index the pack while it is received, and resolve on every core */
+	opts.pipeline = 1;
+	opts.threads = (unsigned int)git__online_cpus();
+
 	backend = (struct pack_backend *)_backend;
 
 	writepack = git__calloc(1, sizeof(struct pack_writepack));
@@ -830,6 +1177,14 @@ static int pack_backend__writemidx(git_odb_backend *_backend)
 			goto cleanup;
 	}
 
+	/*
+	 * If the multi-pack-index is a chain, add a layer to it rather than
+	 * rewrite it all.
+	 */
+	if (backend->midx && backend->midx->chained &&
+	    (error = git_midx_writer_set_incremental(w, 1)) < 0)
+		goto cleanup;
+
 	/*
 	 * Invalidate the previous midx before writing the new one.
 	 */
@@ -899,6 +1254,7 @@ static int pack_backend__alloc(
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.readstream = &pack_backend__readstream;
 	backend->parent.exists = &pack_backend__exists;
 	backend->parent.exists_prefix = &pack_backend__exists_prefix;
 	backend->parent.refresh = &pack_backend__refresh;
@@ -906,6 +1262,7 @@ static int pack_backend__alloc(
 	backend->parent.writepack = &pack_backend__writepack;
 	backend->parent.writemidx = &pack_backend__writemidx;
 	backend->parent.freshen = &pack_backend__freshen;
+	backend->parent.read_many = &pack_backend__read_many;
 	backend->parent.free = &pack_backend__free;
 
 	*out = backend;
@@ -11,7 +11,10 @@
 #include "zstream.h"
 #include "delta.h"
 #include "iterator.h"
+#include "mwindow.h"
+#include "odb.h"
 #include "pack.h"
+#include "pack_bitmap.h"
 #include "thread.h"
 #include "tree.h"
 #include "util.h"
@@ -87,7 +90,7 @@ static unsigned name_hash(const char *name)
 static int packbuilder_config(git_packbuilder *pb)
 {
 	git_config *config;
-	int ret = 0;
+	int ret = 0, use_bitmaps, write_bitmap;
 	int64_t val;
 
 	if ((ret = git_repository_config_snapshot(&config, pb->repo)) < 0)
@@ -118,6 +121,24 @@ static int packbuilder_config(git_packbuilder *pb)
 
 #undef config_get
 
+	if ((ret = git_config_get_bool(&use_bitmaps, config, "pack.useBitmaps")) == GIT_ENOTFOUND) {
+		use_bitmaps = 1;
+		ret = 0;
+	} else if (ret < 0) {
+		goto out;
+	}
+
+	pb->use_bitmaps = !!use_bitmaps;
+
+	if ((ret = git_config_get_bool(&write_bitmap, config, "pack.writeBitmaps")) == GIT_ENOTFOUND) {
+		write_bitmap = 0;
+		ret = 0;
+	} else if (ret < 0) {
+		goto out;
+	}
+
+	pb->write_bitmap = !!write_bitmap;
+
 out:
 	git_config_free(config);
 
@@ -146,8 +167,10 @@ int git_packbuilder_new(git_packbuilder **out, git_repository *repo)
 
 	pb->repo = repo;
 	pb->nr_threads = 1; /* do not spawn any thread by default */
+	pb->ofs_delta = true; /* the transport turns them off if need be */
+	pb->write_memory_limit = GIT_PACK_WRITE_MEMORY;
 
-	if (git_hash_ctx_init(&pb->ctx, hash_algorithm) < 0 ||
+	if (git_hash_ctx_init(&pb->ctx, git_hash_checksum_algorithm(hash_algorithm)) < 0 ||
 		git_zstream_init(&pb->zstream, GIT_ZSTREAM_DEFLATE) < 0 ||
 		git_repository_odb(&pb->odb, repo) < 0 ||
 		packbuilder_config(pb) < 0)
@@ -187,6 +210,22 @@ unsigned int git_packbuilder_set_threads(git_packbuilder *pb, unsigned int n)
 	return pb->nr_threads;
 }
 
+int git_packbuilder_set_write_bitmap(git_packbuilder *pb, int enabled)
+{
+	GIT_ASSERT_ARG(pb);
+
+	pb->write_bitmap = !!enabled;
+	return 0;
+}
+
+int git_packbuilder_set_ofs_delta(git_packbuilder *pb, int enabled)
+{
+	GIT_ASSERT_ARG(pb);
+
+	pb->ofs_delta = !!enabled;
+	return 0;
+}
+
 static int rehash(git_packbuilder *pb)
 {
 	git_pobject *po;
@@ -202,21 +241,17 @@ static int rehash(git_packbuilder *pb)
 	return 0;
 }
 
-int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
-			   const char *name)
+static int packbuilder_insert(
+	git_packbuilder *pb,
+	const git_oid *oid,
+	git_object_t type,
+	size_t size,
+	unsigned int hash)
 {
 	git_pobject *po;
 	size_t newsize;
 	int ret;
 
-	GIT_ASSERT_ARG(pb);
-	GIT_ASSERT_ARG(oid);
-
-	/* If the object already exists in the hash table, then we don't
-	 * have any work to do */
-	if (git_oidmap_exists(pb->object_ix, oid))
-		return 0;
-
 	if (pb->nr_objects >= pb->nr_alloc) {
 		GIT_ERROR_CHECK_ALLOC_ADD(&newsize, pb->nr_alloc, 1024);
 		GIT_ERROR_CHECK_ALLOC_MULTIPLY(&newsize, newsize / 2, 3);
@@ -239,12 +274,11 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 	po = pb->object_list + pb->nr_objects;
 	memset(po, 0x0, sizeof(*po));
 
-	if ((ret = git_odb_read_header(&po->size, &po->type, pb->odb, oid)) < 0)
-		return ret;
-
 	pb->nr_objects++;
 	git_oid_cpy(&po->id, oid);
-	po->hash = name_hash(name);
+	po->type = type;
+	po->size = size;
+	po->hash = hash;
 
 	if (git_oidmap_set(pb->object_ix, &po->id, po) < 0) {
 		git_error_set_oom();
@@ -272,6 +306,27 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 	return 0;
 }
 
+int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
+			   const char *name)
+{
+	git_object_t type;
+	size_t size;
+	int ret;
+
+	GIT_ASSERT_ARG(pb);
+	GIT_ASSERT_ARG(oid);
+
+	/* If the object already exists in the hash table, then we don't
+	 * have any work to do */
+	if (git_oidmap_exists(pb->object_ix, oid))
+		return 0;
+
+	if ((ret = git_odb_read_header(&size, &type, pb->odb, oid)) < 0)
+		return ret;
+
+	return packbuilder_insert(pb, oid, type, size, name_hash(name));
+}
+
 static int get_delta(void **out, git_odb *odb, git_pobject *po)
 {
 	git_odb_object *src = NULL, *trg = NULL;
@@ -310,20 +365,164 @@ on_error:
 	return -1;
 }
 
+struct write_data_context {
+	git_packbuilder *pb;
+	int (*write_cb)(void *buf, size_t size, void *cb_data);
+	void *cb_data;
+};
+
+/* Write some of the pack, keeping track of the checksum and offset */
+static int write_data(
+	struct write_data_context *ctx,
+	const void *data,
+	size_t len)
+{
+	int error;
+
+	if ((error = ctx->write_cb((void *)data, len, ctx->cb_data)) < 0 ||
+	    (error = git_hash_update(&ctx->pb->ctx, data, len)) < 0)
+		return error;
+
+	ctx->pb->write_offset += len;
+	return 0;
+}
+
+/*
+ * Write the object header and, for deltas, the reference to the base:
+ * either its offset (which is always written before its deltas) or,
+ * if offset deltas are disabled, its object ID.
+ */
+static int write_object_header(
+	struct write_data_context *ctx,
+	git_pobject *po,
+	size_t size,
+	git_object_t type)
+{
+	git_packbuilder *pb = ctx->pb;
+	unsigned char hdr[10], ofs[10];
+	size_t hdr_len, pos = sizeof(ofs) - 1;
+	off64_t distance;
+	int error;
+
+	if (po->delta)
+		type = pb->ofs_delta ? GIT_OBJECT_OFS_DELTA : GIT_OBJECT_REF_DELTA;
+
+	if ((error = git_packfile__object_header(&hdr_len, hdr, size, type)) < 0 ||
+	    (error = write_data(ctx, hdr, hdr_len)) < 0)
+		return error;
+
+	if (type == GIT_OBJECT_REF_DELTA)
+		return write_data(ctx, po->delta->id.id, git_oid_size(pb->oid_type));
+
+	if (type != GIT_OBJECT_OFS_DELTA)
+		return 0;
+
+	GIT_ASSERT(po->delta->written && po->delta->offset < po->offset);
+	distance = po->offset - po->delta->offset;
+
+	ofs[pos] = distance & 127;
+	while (distance >>= 7)
+		ofs[--pos] = 128 | (--distance & 127);
+
+	return write_data(ctx, ofs + pos, sizeof(ofs) - pos);
+}
+
+static int reuse_crc_cb(const unsigned char *data, size_t len, void *payload)
+{
+	uint32_t *crc = payload;
+
+	while (len) {
+		uInt chunk = (uInt)min(len, UINT_MAX);
+
+		*crc = crc32(*crc, data, chunk);
+		data += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int reuse_write_cb(const unsigned char *data, size_t len, void *payload)
+{
+	return write_data(payload, data, len);
+}
+
+/*
+ * Check the stored representation of the object against the CRC in its
+ * pack's index.  If it does not match, we forget about it and return
+ * GIT_PASSTHROUGH to have the object packed from scratch.
+ */
+static int verify_reused_object(git_pobject *po)
+{
+	uint32_t crc = crc32(0L, Z_NULL, 0);
+	int error;
+
+	if ((error = git_packfile_foreach_raw(po->reuse_pack,
+			po->reuse_offset, po->reuse_end, reuse_crc_cb, &crc)) < 0)
+		return error;
+
+	if (crc != po->reuse_crc) {
+		po->reuse_pack = NULL;
+
+		if (po->reuse_delta) {
+			po->delta = NULL;
+			po->reuse_delta = 0;
+		}
+
+		return GIT_PASSTHROUGH;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the object's compressed data straight out of the packfile that
+ * it is already stored in, once it has been verified.
+ */
+static int copy_reused_object(
+	struct write_data_context *ctx,
+	git_pobject *po)
+{
+	int error;
+
+	if ((error = write_object_header(ctx, po,
+			po->reuse_delta ? po->delta_size : po->size, po->type)) < 0 ||
+	    (error = git_packfile_foreach_raw(po->reuse_pack,
+			po->reuse_data_offset, po->reuse_end, reuse_write_cb, ctx)) < 0)
+		return error;
+
+	ctx->pb->nr_written++;
+	ctx->pb->nr_reused++;
+	return 0;
+}
+
 static int write_object(
 	git_packbuilder *pb,
 	git_pobject *po,
 	int (*write_cb)(void *buf, size_t size, void *cb_data),
 	void *cb_data)
 {
+	struct write_data_context ctx;
 	git_odb_object *obj = NULL;
 	git_object_t type;
-	unsigned char hdr[10], *zbuf = NULL;
+	unsigned char *zbuf = NULL;
 	void *data = NULL;
-	size_t hdr_len, zbuf_len = COMPRESS_BUFLEN, data_len, oid_size;
+	size_t zbuf_len = COMPRESS_BUFLEN, data_len;
 	int error;
 
-	oid_size = git_oid_size(pb->oid_type);
+	ctx.pb = pb;
+	ctx.write_cb = write_cb;
+	ctx.cb_data = cb_data;
+
+	po->offset = pb->write_offset;
+
+	/*
+	 * Copy the stored representation if we can; a delta that we have
+	 * found ourselves is preferred over a stored full object, though.
+	 */
+	if (po->reuse_pack && (po->reuse_delta || !po->delta) &&
+	    (error = verify_reused_object(po)) != GIT_PASSTHROUGH)
+		return error < 0 ? error : copy_reused_object(&ctx, po);
 
 	/*
 	 * If we have a delta base, let's use the delta to save space.
@@ -337,7 +536,7 @@ static int write_object(
 				goto done;
 
 		data_len = po->delta_size;
-		type = GIT_OBJECT_REF_DELTA;
+		type = po->type;
 	} else {
 		if ((error = git_odb_read(&obj, pb->odb, &po->id)) < 0)
 			goto done;
@@ -348,23 +547,12 @@ static int write_object(
 	}
 
 	/* Write header */
-	if ((error = git_packfile__object_header(&hdr_len, hdr, data_len, type)) < 0 ||
-	    (error = write_cb(hdr, hdr_len, cb_data)) < 0 ||
-	    (error = git_hash_update(&pb->ctx, hdr, hdr_len)) < 0)
+	if ((error = write_object_header(&ctx, po, data_len, type)) < 0)
 		goto done;
 
-	if (type == GIT_OBJECT_REF_DELTA) {
-		if ((error = write_cb(po->delta->id.id, oid_size, cb_data)) < 0 ||
-		    (error = git_hash_update(&pb->ctx, po->delta->id.id, oid_size)) < 0)
-			goto done;
-	}
-
 	/* Write data */
 	if (po->z_delta_size) {
-		data_len = po->z_delta_size;
-
-		if ((error = write_cb(data, data_len, cb_data)) < 0 ||
-			(error = git_hash_update(&pb->ctx, data, data_len)) < 0)
+		if ((error = write_data(&ctx, data, po->z_delta_size)) < 0)
 			goto done;
 	} else {
 		zbuf = git__malloc(zbuf_len);
@@ -377,8 +565,7 @@ static int write_object(
 
 		while (!git_zstream_done(&pb->zstream)) {
 			if ((error = git_zstream_get_output(zbuf, &zbuf_len, &pb->zstream)) < 0 ||
-				(error = write_cb(zbuf, zbuf_len, cb_data)) < 0 ||
-				(error = git_hash_update(&pb->ctx, zbuf, zbuf_len)) < 0)
+				(error = write_data(&ctx, zbuf, zbuf_len)) < 0)
 				goto done;
 
 			zbuf_len = COMPRESS_BUFLEN; /* reuse buffer */
@@ -436,8 +623,14 @@ static int write_one(
 			return error;
 
 		/* we cannot depend on this one */
-		if (*status == WRITE_ONE_RECURSIVE)
+		if (*status == WRITE_ONE_RECURSIVE) {
 			po->delta = NULL;
+
+			if (po->reuse_delta) {
+				po->reuse_pack = NULL;
+				po->reuse_delta = 0;
+			}
+		}
 	}
 
 	*status = WRITE_ONE_WRITTEN;
@@ -447,13 +640,22 @@ static int write_one(
 	return write_object(pb, po, write_cb, cb_data);
 }
 
-GIT_INLINE(void) add_to_write_order(git_pobject **wo, size_t *endp,
+/*
+ * Add the object to the write order, preceded by any of its delta
+ * bases that are not in it yet: offset deltas can only refer back.
+ */
+static void add_to_write_order(git_pobject **wo, size_t *endp,
 	git_pobject *po)
 {
-	if (po->filled)
-		return;
-	wo[(*endp)++] = po;
-	po->filled = 1;
+	git_pobject *base;
+
+	while (!po->filled) {
+		for (base = po; base->delta && !base->delta->filled; base = base->delta)
+			; /* nothing */
+
+		wo[(*endp)++] = base;
+		base->filled = 1;
+	}
 }
 
 static void add_descendants_to_write_order(git_pobject **wo, size_t *endp,
@@ -629,16 +831,288 @@ static int compute_write_order(git_pobject ***out, git_packbuilder *pb)
 	return 0;
 }
 
+#ifdef GIT_THREADS
+
+/*
+ * When writing with several threads, the worker threads compress the
+ * objects ahead of the output, in write order, and the calling thread
+ * writes them out in that same order as they become ready.  We stop
+ * compressing ahead once the compressed data waiting to be written
+ * reaches `write_memory_limit`.
+ */
+struct compressed_object {
+	git_str data;
+	size_t size;
+	git_object_t type;
+	git_error *error_info;
+	int error;
+	unsigned int done:1,
+	             reuse:1;
+};
+
+struct write_threads {
+	git_packbuilder *pb;
+	git_pobject **write_order;
+	struct compressed_object *objects;
+	size_t next;
+	size_t memory_used;
+	bool stop;
+	git_mutex lock;
+	git_cond cond;
+};
+
+static int compress_object(
+	struct compressed_object *out,
+	git_packbuilder *pb,
+	git_pobject *po)
+{
+	git_odb_object *obj = NULL;
+	void *data = NULL;
+	size_t data_len;
+	int error;
+
+	if (po->reuse_pack && (po->reuse_delta || !po->delta) &&
+	    (error = verify_reused_object(po)) != GIT_PASSTHROUGH) {
+		out->reuse = 1;
+		return error;
+	}
+
+	if (po->delta) {
+		/* Already compressed during the delta search */
+		if (po->z_delta_size)
+			return 0;
+
+		if (po->delta_data)
+			data = po->delta_data;
+		else if ((error = get_delta(&data, pb->odb, po)) < 0)
+			return error;
+
+		data_len = po->delta_size;
+		out->type = po->type;
+	} else {
+		if ((error = git_odb_read(&obj, pb->odb, &po->id)) < 0)
+			return error;
+
+		data = (void *)git_odb_object_data(obj);
+		data_len = git_odb_object_size(obj);
+		out->type = git_odb_object_type(obj);
+	}
+
+	out->size = data_len;
+	error = git_zstream_deflatebuf(&out->data, data, data_len);
+
+	if (po->delta) {
+		git__free(data);
+		po->delta_data = NULL;
+	}
+
+	git_odb_object_free(obj);
+	return error;
+}
+
+static void *write_thread(void *arg)
+{
+	struct write_threads *wt = arg;
+	struct compressed_object *out;
+	size_t i;
+	int error;
+
+	for (;;) {
+		if (git_mutex_lock(&wt->lock) < 0)
+			return NULL;
+
+		while (!wt->stop && wt->next < wt->pb->nr_objects &&
+		       wt->memory_used >= wt->pb->write_memory_limit)
+			git_cond_wait(&wt->cond, &wt->lock);
+
+		if (wt->stop || wt->next == wt->pb->nr_objects) {
+			git_mutex_unlock(&wt->lock);
+			return NULL;
+		}
+
+		i = wt->next++;
+		git_mutex_unlock(&wt->lock);
+
+		out = &wt->objects[i];
+
+		if ((error = compress_object(out, wt->pb, wt->write_order[i])) < 0)
+			git_error_save(&out->error_info);
+
+		if (git_mutex_lock(&wt->lock) < 0)
+			return NULL;
+
+		out->error = error;
+		out->done = 1;
+		wt->memory_used += out->data.size;
+
+		git_cond_broadcast(&wt->cond);
+		git_mutex_unlock(&wt->lock);
+	}
+}
+
+static int write_compressed_object(
+	struct write_data_context *ctx,
+	git_pobject *po,
+	struct compressed_object *out)
+{
+	int error;
+
+	po->written = 1;
+	po->offset = ctx->pb->write_offset;
+
+	if (out->reuse)
+		return copy_reused_object(ctx, po);
+
+	if (po->delta && po->z_delta_size) {
+		if ((error = write_object_header(ctx, po, po->delta_size, po->type)) < 0 ||
+		    (error = write_data(ctx, po->delta_data, po->z_delta_size)) < 0)
+			return error;
+
+		git__free(po->delta_data);
+		po->delta_data = NULL;
+	} else if ((error = write_object_header(ctx, po, out->size, out->type)) < 0 ||
+	           (error = write_data(ctx, out->data.ptr, out->data.size)) < 0) {
+		return error;
+	}
+
+	ctx->pb->nr_written++;
+	return 0;
+}
+
+static int write_objects_threaded(
+	git_packbuilder *pb,
+	git_pobject **write_order,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	struct write_threads wt = {0};
+	struct write_data_context ctx;
+	git_thread *threads;
+	size_t i, n;
+	int error = 0;
+
+	threads = git__calloc(pb->nr_threads, sizeof(git_thread));
+	GIT_ERROR_CHECK_ALLOC(threads);
+
+	wt.pb = pb;
+	wt.write_order = write_order;
+	wt.objects = git__calloc(pb->nr_objects, sizeof(struct compressed_object));
+
+	if (!wt.objects) {
+		git__free(threads);
+		return -1;
+	}
+
+	ctx.pb = pb;
+	ctx.write_cb = write_cb;
+	ctx.cb_data = cb_data;
+
+	if (git_mutex_init(&wt.lock)) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize packbuilder mutex");
+		error = -1;
+		goto cleanup;
+	}
+
+	if (git_cond_init(&wt.cond)) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize packbuilder condition");
+		error = -1;
+		goto cleanup_lock;
+	}
+
+	for (n = 0; n < pb->nr_threads; n++) {
+		if (git_thread_create(&threads[n], write_thread, &wt) != 0) {
+			git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+			error = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < pb->nr_objects && !error; i++) {
+		struct compressed_object *out = &wt.objects[i];
+
+		if ((error = git_mutex_lock(&wt.lock)) < 0)
+			break;
+
+		while (!out->done)
+			git_cond_wait(&wt.cond, &wt.lock);
+
+		git_mutex_unlock(&wt.lock);
+
+		if (out->error < 0) {
+			git_error_restore(out->error_info);
+			out->error_info = NULL;
+			error = out->error;
+			break;
+		}
+
+		error = write_compressed_object(&ctx, write_order[i], out);
+
+		git_mutex_lock(&wt.lock);
+		wt.memory_used -= out->data.size;
+		git_cond_broadcast(&wt.cond);
+		git_mutex_unlock(&wt.lock);
+
+		git_str_dispose(&out->data);
+	}
+
+	git_mutex_lock(&wt.lock);
+	wt.stop = true;
+	git_cond_broadcast(&wt.cond);
+	git_mutex_unlock(&wt.lock);
+
+	for (i = 0; i < n; i++)
+		git_thread_join(&threads[i], NULL);
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		git_str_dispose(&wt.objects[i].data);
+		git_error_free(wt.objects[i].error_info);
+	}
+
+	git_cond_free(&wt.cond);
+
+cleanup_lock:
+	git_mutex_free(&wt.lock);
+
+cleanup:
+	git__free(wt.objects);
+	git__free(threads);
+	return error;
+}
+
+#endif
+
+static int write_objects(
+	git_packbuilder *pb,
+	git_pobject **write_order,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	enum write_one_status status;
+	size_t i = 0;
+	int error;
+
+	do {
+		pb->nr_written = 0;
+		for ( ; i < pb->nr_objects; ++i) {
+			if ((error = write_one(&status, pb, write_order[i], write_cb, cb_data)) < 0)
+				return error;
+		}
+
+		pb->nr_remaining -= pb->nr_written;
+	} while (pb->nr_remaining && i < pb->nr_objects);
+
+	return 0;
+}
+
 static int write_pack(git_packbuilder *pb,
 	int (*write_cb)(void *buf, size_t size, void *cb_data),
 	void *cb_data)
 {
 	git_pobject **write_order;
 	git_pobject *po;
-	enum write_one_status status;
 	struct git_pack_header ph;
 	git_oid entry_oid;
-	size_t i = 0;
+	size_t i;
 	int error;
 
 	if ((error = compute_write_order(&write_order, pb)) < 0)
@@ -655,22 +1129,29 @@ static int write_pack(git_packbuilder *pb,
 	ph.hdr_version = htonl(PACK_VERSION);
 	ph.hdr_entries = htonl(pb->nr_objects);
 
+	pb->write_offset = 0;
+
 	if ((error = write_cb(&ph, sizeof(ph), cb_data)) < 0 ||
 		(error = git_hash_update(&pb->ctx, &ph, sizeof(ph))) < 0)
 		goto done;
 
+	pb->write_offset += sizeof(ph);
 	pb->nr_remaining = pb->nr_objects;
-	do {
-		pb->nr_written = 0;
-		for ( ; i < pb->nr_objects; ++i) {
-			po = write_order[i];
 
-			if ((error = write_one(&status, pb, po, write_cb, cb_data)) < 0)
-				goto done;
-		}
+	if (!pb->nr_threads)
+		pb->nr_threads = git__online_cpus();
 
+#ifdef GIT_THREADS
+	if (pb->nr_threads > 1) {
+		pb->nr_written = 0;
+		error = write_objects_threaded(pb, write_order, write_cb, cb_data);
 		pb->nr_remaining -= pb->nr_written;
-	} while (pb->nr_remaining && i < pb->nr_objects);
+	} else
+#endif
+	error = write_objects(pb, write_order, write_cb, cb_data);
+
+	if (error < 0)
+		goto done;
 
 	if ((error = git_hash_final(entry_oid.id, &pb->ctx)) < 0)
 		goto done;
@@ -679,7 +1160,7 @@ static int write_pack(git_packbuilder *pb,
 
 done:
 	/* if callback cancelled writing, we must still free delta_data */
-	for ( ; i < pb->nr_objects; ++i) {
+	for (i = 0; i < pb->nr_objects; ++i) {
 		po = write_order[i];
 		if (po->delta_data) {
 			git__free(po->delta_data);
@@ -1315,6 +1796,206 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 #define ll_find_deltas(pb, l, ls, w, d) find_deltas(pb, l, &ls, w, d)
 #endif
 
+/*
+ * Take a reference to a packfile that objects are reused from, so that
+ * it stays open until they are written even if the odb lets go of it.
+ */
+static int hold_reuse_pack(
+	struct git_pack_file **out,
+	git_packbuilder *pb,
+	struct git_pack_file *p)
+{
+	struct git_pack_file *held;
+	git_str idx_path = GIT_STR_INIT;
+	size_t i, name_len;
+	int error;
+
+	git_vector_foreach(&pb->reuse_packs, i, held) {
+		if (held == p) {
+			*out = held;
+			return 0;
+		}
+	}
+
+	name_len = strlen(p->pack_name);
+	GIT_ASSERT(name_len > strlen(".pack"));
+
+	if ((error = git_str_put(&idx_path, p->pack_name, name_len - strlen(".pack"))) < 0 ||
+	    (error = git_str_puts(&idx_path, ".idx")) < 0 ||
+	    (error = git_mwindow_get_pack(&held, idx_path.ptr, p->oid_type)) < 0)
+		goto done;
+
+	if ((error = git_vector_insert(&pb->reuse_packs, held)) < 0) {
+		git_mwindow_put_pack(held);
+		goto done;
+	}
+
+	*out = held;
+
+done:
+	git_str_dispose(&idx_path);
+	return error;
+}
+
+/*
+ * Look for the object in the existing packfiles, and remember where it
+ * is stored if its compressed data can be copied into the new pack.  A
+ * stored delta can only be copied if its base is part of the new pack,
+ * too; it then becomes the delta that we use for the object.
+ */
+static int find_reusable_object(git_packbuilder *pb, git_pobject *po)
+{
+	struct git_pack_entry e;
+	git_mwindow *w_curs = NULL;
+	git_pobject *base = NULL;
+	git_object_t type;
+	git_oid base_id;
+	off64_t curpos, base_offset, end;
+	uint32_t pack_pos, index_pos, crc;
+	size_t size;
+	int error;
+
+	if (po->reuse_pack || po->delta)
+		return 0;
+
+	if ((error = git_odb__find_pack_entry(&e, pb->odb, &po->id)) < 0)
+		goto done;
+
+	curpos = e.offset;
+
+	if ((error = git_packfile_unpack_header(&size, &type, e.p, &w_curs, &curpos)) < 0)
+		goto done;
+
+	if (type == GIT_OBJECT_OFS_DELTA || type == GIT_OBJECT_REF_DELTA) {
+		if ((error = get_delta_base(&base_offset, e.p, &w_curs, &curpos, type, e.offset)) < 0 ||
+		    (error = git_pack_offset_to_pack_pos(&pack_pos, e.p, base_offset)) < 0 ||
+		    (error = git_pack_pos_to_index(&index_pos, e.p, pack_pos)) < 0 ||
+		    (error = git_pack_nth_entry(&base_id, NULL, e.p, index_pos)) < 0)
+			goto done;
+
+		if ((base = git_oidmap_get(pb->object_ix, &base_id)) == NULL)
+			goto done;
+	} else if (type != po->type || size != po->size) {
+		goto done;
+	}
+
+	if ((error = git_pack_entry_extent(&end, &crc, e.p, e.offset)) < 0 ||
+	    (error = hold_reuse_pack(&po->reuse_pack, pb, e.p)) < 0)
+		goto done;
+
+	po->reuse_offset = e.offset;
+	po->reuse_data_offset = curpos;
+	po->reuse_end = end;
+	po->reuse_crc = crc;
+
+	if (base) {
+		po->delta = base;
+		po->delta_size = size;
+		po->reuse_delta = 1;
+	}
+
+done:
+	git_mwindow_close(&w_curs);
+
+	/* Objects that we cannot find are simply packed from scratch */
+	if (error == GIT_ENOTFOUND || error == GIT_PASSTHROUGH) {
+		git_error_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+/*
+ * The stored deltas that we reuse may come from different packfiles, so
+ * in theory they can form a cycle; break it by storing an object whole.
+ */
+static void break_delta_cycles(git_packbuilder *pb)
+{
+	git_pobject *po, *cur;
+	size_t i;
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		po = pb->object_list + i;
+
+		for (cur = po; cur->delta && !cur->recursing; cur = cur->delta)
+			cur->recursing = 1;
+
+		if (cur->delta) {
+			cur->delta = NULL;
+			cur->reuse_pack = NULL;
+			cur->reuse_delta = 0;
+		}
+
+		for (cur = po; cur && cur->recursing; cur = cur->delta)
+			cur->recursing = 0;
+	}
+}
+
+/*
+ * The stored deltas that we reuse come with chains of their own, which
+ * may be deeper than we allow; store the objects at which a chain gets
+ * too deep whole (or as new deltas), cutting it into shorter ones.
+ * Then link the rest to their bases, so that the delta search takes the
+ * depth of the chains below an object into account if it deltifies it.
+ */
+static int limit_reused_delta_depth(git_packbuilder *pb, size_t max_depth)
+{
+	git_array_t(git_pobject *) chain = GIT_ARRAY_INIT;
+	git_pobject *po, *cur, **next;
+	size_t *depths, depth, i;
+	int error = 0;
+
+	depths = git__mallocarray(pb->nr_objects, sizeof(size_t));
+	GIT_ERROR_CHECK_ALLOC(depths);
+
+	for (i = 0; i < pb->nr_objects; i++)
+		depths[i] = SIZE_MAX;
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		po = pb->object_list + i;
+
+		for (cur = po; cur->reuse_delta &&
+		     depths[cur - pb->object_list] == SIZE_MAX; cur = cur->delta) {
+			if ((next = git_array_alloc(chain)) == NULL) {
+				error = -1;
+				goto done;
+			}
+
+			*next = cur;
+		}
+
+		depth = cur->reuse_delta ? depths[cur - pb->object_list] : 0;
+
+		while ((next = git_array_pop(chain)) != NULL) {
+			cur = *next;
+
+			if (++depth > max_depth) {
+				cur->delta = NULL;
+				cur->reuse_pack = NULL;
+				cur->reuse_delta = 0;
+				depth = 0;
+			}
+
+			depths[cur - pb->object_list] = depth;
+		}
+	}
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		po = pb->object_list + i;
+
+		if (po->reuse_delta) {
+			po->delta_sibling = po->delta->delta_child;
+			po->delta->delta_child = po;
+		}
+	}
+
+done:
+	git_array_clear(chain);
+	git__free(depths);
+	return error;
+}
+
 int git_packbuilder__prepare(git_packbuilder *pb)
 {
 	git_pobject **delta_list;
@@ -1333,9 +2014,27 @@ int git_packbuilder__prepare(git_packbuilder *pb)
 	delta_list = git__mallocarray(pb->nr_objects, sizeof(*delta_list));
 	GIT_ERROR_CHECK_ALLOC(delta_list);
 
+	for (i = 0; i < pb->nr_objects; ++i) {
+		if (find_reusable_object(pb, pb->object_list + i) < 0) {
+			git__free(delta_list);
+			return -1;
+		}
+	}
+
+	break_delta_cycles(pb);
+
+	if (limit_reused_delta_depth(pb, GIT_PACK_DEPTH) < 0) {
+		git__free(delta_list);
+		return -1;
+	}
+
 	for (i = 0; i < pb->nr_objects; ++i) {
 		git_pobject *po = pb->object_list + i;
 
+		/* A stored delta is kept as it is */
+		if (po->reuse_delta)
+			continue;
+
 		/* Make sure the item is within our size limits */
 		if (po->size < 50 || po->size > pb->big_file_threshold)
 			continue;
@@ -1386,6 +2085,64 @@ static int write_cb(void *buf, size_t len, void *payload)
 	return git_indexer_append(ctx->indexer, buf, len, ctx->stats);
 }
 
+/*
+ * Write the bitmap index for the packfile that was just written (and
+ * indexed) into `pack_dir`.
+ */
+static int write_bitmap_index(git_packbuilder *pb, const char *pack_dir)
+{
+	git_str pack_path = GIT_STR_INIT, bitmap_path = GIT_STR_INIT;
+	unsigned char checksum[GIT_OID_MAX_SIZE];
+	git_pack_bitmap_writer *writer = NULL;
+	struct git_pack_file *p = NULL;
+	git_pobject *po;
+	git_object_t type;
+	uint32_t pos, index_pos;
+	size_t size;
+	git_oid id;
+	int error;
+
+	if ((error = git_str_joinpath(&pack_path, pack_dir, "pack-")) < 0 ||
+	    (error = git_str_puts(&pack_path, pb->pack_name)) < 0 ||
+	    (error = git_str_puts(&bitmap_path, pack_path.ptr)) < 0 ||
+	    (error = git_str_puts(&pack_path, ".idx")) < 0 ||
+	    (error = git_str_puts(&bitmap_path, ".bitmap")) < 0)
+		goto cleanup;
+
+	if ((error = git_mwindow_get_pack(&p, pack_path.ptr, pb->oid_type)) < 0 ||
+	    (error = git_pack_checksum(checksum, p)) < 0 ||
+	    (error = git_pack_bitmap_writer_new(&writer, pb->repo, p->num_objects)) < 0)
+		goto cleanup;
+
+	for (pos = 0; pos < p->num_objects; pos++) {
+		if ((error = git_pack_pos_to_index(&index_pos, p, pos)) < 0 ||
+		    (error = git_pack_nth_entry(&id, NULL, p, index_pos)) < 0)
+			goto cleanup;
+
+		if ((po = git_oidmap_get(pb->object_ix, &id)) != NULL) {
+			error = git_pack_bitmap_writer_add(writer, &id, po->type, index_pos, po->hash);
+		} else if ((error = git_odb_read_header(&size, &type, pb->odb, &id)) == 0) {
+			/* a base that the indexer added to complete the pack */
+			error = git_pack_bitmap_writer_add(writer, &id, type, index_pos, 0);
+		}
+
+		if (error < 0)
+			goto cleanup;
+	}
+
+	error = git_pack_bitmap_writer_commit(writer, bitmap_path.ptr, checksum);
+
+cleanup:
+	git_pack_bitmap_writer_free(writer);
+
+	if (p)
+		git_mwindow_put_pack(p);
+
+	git_str_dispose(&pack_path);
+	git_str_dispose(&bitmap_path);
+	return error;
+}
+
 int git_packbuilder_write(
 	git_packbuilder *pb,
 	const char *path,
@@ -1447,6 +2204,9 @@ int git_packbuilder_write(
 	pb->pack_name = git__strdup(git_indexer_name(indexer));
 	GIT_ERROR_CHECK_ALLOC(pb->pack_name);
 
+	if (pb->write_bitmap)
+		error = write_bitmap_index(pb, path);
+
 cleanup:
 	git_indexer_free(indexer);
 	git_str_dispose(&object_path);
@@ -1757,6 +2517,93 @@ cleanup:
 	return error;
 }
 
+static int insert_bitmap_object(
+	const git_oid *id,
+	git_object_t type,
+	struct git_pack_file *pack,
+	off64_t offset,
+	uint32_t hash,
+	void *payload)
+{
+	git_packbuilder *pb = payload;
+	git_object_t unused;
+	size_t size;
+	int error;
+
+	if (git_oidmap_exists(pb->object_ix, id))
+		return 0;
+
+	if ((error = git_packfile_resolve_header(&size, &unused, pack, offset)) < 0)
+		return error;
+
+	return packbuilder_insert(pb, id, type, size, hash);
+}
+
+/*
+ * Use the repository's reachability bitmaps (if any) to find the
+ * objects that are reachable from the interesting commits in the walk
+ * but not from the uninteresting ones, without walking the trees.
+ * Returns `GIT_ENOTFOUND` when there is no bitmap, when the wanted
+ * objects are not all covered by it, or when it cannot be read: it is
+ * only a cache, so the graph can always be walked instead.
+ */
+static int insert_walk_bitmap(git_packbuilder *pb, git_revwalk *walk)
+{
+	/* The order that git itself adds the objects in */
+	static const git_object_t types[] = {
+		GIT_OBJECT_COMMIT, GIT_OBJECT_TAG, GIT_OBJECT_TREE, GIT_OBJECT_BLOB
+	};
+	git_array_t(git_oid) wants = GIT_ARRAY_INIT, haves = GIT_ARRAY_INIT;
+	git_bitmap want_set = GIT_BITMAP_INIT, have_set = GIT_BITMAP_INIT;
+	git_pack_bitmap *bitmap = NULL;
+	git_commit_list *list;
+	git_oid *id;
+	size_t i;
+	int error;
+
+	if (git_pack_bitmap_find(&bitmap, pb->repo) < 0)
+		return GIT_ENOTFOUND;
+
+	for (list = walk->user_input; list; list = list->next) {
+		if (list->item->uninteresting)
+			id = git_array_alloc(haves);
+		else
+			id = git_array_alloc(wants);
+
+		if (!id) {
+			git_error_set_oom();
+			error = -1;
+			goto done;
+		}
+
+		git_oid_cpy(id, &list->item->oid);
+	}
+
+	if (git_pack_bitmap_reachable(&want_set, bitmap, pb->repo,
+			wants.ptr, wants.size, false) < 0 ||
+	    git_pack_bitmap_reachable(&have_set, bitmap, pb->repo,
+			haves.ptr, haves.size, true) < 0) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	git_bitmap_and_not(&want_set, &have_set);
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		if ((error = git_pack_bitmap_foreach(bitmap, &want_set, types[i],
+				insert_bitmap_object, pb)) < 0)
+			goto done;
+	}
+
+done:
+	git_bitmap_dispose(&want_set);
+	git_bitmap_dispose(&have_set);
+	git_array_clear(wants);
+	git_array_clear(haves);
+	git_pack_bitmap_free(bitmap);
+	return error;
+}
+
 int git_packbuilder_insert_walk(git_packbuilder *pb, git_revwalk *walk)
 {
 	int error;
@@ -1766,6 +2613,17 @@ int git_packbuilder_insert_walk(git_packbuilder *pb, git_revwalk *walk)
 	GIT_ASSERT_ARG(pb);
 	GIT_ASSERT_ARG(walk);
 
+	/*
+	 * Bitmaps can only answer plain reachability queries, so fall back
+	 * to walking the graph when the walk is filtered.
+	 */
+	if (pb->use_bitmaps && !walk->hide_cb && !walk->first_parent) {
+		if ((error = insert_walk_bitmap(pb, walk)) != GIT_ENOTFOUND)
+			return error;
+
+		git_error_clear();
+	}
+
 	if ((error = mark_edges_uninteresting(pb, walk->user_input)) < 0)
 		return error;
 
@@ -1807,6 +2665,9 @@ int git_packbuilder_set_callbacks(git_packbuilder *pb, git_packbuilder_progress
 
 void git_packbuilder_free(git_packbuilder *pb)
 {
+	struct git_pack_file *p;
+	size_t i;
+
 	if (pb == NULL)
 		return;
 
@@ -1830,6 +2691,10 @@ void git_packbuilder_free(git_packbuilder *pb)
 	git_oidmap_free(pb->walk_objects);
 	git_pool_clear(&pb->object_pool);
 
+	git_vector_foreach(&pb->reuse_packs, i, p)
+		git_mwindow_put_pack(p);
+	git_vector_free(&pb->reuse_packs);
+
 	git_hash_ctx_cleanup(&pb->ctx);
 	git_zstream_free(&pb->zstream);
 
@@ -15,6 +15,7 @@
 #include "oidmap.h"
 #include "zstream.h"
 #include "pool.h"
+#include "vector.h"
 #include "indexer.h"
 
 #include "git2/oid.h"
@@ -25,6 +26,7 @@
 #define GIT_PACK_DELTA_CACHE_SIZE (256 * 1024 * 1024)
 #define GIT_PACK_DELTA_CACHE_LIMIT 1000
 #define GIT_PACK_BIG_FILE_THRESHOLD (512 * 1024 * 1024)
+#define GIT_PACK_WRITE_MEMORY (64 * 1024 * 1024) /* compressed ahead when writing */
 
 typedef struct git_pobject {
 	git_oid id;
@@ -45,10 +47,23 @@ typedef struct git_pobject {
 	size_t delta_size;
 	size_t z_delta_size;
 
+	/*
+	 * Where the object is stored in an existing packfile, when that
+	 * representation can be copied into the new pack as-is.  If
+	 * `reuse_delta` is set, it is stored as a delta against `delta`.
+	 * The packbuilder holds a reference to `reuse_pack`.
+	 */
+	struct git_pack_file *reuse_pack;
+	off64_t reuse_offset;
+	off64_t reuse_data_offset;
+	off64_t reuse_end;
+	uint32_t reuse_crc;
+
 	unsigned int written:1,
 	             recursing:1,
 	             tagged:1,
-	             filled:1;
+	             filled:1,
+	             reuse_delta:1;
 } git_pobject;
 
 struct git_packbuilder {
@@ -63,10 +78,13 @@ struct git_packbuilder {
 	uint32_t nr_objects,
 		nr_deltified,
 		nr_written,
+		nr_reused,
 		nr_remaining;
 
 	size_t nr_alloc;
 
+	off64_t write_offset; /* bytes of the pack written so far */
+
 	git_pobject *object_list;
 
 	git_oidmap *object_ix;
@@ -74,6 +92,9 @@ struct git_packbuilder {
 	git_oidmap *walk_objects;
 	git_pool object_pool;
 
+	/* the packfiles that objects are reused from, which we hold open */
+	git_vector reuse_packs;
+
 #ifndef GIT_DEPRECATE_HARD
 	git_oid pack_oid; /* hash of written pack */
 #endif
@@ -90,9 +111,14 @@ struct git_packbuilder {
 	size_t cache_max_small_delta_size;
 	size_t big_file_threshold;
 	size_t window_memory_limit;
+	size_t write_memory_limit;
 
 	unsigned int nr_threads; /* nr of threads to use */
 
+	bool use_bitmaps; /* use reachability bitmaps when walking */
+	bool write_bitmap; /* write a bitmap index with the pack */
+	bool ofs_delta; /* refer to delta bases by their offset */
+
 	git_packbuilder_progress progress_cb;
 	void *progress_cb_payload;
 
@@ -8,6 +8,7 @@
 #include "pack.h"
 
 #include "delta.h"
+#include "filebuf.h"
 #include "futils.h"
 #include "mwindow.h"
 #include "odb.h"
@@ -16,6 +17,7 @@
 
 /* Option to bypass checking existence of '.keep' files */
 bool git_disable_pack_keep_file_checks = false;
+bool git_pack__index_readahead = false;
 
 static int packfile_open_locked(struct git_pack_file *p);
 static off64_t nth_packed_object_offset_locked(struct git_pack_file *p, uint32_t n);
@@ -36,6 +38,7 @@ static int packfile_unpack_compressed(
  */
 static int pack_entry_find_offset(
 		off64_t *offset_out,
+		uint32_t *pos_out,
 		git_oid *found_oid,
 		struct git_pack_file *p,
 		const git_oid *short_oid,
@@ -51,7 +54,25 @@ static int packfile_error(const char *message)
  * Delta base cache
  ********************/
 
-static git_pack_cache_entry *new_cache_object(git_rawobj *source)
+size_t git_pack__cache_memory_limit = GIT_PACK_CACHE_MEMORY_LIMIT;
+
+static git_atomic_ssize cache_hits;
+static git_atomic_ssize cache_misses;
+static git_atomic_ssize cache_evictions;
+
+void git_pack__cache_stats(size_t *hits, size_t *misses, size_t *evictions)
+{
+	if (hits)
+		*hits = (size_t)git_atomic_ssize_get(&cache_hits);
+	if (misses)
+		*misses = (size_t)git_atomic_ssize_get(&cache_misses);
+	if (evictions)
+		*evictions = (size_t)git_atomic_ssize_get(&cache_evictions);
+}
+
+#define cache_entry_size(e) (sizeof(git_pack_cache_entry) + (e)->raw.len)
+
+static git_pack_cache_entry *new_cache_object(git_rawobj *source, off64_t offset)
 {
 	git_pack_cache_entry *e = git__calloc(1, sizeof(git_pack_cache_entry));
 	if (!e)
@@ -59,6 +80,7 @@ static git_pack_cache_entry *new_cache_object(git_rawobj *source)
 
 	git_atomic32_inc(&e->refcount);
 	memcpy(&e->raw, source, sizeof(git_rawobj));
+	e->offset = offset;
 
 	return e;
 }
@@ -85,6 +107,9 @@ static void cache_free(git_pack_cache *cache)
 		git_offmap_free(cache->entries);
 		cache->entries = NULL;
 	}
+
+	cache->lru_head = cache->lru_tail = NULL;
+	cache->memory_used = 0;
 }
 
 static int cache_init(git_pack_cache *cache)
@@ -92,8 +117,6 @@ static int cache_init(git_pack_cache *cache)
 	if (git_offmap_new(&cache->entries) < 0)
 		return -1;
 
-	cache->memory_limit = GIT_PACK_CACHE_MEMORY_LIMIT;
-
 	if (git_mutex_init(&cache->lock)) {
 		git_error_set(GIT_ERROR_OS, "failed to initialize pack cache mutex");
 
@@ -106,6 +129,36 @@ static int cache_init(git_pack_cache *cache)
 	return 0;
 }
 
+/* Run with the cache lock held */
+static void cache_lru_unlink(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+/* Run with the cache lock held */
+static void cache_lru_push(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+
+	if (cache->lru_head)
+		cache->lru_head->lru_prev = entry;
+	else
+		cache->lru_tail = entry;
+
+	cache->lru_head = entry;
+}
+
 static git_pack_cache_entry *cache_get(git_pack_cache *cache, off64_t offset)
 {
 	git_pack_cache_entry *entry;
@@ -115,26 +168,49 @@ static git_pack_cache_entry *cache_get(git_pack_cache *cache, off64_t offset)
 
 	if ((entry = git_offmap_get(cache->entries, offset)) != NULL) {
 		git_atomic32_inc(&entry->refcount);
-		entry->last_usage = cache->use_ctr++;
+
+		if (cache->lru_head != entry) {
+			cache_lru_unlink(cache, entry);
+			cache_lru_push(cache, entry);
+		}
 	}
 	git_mutex_unlock(&cache->lock);
 
+	git_atomic_ssize_add(entry ? &cache_hits : &cache_misses, 1);
 	return entry;
 }
 
-/* Run with the cache lock held */
-static void free_lowest_entry(git_pack_cache *cache)
+/*
+ * Evict the least recently used entries until there is room for
+ * `needed` more bytes.  Entries that are in use are skipped; returns
+ * false if there is still not enough room once they are all that is
+ * left.  Run with the cache lock held.
+ */
+static bool cache_make_room(git_pack_cache *cache, size_t needed)
 {
-	off64_t offset;
-	git_pack_cache_entry *entry;
+	git_pack_cache_entry *entry, *prev;
+	size_t limit = git_pack__cache_memory_limit;
 
-	git_offmap_foreach(cache->entries, offset, entry, {
-		if (entry && git_atomic32_get(&entry->refcount) == 0) {
-			cache->memory_used -= entry->raw.len;
-			git_offmap_delete(cache->entries, offset);
-			free_cache_object(entry);
-		}
-	});
+	if (needed > limit)
+		return false;
+
+	for (entry = cache->lru_tail;
+	     entry && cache->memory_used + needed > limit;
+	     entry = prev) {
+		prev = entry->lru_prev;
+
+		if (git_atomic32_get(&entry->refcount) != 0)
+			continue;
+
+		cache_lru_unlink(cache, entry);
+		git_offmap_delete(cache->entries, entry->offset);
+		cache->memory_used -= cache_entry_size(entry);
+		free_cache_object(entry);
+
+		git_atomic_ssize_add(&cache_evictions, 1);
+	}
+
+	return (cache->memory_used + needed <= limit);
 }
 
 static int cache_add(
@@ -144,32 +220,31 @@ static int cache_add(
 		off64_t offset)
 {
 	git_pack_cache_entry *entry;
-	int exists;
+	int added = 0;
 
 	if (base->len > GIT_PACK_CACHE_SIZE_LIMIT)
 		return -1;
 
-	entry = new_cache_object(base);
+	entry = new_cache_object(base, offset);
 	if (entry) {
 		if (git_mutex_lock(&cache->lock) < 0) {
 			git_error_set(GIT_ERROR_OS, "failed to lock cache");
 			git__free(entry);
 			return -1;
 		}
-		/* Add it to the cache if nobody else has */
-		exists = git_offmap_exists(cache->entries, offset);
-		if (!exists) {
-			while (cache->memory_used + base->len > cache->memory_limit)
-				free_lowest_entry(cache);
-
-			git_offmap_set(cache->entries, offset, entry);
-			cache->memory_used += entry->raw.len;
+		/* Add it to the cache if nobody else has and it fits */
+		if (!git_offmap_exists(cache->entries, offset) &&
+		    cache_make_room(cache, cache_entry_size(entry)) &&
+		    git_offmap_set(cache->entries, offset, entry) == 0) {
+			cache_lru_push(cache, entry);
+			cache->memory_used += cache_entry_size(entry);
 
 			*cached_out = entry;
+			added = 1;
 		}
 		git_mutex_unlock(&cache->lock);
-		/* Somebody beat us to adding it into the cache */
-		if (exists) {
+		/* Somebody beat us to adding it, or there was no room */
+		if (!added) {
 			git__free(entry);
 			return -1;
 		}
@@ -190,6 +265,14 @@ static void pack_index_free(struct git_pack_file *p)
 		git__free(p->ids);
 		p->ids = NULL;
 	}
+	if (p->revindex) {
+		git__free(p->revindex);
+		p->revindex = NULL;
+	}
+	if (p->rev_map.data) {
+		git_futils_mmap_free(&p->rev_map);
+		p->rev_map.data = NULL;
+	}
 	if (p->index_map.data) {
 		git_futils_mmap_free(&p->index_map);
 		p->index_map.data = NULL;
@@ -298,6 +381,15 @@ static int pack_index_check_locked(const char *path, struct git_pack_file *p)
 		}
 	}
 
+	/* Lookups jump around the index, where readahead would be wasted */
+	p_madvise(&p->index_map, 0, idx_size, GIT_MAP_ADVICE_RANDOM);
+
+	/* But they all need the fanout and the object ids, so start reading those */
+	if (git_pack__index_readahead)
+		p_madvise(&p->index_map, 0, (version > 1 ? 8 : 0) + (4 * 256) +
+			(size_t)nr * (version > 1 ? p->oid_size : p->oid_size + 4),
+			GIT_MAP_ADVICE_WILLNEED);
+
 	p->num_objects = nr;
 	p->index_version = version;
 	return 0;
@@ -344,6 +436,10 @@ static unsigned char *pack_window_open(
 {
 	unsigned char *pack_data = NULL;
 
+	/* A pack that is mapped whole can be read without any locking */
+	if ((pack_data = git_mwindow_open_whole(&p->mwf, w_cursor, offset, p->oid_size, left)) != NULL)
+		return pack_data;
+
 	if (git_mutex_lock(&p->lock) < 0) {
 		git_error_set(GIT_ERROR_THREAD, "unable to lock packfile");
 		return NULL;
@@ -460,6 +556,9 @@ int git_packfile_unpack_header(
 	unsigned long used;
 	int error;
 
+	if ((base = git_mwindow_open_whole(&p->mwf, w_curs, *curpos, p->oid_size, &left)) != NULL)
+		goto parse;
+
 	if ((error = git_mutex_lock(&p->lock)) < 0)
 		return error;
 	if ((error = git_mutex_lock(&p->mwf.lock)) < 0) {
@@ -485,6 +584,7 @@ int git_packfile_unpack_header(
 	if (base == NULL)
 		return GIT_EBUFS;
 
+parse:
 	error = packfile_unpack_header1(&used, size_p, type_p, base, left);
 	git_mwindow_close(w_curs);
 	if (error == GIT_EBUFS)
@@ -893,14 +993,38 @@ static int packfile_unpack_compressed(
 	git_object_t type)
 {
 	git_zstream zstream = GIT_ZSTREAM_INIT;
-	size_t buffer_len, total = 0;
+	size_t buffer_len, total = 0, used;
+	unsigned int window_len;
+	unsigned char *in;
 	char *data = NULL;
 	int error;
 
 	GIT_ERROR_CHECK_ALLOC_ADD(&buffer_len, size, 1);
-	data = git__calloc(1, buffer_len);
+	data = git__malloc(buffer_len);
 	GIT_ERROR_CHECK_ALLOC(data);
 
+	data[size] = '\0';
+
+	/*
+	 * We know how big the object is, so inflate it in one go if the
+	 * window holds all of it (as it nearly always does); otherwise
+	 * stream it through the windows.
+	 */
+	if ((in = pack_window_open(p, mwindow, *position, &window_len)) == NULL) {
+		error = -1;
+		goto out;
+	}
+
+	error = git_zstream_inflate_known(&used, data, size, in, window_len);
+	git_mwindow_close(mwindow);
+
+	if (error == 0) {
+		*position += used;
+		goto done;
+	} else if (error != GIT_EBUFS) {
+		goto out;
+	}
+
 	if ((error = git_zstream_init(&zstream, GIT_ZSTREAM_INFLATE)) < 0) {
 		git_error_set(GIT_ERROR_ZLIB, "failed to init zlib stream on unpack");
 		goto out;
@@ -908,8 +1032,7 @@ static int packfile_unpack_compressed(
 
 	do {
 		size_t bytes = buffer_len - total;
-		unsigned int window_len, consumed;
-		unsigned char *in;
+		unsigned int consumed;
 
 		if ((in = pack_window_open(p, mwindow, *position, &window_len)) == NULL) {
 			error = -1;
@@ -942,6 +1065,7 @@ static int packfile_unpack_compressed(
 		goto out;
 	}
 
+done:
 	obj->type = type;
 	obj->len = size;
 	obj->data = data;
@@ -1026,7 +1150,7 @@ int get_delta_base(
 		}
 
 		/* The base entry _must_ be in the same pack */
-		if (pack_entry_find_offset(&base_offset, &unused, p, &base_oid, p->oid_hexsize) < 0)
+		if (pack_entry_find_offset(&base_offset, NULL, &unused, p, &base_oid, p->oid_hexsize) < 0)
 			return packfile_error("base entry delta is not in the same pack");
 		*curpos += p->oid_size;
 	} else
@@ -1323,6 +1447,9 @@ int git_pack_foreach_entry(
 	if (p->ids == NULL) {
 		git_vector offsets, oids;
 
+		/* This reads the whole index, in no particular order */
+		p_madvise(&p->index_map, 0, p->index_map.len, GIT_MAP_ADVICE_WILLNEED);
+
 		if ((error = git_vector_init(&oids, p->num_objects, NULL))) {
 			git_mutex_unlock(&p->lock);
 			return error;
@@ -1416,6 +1543,8 @@ int git_pack_foreach_entry_offset(
 		index = p->index_map.data;
 	}
 
+	p_madvise(&p->index_map, 0, p->index_map.len, GIT_MAP_ADVICE_SEQUENTIAL);
+
 	if (p->index_version > 1)
 		index += 8;
 
@@ -1460,10 +1589,69 @@ int git_pack_foreach_entry_offset(
 	}
 
 cleanup:
+	if (p->index_map.data)
+		p_madvise(&p->index_map, 0, p->index_map.len, GIT_MAP_ADVICE_RANDOM);
+
 	git_mutex_unlock(&p->lock);
 	return error;
 }
 
+/*
+ * Object ids are uniformly distributed, so rather than bisecting the
+ * lookup table we can estimate where an id is from its value, the way
+ * one looks up a word in a dictionary.  The first four bytes of each id
+ * serve as its key for this; the range being searched is normally one
+ * fanout bucket, where the first byte is the same for every entry.
+ *
+ * Interpolation takes far fewer probes than bisection when the ids are
+ * uniform, and the key also settles most comparisons without looking
+ * at the rest of the id.  To bound the cost when they are not uniform,
+ * only the first few probes are interpolated.
+ */
+#define LOOKUP_INTERPOLATION_STEPS 4
+#define LOOKUP_INTERPOLATION_MIN 8
+
+GIT_INLINE(uint32_t) lookup_key(const unsigned char *id)
+{
+	return ((uint32_t)id[0] << 24) | ((uint32_t)id[1] << 16) |
+	       ((uint32_t)id[2] << 8) | (uint32_t)id[3];
+}
+
+/*
+ * Estimate the position of `key` in [lo, hi), given that the keys in
+ * that range are between `lo_key` and `hi_key`.
+ */
+GIT_INLINE(unsigned) lookup_interpolate(
+	unsigned lo,
+	unsigned hi,
+	uint32_t lo_key,
+	uint32_t hi_key,
+	uint32_t key)
+{
+	uint64_t span = (uint64_t)hi_key - lo_key + 1, distance;
+
+	if (key <= lo_key)
+		return lo;
+	else if (key >= hi_key)
+		return hi - 1;
+
+	distance = (uint64_t)key - lo_key;
+	return lo + (unsigned)(((uint64_t)(hi - lo) * distance) / span);
+}
+
+/* Where a lookup in [lo, hi) starts */
+GIT_INLINE(unsigned) lookup_first_probe(
+	unsigned lo,
+	unsigned hi,
+	uint32_t key)
+{
+	if (hi - lo <= LOOKUP_INTERPOLATION_MIN)
+		return lo + (hi - lo) / 2;
+
+	return lookup_interpolate(lo, hi,
+		key & 0xff000000, key | 0x00ffffff, key);
+}
+
 int git_pack__lookup_id(
 	const void *oid_lookup_table,
 	size_t stride,
@@ -1472,27 +1660,122 @@ int git_pack__lookup_id(
 	const unsigned char *oid_prefix,
 	const git_oid_t oid_type)
 {
-	const unsigned char *base = oid_lookup_table;
+	const unsigned char *base = oid_lookup_table, *current;
 	size_t oid_size = git_oid_size(oid_type);
+	uint32_t key = lookup_key(oid_prefix), lo_key, hi_key, current_key;
+	unsigned mi, steps = 0;
+	int cmp;
+
+	lo_key = key & 0xff000000;
+	hi_key = key | 0x00ffffff;
 
 	while (lo < hi) {
-		unsigned mi = (lo + hi) / 2;
-		int cmp = git_oid_raw_cmp(base + mi * stride, oid_prefix, oid_size);
+		if (steps++ == 0)
+			mi = lookup_first_probe(lo, hi, key);
+		else if (steps <= LOOKUP_INTERPOLATION_STEPS &&
+		         hi - lo > LOOKUP_INTERPOLATION_MIN && lo_key < hi_key)
+			mi = lookup_interpolate(lo, hi, lo_key, hi_key, key);
+		else
+			mi = lo + (hi - lo) / 2;
+
+		current = base + mi * stride;
+		current_key = lookup_key(current);
+
+		if (current_key != key)
+			cmp = current_key < key ? -1 : 1;
+		else
+			cmp = git_oid_raw_cmp(current, oid_prefix, oid_size);
 
 		if (!cmp)
 			return mi;
 
-		if (cmp > 0)
+		if (cmp > 0) {
 			hi = mi;
-		else
-			lo = mi+1;
+			hi_key = current_key;
+		} else {
+			lo = mi + 1;
+			lo_key = current_key;
+		}
 	}
 
 	return -((int)lo)-1;
 }
 
+void git_pack__lookup_id_prefetch(
+	const void *oid_lookup_table,
+	size_t stride,
+	const uint32_t *fanout,
+	const git_oid *ids,
+	size_t count)
+{
+	const unsigned char *base = oid_lookup_table;
+	unsigned lo, hi;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		const unsigned char *id = ids[i].id;
+
+		hi = ntohl(fanout[id[0]]);
+		lo = id[0] ? ntohl(fanout[id[0] - 1]) : 0;
+
+		if (lo < hi)
+			GIT_PREFETCH(base + lookup_first_probe(lo, hi, lookup_key(id)) * stride);
+	}
+}
+
+static int pack_index_prefetch_locked(
+	struct git_pack_file *p,
+	const git_oid *ids,
+	size_t count)
+{
+	const uint32_t *fanout;
+	const unsigned char *index;
+	size_t stride;
+	int error;
+
+	if ((error = pack_index_open_locked(p)) < 0)
+		return error;
+
+	index = p->index_map.data;
+	fanout = p->index_map.data;
+
+	if (p->index_version > 1) {
+		fanout += 2;
+		index += 8;
+	}
+
+	index += 4 * 256;
+
+	if (p->index_version > 1) {
+		stride = p->oid_size;
+	} else {
+		stride = p->oid_size + 4;
+		index += 4;
+	}
+
+	git_pack__lookup_id_prefetch(index, stride, fanout, ids, count);
+	return 0;
+}
+
+int git_pack_index_prefetch(
+	struct git_pack_file *p,
+	const git_oid *ids,
+	size_t count)
+{
+	int error;
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_index_prefetch");
+
+	error = pack_index_prefetch_locked(p, ids, count);
+
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
 static int pack_entry_find_offset(
 	off64_t *offset_out,
+	uint32_t *pos_out,
 	git_oid *found_oid,
 	struct git_pack_file *p,
 	const git_oid *short_oid,
@@ -1591,6 +1874,9 @@ static int pack_entry_find_offset(
 	*offset_out = offset;
 	git_oid__fromraw(found_oid, current, p->oid_type);
 
+	if (pos_out)
+		*pos_out = (uint32_t)pos;
+
 #ifdef INDEX_DEBUG_LOOKUP
 	{
 		char hex_sha1[p->oid_hexsize + 1];
@@ -1624,7 +1910,7 @@ int git_pack_entry_find(
 				return packfile_error("bad object found in packfile");
 	}
 
-	error = pack_entry_find_offset(&offset, &found_oid, p, short_oid, len);
+	error = pack_entry_find_offset(&offset, NULL, &found_oid, p, short_oid, len);
 	if (error < 0)
 		return error;
 
@@ -1656,3 +1942,505 @@ int git_pack_entry_find(
 	git_oid_cpy(&e->id, &found_oid);
 	return 0;
 }
+
+int git_pack_entry_find_position(
+		uint32_t *pos_out,
+		struct git_pack_file *p,
+		const git_oid *id)
+{
+	off64_t offset;
+	git_oid found_oid;
+
+	GIT_ASSERT_ARG(pos_out);
+	GIT_ASSERT_ARG(p);
+	GIT_ASSERT_ARG(id);
+
+	return pack_entry_find_offset(&offset, pos_out, &found_oid, p, id, p->oid_hexsize);
+}
+
+int git_pack_checksum(unsigned char *out, struct git_pack_file *p)
+{
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(p);
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_checksum");
+
+	if ((error = pack_index_open_locked(p)) == 0)
+		memcpy(out, (unsigned char *)p->index_map.data +
+			p->index_map.len - (p->oid_size * 2), p->oid_size);
+
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
+int git_pack_nth_entry(
+		git_oid *id_out,
+		off64_t *offset_out,
+		struct git_pack_file *p,
+		uint32_t n)
+{
+	const unsigned char *index;
+	off64_t offset;
+	int error;
+
+	GIT_ASSERT_ARG(p);
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_nth_entry");
+
+	if ((error = pack_index_open_locked(p)) < 0)
+		goto cleanup;
+
+	if (n >= p->num_objects) {
+		git_error_set(GIT_ERROR_ODB, "pack index position %u is out of range", n);
+		error = -1;
+		goto cleanup;
+	}
+
+	index = p->index_map.data;
+
+	if (p->index_version > 1)
+		index += 8 + (4 * 256) + ((size_t)p->oid_size * n);
+	else
+		index += (4 * 256) + ((size_t)(p->oid_size + 4) * n) + 4;
+
+	if (offset_out) {
+		if ((offset = nth_packed_object_offset_locked(p, n)) < 0) {
+			error = packfile_error("packfile index is corrupt");
+			goto cleanup;
+		}
+
+		*offset_out = offset;
+	}
+
+	if (id_out)
+		error = git_oid__fromraw(id_out, index, p->oid_type);
+
+cleanup:
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
+static uint32_t revindex_oid_version(git_oid_t oid_type)
+{
+	switch (oid_type) {
+	case GIT_OID_SHA1:
+		return 1;
+#ifdef GIT_EXPERIMENTAL_SHA256
+	case GIT_OID_SHA256:
+		return 2;
+#endif
+	default:
+		return 0;
+	}
+}
+
+int git_pack__revindex_open(
+	git_map *out,
+	const char *path,
+	uint32_t num_objects,
+	const unsigned char *checksum,
+	git_oid_t oid_type)
+{
+	const struct git_pack_revindex_header *hdr;
+	const unsigned char *data;
+	size_t oid_size = git_oid_size(oid_type), rev_size;
+	uint64_t expected_size;
+	struct stat st;
+	git_file fd;
+	int error;
+
+	GIT_ASSERT_ARG(out && path && checksum);
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	if (p_fstat(fd, &st) < 0) {
+		p_close(fd);
+		git_error_set(GIT_ERROR_OS, "unable to stat reverse index '%s'", path);
+		return -1;
+	}
+
+	expected_size = sizeof(struct git_pack_revindex_header) +
+		((uint64_t)num_objects * 4) + (oid_size * 2);
+
+	if (!S_ISREG(st.st_mode) ||
+	    !git__is_sizet(st.st_size) ||
+	    (rev_size = (size_t)st.st_size) != expected_size) {
+		p_close(fd);
+		git_error_set(GIT_ERROR_ODB, "invalid reverse index '%s'", path);
+		return -1;
+	}
+
+	error = git_futils_mmap_ro(out, fd, 0, rev_size);
+	p_close(fd);
+
+	if (error < 0)
+		return error;
+
+	p_madvise(out, 0, rev_size, GIT_MAP_ADVICE_RANDOM);
+
+	data = out->data;
+	hdr = out->data;
+
+	if (hdr->ridx_signature != htonl(PACK_REVINDEX_SIGNATURE) ||
+	    ntohl(hdr->ridx_version) != PACK_REVINDEX_VERSION ||
+	    ntohl(hdr->ridx_oid_version) != revindex_oid_version(oid_type)) {
+		error = packfile_error("unsupported reverse index version");
+		goto on_error;
+	}
+
+	if (memcmp(data + rev_size - (oid_size * 2), checksum, oid_size) != 0) {
+		error = packfile_error("reverse index does not match the pack");
+		goto on_error;
+	}
+
+	return 0;
+
+on_error:
+	git_futils_mmap_free(out);
+	out->data = NULL;
+	return error;
+}
+
+int git_pack__revindex_write(
+	const char *path,
+	const uint32_t *index_positions,
+	uint32_t num_objects,
+	const unsigned char *checksum,
+	git_oid_t oid_type,
+	mode_t mode,
+	bool do_fsync)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	struct git_pack_revindex_header hdr;
+	unsigned char trailer[GIT_HASH_MAX_SIZE];
+	size_t oid_size = git_oid_size(oid_type);
+	int flags;
+	uint32_t i;
+
+	GIT_ASSERT_ARG(path && checksum);
+	GIT_ASSERT_ARG(index_positions || !num_objects);
+
+	flags = git_filebuf_hash_flags(git_oid_algorithm(oid_type)) |
+		(do_fsync ? GIT_FILEBUF_FSYNC : 0);
+
+	if (git_filebuf_open(&file, path, flags, mode) < 0)
+		return -1;
+
+	hdr.ridx_signature = htonl(PACK_REVINDEX_SIGNATURE);
+	hdr.ridx_version = htonl(PACK_REVINDEX_VERSION);
+	hdr.ridx_oid_version = htonl(revindex_oid_version(oid_type));
+	git_filebuf_write(&file, &hdr, sizeof(hdr));
+
+	for (i = 0; i < num_objects; i++) {
+		uint32_t n = htonl(index_positions[i]);
+		git_filebuf_write(&file, &n, sizeof(n));
+	}
+
+	git_filebuf_write(&file, checksum, oid_size);
+
+	if (git_filebuf_hash(trailer, &file) < 0)
+		goto on_error;
+
+	git_filebuf_write(&file, trailer, oid_size);
+
+	if (git_filebuf_commit(&file) < 0)
+		goto on_error;
+
+	return 0;
+
+on_error:
+	git_filebuf_cleanup(&file);
+	return -1;
+}
+
+struct revindex_entry {
+	off64_t offset;
+	uint32_t index_pos;
+};
+
+static int revindex_entry_cmp(const void *a_, const void *b_, void *payload)
+{
+	const struct revindex_entry *a = a_, *b = b_;
+
+	GIT_UNUSED(payload);
+
+	return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+/* Run with the packfile lock held */
+static int pack_revindex_compute_locked(struct git_pack_file *p)
+{
+	struct revindex_entry *entries;
+	uint32_t i;
+
+	entries = git__mallocarray(p->num_objects, sizeof(struct revindex_entry));
+	GIT_ERROR_CHECK_ALLOC(entries);
+
+	for (i = 0; i < p->num_objects; i++) {
+		if ((entries[i].offset = nth_packed_object_offset_locked(p, i)) < 0) {
+			git__free(entries);
+			return packfile_error("packfile index is corrupt");
+		}
+
+		entries[i].index_pos = i;
+	}
+
+	git__qsort_r(entries, p->num_objects, sizeof(struct revindex_entry),
+		revindex_entry_cmp, NULL);
+
+	if ((p->revindex = git__mallocarray(p->num_objects, sizeof(uint32_t))) == NULL) {
+		git__free(entries);
+		return -1;
+	}
+
+	for (i = 0; i < p->num_objects; i++)
+		p->revindex[i] = entries[i].index_pos;
+
+	git__free(entries);
+	return 0;
+}
+
+/* Run with the packfile lock held */
+static int pack_revindex_load_locked(struct git_pack_file *p)
+{
+	git_str rev_name = GIT_STR_INIT;
+	const unsigned char *checksum;
+	size_t name_len;
+	int error;
+
+	if (p->revindex || p->rev_map.data)
+		return 0;
+
+	if ((error = pack_index_open_locked(p)) < 0)
+		return error;
+
+	name_len = strlen(p->pack_name);
+	GIT_ASSERT(name_len > strlen(".pack"));
+
+	git_str_put(&rev_name, p->pack_name, name_len - strlen(".pack"));
+	git_str_puts(&rev_name, ".rev");
+	if (git_str_oom(&rev_name))
+		return -1;
+
+	checksum = (const unsigned char *)p->index_map.data +
+		p->index_map.len - (p->oid_size * 2);
+
+	/*
+	 * The `.rev` file is only a cache of what the index says; compute
+	 * the reverse index instead if it is missing or cannot be used.
+	 */
+	error = git_pack__revindex_open(&p->rev_map, rev_name.ptr,
+		p->num_objects, checksum, p->oid_type);
+	git_str_dispose(&rev_name);
+
+	if (error < 0) {
+		p->rev_map.data = NULL;
+		git_error_clear();
+		error = pack_revindex_compute_locked(p);
+	}
+
+	return error;
+}
+
+/*
+ * Run with the packfile lock held, after loading the reverse index.
+ * The positions in a `.rev` file are only validated as they are read.
+ */
+GIT_INLINE(int) pack_revindex_get_locked(
+	uint32_t *out,
+	struct git_pack_file *p,
+	uint32_t pack_pos)
+{
+	const uint32_t *positions;
+
+	if (p->revindex) {
+		*out = p->revindex[pack_pos];
+		return 0;
+	}
+
+	positions = (const uint32_t *)((const unsigned char *)p->rev_map.data +
+		sizeof(struct git_pack_revindex_header));
+	*out = ntohl(positions[pack_pos]);
+
+	if (*out >= p->num_objects)
+		return packfile_error("reverse index is corrupt");
+
+	return 0;
+}
+
+int git_pack_pos_to_index(
+		uint32_t *index_pos_out,
+		struct git_pack_file *p,
+		uint32_t pack_pos)
+{
+	int error;
+
+	GIT_ASSERT_ARG(index_pos_out);
+	GIT_ASSERT_ARG(p);
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_pos_to_index");
+
+	if ((error = pack_revindex_load_locked(p)) < 0)
+		goto cleanup;
+
+	if (pack_pos >= p->num_objects) {
+		git_error_set(GIT_ERROR_ODB, "pack position %u is out of range", pack_pos);
+		error = -1;
+		goto cleanup;
+	}
+
+	error = pack_revindex_get_locked(index_pos_out, p, pack_pos);
+
+cleanup:
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
+/* Run with the packfile lock held, after loading the reverse index */
+static int pack_offset_to_pack_pos_locked(
+	uint32_t *pack_pos_out,
+	struct git_pack_file *p,
+	off64_t offset)
+{
+	uint32_t lo = 0, hi = p->num_objects;
+	int error;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2, index_pos;
+		off64_t current;
+
+		if ((error = pack_revindex_get_locked(&index_pos, p, mi)) < 0)
+			return error;
+
+		current = nth_packed_object_offset_locked(p, index_pos);
+
+		if (current == offset) {
+			*pack_pos_out = mi;
+			return 0;
+		} else if (current > offset) {
+			hi = mi;
+		} else {
+			lo = mi + 1;
+		}
+	}
+
+	return git_odb__error_notfound("no object at the given pack offset", NULL, 0);
+}
+
+int git_pack_offset_to_pack_pos(
+		uint32_t *pack_pos_out,
+		struct git_pack_file *p,
+		off64_t offset)
+{
+	int error;
+
+	GIT_ASSERT_ARG(pack_pos_out);
+	GIT_ASSERT_ARG(p);
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_offset_to_pack_pos");
+
+	if ((error = pack_revindex_load_locked(p)) == 0)
+		error = pack_offset_to_pack_pos_locked(pack_pos_out, p, offset);
+
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
+int git_pack_entry_extent(
+		off64_t *end_out,
+		uint32_t *crc_out,
+		struct git_pack_file *p,
+		off64_t offset)
+{
+	const unsigned char *crcs;
+	uint32_t pack_pos, index_pos, next_pos;
+	off64_t end;
+	int error;
+
+	GIT_ASSERT_ARG(end_out);
+	GIT_ASSERT_ARG(crc_out);
+	GIT_ASSERT_ARG(p);
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return packfile_error("failed to get lock for git_pack_entry_extent");
+
+	if ((error = pack_revindex_load_locked(p)) < 0)
+		goto cleanup;
+
+	if (p->index_version < 2) {
+		error = git_odb__error_notfound("pack index has no checksums", NULL, 0);
+		goto cleanup;
+	}
+
+	if ((error = pack_offset_to_pack_pos_locked(&pack_pos, p, offset)) < 0 ||
+	    (error = pack_revindex_get_locked(&index_pos, p, pack_pos)) < 0)
+		goto cleanup;
+
+	/* The entry runs up to the next one, or to the pack's trailer */
+	if (pack_pos + 1 < p->num_objects) {
+		if ((error = pack_revindex_get_locked(&next_pos, p, pack_pos + 1)) < 0)
+			goto cleanup;
+
+		end = nth_packed_object_offset_locked(p, next_pos);
+	} else {
+		end = p->mwf.size - p->oid_size;
+	}
+
+	if (end <= offset) {
+		error = packfile_error("packfile index is corrupt");
+		goto cleanup;
+	}
+
+	crcs = (const unsigned char *)p->index_map.data + 8 + (4 * 256) +
+		((size_t)p->oid_size * p->num_objects);
+
+	*end_out = end;
+	*crc_out = ntohl(*((uint32_t *)(crcs + 4 * (size_t)index_pos)));
+
+cleanup:
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
+int git_packfile_foreach_raw(
+		struct git_pack_file *p,
+		off64_t start,
+		off64_t end,
+		git_packfile_raw_cb cb,
+		void *payload)
+{
+	git_mwindow *w_curs = NULL;
+	unsigned char *data;
+	unsigned int left;
+	size_t len;
+	int error = 0;
+
+	GIT_ASSERT_ARG(p);
+	GIT_ASSERT_ARG(cb);
+	GIT_ASSERT_ARG(start <= end);
+
+	while (start < end) {
+		if ((data = pack_window_open(p, &w_curs, start, &left)) == NULL || !left) {
+			git_mwindow_close(&w_curs);
+			return packfile_error("object data is out of bounds");
+		}
+
+		len = (size_t)min((off64_t)left, end - start);
+		error = cb(data, len, payload);
+		git_mwindow_close(&w_curs);
+
+		if (error)
+			return error;
+
+		start += len;
+	}
+
+	return 0;
+}
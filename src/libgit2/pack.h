@@ -65,10 +65,29 @@ struct git_pack_idx_header {
 	uint32_t idx_version;
 };
 
+/*
+ * A reverse index (`.rev` file) lists the index position of each object
+ * in the order in which the objects appear in the packfile (or, for a
+ * multi-pack-index, in the "pseudo-pack" order that its bitmaps use).
+ * It is followed by the checksum of the packfile and a trailing hash.
+ */
+#define PACK_REVINDEX_SIGNATURE 0x52494458	/* "RIDX" */
+#define PACK_REVINDEX_VERSION 1
+
+struct git_pack_revindex_header {
+	uint32_t ridx_signature;
+	uint32_t ridx_version;
+	uint32_t ridx_oid_version;
+};
+
 typedef struct git_pack_cache_entry {
-	size_t last_usage; /* enough? */
+	off64_t offset;
 	git_atomic32 refcount;
 	git_rawobj raw;
+
+	/* Neighbours in the cache's list, from most to least recently used */
+	struct git_pack_cache_entry *lru_prev;
+	struct git_pack_cache_entry *lru_next;
 } git_pack_cache_entry;
 
 struct pack_chain_elem {
@@ -83,14 +102,30 @@ typedef git_array_t(struct pack_chain_elem) git_dependency_chain;
 #define GIT_PACK_CACHE_MEMORY_LIMIT 16 * 1024 * 1024
 #define GIT_PACK_CACHE_SIZE_LIMIT 1024 * 1024 /* don't bother caching anything over 1MB */
 
+/*
+ * The delta base cache: recently inflated objects, keyed by their
+ * offset in the packfile, so that objects which share delta bases do
+ * not need to inflate the whole chain again.  When the cache is full,
+ * the least recently used entries that nobody holds a reference to are
+ * evicted.  The memory used by each entry (including its bookkeeping)
+ * counts towards `git_pack__cache_memory_limit`.
+ */
 typedef struct {
 	size_t memory_used;
-	size_t memory_limit;
-	size_t use_ctr;
+	git_pack_cache_entry *lru_head;
+	git_pack_cache_entry *lru_tail;
 	git_mutex lock;
 	git_offmap *entries;
 } git_pack_cache;
 
+extern size_t git_pack__cache_memory_limit;
+
+/*
+ * Statistics about the delta base caches of all packfiles, for
+ * `GIT_OPT_GET_PACK_CACHE_STATS`.
+ */
+void git_pack__cache_stats(size_t *hits, size_t *misses, size_t *evictions);
+
 struct git_pack_file {
 	git_mwindow_file mwf;
 	git_map index_map;
@@ -113,6 +148,15 @@ struct git_pack_file {
 	git_oidmap *idx_cache;
 	unsigned char **ids;
 
+	/*
+	 * Reverse index: the index position of each object, in the order
+	 * in which the objects appear in the packfile.  This is either the
+	 * `.rev` file that lives alongside the index, or (when there is
+	 * none) computed in memory from the index.
+	 */
+	git_map rev_map;
+	uint32_t *revindex;
+
 	git_pack_cache bases; /* delta base cache */
 
 	time_t last_freshen; /* last time the packfile was freshened */
@@ -123,8 +167,8 @@ struct git_pack_file {
 
 /**
  * Return the position where an OID (or a prefix) would be inserted within
- * the OID Lookup Table of an .idx file. This performs binary search
- * between the lo and hi indices.
+ * the OID Lookup Table of an .idx file. This searches between the lo and
+ * hi indices, interpolating on the (uniformly distributed) ids.
  *
  * The stride parameter is provided because .idx files version 1 store the
  * OIDs interleaved with the 4-byte file offsets of the objects within the
@@ -139,6 +183,56 @@ int git_pack__lookup_id(
 	const unsigned char *id_prefix,
 	const git_oid_t oid_type);
 
+/**
+ * Start loading the entries of an .idx-style lookup table (with the
+ * given fanout table, in network byte order) that looking up each of
+ * the given ids will look at first, so that the lookups that follow
+ * do not wait on each of them in turn.
+ */
+void git_pack__lookup_id_prefetch(
+	const void *id_lookup_table,
+	size_t stride,
+	const uint32_t *fanout,
+	const git_oid *ids,
+	size_t count);
+
+/**
+ * Prefetch the parts of the pack index that looking up the given ids
+ * in it will need; see `git_pack__lookup_id_prefetch`.
+ */
+int git_pack_index_prefetch(
+	struct git_pack_file *p,
+	const git_oid *ids,
+	size_t count);
+
+/**
+ * Open the reverse index at `path` and validate it against the number
+ * of objects and the checksum of the packfile (or multi-pack-index)
+ * that it describes.  Returns `GIT_ENOTFOUND` if there is no such file.
+ * The index positions start `sizeof(struct git_pack_revindex_header)`
+ * bytes into the map, in network byte order.
+ */
+int git_pack__revindex_open(
+	git_map *out,
+	const char *path,
+	uint32_t num_objects,
+	const unsigned char *checksum,
+	git_oid_t oid_type);
+
+/**
+ * Write a reverse index to `path`, given the index position of each
+ * object in pack order and the checksum of the packfile (or
+ * multi-pack-index) that it describes.
+ */
+int git_pack__revindex_write(
+	const char *path,
+	const uint32_t *index_positions,
+	uint32_t num_objects,
+	const unsigned char *checksum,
+	git_oid_t oid_type,
+	mode_t mode,
+	bool do_fsync);
+
 struct git_pack_entry {
 	off64_t offset;
 	git_oid id;
@@ -195,6 +289,80 @@ int git_pack_entry_find(
 		struct git_pack_file *p,
 		const git_oid *short_id,
 		size_t len);
+
+/**
+ * Look up the position of the given object in the pack index, ie its
+ * position when all the objects in the pack are sorted by object ID.
+ */
+int git_pack_entry_find_position(
+		uint32_t *pos_out,
+		struct git_pack_file *p,
+		const git_oid *id);
+
+/**
+ * Copy the checksum of the packfile (as recorded in its index) into
+ * `out`, which must be able to hold `p->oid_size` bytes.
+ */
+int git_pack_checksum(unsigned char *out, struct git_pack_file *p);
+
+/**
+ * Look up the object ID and the offset of the object at the given
+ * position of the pack index.
+ */
+int git_pack_nth_entry(
+		git_oid *id_out,
+		off64_t *offset_out,
+		struct git_pack_file *p,
+		uint32_t n);
+
+/**
+ * Translate a position in pack order (ie, the `n`th object in the
+ * packfile when sorted by offset) to the position in the pack index.
+ */
+int git_pack_pos_to_index(
+		uint32_t *index_pos_out,
+		struct git_pack_file *p,
+		uint32_t pack_pos);
+
+/**
+ * Find the position in pack order of the object that starts at the
+ * given offset.
+ */
+int git_pack_offset_to_pack_pos(
+		uint32_t *pack_pos_out,
+		struct git_pack_file *p,
+		off64_t offset);
+
+/**
+ * Look up the extent of the packfile entry that starts at `offset`:
+ * `end_out` is set to the offset just past its last byte, and `crc_out`
+ * to the CRC32 of its bytes as recorded in the pack index.  Returns
+ * `GIT_ENOTFOUND` for version 1 indexes, which do not record a CRC.
+ */
+int git_pack_entry_extent(
+		off64_t *end_out,
+		uint32_t *crc_out,
+		struct git_pack_file *p,
+		off64_t offset);
+
+typedef int GIT_CALLBACK(git_packfile_raw_cb)(
+		const unsigned char *data,
+		size_t len,
+		void *payload);
+
+/**
+ * Pass the raw bytes of the packfile between `start` and `end` to
+ * `cb`, straight from the mapped windows and without inflating them.
+ * The callback may be called several times; a non-zero return from it
+ * stops the iteration and is returned.
+ */
+int git_packfile_foreach_raw(
+		struct git_pack_file *p,
+		off64_t start,
+		off64_t end,
+		git_packfile_raw_cb cb,
+		void *payload);
+
 int git_pack_foreach_entry(
 		struct git_pack_file *p,
 		git_odb_foreach_cb cb,
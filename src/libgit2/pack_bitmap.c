@@ -0,0 +1,1532 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "pack_bitmap.h"
+
+#include "array.h"
+#include "commit.h"
+#include "filebuf.h"
+#include "futils.h"
+#include "midx.h"
+#include "mwindow.h"
+#include "odb.h"
+#include "repository.h"
+#include "tag.h"
+#include "tree.h"
+
+#include "git2/object.h"
+
+#define BITMAP_HEADER_SIZE 12 /* signature, version, options, count */
+#define BITMAP_LOOKUP_TABLE_WIDTH 16
+
+static int bitmap_error(const char *message)
+{
+	git_error_set(GIT_ERROR_ODB, "invalid bitmap index: %s", message);
+	return -1;
+}
+
+GIT_INLINE(uint16_t) read_be16(const unsigned char *data)
+{
+	return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+GIT_INLINE(uint32_t) read_be32(const unsigned char *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	       ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+/*
+ * A bitmap index describes either a single packfile or all the objects
+ * of a multi-pack-index; these give the objects' ids and positions in
+ * "pack order" in whichever of them it is.
+ */
+GIT_INLINE(size_t) bitmap_num_objects(const git_pack_bitmap *bitmap)
+{
+	return bitmap->midx ? bitmap->midx->num_objects : bitmap->pack->num_objects;
+}
+
+/* Get the object at the given position in the index (object id order) */
+static int bitmap_nth_object(
+	git_oid *id,
+	struct git_pack_file **pack,
+	off64_t *offset,
+	const git_pack_bitmap *bitmap,
+	uint32_t index_pos)
+{
+	git_midx_entry e;
+	int error;
+
+	if (!bitmap->midx) {
+		if (pack)
+			*pack = bitmap->pack;
+
+		return git_pack_nth_entry(id, offset, bitmap->pack, index_pos);
+	}
+
+	if ((error = git_midx_nth_entry(&e, bitmap->midx, index_pos)) < 0)
+		return error;
+
+	if (e.pack_index >= git_vector_length(&bitmap->packs))
+		return bitmap_error("object is in an unknown packfile");
+
+	if (id)
+		git_oid_cpy(id, &e.sha1);
+	if (pack)
+		*pack = git_vector_get(&bitmap->packs, e.pack_index);
+	if (offset)
+		*offset = e.offset;
+
+	return 0;
+}
+
+static int bitmap_pos_to_index(
+	uint32_t *index_pos,
+	const git_pack_bitmap *bitmap,
+	uint32_t pack_pos)
+{
+	if (bitmap->midx)
+		return git_midx_pos_to_index(index_pos, bitmap->midx, pack_pos);
+
+	return git_pack_pos_to_index(index_pos, bitmap->pack, pack_pos);
+}
+
+static int bitmap_id_to_pos(
+	uint32_t *pack_pos,
+	const git_pack_bitmap *bitmap,
+	const git_oid *id)
+{
+	struct git_pack_entry e;
+	git_midx_entry midx_entry;
+	int error;
+
+	if (bitmap->midx) {
+		if ((error = git_midx_entry_find(&midx_entry, bitmap->midx, id,
+				git_oid_hexsize(bitmap->oid_type))) < 0)
+			return error;
+
+		*pack_pos = bitmap->pack_positions[midx_entry.position];
+		return 0;
+	}
+
+	if ((error = git_pack_entry_find(&e, bitmap->pack, id,
+			git_oid_hexsize(bitmap->oid_type))) < 0)
+		return error;
+
+	return git_pack_offset_to_pack_pos(pack_pos, bitmap->pack, e.offset);
+}
+
+/* A bitmap can only have bits for the objects in the packfile. */
+static int check_ewah_size(const git_pack_bitmap *bitmap, const git_ewah *ewah)
+{
+	size_t num_objects = bitmap_num_objects(bitmap);
+
+	/* The size is rounded up to whole words */
+	if (ewah->bit_size > (num_objects + 63) / 64 * 64)
+		return bitmap_error("bitmap is larger than the packfile");
+
+	return 0;
+}
+
+static int parse_type_bitmap(
+	git_bitmap *out,
+	const git_pack_bitmap *bitmap,
+	const unsigned char **data,
+	size_t *remain)
+{
+	git_ewah ewah;
+	size_t consumed;
+	int error;
+
+	if ((error = git_ewah_parse(&ewah, &consumed, *data, *remain)) < 0)
+		return error;
+
+	if ((error = check_ewah_size(bitmap, &ewah)) == 0)
+		error = git_ewah_to_bitmap(out, &ewah);
+
+	git_ewah_dispose(&ewah);
+
+	*data += consumed;
+	*remain -= consumed;
+
+	return error;
+}
+
+static int parse_entries(
+	git_pack_bitmap *bitmap,
+	const unsigned char *data,
+	size_t remain)
+{
+	git_pack_bitmap_entry *entry;
+	uint32_t i, index_pos;
+	size_t consumed;
+	int error;
+
+	if (!bitmap->entries_count)
+		return 0;
+
+	bitmap->entries = git__calloc(bitmap->entries_count, sizeof(git_pack_bitmap_entry));
+	GIT_ERROR_CHECK_ALLOC(bitmap->entries);
+
+	for (i = 0; i < bitmap->entries_count; i++) {
+		entry = &bitmap->entries[i];
+
+		if (remain < 6)
+			return bitmap_error("entry is truncated");
+
+		index_pos = read_be32(data);
+		entry->xor_offset = data[4];
+		entry->flags = data[5];
+
+		if (entry->xor_offset > GIT_PACK_BITMAP_MAX_XOR_OFFSET ||
+		    entry->xor_offset > i)
+			return bitmap_error("entry has an invalid xor offset");
+
+		if ((error = bitmap_nth_object(&entry->commit, NULL, NULL, bitmap, index_pos)) < 0)
+			return error;
+
+		if ((error = git_ewah_parse(&entry->stored, &consumed, data + 6, remain - 6)) < 0 ||
+		    (error = check_ewah_size(bitmap, &entry->stored)) < 0)
+			return error;
+
+		data += 6 + consumed;
+		remain -= 6 + consumed;
+
+		if (git_oidmap_set(bitmap->entry_map, &entry->commit, entry) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int bitmap_parse(git_pack_bitmap *bitmap)
+{
+	const unsigned char *data = bitmap->map.data;
+	unsigned char pack_checksum[GIT_OID_MAX_SIZE];
+	const unsigned char *checksum;
+	size_t remain = bitmap->map.len, oid_size, hashes_size, table_size;
+	int error;
+
+	oid_size = git_oid_size(bitmap->oid_type);
+
+	if (remain < BITMAP_HEADER_SIZE + oid_size * 2)
+		return bitmap_error("file is too short");
+
+	if (memcmp(data, GIT_PACK_BITMAP_SIGNATURE, 4) != 0)
+		return bitmap_error("incorrect signature");
+
+	if (read_be16(data + 4) != GIT_PACK_BITMAP_VERSION)
+		return bitmap_error("unsupported version");
+
+	bitmap->options = read_be16(data + 6);
+	bitmap->entries_count = read_be32(data + 8);
+
+	if ((bitmap->options & GIT_PACK_BITMAP_OPT_FULL_DAG) == 0)
+		return bitmap_error("bitmaps without a full closure are not supported");
+
+	if (bitmap->midx) {
+		checksum = bitmap->midx->checksum;
+	} else {
+		if ((error = git_pack_checksum(pack_checksum, bitmap->pack)) < 0)
+			return error;
+
+		checksum = pack_checksum;
+	}
+
+	if (memcmp(checksum, data + BITMAP_HEADER_SIZE, oid_size) != 0)
+		return bitmap_error("checksum does not match the packfile");
+
+	/* Strip the header and the trailing checksum */
+	data += BITMAP_HEADER_SIZE + oid_size;
+	remain -= BITMAP_HEADER_SIZE + oid_size * 2;
+
+	/* The optional extensions live at the end of the file */
+	if (bitmap->options & GIT_PACK_BITMAP_OPT_HASH_CACHE) {
+		if (GIT_MULTIPLY_SIZET_OVERFLOW(&hashes_size, bitmap_num_objects(bitmap), 4) ||
+		    hashes_size > remain)
+			return bitmap_error("hash cache is truncated");
+
+		remain -= hashes_size;
+		bitmap->hashes = data + remain;
+	}
+
+	if (bitmap->options & GIT_PACK_BITMAP_OPT_LOOKUP_TABLE) {
+		if (GIT_MULTIPLY_SIZET_OVERFLOW(&table_size, bitmap->entries_count, BITMAP_LOOKUP_TABLE_WIDTH) ||
+		    table_size > remain)
+			return bitmap_error("lookup table is truncated");
+
+		remain -= table_size;
+	}
+
+	if ((error = parse_type_bitmap(&bitmap->commits, bitmap, &data, &remain)) < 0 ||
+	    (error = parse_type_bitmap(&bitmap->trees, bitmap, &data, &remain)) < 0 ||
+	    (error = parse_type_bitmap(&bitmap->blobs, bitmap, &data, &remain)) < 0 ||
+	    (error = parse_type_bitmap(&bitmap->tags, bitmap, &data, &remain)) < 0)
+		return error;
+
+	return parse_entries(bitmap, data, remain);
+}
+
+static int bitmap_new(git_pack_bitmap **out, git_oid_t oid_type)
+{
+	git_pack_bitmap *bitmap;
+
+	bitmap = git__calloc(1, sizeof(git_pack_bitmap));
+	GIT_ERROR_CHECK_ALLOC(bitmap);
+
+	bitmap->oid_type = oid_type;
+
+	if (git_mutex_init(&bitmap->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize bitmap mutex");
+		git__free(bitmap);
+		return -1;
+	}
+
+	if (git_oidmap_new(&bitmap->entry_map) < 0) {
+		git_pack_bitmap_free(bitmap);
+		return -1;
+	}
+
+	*out = bitmap;
+	return 0;
+}
+
+/* Map the bitmap index file, once what it describes has been opened */
+static int bitmap_load(git_pack_bitmap *bitmap, const char *path)
+{
+	git_file fd;
+	struct stat st;
+	int error;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	if (p_fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !git__is_sizet(st.st_size)) {
+		git_error_set(GIT_ERROR_ODB, "invalid bitmap index '%s'", path);
+		p_close(fd);
+		return -1;
+	}
+
+	error = git_futils_mmap_ro(&bitmap->map, fd, 0, (size_t)st.st_size);
+	p_close(fd);
+
+	if (error < 0)
+		return error;
+
+	return bitmap_parse(bitmap);
+}
+
+int git_pack_bitmap_open(
+	git_pack_bitmap **out,
+	const char *path,
+	git_oid_t oid_type)
+{
+	git_pack_bitmap *bitmap = NULL;
+	git_str idx_path = GIT_STR_INIT;
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(path);
+
+	*out = NULL;
+
+	if (git__suffixcmp(path, ".bitmap") != 0) {
+		git_error_set(GIT_ERROR_ODB, "invalid bitmap index path '%s'", path);
+		return -1;
+	}
+
+	if ((error = bitmap_new(&bitmap, oid_type)) < 0 ||
+	    (error = git_str_set(&idx_path, path, strlen(path) - strlen(".bitmap"))) < 0 ||
+	    (error = git_str_puts(&idx_path, ".idx")) < 0 ||
+	    (error = git_mwindow_get_pack(&bitmap->pack, idx_path.ptr, oid_type)) < 0 ||
+	    (error = bitmap_load(bitmap, path)) < 0)
+		goto done;
+
+	*out = bitmap;
+
+done:
+	if (error < 0)
+		git_pack_bitmap_free(bitmap);
+
+	git_str_dispose(&idx_path);
+	return error;
+}
+
+/*
+ * The objects of a multi-pack-index are in "pseudo-pack" order in its
+ * bitmap, which its reverse index maps to their positions in the midx;
+ * invert it to find the bit of an object.
+ */
+static int midx_bitmap_positions(git_pack_bitmap *bitmap)
+{
+	git_midx_file *midx = bitmap->midx;
+	uint32_t pack_pos, index_pos;
+	int error;
+
+	bitmap->pack_positions = git__mallocarray(midx->num_objects, sizeof(uint32_t));
+	GIT_ERROR_CHECK_ALLOC(bitmap->pack_positions);
+
+	for (pack_pos = 0; pack_pos < midx->num_objects; pack_pos++) {
+		if ((error = git_midx_pos_to_index(&index_pos, midx, pack_pos)) < 0)
+			return error;
+
+		bitmap->pack_positions[index_pos] = pack_pos;
+	}
+
+	return 0;
+}
+
+static int midx_bitmap_packs(git_pack_bitmap *bitmap, const char *midx_path)
+{
+	git_str pack_dir = GIT_STR_INIT, idx_path = GIT_STR_INIT;
+	struct git_pack_file *p;
+	const char *name;
+	size_t i;
+	int error;
+
+	if ((error = git_fs_path_dirname_r(&pack_dir, midx_path)) < 0 ||
+	    (error = git_vector_init(&bitmap->packs,
+			git_vector_length(&bitmap->midx->packfile_names), NULL)) < 0)
+		goto done;
+
+	git_vector_foreach(&bitmap->midx->packfile_names, i, name) {
+		if ((error = git_str_joinpath(&idx_path, pack_dir.ptr, name)) < 0 ||
+		    (error = git_mwindow_get_pack(&p, idx_path.ptr, bitmap->oid_type)) < 0)
+			goto done;
+
+		if ((error = git_vector_insert(&bitmap->packs, p)) < 0) {
+			git_mwindow_put_pack(p);
+			goto done;
+		}
+	}
+
+done:
+	git_str_dispose(&idx_path);
+	git_str_dispose(&pack_dir);
+	return error;
+}
+
+int git_pack_bitmap_open_midx(
+	git_pack_bitmap **out,
+	const char *midx_path,
+	git_oid_t oid_type)
+{
+	git_pack_bitmap *bitmap = NULL;
+	git_str path = GIT_STR_INIT;
+	char checksum_hex[GIT_HASH_MAX_SIZE * 2 + 1];
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(midx_path);
+
+	*out = NULL;
+
+	if ((error = bitmap_new(&bitmap, oid_type)) < 0 ||
+	    (error = git_midx_open(&bitmap->midx, midx_path, oid_type)) < 0)
+		goto done;
+
+	git_hash_fmt(checksum_hex, bitmap->midx->checksum, git_oid_size(oid_type));
+
+	if ((error = git_str_printf(&path, "%s-%s.bitmap", midx_path, checksum_hex)) < 0)
+		goto done;
+
+	if (!git_fs_path_isfile(path.ptr)) {
+		git_error_set(GIT_ERROR_ODB, "multi-pack-index has no bitmap index");
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if ((error = midx_bitmap_packs(bitmap, midx_path)) < 0 ||
+	    (error = midx_bitmap_positions(bitmap)) < 0 ||
+	    (error = bitmap_load(bitmap, path.ptr)) < 0)
+		goto done;
+
+	*out = bitmap;
+
+done:
+	if (error < 0)
+		git_pack_bitmap_free(bitmap);
+
+	git_str_dispose(&path);
+	return error;
+}
+
+/*
+ * Collect the bitmaps of packfiles whose index and pack are both there;
+ * those of a multi-pack-index are named differently and skipped, as it
+ * is looked at separately.
+ */
+static int find_bitmap_cb(void *payload, git_str *path)
+{
+	git_vector *found = payload;
+	git_str other = GIT_STR_INIT;
+	const char *filename = path->ptr + path->size;
+	size_t base_len;
+	char *bitmap_path;
+	int error = 0;
+
+	while (filename > path->ptr && filename[-1] != '/')
+		filename--;
+
+	if (git__prefixcmp(filename, "pack-") != 0 ||
+	    git__suffixcmp(filename, ".bitmap") != 0)
+		return 0;
+
+	base_len = path->size - strlen(".bitmap");
+
+	if ((error = git_str_set(&other, path->ptr, base_len)) < 0 ||
+	    (error = git_str_puts(&other, ".idx")) < 0)
+		goto done;
+
+	if (!git_fs_path_isfile(other.ptr))
+		goto done;
+
+	git_str_truncate(&other, base_len);
+
+	if ((error = git_str_puts(&other, ".pack")) < 0)
+		goto done;
+
+	if (!git_fs_path_isfile(other.ptr))
+		goto done;
+
+	if ((bitmap_path = git__strndup(path->ptr, path->size)) == NULL ||
+	    (error = git_vector_insert(found, bitmap_path)) < 0) {
+		git__free(bitmap_path);
+		error = -1;
+	}
+
+done:
+	git_str_dispose(&other);
+	return error;
+}
+
+int git_pack_bitmap_find(git_pack_bitmap **out, git_repository *repo)
+{
+	git_str pack_dir = GIT_STR_INIT, midx_path = GIT_STR_INIT;
+	git_vector found = GIT_VECTOR_INIT;
+	char *path;
+	size_t i;
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(repo);
+
+	*out = NULL;
+
+	if ((error = git_repository__item_path(&pack_dir, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_str_joinpath(&pack_dir, pack_dir.ptr, "pack")) < 0 ||
+	    (error = git_vector_init(&found, 4, git__strcmp_cb)) < 0)
+		goto done;
+
+	if (!git_fs_path_isdir(pack_dir.ptr)) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	/* Like git, prefer the bitmap of the multi-pack-index if it has one */
+	if ((error = git_str_joinpath(&midx_path, pack_dir.ptr, "multi-pack-index")) < 0)
+		goto done;
+
+	if (git_fs_path_isfile(midx_path.ptr)) {
+		if ((error = git_pack_bitmap_open_midx(out, midx_path.ptr, repo->oid_type)) == 0)
+			goto done;
+
+		git_error_clear();
+	}
+
+	if ((error = git_fs_path_direach(&pack_dir, 0, find_bitmap_cb, &found)) < 0)
+		goto done;
+
+	/*
+	 * Use the first bitmap by name that can be opened, so that the
+	 * same one is used whatever order the directory is listed in.
+	 */
+	git_vector_sort(&found);
+	error = GIT_ENOTFOUND;
+
+	git_vector_foreach(&found, i, path) {
+		if ((error = git_pack_bitmap_open(out, path, repo->oid_type)) == 0)
+			break;
+	}
+
+done:
+	if (error == GIT_ENOTFOUND)
+		git_error_set(GIT_ERROR_ODB, "no bitmap index found in repository");
+
+	git_vector_foreach(&found, i, path)
+		git__free(path);
+	git_vector_free(&found);
+	git_str_dispose(&midx_path);
+	git_str_dispose(&pack_dir);
+	return error;
+}
+
+void git_pack_bitmap_free(git_pack_bitmap *bitmap)
+{
+	struct git_pack_file *p;
+	size_t j;
+	uint32_t i;
+
+	if (!bitmap)
+		return;
+
+	if (bitmap->entries) {
+		for (i = 0; i < bitmap->entries_count; i++) {
+			git_ewah_dispose(&bitmap->entries[i].stored);
+			git_ewah_dispose(&bitmap->entries[i].resolved);
+		}
+	}
+
+	git__free(bitmap->entries);
+	git_oidmap_free(bitmap->entry_map);
+
+	git_bitmap_dispose(&bitmap->commits);
+	git_bitmap_dispose(&bitmap->trees);
+	git_bitmap_dispose(&bitmap->blobs);
+	git_bitmap_dispose(&bitmap->tags);
+
+	if (bitmap->map.data)
+		git_futils_mmap_free(&bitmap->map);
+
+	if (bitmap->pack)
+		git_mwindow_put_pack(bitmap->pack);
+
+	git_vector_foreach(&bitmap->packs, j, p)
+		git_mwindow_put_pack(p);
+	git_vector_free(&bitmap->packs);
+
+	git__free(bitmap->pack_positions);
+	git_midx_free(bitmap->midx);
+
+	git_mutex_free(&bitmap->lock);
+	git__free(bitmap);
+}
+
+size_t git_pack_bitmap_objects(git_pack_bitmap *bitmap)
+{
+	GIT_ASSERT_ARG_WITH_RETVAL(bitmap, 0);
+	return bitmap_num_objects(bitmap);
+}
+
+GIT_INLINE(const git_ewah *) entry_ewah(const git_pack_bitmap_entry *entry)
+{
+	return entry->xor_offset ? &entry->resolved : &entry->stored;
+}
+
+/*
+ * Stored bitmaps may be XOR'd against an earlier entry; resolve the
+ * chain (oldest first) and cache the result on each entry along the
+ * way.  Must be called with the bitmap lock held.
+ */
+static int entry_resolve_locked(git_pack_bitmap_entry *entry)
+{
+	git_array_t(git_pack_bitmap_entry *) chain = GIT_ARRAY_INIT;
+	git_pack_bitmap_entry **link, *current = entry;
+	git_bitmap composed = GIT_BITMAP_INIT;
+	int error = 0;
+
+	while (current->xor_offset && !current->is_resolved) {
+		link = git_array_alloc(chain);
+		GIT_ERROR_CHECK_ALLOC(link);
+
+		*link = current;
+		current -= current->xor_offset;
+	}
+
+	while ((link = git_array_pop(chain)) != NULL) {
+		current = *link;
+
+		if ((error = git_ewah_to_bitmap(&composed, entry_ewah(current - current->xor_offset))) < 0 ||
+		    (error = git_ewah_xor_into(&composed, &current->stored)) < 0 ||
+		    (error = git_ewah_from_bitmap(&current->resolved, &composed)) < 0)
+			goto done;
+
+		current->is_resolved = 1;
+	}
+
+done:
+	git_bitmap_dispose(&composed);
+	git_array_clear(chain);
+	return error;
+}
+
+static int entry_or_into(
+	git_bitmap *out,
+	git_pack_bitmap *bitmap,
+	git_pack_bitmap_entry *entry)
+{
+	int error;
+
+	if (git_mutex_lock(&bitmap->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock bitmap index");
+		return -1;
+	}
+
+	if ((error = entry_resolve_locked(entry)) == 0)
+		error = git_ewah_or_into(out, entry_ewah(entry));
+
+	git_mutex_unlock(&bitmap->lock);
+	return error;
+}
+
+int git_pack_bitmap_lookup(
+	git_bitmap *out,
+	git_pack_bitmap *bitmap,
+	const git_oid *commit_id)
+{
+	git_pack_bitmap_entry *entry;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(bitmap);
+	GIT_ASSERT_ARG(commit_id);
+
+	if ((entry = git_oidmap_get(bitmap->entry_map, commit_id)) == NULL)
+		return git_odb__error_notfound("no bitmap for commit", commit_id,
+			git_oid_hexsize(bitmap->oid_type));
+
+	git_bitmap_clear(out);
+	return entry_or_into(out, bitmap, entry);
+}
+
+typedef git_array_t(git_oid) reachable_stack;
+
+GIT_INLINE(int) push_id(reachable_stack *stack, const git_oid *id)
+{
+	git_oid *entry = git_array_alloc(*stack);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	git_oid_cpy(entry, id);
+	return 0;
+}
+
+static int push_children(
+	reachable_stack *stack,
+	git_repository *repo,
+	const git_oid *id)
+{
+	git_object *object;
+	const git_tree_entry *tree_entry;
+	size_t i, cnt;
+	int error;
+
+	if ((error = git_object_lookup(&object, repo, id, GIT_OBJECT_ANY)) < 0)
+		return error;
+
+	switch (git_object_type(object)) {
+	case GIT_OBJECT_COMMIT:
+		if ((error = push_id(stack, git_commit_tree_id((git_commit *)object))) < 0)
+			break;
+
+		cnt = git_commit_parentcount((git_commit *)object);
+
+		for (i = 0; i < cnt && !error; i++)
+			error = push_id(stack, git_commit_parent_id((git_commit *)object, (unsigned int)i));
+		break;
+
+	case GIT_OBJECT_TREE:
+		cnt = git_tree_entrycount((git_tree *)object);
+
+		for (i = 0; i < cnt && !error; i++) {
+			tree_entry = git_tree_entry_byindex((git_tree *)object, i);
+
+			/* Submodules are not part of this repository's graph */
+			if (git_tree_entry_type(tree_entry) == GIT_OBJECT_COMMIT)
+				continue;
+
+			error = push_id(stack, git_tree_entry_id(tree_entry));
+		}
+		break;
+
+	case GIT_OBJECT_TAG:
+		error = push_id(stack, git_tag_target_id((git_tag *)object));
+		break;
+
+	default:
+		break;
+	}
+
+	git_object_free(object);
+	return error;
+}
+
+/*
+ * The object graph walk behind reachability queries, shared by the
+ * reader and the writer: they differ only in how an object's bit
+ * position is found and in where the already computed bitmaps for
+ * commits come from.
+ */
+typedef struct {
+	git_repository *repo;
+	const git_bitmap *commits;
+	const git_bitmap *blobs;
+
+	int GIT_CALLBACK(position)(uint32_t *out, const git_oid *id, void *payload);
+
+	/* OR the commit's bitmap into `out`, or return `GIT_ENOTFOUND` */
+	int GIT_CALLBACK(stored)(git_bitmap *out, const git_oid *id, void *payload);
+
+	void *payload;
+} reachable_walk;
+
+static int reachable(
+	git_bitmap *out,
+	reachable_walk *walk,
+	const git_oid *tips,
+	size_t tips_count,
+	bool allow_missing)
+{
+	reachable_stack stack = GIT_ARRAY_INIT;
+	git_oid *top, id;
+	uint32_t pos;
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < tips_count; i++) {
+		if ((error = push_id(&stack, &tips[i])) < 0)
+			goto done;
+	}
+
+	while ((top = git_array_pop(stack)) != NULL) {
+		git_oid_cpy(&id, top);
+
+		if ((error = walk->position(&pos, &id, walk->payload)) < 0) {
+			if (error == GIT_ENOTFOUND && allow_missing) {
+				git_error_clear();
+				error = 0;
+				continue;
+			}
+
+			goto done;
+		}
+
+		if (git_bitmap_get(out, pos))
+			continue;
+
+		/*
+		 * A commit's bitmap contains its full closure, so there is no
+		 * need to walk any further.
+		 */
+		if (git_bitmap_get(walk->commits, pos)) {
+			if ((error = walk->stored(out, &id, walk->payload)) == 0)
+				continue;
+			else if (error != GIT_ENOTFOUND)
+				goto done;
+
+			error = 0;
+		}
+
+		if ((error = git_bitmap_set(out, pos)) < 0)
+			goto done;
+
+		if (git_bitmap_get(walk->blobs, pos))
+			continue;
+
+		if ((error = push_children(&stack, walk->repo, &id)) < 0)
+			goto done;
+	}
+
+done:
+	git_array_clear(stack);
+	return error;
+}
+
+static int reader_position(uint32_t *out, const git_oid *id, void *payload)
+{
+	return bitmap_id_to_pos(out, payload, id);
+}
+
+static int reader_stored(git_bitmap *out, const git_oid *id, void *payload)
+{
+	git_pack_bitmap *bitmap = payload;
+	git_pack_bitmap_entry *entry;
+
+	if ((entry = git_oidmap_get(bitmap->entry_map, id)) == NULL)
+		return GIT_ENOTFOUND;
+
+	return entry_or_into(out, bitmap, entry);
+}
+
+int git_pack_bitmap_reachable(
+	git_bitmap *out,
+	git_pack_bitmap *bitmap,
+	git_repository *repo,
+	const git_oid *tips,
+	size_t tips_count,
+	bool allow_missing)
+{
+	reachable_walk walk;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(bitmap);
+	GIT_ASSERT_ARG(repo);
+	GIT_ASSERT_ARG(tips || !tips_count);
+
+	walk.repo = repo;
+	walk.commits = &bitmap->commits;
+	walk.blobs = &bitmap->blobs;
+	walk.position = reader_position;
+	walk.stored = reader_stored;
+	walk.payload = bitmap;
+
+	return reachable(out, &walk, tips, tips_count, allow_missing);
+}
+
+int git_pack_bitmap_foreach(
+	git_pack_bitmap *bitmap,
+	const git_bitmap *set,
+	git_object_t type,
+	git_pack_bitmap_foreach_cb cb,
+	void *payload)
+{
+	git_object_t object_type;
+	struct git_pack_file *pack;
+	uint32_t index_pos, name_hash;
+	off64_t offset;
+	git_oid id;
+	size_t pos;
+	int error;
+
+	GIT_ASSERT_ARG(bitmap);
+	GIT_ASSERT_ARG(set);
+	GIT_ASSERT_ARG(cb);
+
+	git_bitmap_foreach(set, pos) {
+		if (pos >= bitmap_num_objects(bitmap))
+			break;
+
+		if (git_bitmap_get(&bitmap->commits, pos)) {
+			object_type = GIT_OBJECT_COMMIT;
+		} else if (git_bitmap_get(&bitmap->trees, pos)) {
+			object_type = GIT_OBJECT_TREE;
+		} else if (git_bitmap_get(&bitmap->blobs, pos)) {
+			object_type = GIT_OBJECT_BLOB;
+		} else if (git_bitmap_get(&bitmap->tags, pos)) {
+			object_type = GIT_OBJECT_TAG;
+		} else {
+			return bitmap_error("object has no type");
+		}
+
+		if (type != GIT_OBJECT_ANY && type != object_type)
+			continue;
+
+		if ((error = bitmap_pos_to_index(&index_pos, bitmap, (uint32_t)pos)) < 0 ||
+		    (error = bitmap_nth_object(&id, &pack, &offset, bitmap, index_pos)) < 0)
+			return error;
+
+		name_hash = bitmap->hashes ? read_be32(bitmap->hashes + (index_pos * 4)) : 0;
+
+		if ((error = cb(&id, object_type, pack, offset, name_hash, payload)) != 0)
+			return git_error_set_after_callback(error);
+	}
+
+	return 0;
+}
+
+/*
+ * Commit selection follows git: every commit is bitmapped in small
+ * packs; otherwise the most recent commits are all selected, and
+ * further back in history the gap between selected commits grows,
+ * preferring the tips of the history and merges within each gap.
+ */
+#define SELECT_MIN_COMMITS  100
+#define SELECT_MAX_COMMITS  5000
+#define SELECT_MUST_REGION  100
+#define SELECT_MIN_REGION   20000
+
+/* How many earlier entries to try XOR'ing each bitmap against */
+#define XOR_SEARCH_DEPTH 10
+
+typedef struct {
+	git_oid id;
+	git_object_t type;
+	uint32_t index_pos;
+	uint32_t name_hash;
+} bitmap_writer_object;
+
+typedef struct {
+	const git_oid *id;
+	uint32_t pos;
+	int64_t time;
+
+	git_ewah bitmap;
+
+	unsigned int tip : 1,
+	             merge : 1,
+	             selected : 1,
+	             computed : 1;
+} bitmap_writer_commit;
+
+struct git_pack_bitmap_writer {
+	git_repository *repo;
+
+	bitmap_writer_object *objects;
+	size_t objects_count;
+	size_t objects_alloc;
+
+	/* Maps object ids to their entry in `objects` */
+	git_oidmap *positions;
+
+	git_bitmap commits;
+	git_bitmap trees;
+	git_bitmap blobs;
+	git_bitmap tags;
+
+	bitmap_writer_commit *commit_list;
+	size_t commit_list_count;
+	git_oidmap *commit_map;
+
+	unsigned int has_hashes : 1;
+};
+
+int git_pack_bitmap_writer_new(
+	git_pack_bitmap_writer **out,
+	git_repository *repo,
+	size_t objects_count)
+{
+	git_pack_bitmap_writer *w;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(repo);
+
+	if (objects_count > UINT32_MAX) {
+		git_error_set(GIT_ERROR_INVALID, "too many objects for a bitmap index");
+		return -1;
+	}
+
+	w = git__calloc(1, sizeof(git_pack_bitmap_writer));
+	GIT_ERROR_CHECK_ALLOC(w);
+
+	w->repo = repo;
+
+	if (objects_count) {
+		w->objects = git__calloc(objects_count, sizeof(bitmap_writer_object));
+		GIT_ERROR_CHECK_ALLOC(w->objects);
+	}
+
+	w->objects_alloc = objects_count;
+
+	if (git_oidmap_new(&w->positions) < 0 ||
+	    git_oidmap_new(&w->commit_map) < 0) {
+		git_pack_bitmap_writer_free(w);
+		return -1;
+	}
+
+	*out = w;
+	return 0;
+}
+
+int git_pack_bitmap_writer_add(
+	git_pack_bitmap_writer *w,
+	const git_oid *id,
+	git_object_t type,
+	uint32_t index_pos,
+	uint32_t name_hash)
+{
+	bitmap_writer_object *object;
+	git_bitmap *type_bitmap;
+	size_t pos;
+
+	GIT_ASSERT_ARG(w);
+	GIT_ASSERT_ARG(id);
+
+	if (w->objects_count == w->objects_alloc) {
+		git_error_set(GIT_ERROR_INVALID, "too many objects added to bitmap index");
+		return -1;
+	}
+
+	switch (type) {
+	case GIT_OBJECT_COMMIT:
+		type_bitmap = &w->commits;
+		break;
+	case GIT_OBJECT_TREE:
+		type_bitmap = &w->trees;
+		break;
+	case GIT_OBJECT_BLOB:
+		type_bitmap = &w->blobs;
+		break;
+	case GIT_OBJECT_TAG:
+		type_bitmap = &w->tags;
+		break;
+	default:
+		git_error_set(GIT_ERROR_INVALID, "invalid object type for bitmap index");
+		return -1;
+	}
+
+	pos = w->objects_count++;
+	object = &w->objects[pos];
+
+	git_oid_cpy(&object->id, id);
+	object->type = type;
+	object->index_pos = index_pos;
+	object->name_hash = name_hash;
+
+	if (name_hash)
+		w->has_hashes = 1;
+
+	if (git_bitmap_set(type_bitmap, pos) < 0 ||
+	    git_oidmap_set(w->positions, &object->id, object) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int load_commits(git_pack_bitmap_writer *w)
+{
+	bitmap_writer_commit *commit, *parent;
+	git_commit *c;
+	size_t pos, i, cnt;
+	int error;
+
+	if ((cnt = git_bitmap_popcount(&w->commits)) == 0)
+		return 0;
+
+	w->commit_list = git__calloc(cnt, sizeof(bitmap_writer_commit));
+	GIT_ERROR_CHECK_ALLOC(w->commit_list);
+
+	git_bitmap_foreach(&w->commits, pos) {
+		commit = &w->commit_list[w->commit_list_count++];
+		commit->id = &w->objects[pos].id;
+		commit->pos = (uint32_t)pos;
+		commit->tip = 1;
+
+		if (git_oidmap_set(w->commit_map, commit->id, commit) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < w->commit_list_count; i++) {
+		commit = &w->commit_list[i];
+
+		if ((error = git_commit_lookup(&c, w->repo, commit->id)) < 0)
+			return error;
+
+		commit->time = git_commit_time(c);
+		commit->merge = git_commit_parentcount(c) > 1;
+
+		for (cnt = 0; cnt < git_commit_parentcount(c); cnt++) {
+			parent = git_oidmap_get(w->commit_map,
+				git_commit_parent_id(c, (unsigned int)cnt));
+
+			if (parent)
+				parent->tip = 0;
+		}
+
+		git_commit_free(c);
+	}
+
+	return 0;
+}
+
+static int commit_recency_cmp(const void *a_, const void *b_, void *payload)
+{
+	const bitmap_writer_commit *a = *(const bitmap_writer_commit **)a_;
+	const bitmap_writer_commit *b = *(const bitmap_writer_commit **)b_;
+
+	GIT_UNUSED(payload);
+
+	if (a->time != b->time)
+		return a->time > b->time ? -1 : 1;
+
+	return git_oid_cmp(a->id, b->id);
+}
+
+static size_t next_commit_index(size_t idx)
+{
+	size_t offset, next;
+
+	if (idx <= SELECT_MUST_REGION)
+		return 0;
+
+	if (idx <= SELECT_MIN_REGION) {
+		offset = idx - SELECT_MUST_REGION;
+		return min(offset, SELECT_MIN_COMMITS);
+	}
+
+	offset = idx - SELECT_MIN_REGION;
+	next = min(offset, SELECT_MAX_COMMITS);
+
+	return max(next, SELECT_MIN_COMMITS);
+}
+
+/*
+ * Select the commits to store bitmaps for, and return them sorted from
+ * the oldest to the most recent, so that (most of the time) the
+ * bitmaps for a commit's ancestors are built before the commit's own.
+ */
+static int select_commits(
+	bitmap_writer_commit ***out,
+	size_t *out_count,
+	git_pack_bitmap_writer *w)
+{
+	bitmap_writer_commit **sorted, **selected, *chosen;
+	size_t i, j, next, selected_count = 0;
+
+	*out = NULL;
+	*out_count = 0;
+
+	if (!w->commit_list_count)
+		return 0;
+
+	sorted = git__mallocarray(w->commit_list_count, sizeof(bitmap_writer_commit *));
+	GIT_ERROR_CHECK_ALLOC(sorted);
+
+	selected = git__mallocarray(w->commit_list_count, sizeof(bitmap_writer_commit *));
+	if (!selected) {
+		git__free(sorted);
+		return -1;
+	}
+
+	for (i = 0; i < w->commit_list_count; i++)
+		sorted[i] = &w->commit_list[i];
+
+	git__qsort_r(sorted, w->commit_list_count, sizeof(bitmap_writer_commit *),
+		commit_recency_cmp, NULL);
+
+	if (w->commit_list_count < SELECT_MIN_COMMITS) {
+		for (i = 0; i < w->commit_list_count; i++)
+			selected[selected_count++] = sorted[i];
+	} else {
+		for (i = 0; ; i += next + 1) {
+			next = next_commit_index(i);
+
+			if (i + next >= w->commit_list_count)
+				break;
+
+			chosen = sorted[i + next];
+
+			for (j = 0; next && j <= next; j++) {
+				if (sorted[i + j]->tip) {
+					chosen = sorted[i + j];
+					break;
+				}
+
+				if (sorted[i + j]->merge)
+					chosen = sorted[i + j];
+			}
+
+			selected[selected_count++] = chosen;
+		}
+	}
+
+	/* Reverse into oldest-first order */
+	for (i = 0; i < selected_count / 2; i++) {
+		chosen = selected[i];
+		selected[i] = selected[selected_count - i - 1];
+		selected[selected_count - i - 1] = chosen;
+	}
+
+	for (i = 0; i < selected_count; i++)
+		selected[i]->selected = 1;
+
+	git__free(sorted);
+
+	*out = selected;
+	*out_count = selected_count;
+	return 0;
+}
+
+static int writer_position(uint32_t *out, const git_oid *id, void *payload)
+{
+	git_pack_bitmap_writer *w = payload;
+	bitmap_writer_object *object;
+
+	if ((object = git_oidmap_get(w->positions, id)) == NULL) {
+		git_error_set(GIT_ERROR_ODB, "object is not in the packfile");
+		return GIT_ENOTFOUND;
+	}
+
+	*out = (uint32_t)(object - w->objects);
+	return 0;
+}
+
+static int writer_stored(git_bitmap *out, const git_oid *id, void *payload)
+{
+	git_pack_bitmap_writer *w = payload;
+	bitmap_writer_commit *commit;
+
+	if ((commit = git_oidmap_get(w->commit_map, id)) == NULL ||
+	    !commit->computed)
+		return GIT_ENOTFOUND;
+
+	return git_ewah_or_into(out, &commit->bitmap);
+}
+
+/*
+ * Build the bitmaps for the selected commits.  Commits whose history
+ * is not entirely contained in the packfile cannot be bitmapped; they
+ * are dropped from the selection.
+ */
+static int compute_bitmaps(
+	git_pack_bitmap_writer *w,
+	bitmap_writer_commit **selected,
+	size_t selected_count)
+{
+	git_bitmap bitmap = GIT_BITMAP_INIT;
+	reachable_walk walk;
+	size_t i;
+	int error = 0;
+
+	walk.repo = w->repo;
+	walk.commits = &w->commits;
+	walk.blobs = &w->blobs;
+	walk.position = writer_position;
+	walk.stored = writer_stored;
+	walk.payload = w;
+
+	for (i = 0; i < selected_count; i++) {
+		git_bitmap_clear(&bitmap);
+
+		error = reachable(&bitmap, &walk, selected[i]->id, 1, false);
+
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			selected[i]->selected = 0;
+			error = 0;
+			continue;
+		} else if (error < 0) {
+			break;
+		}
+
+		if ((error = git_ewah_from_bitmap(&selected[i]->bitmap, &bitmap)) < 0)
+			break;
+
+		selected[i]->computed = 1;
+	}
+
+	git_bitmap_dispose(&bitmap);
+	return error;
+}
+
+GIT_INLINE(int) put_be32(git_str *out, uint32_t value)
+{
+	unsigned char data[4];
+
+	data[0] = (unsigned char)(value >> 24);
+	data[1] = (unsigned char)(value >> 16);
+	data[2] = (unsigned char)(value >> 8);
+	data[3] = (unsigned char)value;
+
+	return git_str_put(out, (const char *)data, 4);
+}
+
+static int write_type_bitmap(git_str *out, const git_bitmap *bitmap)
+{
+	git_ewah ewah;
+	int error;
+
+	if ((error = git_ewah_from_bitmap(&ewah, bitmap)) == 0)
+		error = git_ewah_serialize(out, &ewah);
+
+	git_ewah_dispose(&ewah);
+	return error;
+}
+
+/*
+ * Write the entry for a commit, XOR'd against whichever of the last
+ * few entries gives the smallest result (if that is any smaller than
+ * the bitmap itself).
+ */
+static int write_entry(
+	git_str *out,
+	git_pack_bitmap_writer *w,
+	bitmap_writer_commit **written,
+	size_t written_count)
+{
+	bitmap_writer_commit *commit = written[written_count];
+	git_bitmap current = GIT_BITMAP_INIT, candidate = GIT_BITMAP_INIT;
+	git_ewah best = GIT_EWAH_INIT, xored = GIT_EWAH_INIT;
+	size_t depth, best_offset = 0;
+	unsigned char data[2];
+	int error;
+
+	if ((error = git_ewah_to_bitmap(&current, &commit->bitmap)) < 0)
+		goto done;
+
+	for (depth = 1; depth <= XOR_SEARCH_DEPTH && depth <= written_count; depth++) {
+		if ((error = git_ewah_to_bitmap(&candidate, &written[written_count - depth]->bitmap)) < 0 ||
+		    (error = git_bitmap_xor(&candidate, &current)) < 0 ||
+		    (error = git_ewah_from_bitmap(&xored, &candidate)) < 0)
+			goto done;
+
+		if (xored.buffer_size < (best_offset ? best.buffer_size : commit->bitmap.buffer_size)) {
+			git_ewah_dispose(&best);
+			memcpy(&best, &xored, sizeof(git_ewah));
+			memset(&xored, 0x0, sizeof(git_ewah));
+			best_offset = depth;
+		} else {
+			git_ewah_dispose(&xored);
+		}
+	}
+
+	data[0] = (unsigned char)best_offset;
+	data[1] = 0;
+
+	if ((error = put_be32(out, w->objects[commit->pos].index_pos)) < 0 ||
+	    (error = git_str_put(out, (const char *)data, 2)) < 0)
+		goto done;
+
+	error = git_ewah_serialize(out, best_offset ? &best : &commit->bitmap);
+
+done:
+	git_bitmap_dispose(&current);
+	git_bitmap_dispose(&candidate);
+	git_ewah_dispose(&best);
+	git_ewah_dispose(&xored);
+	return error;
+}
+
+static int write_bitmap(
+	git_str *out,
+	git_pack_bitmap_writer *w,
+	bitmap_writer_commit **selected,
+	size_t selected_count,
+	const unsigned char *checksum)
+{
+	bitmap_writer_commit **written = NULL;
+	uint32_t *hashes = NULL;
+	unsigned char trailer[GIT_HASH_MAX_SIZE];
+	git_hash_algorithm_t algorithm;
+	uint16_t options = GIT_PACK_BITMAP_OPT_FULL_DAG;
+	size_t oid_size, written_count = 0, i;
+	int error;
+
+	algorithm = git_hash_checksum_algorithm(git_oid_algorithm(w->repo->oid_type));
+	oid_size = git_oid_size(w->repo->oid_type);
+
+	if (w->has_hashes)
+		options |= GIT_PACK_BITMAP_OPT_HASH_CACHE;
+
+	if (selected_count) {
+		written = git__mallocarray(selected_count, sizeof(bitmap_writer_commit *));
+		GIT_ERROR_CHECK_ALLOC(written);
+	}
+
+	for (i = 0; i < selected_count; i++) {
+		if (selected[i]->computed)
+			written[written_count++] = selected[i];
+	}
+
+	git_str_put(out, GIT_PACK_BITMAP_SIGNATURE, 4);
+	git_str_putc(out, 0);
+	git_str_putc(out, GIT_PACK_BITMAP_VERSION);
+	git_str_putc(out, (char)(options >> 8));
+	git_str_putc(out, (char)(options & 0xff));
+	put_be32(out, (uint32_t)written_count);
+	git_str_put(out, (const char *)checksum, oid_size);
+
+	if (git_str_oom(out)) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = write_type_bitmap(out, &w->commits)) < 0 ||
+	    (error = write_type_bitmap(out, &w->trees)) < 0 ||
+	    (error = write_type_bitmap(out, &w->blobs)) < 0 ||
+	    (error = write_type_bitmap(out, &w->tags)) < 0)
+		goto done;
+
+	for (i = 0; i < written_count; i++) {
+		if ((error = write_entry(out, w, written, i)) < 0)
+			goto done;
+	}
+
+	if (w->has_hashes) {
+		if (w->objects_count) {
+			hashes = git__calloc(w->objects_count, sizeof(uint32_t));
+			GIT_ERROR_CHECK_ALLOC(hashes);
+		}
+
+		for (i = 0; i < w->objects_count; i++) {
+			if (w->objects[i].index_pos >= w->objects_count) {
+				git_error_set(GIT_ERROR_INVALID, "invalid index position for bitmap index");
+				error = -1;
+				goto done;
+			}
+
+			hashes[w->objects[i].index_pos] = w->objects[i].name_hash;
+		}
+
+		for (i = 0; i < w->objects_count; i++) {
+			if ((error = put_be32(out, hashes[i])) < 0)
+				goto done;
+		}
+	}
+
+	if ((error = git_hash_buf(trailer, out->ptr, out->size, algorithm)) < 0)
+		goto done;
+
+	error = git_str_put(out, (const char *)trailer, git_hash_size(algorithm));
+
+done:
+	git__free(written);
+	git__free(hashes);
+	return error;
+}
+
+int git_pack_bitmap_writer_commit(
+	git_pack_bitmap_writer *w,
+	const char *path,
+	const unsigned char *checksum)
+{
+	bitmap_writer_commit **selected = NULL;
+	git_filebuf output = GIT_FILEBUF_INIT;
+	git_str buf = GIT_STR_INIT;
+	size_t selected_count = 0;
+	int filebuf_flags = GIT_FILEBUF_DO_NOT_BUFFER;
+	int error;
+
+	GIT_ASSERT_ARG(w);
+	GIT_ASSERT_ARG(path);
+	GIT_ASSERT_ARG(checksum);
+
+	if (w->objects_count != w->objects_alloc) {
+		git_error_set(GIT_ERROR_INVALID, "bitmap index is missing objects");
+		return -1;
+	}
+
+	if ((error = load_commits(w)) < 0 ||
+	    (error = select_commits(&selected, &selected_count, w)) < 0 ||
+	    (error = compute_bitmaps(w, selected, selected_count)) < 0 ||
+	    (error = write_bitmap(&buf, w, selected, selected_count, checksum)) < 0)
+		goto done;
+
+	if (git_repository__fsync_gitdir)
+		filebuf_flags |= GIT_FILEBUF_FSYNC;
+
+	if ((error = git_filebuf_open(&output, path, filebuf_flags, GIT_PACK_FILE_MODE)) < 0 ||
+	    (error = git_filebuf_write(&output, buf.ptr, buf.size)) < 0 ||
+	    (error = git_filebuf_commit(&output)) < 0)
+		goto done;
+
+done:
+	git_filebuf_cleanup(&output);
+	git_str_dispose(&buf);
+	git__free(selected);
+	return error;
+}
+
+void git_pack_bitmap_writer_free(git_pack_bitmap_writer *w)
+{
+	size_t i;
+
+	if (!w)
+		return;
+
+	for (i = 0; i < w->commit_list_count; i++)
+		git_ewah_dispose(&w->commit_list[i].bitmap);
+
+	git__free(w->commit_list);
+	git_oidmap_free(w->commit_map);
+	git_oidmap_free(w->positions);
+	git__free(w->objects);
+
+	git_bitmap_dispose(&w->commits);
+	git_bitmap_dispose(&w->trees);
+	git_bitmap_dispose(&w->blobs);
+	git_bitmap_dispose(&w->tags);
+
+	git__free(w);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_pack_bitmap_h__
+#define INCLUDE_pack_bitmap_h__
+
+#include "common.h"
+
+#include "git2/types.h"
+
+#include "ewah.h"
+#include "map.h"
+#include "oidmap.h"
+#include "pack.h"
+#include "thread.h"
+#include "vector.h"
+
+#define GIT_PACK_BITMAP_SIGNATURE "BITM"
+#define GIT_PACK_BITMAP_VERSION 1
+
+/* Header options */
+#define GIT_PACK_BITMAP_OPT_FULL_DAG     0x01
+#define GIT_PACK_BITMAP_OPT_HASH_CACHE   0x04
+#define GIT_PACK_BITMAP_OPT_LOOKUP_TABLE 0x10
+
+/* The furthest back that an entry may be XOR'd against */
+#define GIT_PACK_BITMAP_MAX_XOR_OFFSET 160
+
+typedef struct {
+	git_oid commit;
+
+	uint8_t xor_offset;
+	uint8_t flags;
+
+	/* The bitmap as stored on disk (possibly XOR'd against another) */
+	git_ewah stored;
+
+	/* The reachability bitmap once the XOR chain has been resolved */
+	git_ewah resolved;
+	unsigned int is_resolved : 1;
+} git_pack_bitmap_entry;
+
+/**
+ * A reachability bitmap index (a `.bitmap` file) for a single packfile,
+ * in the format that git writes.
+ *
+ * Each bit in a bitmap represents one object in the packfile; bit `n`
+ * is the `n`th object in "pack order", ie when the objects are sorted
+ * by their offset in the packfile.  A bitmap is stored for a subset of
+ * the commits in the pack, with the bits set for every object that is
+ * reachable from that commit.
+ *
+ * A bitmap index may also be for a multi-pack-index instead, in which
+ * case the objects are in its "pseudo-pack" order: those of the
+ * preferred pack first, then those of each other pack, each by offset.
+ */
+typedef struct git_pack_bitmap {
+	git_map map;
+	git_oid_t oid_type;
+
+	/* The packfile that the bitmap is for, or NULL for a midx. */
+	struct git_pack_file *pack;
+
+	/*
+	 * The multi-pack-index that the bitmap is for, or NULL, along with
+	 * its packfiles and the pseudo-pack position of each of its objects.
+	 */
+	struct git_midx_file *midx;
+	git_vector packs;
+	uint32_t *pack_positions;
+
+	uint16_t options;
+
+	/* Which objects in the pack are of each type */
+	git_bitmap commits;
+	git_bitmap trees;
+	git_bitmap blobs;
+	git_bitmap tags;
+
+	git_pack_bitmap_entry *entries;
+	uint32_t entries_count;
+
+	/* Maps commit ids to their entry */
+	git_oidmap *entry_map;
+
+	/*
+	 * The name-hash cache: one 32-bit value in network byte order for
+	 * each object in the pack, in index (object id) order.
+	 */
+	const unsigned char *hashes;
+
+	git_mutex lock;
+} git_pack_bitmap;
+
+/**
+ * Open the bitmap index at `path`, along with the packfile that it
+ * describes (which must live alongside it).
+ */
+int git_pack_bitmap_open(
+	git_pack_bitmap **out,
+	const char *path,
+	git_oid_t oid_type);
+
+/**
+ * Open the bitmap index of the multi-pack-index at `midx_path`, along
+ * with the multi-pack-index and its packfiles.  Returns `GIT_ENOTFOUND`
+ * if it has no bitmap.
+ */
+int git_pack_bitmap_open_midx(
+	git_pack_bitmap **out,
+	const char *midx_path,
+	git_oid_t oid_type);
+
+/**
+ * Find a bitmap index in the repository's object directory and open
+ * it, along with what it describes; that of the multi-pack-index is
+ * preferred over those of the packfiles.  Returns `GIT_ENOTFOUND` if
+ * the repository has no bitmap.
+ */
+int git_pack_bitmap_find(git_pack_bitmap **out, git_repository *repo);
+
+void git_pack_bitmap_free(git_pack_bitmap *bitmap);
+
+/** The number of objects that the bitmap index covers. */
+size_t git_pack_bitmap_objects(git_pack_bitmap *bitmap);
+
+/**
+ * Load the stored reachability bitmap for the given commit into
+ * `out`.  Returns `GIT_ENOTFOUND` if no bitmap was stored for it.
+ */
+int git_pack_bitmap_lookup(
+	git_bitmap *out,
+	git_pack_bitmap *bitmap,
+	const git_oid *commit_id);
+
+/**
+ * Compute the set of objects reachable from the given tips, using the
+ * stored bitmaps where possible and walking the object graph
+ * otherwise.  The result is OR'd into `out`.
+ *
+ * If a reachable object is not in the bitmapped packfile then this
+ * fails with `GIT_ENOTFOUND`, unless `allow_missing` is set, in which
+ * case that object (and anything only reachable through it) is left
+ * out of the result.
+ */
+int git_pack_bitmap_reachable(
+	git_bitmap *out,
+	git_pack_bitmap *bitmap,
+	git_repository *repo,
+	const git_oid *tips,
+	size_t tips_count,
+	bool allow_missing);
+
+typedef int GIT_CALLBACK(git_pack_bitmap_foreach_cb)(
+	const git_oid *id,
+	git_object_t type,
+	struct git_pack_file *pack,
+	off64_t offset,
+	uint32_t name_hash,
+	void *payload);
+
+/**
+ * Call `cb` for each object of the given type (or of any type, with
+ * `GIT_OBJECT_ANY`) in the given set, in pack order, along with the
+ * packfile that it is in and its offset there.  The name hash is zero
+ * when the bitmap index does not include a hash cache.
+ */
+int git_pack_bitmap_foreach(
+	git_pack_bitmap *bitmap,
+	const git_bitmap *set,
+	git_object_t type,
+	git_pack_bitmap_foreach_cb cb,
+	void *payload);
+
+/**
+ * A writer for bitmap indexes.  The objects of the packfile are added
+ * in pack order; on commit, a selection of the commits in the pack get
+ * their reachability bitmaps computed and stored.
+ */
+typedef struct git_pack_bitmap_writer git_pack_bitmap_writer;
+
+int git_pack_bitmap_writer_new(
+	git_pack_bitmap_writer **out,
+	git_repository *repo,
+	size_t objects_count);
+
+/**
+ * Add the next object (in pack order) to the writer, along with its
+ * position in the pack index and the hash of its name (or zero).
+ */
+int git_pack_bitmap_writer_add(
+	git_pack_bitmap_writer *w,
+	const git_oid *id,
+	git_object_t type,
+	uint32_t index_pos,
+	uint32_t name_hash);
+
+/**
+ * Compute the bitmaps and write them to `path`.  The `checksum` is
+ * the checksum of the packfile (or multi-pack-index) that the bitmap
+ * index describes.
+ */
+int git_pack_bitmap_writer_commit(
+	git_pack_bitmap_writer *w,
+	const char *path,
+	const unsigned char *checksum);
+
+void git_pack_bitmap_writer_free(git_pack_bitmap_writer *w);
+
+#endif
@@ -1204,6 +1204,10 @@ int git_smart__push(git_transport *transport, git_push *push)
 		}
 	}
 
+	/* only send offset deltas to servers that understand them */
+	if ((error = git_packbuilder_set_ofs_delta(push->pb, t->caps.ofs_delta)) < 0)
+		goto done;
+
 	/* prepare pack before sending pack header to avoid timeouts */
 	if (need_pack && ((error = git_packbuilder__prepare(push->pb))) < 0)
 		goto done;
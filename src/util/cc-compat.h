@@ -49,6 +49,16 @@
 # define GIT_UNUSED_ARG
 #endif
 
+/* Hint that the memory at `addr` is about to be read */
+#if defined(__GNUC__)
+# define GIT_PREFETCH(addr) __builtin_prefetch((addr), 0)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# include <xmmintrin.h>
+# define GIT_PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+# define GIT_PREFETCH(addr) ((void)(addr))
+#endif
+
 /* Define the printf format specifier to use for size_t output */
 #if defined(_MSC_VER) || defined(__MINGW32__)
 
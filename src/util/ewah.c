@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+/*
+ * Layout of a run length word: the lowest bit is the value of the
+ * clean words in the run, the next 32 bits are the length of the run
+ * and the upper 31 bits are the number of literal words that follow.
+ */
+#define RLW_RUNNING_BITS 32
+#define RLW_LITERAL_BITS 31
+#define RLW_LARGEST_RUNNING_COUNT (((uint64_t)1 << RLW_RUNNING_BITS) - 1)
+#define RLW_LARGEST_LITERAL_COUNT (((uint64_t)1 << RLW_LITERAL_BITS) - 1)
+
+#define rlw_running_bit(w) ((w) & 1)
+#define rlw_running_len(w) (((w) >> 1) & RLW_LARGEST_RUNNING_COUNT)
+#define rlw_literal_words(w) ((w) >> (1 + RLW_RUNNING_BITS))
+
+#define BITS_IN_WORD 64
+#define WORD_ONES (~(uint64_t)0)
+
+/***********************************************************
+ *
+ * UNCOMPRESSED BITMAPS
+ *
+ ***********************************************************/
+
+static int bitmap_grow(git_bitmap *bitmap, size_t words)
+{
+	uint64_t *new_words;
+	size_t new_alloc;
+
+	if (words <= bitmap->word_alloc)
+		return 0;
+
+	new_alloc = bitmap->word_alloc ? bitmap->word_alloc : 4;
+
+	while (new_alloc < words)
+		GIT_ERROR_CHECK_ALLOC_MULTIPLY(&new_alloc, new_alloc, 2);
+
+	new_words = git__reallocarray(bitmap->words, new_alloc, sizeof(uint64_t));
+	GIT_ERROR_CHECK_ALLOC(new_words);
+
+	memset(new_words + bitmap->word_alloc, 0x0,
+		(new_alloc - bitmap->word_alloc) * sizeof(uint64_t));
+
+	bitmap->words = new_words;
+	bitmap->word_alloc = new_alloc;
+	return 0;
+}
+
+int git_bitmap_init(git_bitmap *bitmap, size_t bits)
+{
+	GIT_ASSERT_ARG(bitmap);
+
+	memset(bitmap, 0x0, sizeof(*bitmap));
+
+	if (!bits)
+		return 0;
+
+	return bitmap_grow(bitmap, (bits + BITS_IN_WORD - 1) / BITS_IN_WORD);
+}
+
+int git_bitmap_dup(git_bitmap *out, const git_bitmap *src)
+{
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(src);
+
+	memset(out, 0x0, sizeof(*out));
+
+	if (!src->word_alloc)
+		return 0;
+
+	out->words = git__mallocarray(src->word_alloc, sizeof(uint64_t));
+	GIT_ERROR_CHECK_ALLOC(out->words);
+
+	memcpy(out->words, src->words, src->word_alloc * sizeof(uint64_t));
+	out->word_alloc = src->word_alloc;
+	return 0;
+}
+
+void git_bitmap_dispose(git_bitmap *bitmap)
+{
+	if (!bitmap)
+		return;
+
+	git__free(bitmap->words);
+	bitmap->words = NULL;
+	bitmap->word_alloc = 0;
+}
+
+int git_bitmap_set(git_bitmap *bitmap, size_t pos)
+{
+	size_t word = pos / BITS_IN_WORD;
+
+	if (bitmap_grow(bitmap, word + 1) < 0)
+		return -1;
+
+	bitmap->words[word] |= (uint64_t)1 << (pos % BITS_IN_WORD);
+	return 0;
+}
+
+void git_bitmap_unset(git_bitmap *bitmap, size_t pos)
+{
+	size_t word = pos / BITS_IN_WORD;
+
+	if (word < bitmap->word_alloc)
+		bitmap->words[word] &= ~((uint64_t)1 << (pos % BITS_IN_WORD));
+}
+
+bool git_bitmap_get(const git_bitmap *bitmap, size_t pos)
+{
+	size_t word = pos / BITS_IN_WORD;
+
+	return word < bitmap->word_alloc &&
+	       (bitmap->words[word] & ((uint64_t)1 << (pos % BITS_IN_WORD))) != 0;
+}
+
+void git_bitmap_clear(git_bitmap *bitmap)
+{
+	if (bitmap->word_alloc)
+		memset(bitmap->words, 0x0, bitmap->word_alloc * sizeof(uint64_t));
+}
+
+int git_bitmap_or(git_bitmap *dst, const git_bitmap *src)
+{
+	size_t i;
+
+	if (bitmap_grow(dst, src->word_alloc) < 0)
+		return -1;
+
+	for (i = 0; i < src->word_alloc; i++)
+		dst->words[i] |= src->words[i];
+
+	return 0;
+}
+
+void git_bitmap_and(git_bitmap *dst, const git_bitmap *src)
+{
+	size_t i, common = min(dst->word_alloc, src->word_alloc);
+
+	for (i = 0; i < common; i++)
+		dst->words[i] &= src->words[i];
+
+	for (; i < dst->word_alloc; i++)
+		dst->words[i] = 0;
+}
+
+void git_bitmap_and_not(git_bitmap *dst, const git_bitmap *src)
+{
+	size_t i, common = min(dst->word_alloc, src->word_alloc);
+
+	for (i = 0; i < common; i++)
+		dst->words[i] &= ~src->words[i];
+}
+
+int git_bitmap_xor(git_bitmap *dst, const git_bitmap *src)
+{
+	size_t i;
+
+	if (bitmap_grow(dst, src->word_alloc) < 0)
+		return -1;
+
+	for (i = 0; i < src->word_alloc; i++)
+		dst->words[i] ^= src->words[i];
+
+	return 0;
+}
+
+bool git_bitmap_equal(const git_bitmap *a, const git_bitmap *b)
+{
+	const git_bitmap *longer = a->word_alloc > b->word_alloc ? a : b;
+	size_t i, common = min(a->word_alloc, b->word_alloc);
+
+	if (common && memcmp(a->words, b->words, common * sizeof(uint64_t)) != 0)
+		return false;
+
+	for (i = common; i < longer->word_alloc; i++) {
+		if (longer->words[i])
+			return false;
+	}
+
+	return true;
+}
+
+GIT_INLINE(size_t) word_popcount(uint64_t w)
+{
+	w = w - ((w >> 1) & 0x5555555555555555ull);
+	w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (size_t)((w * 0x0101010101010101ull) >> 56);
+}
+
+size_t git_bitmap_popcount(const git_bitmap *bitmap)
+{
+	size_t i, count = 0;
+
+	for (i = 0; i < bitmap->word_alloc; i++)
+		count += word_popcount(bitmap->words[i]);
+
+	return count;
+}
+
+int git_bitmap_next(size_t *pos, const git_bitmap *bitmap)
+{
+	size_t word = *pos / BITS_IN_WORD;
+	uint64_t w;
+
+	if (word >= bitmap->word_alloc)
+		return GIT_ITEROVER;
+
+	/* mask off the bits below the starting position */
+	w = bitmap->words[word] & (WORD_ONES << (*pos % BITS_IN_WORD));
+
+	while (!w) {
+		if (++word >= bitmap->word_alloc)
+			return GIT_ITEROVER;
+
+		w = bitmap->words[word];
+	}
+
+	*pos = word * BITS_IN_WORD;
+
+	while (!(w & 1)) {
+		w >>= 1;
+		(*pos)++;
+	}
+
+	return 0;
+}
+
+/***********************************************************
+ *
+ * EWAH COMPRESSED BITMAPS
+ *
+ ***********************************************************/
+
+GIT_INLINE(uint32_t) read_be32(const unsigned char *data)
+{
+	uint32_t word;
+
+	/* bitmaps are not necessarily aligned within their file */
+	memcpy(&word, data, sizeof(word));
+	return ntohl(word);
+}
+
+GIT_INLINE(uint64_t) read_be64(const unsigned char *data)
+{
+	return ((uint64_t)read_be32(data) << 32) | read_be32(data + 4);
+}
+
+static int ewah_error(const char *message)
+{
+	git_error_set(GIT_ERROR_ODB, "invalid ewah bitmap - %s", message);
+	return -1;
+}
+
+int git_ewah_parse(
+	git_ewah *out,
+	size_t *consumed,
+	const unsigned char *data,
+	size_t len)
+{
+	size_t buffer_size, alloc_len, i;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(consumed);
+	GIT_ASSERT_ARG(data);
+
+	memset(out, 0x0, sizeof(*out));
+
+	if (len < 8)
+		return ewah_error("bitmap is truncated");
+
+	out->bit_size = read_be32(data);
+	buffer_size = read_be32(data + 4);
+
+	if (GIT_MULTIPLY_SIZET_OVERFLOW(&alloc_len, buffer_size, 8) ||
+	    GIT_ADD_SIZET_OVERFLOW(&alloc_len, alloc_len, 12))
+		return -1;
+
+	if (len < alloc_len)
+		return ewah_error("bitmap is truncated");
+
+	if (buffer_size) {
+		out->buffer = git__mallocarray(buffer_size, sizeof(uint64_t));
+		GIT_ERROR_CHECK_ALLOC(out->buffer);
+	}
+
+	for (i = 0; i < buffer_size; i++)
+		out->buffer[i] = read_be64(data + 8 + (i * 8));
+
+	out->buffer_size = out->buffer_alloc = buffer_size;
+	out->rlw = read_be32(data + 8 + (buffer_size * 8));
+
+	if (buffer_size && out->rlw >= buffer_size) {
+		git_ewah_dispose(out);
+		return ewah_error("last run length word is out of bounds");
+	}
+
+	*consumed = alloc_len;
+	return 0;
+}
+
+int git_ewah_serialize(git_str *out, const git_ewah *ewah)
+{
+	uint32_t word32;
+	size_t i;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(ewah);
+
+	if (!git__is_uint32(ewah->bit_size) ||
+	    !git__is_uint32(ewah->buffer_size)) {
+		git_error_set(GIT_ERROR_INVALID, "bitmap is too large to serialize");
+		return -1;
+	}
+
+	word32 = htonl((uint32_t)ewah->bit_size);
+	git_str_put(out, (const char *)&word32, sizeof(word32));
+
+	word32 = htonl((uint32_t)ewah->buffer_size);
+	git_str_put(out, (const char *)&word32, sizeof(word32));
+
+	for (i = 0; i < ewah->buffer_size; i++) {
+		word32 = htonl((uint32_t)(ewah->buffer[i] >> 32));
+		git_str_put(out, (const char *)&word32, sizeof(word32));
+
+		word32 = htonl((uint32_t)(ewah->buffer[i] & 0xffffffff));
+		git_str_put(out, (const char *)&word32, sizeof(word32));
+	}
+
+	word32 = htonl((uint32_t)ewah->rlw);
+	git_str_put(out, (const char *)&word32, sizeof(word32));
+
+	return git_str_oom(out) ? -1 : 0;
+}
+
+static int ewah_push(git_ewah *ewah, uint64_t word)
+{
+	if (ewah->buffer_size == ewah->buffer_alloc) {
+		size_t new_alloc = ewah->buffer_alloc ? ewah->buffer_alloc : 8;
+		uint64_t *new_buffer;
+
+		GIT_ERROR_CHECK_ALLOC_MULTIPLY(&new_alloc, new_alloc, 2);
+
+		new_buffer = git__reallocarray(ewah->buffer, new_alloc, sizeof(uint64_t));
+		GIT_ERROR_CHECK_ALLOC(new_buffer);
+
+		ewah->buffer = new_buffer;
+		ewah->buffer_alloc = new_alloc;
+	}
+
+	ewah->buffer[ewah->buffer_size++] = word;
+	return 0;
+}
+
+int git_ewah_from_bitmap(git_ewah *out, const git_bitmap *bitmap)
+{
+	size_t words = bitmap->word_alloc, i = 0;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(bitmap);
+
+	memset(out, 0x0, sizeof(*out));
+
+	/* trailing empty words do not need to be stored at all */
+	while (words && !bitmap->words[words - 1])
+		words--;
+
+	out->bit_size = words * BITS_IN_WORD;
+
+	/* an empty bitmap is still represented by a single marker word */
+	if (!words)
+		return ewah_push(out, 0);
+
+	while (i < words) {
+		uint64_t rlw, run_bit = 0, run_len = 0, literals = 0;
+		size_t rlw_pos = out->buffer_size;
+
+		if (ewah_push(out, 0) < 0)
+			goto on_error;
+
+		if (bitmap->words[i] == 0 || bitmap->words[i] == WORD_ONES) {
+			uint64_t clean = bitmap->words[i];
+
+			run_bit = (clean != 0);
+
+			while (i < words && bitmap->words[i] == clean &&
+			       run_len < RLW_LARGEST_RUNNING_COUNT) {
+				run_len++;
+				i++;
+			}
+		}
+
+		while (i < words && literals < RLW_LARGEST_LITERAL_COUNT &&
+		       bitmap->words[i] != 0 && bitmap->words[i] != WORD_ONES) {
+			if (ewah_push(out, bitmap->words[i]) < 0)
+				goto on_error;
+
+			literals++;
+			i++;
+		}
+
+		rlw = run_bit |
+		      (run_len << 1) |
+		      (literals << (1 + RLW_RUNNING_BITS));
+
+		out->buffer[rlw_pos] = rlw;
+		out->rlw = rlw_pos;
+	}
+
+	return 0;
+
+on_error:
+	git_ewah_dispose(out);
+	return -1;
+}
+
+typedef enum {
+	EWAH_OP_OR,
+	EWAH_OP_XOR
+} ewah_op;
+
+static int ewah_apply(git_bitmap *bitmap, const git_ewah *ewah, ewah_op op)
+{
+	size_t pos = 0, word = 0;
+	size_t max_words = ewah->bit_size / BITS_IN_WORD + !!(ewah->bit_size % BITS_IN_WORD);
+
+	while (pos < ewah->buffer_size) {
+		uint64_t rlw = ewah->buffer[pos++];
+		size_t run_len = (size_t)rlw_running_len(rlw);
+		size_t literals = (size_t)rlw_literal_words(rlw);
+		size_t end, i;
+
+		if (literals > ewah->buffer_size - pos)
+			return ewah_error("literal words are out of bounds");
+
+		if (GIT_ADD_SIZET_OVERFLOW(&end, word, run_len) ||
+		    GIT_ADD_SIZET_OVERFLOW(&end, end, literals))
+			return -1;
+
+		if (end > max_words)
+			return ewah_error("bitmap is longer than its size");
+
+		/* runs of zeros do not change the result of either operation */
+		if (rlw_running_bit(rlw) || literals) {
+			if (bitmap_grow(bitmap, end) < 0)
+				return -1;
+		}
+
+		if (rlw_running_bit(rlw)) {
+			for (i = word; i < word + run_len; i++) {
+				if (op == EWAH_OP_OR)
+					bitmap->words[i] = WORD_ONES;
+				else
+					bitmap->words[i] ^= WORD_ONES;
+			}
+		}
+
+		word += run_len;
+
+		for (i = 0; i < literals; i++) {
+			if (op == EWAH_OP_OR)
+				bitmap->words[word + i] |= ewah->buffer[pos + i];
+			else
+				bitmap->words[word + i] ^= ewah->buffer[pos + i];
+		}
+
+		word += literals;
+		pos += literals;
+	}
+
+	return 0;
+}
+
+int git_ewah_to_bitmap(git_bitmap *out, const git_ewah *ewah)
+{
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(ewah);
+
+	git_bitmap_clear(out);
+	return ewah_apply(out, ewah, EWAH_OP_OR);
+}
+
+int git_ewah_or_into(git_bitmap *bitmap, const git_ewah *ewah)
+{
+	GIT_ASSERT_ARG(bitmap);
+	GIT_ASSERT_ARG(ewah);
+
+	return ewah_apply(bitmap, ewah, EWAH_OP_OR);
+}
+
+int git_ewah_xor_into(git_bitmap *bitmap, const git_ewah *ewah)
+{
+	GIT_ASSERT_ARG(bitmap);
+	GIT_ASSERT_ARG(ewah);
+
+	return ewah_apply(bitmap, ewah, EWAH_OP_XOR);
+}
+
+void git_ewah_dispose(git_ewah *ewah)
+{
+	if (!ewah)
+		return;
+
+	git__free(ewah->buffer);
+	memset(ewah, 0x0, sizeof(*ewah));
+}
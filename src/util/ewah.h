@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "git2_util.h"
+
+#include "str.h"
+
+/*
+ * An uncompressed, growable bitmap.  This is the representation that
+ * reachability computations work on: bits can be set and tested in
+ * constant time and whole bitmaps can be combined word by word.
+ */
+typedef struct {
+	uint64_t *words;
+	size_t word_alloc;
+} git_bitmap;
+
+#define GIT_BITMAP_INIT { NULL, 0 }
+
+/*
+ * An EWAH (Enhanced Word-Aligned Hybrid) compressed bitmap, in the
+ * format that git uses in `.bitmap` files.  The buffer is a sequence of
+ * "run length words" (RLW), each of which describes a run of identical
+ * clean words (all zeros or all ones) followed by a number of literal
+ * words that are stored verbatim after it.
+ *
+ * Words are kept in native byte order in memory; they are converted
+ * to and from network byte order when (de)serialized.
+ */
+typedef struct {
+	uint64_t *buffer;
+	size_t buffer_size;
+	size_t buffer_alloc;
+
+	/* The number of bits that this bitmap covers */
+	size_t bit_size;
+
+	/* The position of the last run length word in the buffer */
+	size_t rlw;
+} git_ewah;
+
+#define GIT_EWAH_INIT { NULL, 0, 0, 0, 0 }
+
+extern int git_bitmap_init(git_bitmap *bitmap, size_t bits);
+extern int git_bitmap_dup(git_bitmap *out, const git_bitmap *src);
+extern void git_bitmap_dispose(git_bitmap *bitmap);
+
+extern int git_bitmap_set(git_bitmap *bitmap, size_t pos);
+extern void git_bitmap_unset(git_bitmap *bitmap, size_t pos);
+extern bool git_bitmap_get(const git_bitmap *bitmap, size_t pos);
+extern void git_bitmap_clear(git_bitmap *bitmap);
+
+/* dst |= src */
+extern int git_bitmap_or(git_bitmap *dst, const git_bitmap *src);
+/* dst &= src */
+extern void git_bitmap_and(git_bitmap *dst, const git_bitmap *src);
+/* dst &= ~src */
+extern void git_bitmap_and_not(git_bitmap *dst, const git_bitmap *src);
+/* dst ^= src */
+extern int git_bitmap_xor(git_bitmap *dst, const git_bitmap *src);
+
+extern bool git_bitmap_equal(const git_bitmap *a, const git_bitmap *b);
+extern size_t git_bitmap_popcount(const git_bitmap *bitmap);
+
+/**
+ * Find the next bit that is set in the bitmap, starting at (and
+ * including) `*pos`.  Returns `GIT_ITEROVER` if there are no more set
+ * bits.
+ */
+extern int git_bitmap_next(size_t *pos, const git_bitmap *bitmap);
+
+#define git_bitmap_foreach(bitmap, pos) \
+	for ((pos) = 0; git_bitmap_next(&(pos), (bitmap)) == 0; (pos)++)
+
+/**
+ * Parse a serialized EWAH bitmap from the given buffer.  On success,
+ * `consumed` is set to the number of bytes of `data` that the bitmap
+ * occupied.
+ */
+extern int git_ewah_parse(
+	git_ewah *out,
+	size_t *consumed,
+	const unsigned char *data,
+	size_t len);
+
+extern int git_ewah_serialize(git_str *out, const git_ewah *ewah);
+
+/* Compress the given bitmap */
+extern int git_ewah_from_bitmap(git_ewah *out, const git_bitmap *bitmap);
+
+/* Decompress into the given (initialized) bitmap, replacing its contents */
+extern int git_ewah_to_bitmap(git_bitmap *out, const git_ewah *ewah);
+
+/* bitmap |= ewah */
+extern int git_ewah_or_into(git_bitmap *bitmap, const git_ewah *ewah);
+
+/* bitmap ^= ewah */
+extern int git_ewah_xor_into(git_bitmap *bitmap, const git_ewah *ewah);
+
+extern void git_ewah_dispose(git_ewah *ewah);
+
+#endif
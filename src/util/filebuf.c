@@ -305,7 +305,7 @@ int git_filebuf_open_withsize(git_filebuf *file, const char *path, int flags, mo
 	if (flags & GIT_FILEBUF_HASH_SHA1) {
 		file->compute_digest = 1;
 
-		if (git_hash_ctx_init(&file->digest, GIT_HASH_ALGORITHM_SHA1) < 0)
+		if (git_hash_ctx_init(&file->digest, GIT_HASH_ALGORITHM_SHA1_UNSAFE) < 0)
 			goto cleanup;
 	} else if (flags & GIT_FILEBUF_HASH_SHA256) {
 		file->compute_digest = 1;
@@ -17,6 +17,10 @@
 #	define GIT_FILEBUF_THREADS
 #endif
 
+/*
+ * The hash of the written data is a checksum, never an object id, so
+ * the SHA1 hash is computed without collision detection.
+ */
 #define GIT_FILEBUF_HASH_SHA1           (1 << 0)
 #define GIT_FILEBUF_HASH_SHA256         (1 << 1)
 #define GIT_FILEBUF_APPEND              (1 << 2)
@@ -96,6 +100,7 @@ GIT_INLINE(int) git_filebuf_hash_flags(git_hash_algorithm_t algorithm)
 {
 	switch (algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
 		return GIT_FILEBUF_HASH_SHA1;
 	case GIT_HASH_ALGORITHM_SHA256:
 		return GIT_FILEBUF_HASH_SHA256;
@@ -9,17 +9,41 @@
 
 int git_hash_global_init(void)
 {
-	if (git_hash_sha1_global_init() < 0 ||
+	if (git_hash_accelerated_global_init() < 0 ||
+	    git_hash_sha1_global_init() < 0 ||
 	    git_hash_sha256_global_init() < 0)
 		return -1;
 
 	return 0;
 }
 
+/*
+ * Use the processor's SHA1 instructions if it has them, otherwise the
+ * SHA1 backend (without collision detection).
+ */
+static int sha1_unsafe_init(git_hash_ctx *ctx)
+{
+	int error;
+
+	if ((error = git_hash_sha1_accelerated_init(&ctx->ctx.accelerated)) != GIT_ENOTFOUND) {
+		ctx->accelerated = (error == 0);
+		return error;
+	}
+
+	ctx->accelerated = 0;
+
+	if ((error = git_hash_sha1_ctx_init(&ctx->ctx.sha1)) < 0)
+		return error;
+
+	return git_hash_sha1_init_unsafe(&ctx->ctx.sha1);
+}
+
 int git_hash_ctx_init(git_hash_ctx *ctx, git_hash_algorithm_t algorithm)
 {
 	int error;
 
+	ctx->accelerated = 0;
+
 	switch (algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
 		error = git_hash_sha1_ctx_init(&ctx->ctx.sha1);
@@ -27,6 +51,9 @@ int git_hash_ctx_init(git_hash_ctx *ctx, git_hash_algorithm_t algorithm)
 	case GIT_HASH_ALGORITHM_SHA256:
 		error = git_hash_sha256_ctx_init(&ctx->ctx.sha256);
 		break;
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
+		error = sha1_unsafe_init(ctx);
+		break;
 	default:
 		git_error_set(GIT_ERROR_INTERNAL, "unknown hash algorithm");
 		error = -1;
@@ -38,8 +65,12 @@ int git_hash_ctx_init(git_hash_ctx *ctx, git_hash_algorithm_t algorithm)
 
 void git_hash_ctx_cleanup(git_hash_ctx *ctx)
 {
+	if (ctx->accelerated)
+		return;
+
 	switch (ctx->algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
 		git_hash_sha1_ctx_cleanup(&ctx->ctx.sha1);
 		return;
 	case GIT_HASH_ALGORITHM_SHA256:
@@ -57,6 +88,9 @@ int git_hash_init(git_hash_ctx *ctx)
 		return git_hash_sha1_init(&ctx->ctx.sha1);
 	case GIT_HASH_ALGORITHM_SHA256:
 		return git_hash_sha256_init(&ctx->ctx.sha256);
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
+		git_hash_ctx_cleanup(ctx);
+		return sha1_unsafe_init(ctx);
 	default:
 		/* unreachable */ ;
 	}
@@ -67,8 +101,14 @@ int git_hash_init(git_hash_ctx *ctx)
 
 int git_hash_update(git_hash_ctx *ctx, const void *data, size_t len)
 {
+	if (ctx->accelerated) {
+		git_hash_accelerated_update(&ctx->ctx.accelerated, data, len);
+		return 0;
+	}
+
 	switch (ctx->algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
 		return git_hash_sha1_update(&ctx->ctx.sha1, data, len);
 	case GIT_HASH_ALGORITHM_SHA256:
 		return git_hash_sha256_update(&ctx->ctx.sha256, data, len);
@@ -82,8 +122,15 @@ int git_hash_update(git_hash_ctx *ctx, const void *data, size_t len)
 
 int git_hash_final(unsigned char *out, git_hash_ctx *ctx)
 {
+	if (ctx->accelerated) {
+		git_hash_accelerated_final(out,
+			git_hash_size(ctx->algorithm), &ctx->ctx.accelerated);
+		return 0;
+	}
+
 	switch (ctx->algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
+	case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
 		return git_hash_sha1_final(out, &ctx->ctx.sha1);
 	case GIT_HASH_ALGORITHM_SHA256:
 		return git_hash_sha256_final(out, &ctx->ctx.sha256);
@@ -141,6 +188,224 @@ done:
 	return error;
 }
 
+/*
+ * Messages longer than this are hashed on their own, so that a few big
+ * ones do not keep most lanes idle while they finish.
+ */
+#define BATCH_LANE_MAX_LEN 4096
+
+typedef struct {
+	const git_hash_batch_entry *entry;
+	size_t piece;
+	size_t offset;
+	uint64_t len;
+	bool padded;
+	unsigned char buf[64];
+} batch_lane;
+
+static uint64_t batch_entry_len(const git_hash_batch_entry *entry)
+{
+	uint64_t len = 0;
+	size_t i;
+
+	for (i = 0; i < entry->vec_len; i++)
+		len += entry->vec[i].len;
+
+	return len;
+}
+
+static bool batch_entry_in_lanes(const git_hash_batch_entry *entry)
+{
+	return batch_entry_len(entry) <= BATCH_LANE_MAX_LEN;
+}
+
+static void batch_lane_start(
+	batch_lane *lane,
+	const git_hash_batch_entry *entry)
+{
+	lane->entry = entry;
+	lane->piece = 0;
+	lane->offset = 0;
+	lane->len = batch_entry_len(entry);
+	lane->padded = false;
+}
+
+/*
+ * The next block of the lane's message (padded at the end, as SHA256
+ * wants it), pointing into the message itself where it can.  `last` is
+ * set for the final block.
+ */
+static const unsigned char *batch_lane_next(batch_lane *lane, bool *last)
+{
+	const git_str_vec *vec = lane->entry->vec;
+	size_t vec_len = lane->entry->vec_len, used = 0, n, i;
+	uint64_t bits;
+
+	*last = false;
+
+	while (lane->piece < vec_len && lane->offset == vec[lane->piece].len) {
+		lane->piece++;
+		lane->offset = 0;
+	}
+
+	if (lane->piece < vec_len && vec[lane->piece].len - lane->offset >= 64) {
+		const unsigned char *block =
+			(const unsigned char *)vec[lane->piece].data + lane->offset;
+
+		lane->offset += 64;
+		return block;
+	}
+
+	while (used < 64 && lane->piece < vec_len) {
+		n = min(64 - used, vec[lane->piece].len - lane->offset);
+		memcpy(lane->buf + used,
+			(const unsigned char *)vec[lane->piece].data + lane->offset, n);
+
+		used += n;
+		lane->offset += n;
+
+		if (lane->offset == vec[lane->piece].len) {
+			lane->piece++;
+			lane->offset = 0;
+		}
+	}
+
+	if (used == 64)
+		return lane->buf;
+
+	if (!lane->padded) {
+		lane->buf[used++] = 0x80;
+		lane->padded = true;
+	}
+
+	/* There may not be room for the length after the data */
+	if (used > 56) {
+		memset(lane->buf + used, 0, 64 - used);
+		return lane->buf;
+	}
+
+	memset(lane->buf + used, 0, 56 - used);
+
+	bits = lane->len * 8;
+
+	for (i = 0; i < 8; i++)
+		lane->buf[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+
+	*last = true;
+	return lane->buf;
+}
+
+static void hash_batch_lanes(
+	git_hash_lanes_ctx *ctx,
+	git_hash_batch_entry *entries,
+	size_t count)
+{
+	static const unsigned char idle_block[64];
+	batch_lane lanes[GIT_HASH_LANES_MAX];
+	const unsigned char *blocks[GIT_HASH_LANES_MAX];
+	size_t next = 0, active = 0, i;
+	bool last[GIT_HASH_LANES_MAX];
+
+	for (i = 0; i < ctx->lanes; i++) {
+		while (next < count && !batch_entry_in_lanes(&entries[next]))
+			next++;
+
+		lanes[i].entry = NULL;
+
+		if (next < count) {
+			batch_lane_start(&lanes[i], &entries[next++]);
+			git_hash_sha256_lanes_reset(ctx, i);
+			active++;
+		}
+	}
+
+	while (active) {
+		for (i = 0; i < ctx->lanes; i++) {
+			if (lanes[i].entry) {
+				blocks[i] = batch_lane_next(&lanes[i], &last[i]);
+			} else {
+				blocks[i] = idle_block;
+				last[i] = false;
+			}
+		}
+
+		ctx->blocks(ctx->state, blocks);
+
+		for (i = 0; i < ctx->lanes; i++) {
+			if (!last[i])
+				continue;
+
+			git_hash_sha256_lanes_final(lanes[i].entry->out, ctx, i);
+
+			while (next < count && !batch_entry_in_lanes(&entries[next]))
+				next++;
+
+			if (next < count) {
+				batch_lane_start(&lanes[i], &entries[next++]);
+				git_hash_sha256_lanes_reset(ctx, i);
+			} else {
+				lanes[i].entry = NULL;
+				active--;
+			}
+		}
+	}
+}
+
+int git_hash_batch(
+	git_hash_batch_entry *entries,
+	size_t count,
+	git_hash_algorithm_t algorithm)
+{
+	git_hash_lanes_ctx lanes;
+	git_hash_ctx ctx;
+	size_t in_lanes = 0, i, j;
+	bool use_lanes = false;
+	int error;
+
+	/*
+	 * Hash in lanes when at least half of them would be busy; with
+	 * fewer, hashing the messages one by one is just as fast.
+	 */
+	if (algorithm == GIT_HASH_ALGORITHM_SHA256 &&
+	    git_hash_sha256_lanes_init(&lanes) == 0) {
+		for (i = 0; i < count; i++) {
+			if (batch_entry_in_lanes(&entries[i]))
+				in_lanes++;
+		}
+
+		if ((use_lanes = (in_lanes >= lanes.lanes / 2)))
+			hash_batch_lanes(&lanes, entries, count);
+	}
+
+	if (use_lanes && in_lanes == count)
+		return 0;
+
+	if ((error = git_hash_ctx_init(&ctx, algorithm)) < 0)
+		return error;
+
+	for (i = 0; i < count; i++) {
+		if (use_lanes && batch_entry_in_lanes(&entries[i]))
+			continue;
+
+		if ((error = git_hash_init(&ctx)) < 0)
+			goto done;
+
+		for (j = 0; j < entries[i].vec_len; j++) {
+			if ((error = git_hash_update(&ctx,
+					entries[i].vec[j].data,
+					entries[i].vec[j].len)) < 0)
+				goto done;
+		}
+
+		if ((error = git_hash_final(entries[i].out, &ctx)) < 0)
+			goto done;
+	}
+
+done:
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
 int git_hash_fmt(char *out, unsigned char *hash, size_t hash_len)
 {
 	static char hex[] = "0123456789abcdef";
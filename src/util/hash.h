@@ -11,6 +11,7 @@
 #include "git2_util.h"
 
 #include "hash/sha.h"
+#include "hash/accelerated.h"
 
 typedef struct {
 	void *data;
@@ -20,7 +21,15 @@ typedef struct {
 typedef enum {
 	GIT_HASH_ALGORITHM_NONE = 0,
 	GIT_HASH_ALGORITHM_SHA1,
-	GIT_HASH_ALGORITHM_SHA256
+	GIT_HASH_ALGORITHM_SHA256,
+
+	/*
+	 * SHA1 without collision detection, for checksums of data that
+	 * we wrote ourselves or otherwise trust (the trailers of packs,
+	 * indexes and the like); never for object ids.  This uses the
+	 * processor's SHA instructions when it has them.
+	 */
+	GIT_HASH_ALGORITHM_SHA1_UNSAFE
 } git_hash_algorithm_t;
 
 #define GIT_HASH_MAX_SIZE GIT_HASH_SHA256_SIZE
@@ -29,8 +38,10 @@ typedef struct git_hash_ctx {
 	union {
 		git_hash_sha1_ctx sha1;
 		git_hash_sha256_ctx sha256;
+		git_hash_accelerated_ctx accelerated;
 	} ctx;
 	git_hash_algorithm_t algorithm;
+	unsigned int accelerated : 1;
 } git_hash_ctx;
 
 int git_hash_global_init(void);
@@ -45,11 +56,31 @@ int git_hash_final(unsigned char *out, git_hash_ctx *c);
 int git_hash_buf(unsigned char *out, const void *data, size_t len, git_hash_algorithm_t algorithm);
 int git_hash_vec(unsigned char *out, git_str_vec *vec, size_t n, git_hash_algorithm_t algorithm);
 
+/*
+ * One message of a batch to hash: its pieces, and where to write its
+ * hash.
+ */
+typedef struct {
+	const git_str_vec *vec;
+	size_t vec_len;
+	unsigned char *out;
+} git_hash_batch_entry;
+
+/*
+ * Hash each of the messages in the batch independently.  This is
+ * equivalent to calling `git_hash_vec` for each of them, but when the
+ * processor allows it, several of them are hashed at once in the lanes
+ * of its vector registers; this is much faster for many small messages
+ * (like objects) than hashing them one after another.
+ */
+int git_hash_batch(git_hash_batch_entry *entries, size_t count, git_hash_algorithm_t algorithm);
+
 int git_hash_fmt(char *out, unsigned char *hash, size_t hash_len);
 
 GIT_INLINE(size_t) git_hash_size(git_hash_algorithm_t algorithm) {
 	switch (algorithm) {
 		case GIT_HASH_ALGORITHM_SHA1:
+		case GIT_HASH_ALGORITHM_SHA1_UNSAFE:
 			return GIT_HASH_SHA1_SIZE;
 		case GIT_HASH_ALGORITHM_SHA256:
 			return GIT_HASH_SHA256_SIZE;
@@ -58,4 +89,15 @@ GIT_INLINE(size_t) git_hash_size(git_hash_algorithm_t algorithm) {
 	}
 }
 
+/*
+ * The algorithm to use for a checksum (rather than an object id) that
+ * is otherwise computed with the given algorithm.
+ */
+GIT_INLINE(git_hash_algorithm_t) git_hash_checksum_algorithm(
+	git_hash_algorithm_t algorithm)
+{
+	return (algorithm == GIT_HASH_ALGORITHM_SHA1) ?
+		GIT_HASH_ALGORITHM_SHA1_UNSAFE : algorithm;
+}
+
 #endif
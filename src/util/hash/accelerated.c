@@ -0,0 +1,1203 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "accelerated.h"
+
+#if defined(GIT_HASH_SHANI)
+# include <immintrin.h>
+# if defined(__GNUC__)
+#  include <cpuid.h>
+#  define SHANI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#  define AVX2_TARGET __attribute__((target("avx2")))
+#  define AVX512_TARGET __attribute__((target("avx512f,avx512bw")))
+# else
+#  include <intrin.h>
+#  define SHANI_TARGET
+#  define AVX2_TARGET
+#  define AVX512_TARGET
+# endif
+#endif
+
+#if defined(GIT_HASH_ARMV8)
+# include <arm_neon.h>
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  ifndef HWCAP_SHA1
+#   define HWCAP_SHA1 (1 << 5)
+#  endif
+#  ifndef HWCAP_SHA2
+#   define HWCAP_SHA2 (1 << 6)
+#  endif
+# endif
+# if defined(__clang__)
+#  define ARMV8_TARGET __attribute__((target("crypto")))
+# else
+#  define ARMV8_TARGET __attribute__((target("+crypto")))
+# endif
+#endif
+
+static git_hash_acceleration_t supported;
+static git_hash_acceleration_t acceleration;
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#if defined(GIT_HASH_SHANI) || defined(GIT_HASH_ARMV8)
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+#endif
+
+#if defined(GIT_HASH_SHANI)
+
+#if defined(GIT_HASH_X86_LANES)
+/* The register state that the operating system saves for us */
+static uint64_t xcr0(void)
+{
+#if defined(__GNUC__)
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	return _xgetbv(0);
+#endif
+}
+#endif
+
+static git_hash_acceleration_t detect_x86(void)
+{
+	unsigned int flags = GIT_HASH_ACCELERATION_NONE;
+	bool osxsave;
+#if defined(__GNUC__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0, NULL) < 7 ||
+	    !__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return GIT_HASH_ACCELERATION_NONE;
+#else
+	int info[4];
+	unsigned int ebx, ecx;
+
+	__cpuid(info, 0);
+
+	if (info[0] < 7)
+		return GIT_HASH_ACCELERATION_NONE;
+
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+#endif
+
+	/* SSSE3 and SSE4.1 */
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return GIT_HASH_ACCELERATION_NONE;
+
+	osxsave = !!(ecx & (1 << 27));
+
+#if defined(__GNUC__)
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+#else
+	__cpuidex(info, 7, 0);
+	ebx = (unsigned int)info[1];
+#endif
+
+	/* SHA */
+	if (ebx & (1 << 29))
+		flags |= GIT_HASH_ACCELERATION_X86_SHA;
+
+#if defined(GIT_HASH_X86_LANES)
+	/*
+	 * AVX2, and AVX-512 (F and BW), provided that the operating
+	 * system also saves the registers that they use.
+	 */
+	if (osxsave) {
+		uint64_t xcr = xcr0();
+
+		if ((ebx & (1 << 5)) && (xcr & 0x06) == 0x06)
+			flags |= GIT_HASH_ACCELERATION_X86_AVX2;
+
+		if ((ebx & (1 << 16)) && (ebx & (1u << 30)) && (xcr & 0xe6) == 0xe6)
+			flags |= GIT_HASH_ACCELERATION_X86_AVX512;
+	}
+#else
+	GIT_UNUSED(osxsave);
+#endif
+
+	return (git_hash_acceleration_t)flags;
+}
+
+static SHANI_TARGET void sha1_x86(
+	uint32_t *state,
+	const unsigned char *data,
+	size_t blocks)
+{
+	const __m128i mask = _mm_set_epi8(
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i abcd, abcd_saved, e0, e0_saved, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+	e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (blocks--) {
+		abcd_saved = abcd;
+		e0_saved = e0;
+
+		/* Rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* Rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* Rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* Rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* Rounds 16-19 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* Rounds 20-23 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* Rounds 24-27 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* Rounds 28-31 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* Rounds 32-35 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* Rounds 36-39 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* Rounds 40-43 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* Rounds 44-47 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* Rounds 48-51 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* Rounds 52-55 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* Rounds 56-59 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* Rounds 60-63 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+
+		/* Rounds 64-67 */
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+
+		/* Rounds 68-71 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* Rounds 72-75 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		/* Rounds 76-79 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+		abcd = _mm_add_epi32(abcd, abcd_saved);
+
+		data += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+static SHANI_TARGET void sha256_x86(
+	uint32_t *state,
+	const unsigned char *data,
+	size_t blocks)
+{
+	const __m128i mask = _mm_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m128i state0, state1, abef_saved, cdgh_saved, wk, tmp;
+	__m128i msg0, msg1, msg2, msg3;
+
+	/* The instructions want the state as ABEF and CDGH */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	while (blocks--) {
+		abef_saved = state0;
+		cdgh_saved = state1;
+
+		/* Rounds 0-3 */
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		wk = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *)&sha256_k[0]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+		/* Rounds 4-7 */
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		wk = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *)&sha256_k[4]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* Rounds 8-11 */
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		wk = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *)&sha256_k[8]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* Rounds 12-15 */
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+		wk = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i *)&sha256_k[12]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg3, msg2, 4);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, tmp), msg3);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* Rounds 16-19 */
+		wk = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *)&sha256_k[16]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg0, msg3, 4);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, tmp), msg0);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* Rounds 20-23 */
+		wk = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *)&sha256_k[20]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg1, msg0, 4);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, tmp), msg1);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* Rounds 24-27 */
+		wk = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *)&sha256_k[24]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg2, msg1, 4);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, tmp), msg2);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* Rounds 28-31 */
+		wk = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i *)&sha256_k[28]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg3, msg2, 4);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, tmp), msg3);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* Rounds 32-35 */
+		wk = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *)&sha256_k[32]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg0, msg3, 4);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, tmp), msg0);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* Rounds 36-39 */
+		wk = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *)&sha256_k[36]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg1, msg0, 4);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, tmp), msg1);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		/* Rounds 40-43 */
+		wk = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *)&sha256_k[40]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg2, msg1, 4);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, tmp), msg2);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		/* Rounds 44-47 */
+		wk = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i *)&sha256_k[44]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg3, msg2, 4);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, tmp), msg3);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+		/* Rounds 48-51 */
+		wk = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *)&sha256_k[48]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg0, msg3, 4);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, tmp), msg0);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+		/* Rounds 52-55 */
+		wk = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *)&sha256_k[52]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg1, msg0, 4);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, tmp), msg1);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+		/* Rounds 56-59 */
+		wk = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *)&sha256_k[56]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		tmp = _mm_alignr_epi8(msg2, msg1, 4);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, tmp), msg2);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+		/* Rounds 60-63 */
+		wk = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i *)&sha256_k[60]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+		wk = _mm_shuffle_epi32(wk, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+		state0 = _mm_add_epi32(state0, abef_saved);
+		state1 = _mm_add_epi32(state1, cdgh_saved);
+
+		data += 64;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+#endif
+
+#if defined(GIT_HASH_X86_LANES)
+
+/*
+ * SHA256 in the lanes of the vector registers: each of `a` to `h`
+ * holds that word of the state of every lane, and the message
+ * schedule likewise.  The blocks are transposed into lanes through a
+ * buffer, a word of each block at a time.
+ */
+
+#define AVX2_ROTR(x, n) \
+	_mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+static AVX2_TARGET void sha256_x8(
+	uint32_t (*state)[GIT_HASH_LANES_MAX],
+	const unsigned char **data)
+{
+	const __m256i mask = _mm256_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i s[8], w[16], a, b, c, d, e, f, g, h, wt, t1, t2;
+	uint32_t words[8];
+	size_t i, lane;
+
+	for (i = 0; i < 8; i++)
+		s[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+
+	for (i = 0; i < 16; i++) {
+		for (lane = 0; lane < 8; lane++)
+			memcpy(&words[lane], data[lane] + i * 4, 4);
+
+		w[i] = _mm256_shuffle_epi8(
+			_mm256_loadu_si256((const __m256i *)words), mask);
+	}
+
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			wt = w[i];
+		} else {
+			__m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			__m256i s0 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(w15, 7), AVX2_ROTR(w15, 18)),
+				_mm256_srli_epi32(w15, 3));
+			__m256i s1 = _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(w2, 17), AVX2_ROTR(w2, 19)),
+				_mm256_srli_epi32(w2, 10));
+
+			wt = _mm256_add_epi32(
+				_mm256_add_epi32(w[i & 15], s0),
+				_mm256_add_epi32(w[(i - 7) & 15], s1));
+			w[i & 15] = wt;
+		}
+
+		/* t1 = h + S1(e) + ch(e, f, g) + k + w */
+		t1 = _mm256_add_epi32(
+			_mm256_add_epi32(h, _mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(e, 6), AVX2_ROTR(e, 11)),
+				AVX2_ROTR(e, 25))),
+			_mm256_add_epi32(
+				_mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+				_mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[i]), wt)));
+
+		/* t2 = S0(a) + maj(a, b, c) */
+		t2 = _mm256_add_epi32(
+			_mm256_xor_si256(
+				_mm256_xor_si256(AVX2_ROTR(a, 2), AVX2_ROTR(a, 13)),
+				AVX2_ROTR(a, 22)),
+			_mm256_or_si256(_mm256_and_si256(a, b),
+				_mm256_and_si256(c, _mm256_or_si256(a, b))));
+
+		h = g; g = f; f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c; c = b; b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+
+	s[0] = _mm256_add_epi32(s[0], a);
+	s[1] = _mm256_add_epi32(s[1], b);
+	s[2] = _mm256_add_epi32(s[2], c);
+	s[3] = _mm256_add_epi32(s[3], d);
+	s[4] = _mm256_add_epi32(s[4], e);
+	s[5] = _mm256_add_epi32(s[5], f);
+	s[6] = _mm256_add_epi32(s[6], g);
+	s[7] = _mm256_add_epi32(s[7], h);
+
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)state[i], s[i]);
+}
+
+/*
+ * AVX-512 has rotations, and three-way logic operations that compute
+ * the xors and ch and maj in one instruction each.
+ */
+#define AVX512_XOR3 0x96
+#define AVX512_CH   0xca
+#define AVX512_MAJ  0xe8
+
+#define AVX512_ROTR3(x, n1, n2, n3) \
+	_mm512_ternarylogic_epi32(_mm512_ror_epi32((x), (n1)), \
+		_mm512_ror_epi32((x), (n2)), _mm512_ror_epi32((x), (n3)), AVX512_XOR3)
+
+static AVX512_TARGET void sha256_x16(
+	uint32_t (*state)[GIT_HASH_LANES_MAX],
+	const unsigned char **data)
+{
+	const __m512i mask = _mm512_set4_epi32(
+		0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+	__m512i s[8], w[16], a, b, c, d, e, f, g, h, wt, t1, t2;
+	uint32_t words[16];
+	size_t i, lane;
+
+	for (i = 0; i < 8; i++)
+		s[i] = _mm512_loadu_si512((const void *)state[i]);
+
+	for (i = 0; i < 16; i++) {
+		for (lane = 0; lane < 16; lane++)
+			memcpy(&words[lane], data[lane] + i * 4, 4);
+
+		w[i] = _mm512_shuffle_epi8(
+			_mm512_loadu_si512((const void *)words), mask);
+	}
+
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			wt = w[i];
+		} else {
+			__m512i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			__m512i s0 = _mm512_ternarylogic_epi32(
+				_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18),
+				_mm512_srli_epi32(w15, 3), AVX512_XOR3);
+			__m512i s1 = _mm512_ternarylogic_epi32(
+				_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19),
+				_mm512_srli_epi32(w2, 10), AVX512_XOR3);
+
+			wt = _mm512_add_epi32(
+				_mm512_add_epi32(w[i & 15], s0),
+				_mm512_add_epi32(w[(i - 7) & 15], s1));
+			w[i & 15] = wt;
+		}
+
+		t1 = _mm512_add_epi32(
+			_mm512_add_epi32(h, AVX512_ROTR3(e, 6, 11, 25)),
+			_mm512_add_epi32(_mm512_ternarylogic_epi32(e, f, g, AVX512_CH),
+				_mm512_add_epi32(_mm512_set1_epi32((int)sha256_k[i]), wt)));
+		t2 = _mm512_add_epi32(AVX512_ROTR3(a, 2, 13, 22),
+			_mm512_ternarylogic_epi32(a, b, c, AVX512_MAJ));
+
+		h = g; g = f; f = e;
+		e = _mm512_add_epi32(d, t1);
+		d = c; c = b; b = a;
+		a = _mm512_add_epi32(t1, t2);
+	}
+
+	s[0] = _mm512_add_epi32(s[0], a);
+	s[1] = _mm512_add_epi32(s[1], b);
+	s[2] = _mm512_add_epi32(s[2], c);
+	s[3] = _mm512_add_epi32(s[3], d);
+	s[4] = _mm512_add_epi32(s[4], e);
+	s[5] = _mm512_add_epi32(s[5], f);
+	s[6] = _mm512_add_epi32(s[6], g);
+	s[7] = _mm512_add_epi32(s[7], h);
+
+	for (i = 0; i < 8; i++)
+		_mm512_storeu_si512((void *)state[i], s[i]);
+}
+
+#endif
+
+#if defined(GIT_HASH_ARMV8)
+
+static const uint32_t sha1_k[4] = {
+	0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+};
+
+static git_hash_acceleration_t detect_armv8(void)
+{
+#if defined(__APPLE__)
+	return GIT_HASH_ACCELERATION_ARMV8_SHA;
+#elif defined(__linux__)
+	unsigned long hwcap = getauxval(AT_HWCAP);
+
+	if ((hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2))
+		return GIT_HASH_ACCELERATION_ARMV8_SHA;
+
+	return GIT_HASH_ACCELERATION_NONE;
+#else
+	return GIT_HASH_ACCELERATION_NONE;
+#endif
+}
+
+GIT_INLINE(uint32x4_t) load_be32x4(const unsigned char *data)
+{
+	return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+}
+
+static ARMV8_TARGET void sha1_armv8(
+	uint32_t *state,
+	const unsigned char *data,
+	size_t blocks)
+{
+	uint32x4_t abcd, abcd_saved, tmp0, tmp1;
+	uint32x4_t msg0, msg1, msg2, msg3;
+	uint32_t e0, e0_saved, e1;
+
+	abcd = vld1q_u32(state);
+	e0 = state[4];
+
+	while (blocks--) {
+		abcd_saved = abcd;
+		e0_saved = e0;
+
+		msg0 = load_be32x4(data);
+		msg1 = load_be32x4(data + 16);
+		msg2 = load_be32x4(data + 32);
+		msg3 = load_be32x4(data + 48);
+
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(sha1_k[0]));
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(sha1_k[0]));
+
+		/* Rounds 0-3 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(sha1_k[0]));
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		/* Rounds 4-7 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(sha1_k[0]));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+		msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+		/* Rounds 8-11 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(sha1_k[0]));
+		msg1 = vsha1su1q_u32(msg1, msg0);
+		msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+		/* Rounds 12-15 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(sha1_k[1]));
+		msg2 = vsha1su1q_u32(msg2, msg1);
+		msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+		/* Rounds 16-19 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(sha1_k[1]));
+		msg3 = vsha1su1q_u32(msg3, msg2);
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		/* Rounds 20-23 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(sha1_k[1]));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+		msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+		/* Rounds 24-27 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(sha1_k[1]));
+		msg1 = vsha1su1q_u32(msg1, msg0);
+		msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+		/* Rounds 28-31 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(sha1_k[1]));
+		msg2 = vsha1su1q_u32(msg2, msg1);
+		msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+		/* Rounds 32-35 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(sha1_k[2]));
+		msg3 = vsha1su1q_u32(msg3, msg2);
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		/* Rounds 36-39 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(sha1_k[2]));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+		msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+		/* Rounds 40-43 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1mq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(sha1_k[2]));
+		msg1 = vsha1su1q_u32(msg1, msg0);
+		msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+		/* Rounds 44-47 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1mq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(sha1_k[2]));
+		msg2 = vsha1su1q_u32(msg2, msg1);
+		msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+		/* Rounds 48-51 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1mq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(sha1_k[2]));
+		msg3 = vsha1su1q_u32(msg3, msg2);
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		/* Rounds 52-55 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1mq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(sha1_k[3]));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+		msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+		/* Rounds 56-59 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1mq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(sha1_k[3]));
+		msg1 = vsha1su1q_u32(msg1, msg0);
+		msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+		/* Rounds 60-63 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(sha1_k[3]));
+		msg2 = vsha1su1q_u32(msg2, msg1);
+		msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+		/* Rounds 64-67 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(sha1_k[3]));
+		msg3 = vsha1su1q_u32(msg3, msg2);
+
+		/* Rounds 68-71 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(sha1_k[3]));
+
+		/* Rounds 72-75 */
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, tmp0);
+
+		/* Rounds 76-79 */
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+
+		e0 += e0_saved;
+		abcd = vaddq_u32(abcd, abcd_saved);
+
+		data += 64;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e0;
+}
+
+static ARMV8_TARGET void sha256_armv8(
+	uint32_t *state,
+	const unsigned char *data,
+	size_t blocks)
+{
+	uint32x4_t state0, state1, abef_saved, cdgh_saved, saved, tmp0, tmp1;
+	uint32x4_t msg0, msg1, msg2, msg3;
+
+	state0 = vld1q_u32(&state[0]);
+	state1 = vld1q_u32(&state[4]);
+
+	while (blocks--) {
+		abef_saved = state0;
+		cdgh_saved = state1;
+
+		msg0 = load_be32x4(data);
+		msg1 = load_be32x4(data + 16);
+		msg2 = load_be32x4(data + 32);
+		msg3 = load_be32x4(data + 48);
+
+		tmp0 = vaddq_u32(msg0, vld1q_u32(&sha256_k[0]));
+
+		/* Rounds 0-3 */
+		msg0 = vsha256su0q_u32(msg0, msg1);
+		saved = state0;
+		tmp1 = vaddq_u32(msg1, vld1q_u32(&sha256_k[4]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+		/* Rounds 4-7 */
+		msg1 = vsha256su0q_u32(msg1, msg2);
+		saved = state0;
+		tmp0 = vaddq_u32(msg2, vld1q_u32(&sha256_k[8]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+		/* Rounds 8-11 */
+		msg2 = vsha256su0q_u32(msg2, msg3);
+		saved = state0;
+		tmp1 = vaddq_u32(msg3, vld1q_u32(&sha256_k[12]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+		/* Rounds 12-15 */
+		msg3 = vsha256su0q_u32(msg3, msg0);
+		saved = state0;
+		tmp0 = vaddq_u32(msg0, vld1q_u32(&sha256_k[16]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+		/* Rounds 16-19 */
+		msg0 = vsha256su0q_u32(msg0, msg1);
+		saved = state0;
+		tmp1 = vaddq_u32(msg1, vld1q_u32(&sha256_k[20]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+		/* Rounds 20-23 */
+		msg1 = vsha256su0q_u32(msg1, msg2);
+		saved = state0;
+		tmp0 = vaddq_u32(msg2, vld1q_u32(&sha256_k[24]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+		/* Rounds 24-27 */
+		msg2 = vsha256su0q_u32(msg2, msg3);
+		saved = state0;
+		tmp1 = vaddq_u32(msg3, vld1q_u32(&sha256_k[28]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+		/* Rounds 28-31 */
+		msg3 = vsha256su0q_u32(msg3, msg0);
+		saved = state0;
+		tmp0 = vaddq_u32(msg0, vld1q_u32(&sha256_k[32]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+		/* Rounds 32-35 */
+		msg0 = vsha256su0q_u32(msg0, msg1);
+		saved = state0;
+		tmp1 = vaddq_u32(msg1, vld1q_u32(&sha256_k[36]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+		/* Rounds 36-39 */
+		msg1 = vsha256su0q_u32(msg1, msg2);
+		saved = state0;
+		tmp0 = vaddq_u32(msg2, vld1q_u32(&sha256_k[40]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+		/* Rounds 40-43 */
+		msg2 = vsha256su0q_u32(msg2, msg3);
+		saved = state0;
+		tmp1 = vaddq_u32(msg3, vld1q_u32(&sha256_k[44]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+		msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+		/* Rounds 44-47 */
+		msg3 = vsha256su0q_u32(msg3, msg0);
+		saved = state0;
+		tmp0 = vaddq_u32(msg0, vld1q_u32(&sha256_k[48]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+		msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+		/* Rounds 48-51 */
+		saved = state0;
+		tmp1 = vaddq_u32(msg1, vld1q_u32(&sha256_k[52]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+
+		/* Rounds 52-55 */
+		saved = state0;
+		tmp0 = vaddq_u32(msg2, vld1q_u32(&sha256_k[56]));
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+
+		/* Rounds 56-59 */
+		saved = state0;
+		tmp1 = vaddq_u32(msg3, vld1q_u32(&sha256_k[60]));
+		state0 = vsha256hq_u32(state0, state1, tmp0);
+		state1 = vsha256h2q_u32(state1, saved, tmp0);
+
+		/* Rounds 60-63 */
+		saved = state0;
+		state0 = vsha256hq_u32(state0, state1, tmp1);
+		state1 = vsha256h2q_u32(state1, saved, tmp1);
+
+		state0 = vaddq_u32(state0, abef_saved);
+		state1 = vaddq_u32(state1, cdgh_saved);
+
+		data += 64;
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+int git_hash_accelerated_global_init(void)
+{
+#if defined(GIT_HASH_SHANI)
+	supported = detect_x86();
+#elif defined(GIT_HASH_ARMV8)
+	supported = detect_armv8();
+#endif
+
+	acceleration = supported;
+	return 0;
+}
+
+git_hash_acceleration_t git_hash_acceleration(void)
+{
+	return acceleration;
+}
+
+int git_hash_set_acceleration(git_hash_acceleration_t requested)
+{
+	if ((requested & ~supported) != 0) {
+		git_error_set(GIT_ERROR_SHA, "hash acceleration is not supported on this processor");
+		return -1;
+	}
+
+	acceleration = requested;
+	return 0;
+}
+
+int git_hash_sha1_accelerated_init(git_hash_accelerated_ctx *ctx)
+{
+	ctx->blocks = NULL;
+
+#if defined(GIT_HASH_SHANI)
+	if (acceleration & GIT_HASH_ACCELERATION_X86_SHA)
+		ctx->blocks = sha1_x86;
+#endif
+#if defined(GIT_HASH_ARMV8)
+	if (acceleration & GIT_HASH_ACCELERATION_ARMV8_SHA)
+		ctx->blocks = sha1_armv8;
+#endif
+
+	if (!ctx->blocks)
+		return GIT_ENOTFOUND;
+
+	memcpy(ctx->state, sha1_iv, sizeof(sha1_iv));
+	ctx->len = 0;
+	return 0;
+}
+
+int git_hash_sha256_accelerated_init(git_hash_accelerated_ctx *ctx)
+{
+	ctx->blocks = NULL;
+
+#if defined(GIT_HASH_SHANI)
+	if (acceleration & GIT_HASH_ACCELERATION_X86_SHA)
+		ctx->blocks = sha256_x86;
+#endif
+#if defined(GIT_HASH_ARMV8)
+	if (acceleration & GIT_HASH_ACCELERATION_ARMV8_SHA)
+		ctx->blocks = sha256_armv8;
+#endif
+
+	if (!ctx->blocks)
+		return GIT_ENOTFOUND;
+
+	memcpy(ctx->state, sha256_iv, sizeof(sha256_iv));
+	ctx->len = 0;
+	return 0;
+}
+
+void git_hash_accelerated_update(
+	git_hash_accelerated_ctx *ctx,
+	const void *data,
+	size_t len)
+{
+	const unsigned char *in = data;
+	size_t used = (size_t)(ctx->len % 64), n;
+
+	ctx->len += len;
+
+	/* Fill up a partial block from before */
+	if (used) {
+		n = min(64 - used, len);
+		memcpy(ctx->buf + used, in, n);
+
+		if (used + n < 64)
+			return;
+
+		ctx->blocks(ctx->state, ctx->buf, 1);
+		in += n;
+		len -= n;
+	}
+
+	if (len >= 64) {
+		ctx->blocks(ctx->state, in, len / 64);
+		in += (len / 64) * 64;
+		len %= 64;
+	}
+
+	if (len)
+		memcpy(ctx->buf, in, len);
+}
+
+void git_hash_accelerated_final(
+	unsigned char *out,
+	size_t out_len,
+	git_hash_accelerated_ctx *ctx)
+{
+	uint64_t bits = ctx->len * 8;
+	size_t used = (size_t)(ctx->len % 64), i;
+
+	ctx->buf[used++] = 0x80;
+
+	if (used > 56) {
+		memset(ctx->buf + used, 0, 64 - used);
+		ctx->blocks(ctx->state, ctx->buf, 1);
+		used = 0;
+	}
+
+	memset(ctx->buf + used, 0, 56 - used);
+
+	for (i = 0; i < 8; i++)
+		ctx->buf[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+
+	ctx->blocks(ctx->state, ctx->buf, 1);
+
+	for (i = 0; i < out_len / 4; i++) {
+		out[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+		out[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+		out[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+		out[i * 4 + 3] = (unsigned char)ctx->state[i];
+	}
+}
+
+int git_hash_sha256_lanes_init(git_hash_lanes_ctx *ctx)
+{
+#if defined(GIT_HASH_X86_LANES)
+	/*
+	 * Sixteen lanes of AVX-512 outrun the SHA instructions, while
+	 * eight of AVX2 do not.
+	 */
+	if (acceleration & GIT_HASH_ACCELERATION_X86_AVX512) {
+		ctx->blocks = sha256_x16;
+		ctx->lanes = 16;
+		return 0;
+	}
+
+	if ((acceleration & GIT_HASH_ACCELERATION_X86_AVX2) &&
+	    !(acceleration & GIT_HASH_ACCELERATION_X86_SHA)) {
+		ctx->blocks = sha256_x8;
+		ctx->lanes = 8;
+		return 0;
+	}
+#endif
+
+	GIT_UNUSED(ctx);
+	return GIT_ENOTFOUND;
+}
+
+void git_hash_sha256_lanes_reset(git_hash_lanes_ctx *ctx, size_t lane)
+{
+	size_t i;
+
+	for (i = 0; i < 8; i++)
+		ctx->state[i][lane] = sha256_iv[i];
+}
+
+void git_hash_sha256_lanes_final(
+	unsigned char *out,
+	git_hash_lanes_ctx *ctx,
+	size_t lane)
+{
+	size_t i;
+
+	for (i = 0; i < 8; i++) {
+		out[i * 4] = (unsigned char)(ctx->state[i][lane] >> 24);
+		out[i * 4 + 1] = (unsigned char)(ctx->state[i][lane] >> 16);
+		out[i * 4 + 2] = (unsigned char)(ctx->state[i][lane] >> 8);
+		out[i * 4 + 3] = (unsigned char)ctx->state[i][lane];
+	}
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_hash_accelerated_h__
+#define INCLUDE_hash_accelerated_h__
+
+#include "git2_util.h"
+
+/*
+ * SHA1 and SHA256 using the instructions that some processors have for
+ * them: the SHA extensions on x86 and the cryptography extension on
+ * ARMv8.  Whether these are available is determined at runtime (in
+ * `git_hash_accelerated_global_init`); when they are not, the
+ * accelerated hashes are unavailable and callers should use a portable
+ * implementation.
+ *
+ * Note that this SHA1 does not detect collision attacks, so it must
+ * only be used for checksums of data that we wrote or have otherwise
+ * validated, never for object ids.
+ *
+ * On x86, the vector instructions can also hash several independent
+ * messages at once, each in its own lane (see `git_hash_lanes_ctx`).
+ */
+
+typedef enum {
+	GIT_HASH_ACCELERATION_NONE = 0,
+	GIT_HASH_ACCELERATION_X86_SHA = (1u << 0),
+	GIT_HASH_ACCELERATION_ARMV8_SHA = (1u << 1),
+	GIT_HASH_ACCELERATION_X86_AVX2 = (1u << 2),
+	GIT_HASH_ACCELERATION_X86_AVX512 = (1u << 3)
+} git_hash_acceleration_t;
+
+typedef struct {
+	void (*blocks)(uint32_t *state, const unsigned char *data, size_t blocks);
+	uint32_t state[8];
+	uint64_t len;
+	unsigned char buf[64];
+} git_hash_accelerated_ctx;
+
+int git_hash_accelerated_global_init(void);
+
+/*
+ * Gets/sets the accelerations in use, as a combination of the flags
+ * above.  Setting them is only for testing purposes, and fails if the
+ * processor does not support them all.
+ */
+git_hash_acceleration_t git_hash_acceleration(void);
+int git_hash_set_acceleration(git_hash_acceleration_t acceleration);
+
+/*
+ * Initialize the context for the given algorithm.  These return
+ * `GIT_ENOTFOUND` (without setting an error) if there is no
+ * accelerated implementation.
+ */
+int git_hash_sha1_accelerated_init(git_hash_accelerated_ctx *ctx);
+int git_hash_sha256_accelerated_init(git_hash_accelerated_ctx *ctx);
+
+void git_hash_accelerated_update(git_hash_accelerated_ctx *ctx, const void *data, size_t len);
+void git_hash_accelerated_final(unsigned char *out, size_t out_len, git_hash_accelerated_ctx *ctx);
+
+/*
+ * SHA256 of up to `GIT_HASH_LANES_MAX` messages at once: eight with
+ * AVX2, sixteen with AVX-512.  Each lane's state is stored word by
+ * word, so that `state[i][lane]` is the i'th word of that lane's
+ * state, and each call to `blocks` hashes one (already padded) block
+ * for every lane.  Lanes that have nothing to hash still need a block
+ * to be given; its result can be ignored.
+ */
+#define GIT_HASH_LANES_MAX 16
+
+typedef struct {
+	void (*blocks)(uint32_t (*state)[GIT_HASH_LANES_MAX], const unsigned char **data);
+	size_t lanes;
+	uint32_t state[8][GIT_HASH_LANES_MAX];
+} git_hash_lanes_ctx;
+
+/*
+ * Initialize the context for SHA256 in lanes.  This returns
+ * `GIT_ENOTFOUND` (without setting an error) if the processor cannot
+ * do it, or if hashing messages one at a time with its SHA instructions
+ * is faster.
+ */
+int git_hash_sha256_lanes_init(git_hash_lanes_ctx *ctx);
+
+/* Start a new message in the given lane */
+void git_hash_sha256_lanes_reset(git_hash_lanes_ctx *ctx, size_t lane);
+
+/* Write out the SHA256 of the message that was hashed in the lane */
+void git_hash_sha256_lanes_final(unsigned char *out, git_hash_lanes_ctx *ctx, size_t lane);
+
+#endif
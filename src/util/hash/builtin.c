@@ -24,8 +24,19 @@ void git_hash_sha256_ctx_cleanup(git_hash_sha256_ctx *ctx)
 
 int git_hash_sha256_init(git_hash_sha256_ctx *ctx)
 {
+	int error;
+
 	GIT_ASSERT_ARG(ctx);
-	if (SHA256Reset(&ctx->c)) {
+
+	/* Use the processor's SHA256 instructions if it has them */
+	if ((error = git_hash_sha256_accelerated_init(&ctx->ctx.accelerated)) != GIT_ENOTFOUND) {
+		ctx->is_accelerated = (error == 0);
+		return error;
+	}
+
+	ctx->is_accelerated = false;
+
+	if (SHA256Reset(&ctx->ctx.c)) {
 		git_error_set(GIT_ERROR_SHA, "SHA256 error");
 		return -1;
 	}
@@ -35,7 +46,13 @@ int git_hash_sha256_init(git_hash_sha256_ctx *ctx)
 int git_hash_sha256_update(git_hash_sha256_ctx *ctx, const void *data, size_t len)
 {
 	GIT_ASSERT_ARG(ctx);
-	if (SHA256Input(&ctx->c, data, len)) {
+
+	if (ctx->is_accelerated) {
+		git_hash_accelerated_update(&ctx->ctx.accelerated, data, len);
+		return 0;
+	}
+
+	if (SHA256Input(&ctx->ctx.c, data, len)) {
 		git_error_set(GIT_ERROR_SHA, "SHA256 error");
 		return -1;
 	}
@@ -45,7 +62,13 @@ int git_hash_sha256_update(git_hash_sha256_ctx *ctx, const void *data, size_t le
 int git_hash_sha256_final(unsigned char *out, git_hash_sha256_ctx *ctx)
 {
 	GIT_ASSERT_ARG(ctx);
-	if (SHA256Result(&ctx->c, out)) {
+
+	if (ctx->is_accelerated) {
+		git_hash_accelerated_final(out, GIT_HASH_SHA256_SIZE, &ctx->ctx.accelerated);
+		return 0;
+	}
+
+	if (SHA256Result(&ctx->ctx.c, out)) {
 		git_error_set(GIT_ERROR_SHA, "SHA256 error");
 		return -1;
 	}
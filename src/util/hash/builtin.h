@@ -10,10 +10,15 @@
 
 #include "hash/sha.h"
 
+#include "hash/accelerated.h"
 #include "rfc6234/sha.h"
 
 struct git_hash_sha256_ctx {
-	SHA256Context c;
+	union {
+		SHA256Context c;
+		git_hash_accelerated_ctx accelerated;
+	} ctx;
+	bool is_accelerated;
 };
 
 #endif
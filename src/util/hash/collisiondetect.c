@@ -29,6 +29,14 @@ int git_hash_sha1_init(git_hash_sha1_ctx *ctx)
 	return 0;
 }
 
+int git_hash_sha1_init_unsafe(git_hash_sha1_ctx *ctx)
+{
+	GIT_ASSERT_ARG(ctx);
+	SHA1DCInit(&ctx->c);
+	SHA1DCSetUseDetectColl(&ctx->c, 0);
+	return 0;
+}
+
 int git_hash_sha1_update(git_hash_sha1_ctx *ctx, const void *data, size_t len)
 {
 	GIT_ASSERT_ARG(ctx);
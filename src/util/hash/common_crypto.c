@@ -33,6 +33,11 @@ int git_hash_sha1_init(git_hash_sha1_ctx *ctx)
 	return 0;
 }
 
+int git_hash_sha1_init_unsafe(git_hash_sha1_ctx *ctx)
+{
+	return git_hash_sha1_init(ctx);
+}
+
 int git_hash_sha1_update(git_hash_sha1_ctx *ctx, const void *_data, size_t len)
 {
 	const unsigned char *data = _data;
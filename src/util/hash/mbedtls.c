@@ -33,6 +33,11 @@ int git_hash_sha1_init(git_hash_sha1_ctx *ctx)
 	return 0;
 }
 
+int git_hash_sha1_init_unsafe(git_hash_sha1_ctx *ctx)
+{
+	return git_hash_sha1_init(ctx);
+}
+
 int git_hash_sha1_update(git_hash_sha1_ctx *ctx, const void *data, size_t len)
 {
 	GIT_ASSERT_ARG(ctx);
@@ -49,6 +49,13 @@ int git_hash_sha1_ctx_init(git_hash_sha1_ctx *ctx);
 void git_hash_sha1_ctx_cleanup(git_hash_sha1_ctx *ctx);
 
 int git_hash_sha1_init(git_hash_sha1_ctx *c);
+
+/*
+ * Like `git_hash_sha1_init`, but for checksums that need no protection
+ * against collision attacks, so that backends which detect them can
+ * skip doing so.
+ */
+int git_hash_sha1_init_unsafe(git_hash_sha1_ctx *c);
 int git_hash_sha1_update(git_hash_sha1_ctx *c, const void *data, size_t len);
 int git_hash_sha1_final(unsigned char *out, git_hash_sha1_ctx *c);
 
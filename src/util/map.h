@@ -23,6 +23,19 @@
 #define GIT_MAP_TYPE	0xf
 #define GIT_MAP_FIXED	0x10
 
+/*
+ * p_madvise() access patterns: the whole of a mapping is going to be read
+ * in order, or in no particular order, or this range of it is going to be
+ * needed soon, or not any more.
+ */
+typedef enum {
+	GIT_MAP_ADVICE_NORMAL = 0,
+	GIT_MAP_ADVICE_SEQUENTIAL,
+	GIT_MAP_ADVICE_RANDOM,
+	GIT_MAP_ADVICE_WILLNEED,
+	GIT_MAP_ADVICE_DONTNEED
+} git_map_advice_t;
+
 #ifdef __amigaos4__
 #define MAP_FAILED 0
 #endif
@@ -43,4 +56,11 @@ typedef struct { /* memory mapped buffer	*/
 extern int p_mmap(git_map *out, size_t len, int prot, int flags, int fd, off64_t offset);
 extern int p_munmap(git_map *map);
 
+/*
+ * Tell the system how `len` bytes of the mapping, from `offset`, are going
+ * to be used.  This is only a hint: it is ignored where it is not
+ * supported, and it does not fail on a valid mapping.
+ */
+extern int p_madvise(git_map *map, size_t offset, size_t len, git_map_advice_t advice);
+
 #endif
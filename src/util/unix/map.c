@@ -62,6 +62,50 @@ int p_mmap(git_map *out, size_t len, int prot, int flags, int fd, off64_t offset
 	return 0;
 }
 
+#ifdef MADV_NORMAL
+/* In the order of git_map_advice_t */
+static const int map_advice[] = {
+	MADV_NORMAL,
+	MADV_SEQUENTIAL,
+	MADV_RANDOM,
+	MADV_WILLNEED,
+	MADV_DONTNEED
+};
+#endif
+
+int p_madvise(git_map *map, size_t offset, size_t len, git_map_advice_t advice)
+{
+#ifdef MADV_NORMAL
+	size_t page_size, start;
+
+	GIT_ASSERT_ARG(map);
+	GIT_ASSERT_ARG((size_t)advice < ARRAY_SIZE(map_advice));
+
+	if (offset >= map->len || !len)
+		return 0;
+
+	if (len > map->len - offset)
+		len = map->len - offset;
+
+	/* The mapping starts on a page boundary, but the range need not */
+	if (git__page_size(&page_size) < 0)
+		return -1;
+
+	start = offset - (offset % page_size);
+
+	/* This is only advice, so the kernel not taking it is not an error */
+	(void)madvise((char *)map->data + start, len + (offset - start), map_advice[advice]);
+#else
+	GIT_ASSERT_ARG(map);
+
+	GIT_UNUSED(offset);
+	GIT_UNUSED(len);
+	GIT_UNUSED(advice);
+#endif
+
+	return 0;
+}
+
 int p_munmap(git_map *map)
 {
 	GIT_ASSERT_ARG(map);
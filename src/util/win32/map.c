@@ -113,6 +113,17 @@ int p_mmap(git_map *out, size_t len, int prot, int flags, int fd, off64_t offset
 	return 0;
 }
 
+int p_madvise(git_map *map, size_t offset, size_t len, git_map_advice_t advice)
+{
+	GIT_ASSERT_ARG(map);
+
+	GIT_UNUSED(offset);
+	GIT_UNUSED(len);
+	GIT_UNUSED(advice);
+
+	return 0;
+}
+
 int p_munmap(git_map *map)
 {
 	int error = 0;
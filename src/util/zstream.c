@@ -9,7 +9,12 @@
 
 #include <zlib.h>
 
+#ifdef GIT_LIBDEFLATE
+# include <libdeflate.h>
+#endif
+
 #include "str.h"
+#include "runtime.h"
 
 #define ZSTREAM_BUFFER_SIZE (1024 * 1024)
 #define ZSTREAM_BUFFER_MIN_EXTRA 8
@@ -208,3 +213,146 @@ int git_zstream_inflatebuf(git_str *out, const void *in, size_t in_len)
 {
 	return zstream_buf(out, in, in_len, GIT_ZSTREAM_INFLATE);
 }
+
+static int inflate_known_error(void)
+{
+	git_error_set(GIT_ERROR_ZLIB, "error inflating zlib stream");
+	return -1;
+}
+
+#ifdef GIT_LIBDEFLATE
+
+/*
+ * A decompressor is tens of kilobytes, so each thread keeps its own
+ * rather than allocating one per object.
+ */
+static git_tlsdata_key decompressor_key;
+
+static void GIT_SYSTEM_CALL decompressor_free(void *d)
+{
+	libdeflate_free_decompressor(d);
+}
+
+static void zstream_global_shutdown(void)
+{
+	struct libdeflate_decompressor *decompressor =
+		git_tlsdata_get(decompressor_key);
+
+	git_tlsdata_set(decompressor_key, NULL);
+
+	if (decompressor)
+		libdeflate_free_decompressor(decompressor);
+
+	git_tlsdata_dispose(decompressor_key);
+}
+
+int git_zstream_global_init(void)
+{
+	if (git_tlsdata_init(&decompressor_key, decompressor_free) != 0)
+		return -1;
+
+	return git_runtime_shutdown_register(zstream_global_shutdown);
+}
+
+int git_zstream_inflate_known(
+	size_t *in_used,
+	void *out,
+	size_t out_len,
+	const void *in,
+	size_t in_len)
+{
+	struct libdeflate_decompressor *decompressor;
+	enum libdeflate_result result;
+	size_t written;
+
+	if ((decompressor = git_tlsdata_get(decompressor_key)) == NULL) {
+		if ((decompressor = libdeflate_alloc_decompressor()) == NULL) {
+			git_error_set_oom();
+			return -1;
+		}
+
+		git_tlsdata_set(decompressor_key, decompressor);
+	}
+
+	result = libdeflate_zlib_decompress_ex(decompressor,
+		in, in_len, out, out_len, in_used, &written);
+
+	switch (result) {
+	case LIBDEFLATE_SUCCESS:
+		return (written == out_len) ? 0 : inflate_known_error();
+	case LIBDEFLATE_INSUFFICIENT_SPACE:
+		return inflate_known_error();
+	default:
+		/* Truncated data looks just like corrupt data to libdeflate */
+		return GIT_EBUFS;
+	}
+}
+
+#else
+
+int git_zstream_global_init(void)
+{
+	return 0;
+}
+
+int git_zstream_inflate_known(
+	size_t *in_used,
+	void *out,
+	size_t out_len,
+	const void *in,
+	size_t in_len)
+{
+	z_stream z;
+	int zerr;
+
+	/* Leave the enormous ones to the stream */
+	if (in_len > UINT_MAX || out_len > UINT_MAX)
+		return GIT_EBUFS;
+
+	memset(&z, 0, sizeof(z));
+
+	if ((zerr = inflateInit(&z)) != Z_OK) {
+		if (zerr == Z_MEM_ERROR)
+			git_error_set_oom();
+		else
+			git_error_set(GIT_ERROR_ZLIB, "failed to initialize zlib");
+
+		return -1;
+	}
+
+	/*
+	 * Finishing in the first call, with all of the output in the
+	 * buffer, lets zlib do without its window.
+	 */
+	z.next_in = (Bytef *)in;
+	z.avail_in = (uInt)in_len;
+	z.next_out = out;
+	z.avail_out = (uInt)out_len;
+
+	zerr = inflate(&z, Z_FINISH);
+	inflateEnd(&z);
+
+	*in_used = in_len - z.avail_in;
+
+	if (zerr == Z_STREAM_END)
+		return z.avail_out ? inflate_known_error() : 0;
+
+	if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+		if (zerr == Z_MEM_ERROR)
+			git_error_set_oom();
+		else if (z.msg)
+			git_error_set_str(GIT_ERROR_ZLIB, z.msg);
+		else
+			return inflate_known_error();
+
+		return -1;
+	}
+
+	/* Out of input, so it may continue beyond it */
+	if (!z.avail_in)
+		return GIT_EBUFS;
+
+	return inflate_known_error();
+}
+
+#endif
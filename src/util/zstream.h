@@ -29,6 +29,8 @@ typedef struct {
 
 #define GIT_ZSTREAM_INIT {{0}}
 
+int git_zstream_global_init(void);
+
 int git_zstream_init(git_zstream *zstream, git_zstream_t type);
 void git_zstream_free(git_zstream *zstream);
 
@@ -51,4 +53,21 @@ void git_zstream_reset(git_zstream *zstream);
 int git_zstream_deflatebuf(git_str *out, const void *in, size_t in_len);
 int git_zstream_inflatebuf(git_str *out, const void *in, size_t in_len);
 
+/*
+ * Inflate `in` into `out` in one go, when the inflated length is known
+ * beforehand (as it is for objects); this is much quicker than
+ * streaming, particularly with libdeflate.  The compressed data may be
+ * followed by other data, and `in_used` is set to its own length.
+ *
+ * This returns `GIT_EBUFS` (without setting an error) if `in` might
+ * not hold all of the compressed data; the caller should then stream
+ * it instead, which also tells what is wrong if the data is corrupt.
+ */
+int git_zstream_inflate_known(
+	size_t *in_used,
+	void *out,
+	size_t out_len,
+	const void *in,
+	size_t in_len);
+
 #endif
@@ -1,5 +1,7 @@
 #include "blame_helpers.h"
 
+#include <git2/sys/commit_graph.h>
+
 static git_repository *g_repo;
 static git_blame *g_blame;
 
@@ -65,6 +67,49 @@ void test_blame_simple__trivial_blamerepo(void)
 }
 
 
+/* The same, with changed-path Bloom filters in the commit-graph */
+void test_blame_simple__trivial_blamerepo_with_changed_paths(void)
+{
+	git_commit_graph_writer *w;
+	git_commit_graph_writer_options opts = GIT_COMMIT_GRAPH_WRITER_OPTIONS_INIT;
+	git_revwalk *walk;
+
+	cl_fixture_sandbox("blametest.git");
+	cl_git_pass(git_repository_open(&g_repo, "blametest.git"));
+	cl_must_pass(p_mkdir("blametest.git/objects/info", 0777));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_commit_graph_writer_new(&w, "blametest.git/objects/info", GIT_OID_SHA1));
+#else
+	cl_git_pass(git_commit_graph_writer_new(&w, "blametest.git/objects/info"));
+#endif
+	cl_git_pass(git_revwalk_new(&walk, g_repo));
+	cl_git_pass(git_revwalk_push_head(walk));
+	cl_git_pass(git_commit_graph_writer_add_revwalk(w, walk));
+	opts.changed_paths = 1;
+	cl_git_pass(git_commit_graph_writer_commit(w, &opts));
+	git_revwalk_free(walk);
+	git_commit_graph_writer_free(w);
+
+	/* Reopen it, now that there is a commit-graph */
+	git_repository_free(g_repo);
+	cl_git_pass(git_repository_open(&g_repo, "blametest.git"));
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "b.txt", NULL));
+
+	cl_assert_equal_i(4, git_blame_get_hunk_count(g_blame));
+	check_blame_hunk_index(g_repo, g_blame, 0,  1, 4, 0, "da237394", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 1,  5, 1, 1, "b99f7ac0", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 2,  6, 5, 0, "63d671eb", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 3, 11, 5, 0, "aa06ecca", "b.txt");
+
+	git_blame_free(g_blame);
+	g_blame = NULL;
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	cl_fixture_cleanup("blametest.git");
+}
+
 /*
  * $ git blame -n 359fc2d -- include/git2.h
  *                     orig line no                                final line no
@@ -178,3 +178,325 @@ void test_graph_commitgraph__validate_corrupt(void)
 
 	cl_fixture_cleanup("testrepo.git");
 }
+
+static void write_graph(
+	git_repository *repo,
+	const char *refs,
+	git_commit_graph_split_strategy_t split_strategy,
+	float size_multiple,
+	int changed_paths)
+{
+	git_commit_graph_writer *w = NULL;
+	git_commit_graph_writer_options opts = GIT_COMMIT_GRAPH_WRITER_OPTIONS_INIT;
+	git_revwalk *walk;
+	git_str path = GIT_STR_INIT;
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/info"));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_commit_graph_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_commit_graph_writer_new(&w, git_str_cstr(&path)));
+#endif
+
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	if (strchr(refs, '*'))
+		cl_git_pass(git_revwalk_push_glob(walk, refs));
+	else
+		cl_git_pass(git_revwalk_push_ref(walk, refs));
+	cl_git_pass(git_commit_graph_writer_add_revwalk(w, walk));
+	git_revwalk_free(walk);
+
+	opts.split_strategy = split_strategy;
+	opts.size_multiple = size_multiple;
+	opts.changed_paths = changed_paths;
+	cl_git_pass(git_commit_graph_writer_commit(w, &opts));
+
+	git_str_dispose(&path);
+	git_commit_graph_writer_free(w);
+}
+
+static size_t chain_length(git_repository *repo)
+{
+	git_str path = GIT_STR_INIT, chain = GIT_STR_INIT;
+	size_t i, lines = 0;
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/info/" GIT_COMMIT_GRAPH_CHAIN_FILE));
+	cl_git_pass(git_futils_readbuffer(&chain, git_str_cstr(&path)));
+
+	for (i = 0; i < git_str_len(&chain); i++)
+		lines += (chain.ptr[i] == '\n');
+
+	git_str_dispose(&chain);
+	git_str_dispose(&path);
+	return lines;
+}
+
+/* Every commit must be in the chain as it is in the fixture's single file */
+static void assert_chain_matches_fixture(git_repository *repo)
+{
+	struct git_commit_graph_file *expected, *file;
+	struct git_commit_graph_entry e, actual, parent, actual_parent;
+	git_oid id;
+	git_str path = GIT_STR_INIT;
+	size_t i, n;
+
+	cl_git_pass(git_commit_graph_file_open(&expected,
+		cl_fixture("testrepo.git/objects/info/commit-graph"), GIT_OID_SHA1));
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/info/" GIT_COMMIT_GRAPH_CHAIN_FILE));
+	cl_git_pass(git_commit_graph_chain_open(&file, git_str_cstr(&path), GIT_OID_SHA1));
+	cl_assert(!git_commit_graph_chain_needs_refresh(file, git_str_cstr(&path)));
+
+	cl_assert_equal_i(expected->num_commits, file->num_commits_in_base + file->num_commits);
+
+	for (i = 0; i < expected->num_commits; i++) {
+		cl_git_pass(git_oid__fromraw(&id, expected->oid_lookup + i * GIT_OID_SHA1_SIZE, GIT_OID_SHA1));
+		cl_git_pass(git_commit_graph_entry_find(&e, expected, &id, GIT_OID_SHA1_HEXSIZE));
+		cl_git_pass(git_commit_graph_entry_find(&actual, file, &id, GIT_OID_SHA1_HEXSIZE));
+
+		cl_assert_equal_oid(&e.tree_oid, &actual.tree_oid);
+		cl_assert_equal_i(e.generation, actual.generation);
+		cl_assert_equal_i(e.commit_time, actual.commit_time);
+		cl_assert_equal_i(e.parent_count, actual.parent_count);
+
+		for (n = 0; n < e.parent_count; n++) {
+			cl_git_pass(git_commit_graph_entry_parent(&parent, expected, &e, n));
+			cl_git_pass(git_commit_graph_entry_parent(&actual_parent, file, &actual, n));
+			cl_assert_equal_oid(&parent.sha1, &actual_parent.sha1);
+		}
+	}
+
+	git_commit_graph_file_free(file);
+	git_commit_graph_file_free(expected);
+	git_str_dispose(&path);
+}
+
+void test_graph_commitgraph__split(void)
+{
+	git_repository *repo;
+	struct git_commit_graph *cgraph;
+	struct git_commit_graph_file *file;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_must_pass(p_unlink("testrepo.git/objects/info/commit-graph"));
+
+	write_graph(repo, "refs/heads/br2", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT, 0, 0);
+	cl_assert_equal_sz(1, chain_length(repo));
+
+	/* Two new commits go in a file of their own */
+	write_graph(repo, "refs/heads/master", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_NO_MERGE, 0, 0);
+	cl_assert_equal_sz(2, chain_length(repo));
+
+	/* Nothing is written when there are no new commits */
+	write_graph(repo, "refs/heads/master", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT, 0, 0);
+	cl_assert_equal_sz(2, chain_length(repo));
+
+	/* Seven new commits merge the small file, but not the large one */
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT, 0.5, 0);
+	cl_assert_equal_sz(2, chain_length(repo));
+	assert_chain_matches_fixture(repo);
+
+	/* The commit-graph of the object database is the chain */
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_commit_graph_open(&cgraph, "testrepo.git/objects", GIT_OID_SHA1));
+#else
+	cl_git_pass(git_commit_graph_open(&cgraph, "testrepo.git/objects"));
+#endif
+	cl_git_pass(git_commit_graph_get_file(&file, cgraph));
+	cl_assert(file->chained && file->base != NULL);
+	git_commit_graph_free(cgraph);
+
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_REPLACE, 0, 0);
+	cl_assert_equal_sz(1, chain_length(repo));
+	assert_chain_matches_fixture(repo);
+
+	/* A single file replaces the chain */
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE, 0, 0);
+	cl_assert(git_fs_path_exists("testrepo.git/objects/info/commit-graph"));
+	cl_assert(!git_fs_path_exists("testrepo.git/objects/info/commit-graphs"));
+
+	cl_git_sandbox_cleanup();
+}
+
+void test_graph_commitgraph__split_single_file(void)
+{
+	git_repository *repo;
+	struct git_commit_graph_file *single;
+	git_str path = GIT_STR_INIT;
+	char checksum_hex[GIT_OID_SHA1_HEXSIZE + 1];
+
+	repo = cl_git_sandbox_init("testrepo.git");
+
+	write_graph(repo, "refs/heads/br2", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE, 0, 0);
+	cl_git_pass(git_commit_graph_file_open(&single,
+		"testrepo.git/objects/info/commit-graph", GIT_OID_SHA1));
+	git_hash_fmt(checksum_hex, single->checksum, GIT_OID_SHA1_SIZE);
+	git_commit_graph_file_free(single);
+
+	/* The single file is moved to the bottom of the chain */
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_NO_MERGE, 0, 0);
+	cl_assert_equal_sz(2, chain_length(repo));
+	cl_assert(!git_fs_path_exists("testrepo.git/objects/info/commit-graph"));
+
+	cl_git_pass(git_str_printf(&path, "testrepo.git/objects/info/commit-graphs/graph-%s.graph", checksum_hex));
+	cl_assert(git_fs_path_exists(git_str_cstr(&path)));
+	assert_chain_matches_fixture(repo);
+
+	git_str_dispose(&path);
+	cl_git_sandbox_cleanup();
+}
+
+/*
+ * The changed-path Bloom filters that `git commit-graph write --reachable
+ * --changed-paths` writes for testrepo.git.
+ */
+static const struct {
+	const char *id;
+	const char *filter;
+} testrepo_bloom_filters[] = {
+	{ "258f0e2a959a364e40ed6603d5d44fbb24765b10", "c39c1c" },
+	{ "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9", "2aaa" },
+	{ "4a202b346bb0fb0db7eff3cffeb3c70babbd2045", "007f" },
+	{ "5001298e0c09ad9c34e4249bc5801c75e9754fa5", "5515" },
+	{ "5b5b025afb0b4c913b4c338a42934a3863bf3644", "c718" },
+	{ "6dcf9bf7541ee10456529833502442f385010c3d", "4936" },
+	{ "763d71aadf09a7951596c9746c024e7eece7c7af", "15611ba28eb33a08fee6" },
+	{ "8496071c1b46c854b31185ea97743be6a8774479", "007f" },
+	{ "9fd738e8f7967c078dceed8190330fc8648ee56a", "c718" },
+	{ "a4a7dce85cf63874e984719f4fdd239f5145052f", "67cd12" },
+	{ "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", "18c7" },
+	{ "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", "18c7" },
+	{ "c47800c7266a2be04c571c04d5a6614691ea99bd", "18c7" },
+	{ "d07b0f9a8c89f1d9e74dc4fce6421dec5ef8a659", "433e6857" },
+	{ "e90810b8df3e80c413d903f631643c716887138d", "4936" }
+};
+
+static int bloom_filter_hex(git_str *hex, git_commit_graph_file *file, const char *commit_id)
+{
+	git_commit_graph_entry e;
+	const unsigned char *filter;
+	size_t filter_len;
+	git_oid id;
+	int error;
+
+	cl_git_pass(git_oid__fromstr(&id, commit_id, GIT_OID_SHA1));
+	cl_git_pass(git_commit_graph_entry_find(&e, file, &id, GIT_OID_SHA1_HEXSIZE));
+
+	if ((error = git_commit_graph_entry_bloom_filter(&filter, &filter_len, file, &e)) < 0)
+		return error;
+
+	git_str_clear(hex);
+	cl_git_pass(git_str_encode_hexstr(hex, (const char *)filter, filter_len));
+	return 0;
+}
+
+static void assert_testrepo_bloom_filters(git_commit_graph_file *file)
+{
+	git_str hex = GIT_STR_INIT;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(testrepo_bloom_filters); i++) {
+		cl_git_pass(bloom_filter_hex(&hex, file, testrepo_bloom_filters[i].id));
+		cl_assert_equal_s(testrepo_bloom_filters[i].filter, git_str_cstr(&hex));
+	}
+
+	git_str_dispose(&hex);
+}
+
+static int maybe_changed_path(git_commit_graph_file *file, const char *commit_id, const char *path)
+{
+	git_commit_graph_entry e;
+	git_oid id;
+
+	cl_git_pass(git_oid__fromstr(&id, commit_id, GIT_OID_SHA1));
+	cl_git_pass(git_commit_graph_entry_find(&e, file, &id, GIT_OID_SHA1_HEXSIZE));
+
+	return git_commit_graph_entry_maybe_changed_path(file, &e, path, strlen(path));
+}
+
+void test_graph_commitgraph__changed_paths(void)
+{
+	git_repository *repo;
+	struct git_commit_graph *cgraph;
+	struct git_commit_graph_file *file;
+	git_oid id;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+
+	/* The fixture's commit-graph has no filters */
+	cl_git_pass(git_commit_graph_file_open(&file,
+		"testrepo.git/objects/info/commit-graph", GIT_OID_SHA1));
+	cl_assert_equal_i(GIT_ENOTFOUND, maybe_changed_path(file,
+		"763d71aadf09a7951596c9746c024e7eece7c7af", "README"));
+	git_commit_graph_file_free(file);
+
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SINGLE_FILE, 0, 1);
+
+	cl_git_pass(git_commit_graph_file_open(&file,
+		"testrepo.git/objects/info/commit-graph", GIT_OID_SHA1));
+	assert_testrepo_bloom_filters(file);
+
+	/* The changed paths are in the filter, and so are their directories */
+	cl_assert_equal_i(1, maybe_changed_path(file, "763d71aadf09a7951596c9746c024e7eece7c7af", "ab/de/fgh/1.txt"));
+	cl_assert_equal_i(1, maybe_changed_path(file, "763d71aadf09a7951596c9746c024e7eece7c7af", "ab/de"));
+	cl_assert_equal_i(1, maybe_changed_path(file, "763d71aadf09a7951596c9746c024e7eece7c7af", "ab/"));
+	cl_assert_equal_i(0, maybe_changed_path(file, "763d71aadf09a7951596c9746c024e7eece7c7af", "README"));
+	cl_assert_equal_i(0, maybe_changed_path(file, "763d71aadf09a7951596c9746c024e7eece7c7af", "ab/de/fgh/2.txt"));
+
+	/* A merge is compared to its first parent */
+	cl_assert_equal_i(1, maybe_changed_path(file, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", "branch_file.txt"));
+	cl_assert_equal_i(0, maybe_changed_path(file, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", "README"));
+
+	/* A root commit is compared to the empty tree */
+	cl_assert_equal_i(1, maybe_changed_path(file, "8496071c1b46c854b31185ea97743be6a8774479", "README"));
+	cl_assert_equal_i(0, maybe_changed_path(file, "8496071c1b46c854b31185ea97743be6a8774479", "new.txt"));
+
+	git_commit_graph_file_free(file);
+
+	/* The same, through the commit-graph of the object database */
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_commit_graph_open(&cgraph, "testrepo.git/objects", GIT_OID_SHA1));
+#else
+	cl_git_pass(git_commit_graph_open(&cgraph, "testrepo.git/objects"));
+#endif
+	cl_git_pass(git_oid__fromstr(&id, "9fd738e8f7967c078dceed8190330fc8648ee56a", GIT_OID_SHA1));
+	cl_assert_equal_i(1, git_commit_graph_maybe_changed_path(cgraph, &id, "new.txt"));
+	cl_assert_equal_i(0, git_commit_graph_maybe_changed_path(cgraph, &id, "branch_file.txt"));
+	git_commit_graph_free(cgraph);
+
+	cl_git_sandbox_cleanup();
+}
+
+void test_graph_commitgraph__changed_paths_split(void)
+{
+	git_repository *repo;
+	struct git_commit_graph_file *file;
+	git_str path = GIT_STR_INIT, hex = GIT_STR_INIT;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_must_pass(p_unlink("testrepo.git/objects/info/commit-graph"));
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/info/" GIT_COMMIT_GRAPH_CHAIN_FILE));
+
+	/* Only the bottom of the chain has filters */
+	write_graph(repo, "refs/heads/br2", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT, 0, 1);
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_NO_MERGE, 0, 0);
+	cl_assert_equal_sz(2, chain_length(repo));
+
+	cl_git_pass(git_commit_graph_chain_open(&file, git_str_cstr(&path), GIT_OID_SHA1));
+	cl_git_pass(bloom_filter_hex(&hex, file, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_assert_equal_s("67cd12", git_str_cstr(&hex));
+	cl_assert_equal_i(GIT_ENOTFOUND, bloom_filter_hex(&hex, file, "763d71aadf09a7951596c9746c024e7eece7c7af"));
+	git_commit_graph_file_free(file);
+
+	/* Merging the chain keeps the filters that it has, and adds the others */
+	write_graph(repo, "refs/*", GIT_COMMIT_GRAPH_SPLIT_STRATEGY_SPLIT_REPLACE, 0, 1);
+	cl_assert_equal_sz(1, chain_length(repo));
+
+	cl_git_pass(git_commit_graph_chain_open(&file, git_str_cstr(&path), GIT_OID_SHA1));
+	assert_testrepo_bloom_filters(file);
+	git_commit_graph_file_free(file);
+
+	git_str_dispose(&hex);
+	git_str_dispose(&path);
+	cl_git_sandbox_cleanup();
+}
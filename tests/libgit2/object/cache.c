@@ -41,6 +41,7 @@ void test_object_cache__cleanup(void)
 	git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, (int)GIT_OBJECT_BLOB, (size_t)0);
 	git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, (int)GIT_OBJECT_TREE, (size_t)4096);
 	git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, (int)GIT_OBJECT_COMMIT, (size_t)4096);
+	git_libgit2_opts(GIT_OPT_ENABLE_CACHING, 1);
 }
 
 static struct {
@@ -274,3 +275,77 @@ void test_object_cache__fast_thread_rush(void)
 		g_repo = NULL;
 	}
 }
+
+void test_object_cache__stats(void)
+{
+	git_oid oid;
+	git_object *obj;
+	size_t hits, misses, new_hits, new_misses;
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("testrepo.git")));
+	cl_git_pass(git_oid__fromstr(&oid, g_data[4].sha, GIT_OID_SHA1));
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_CACHE_STATS, &hits, &misses, NULL));
+
+	cl_git_pass(git_object_lookup(&obj, g_repo, &oid, GIT_OBJECT_ANY));
+	git_object_free(obj);
+	cl_git_pass(git_object_lookup(&obj, g_repo, &oid, GIT_OBJECT_ANY));
+	git_object_free(obj);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_CACHE_STATS, &new_hits, &new_misses, NULL));
+	cl_assert(new_misses > misses);
+	cl_assert(new_hits > hits);
+}
+
+void test_object_cache__eviction(void)
+{
+	git_revwalk *walk;
+	git_commit *commit;
+	git_oid oid;
+	ssize_t current, max_storage;
+	size_t evictions, new_evictions, count = 0;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &current, &max_storage));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_CACHE_STATS, NULL, NULL, &evictions));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)1));
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("testrepo.git")));
+	cl_git_pass(git_revwalk_new(&walk, g_repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "refs/heads/*"));
+
+	while (git_revwalk_next(&oid, walk) == 0) {
+		cl_git_pass(git_commit_lookup(&commit, g_repo, &oid));
+		git_commit_free(commit);
+		count++;
+	}
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_CACHE_STATS, NULL, NULL, &new_evictions));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, max_storage));
+
+	cl_assert(count > 0);
+	cl_assert(new_evictions > evictions);
+	cl_assert(git_cache_size(&g_repo->objects) < count);
+
+	git_revwalk_free(walk);
+}
+
+void test_object_cache__disabling_clears_every_shard(void)
+{
+	git_oid oid;
+	git_object *obj;
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("testrepo.git")));
+
+	cl_git_pass(git_oid__fromstr(&oid, g_data[4].sha, GIT_OID_SHA1));
+	cl_git_pass(git_object_lookup(&obj, g_repo, &oid, GIT_OBJECT_ANY));
+	git_object_free(obj);
+	cl_assert(git_cache_size(&g_repo->objects) > 0);
+
+	/* Storing in another (empty) shard still clears the whole cache */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_CACHING, 0));
+
+	cl_git_pass(git_oid__fromstr(&oid, g_data[6].sha, GIT_OID_SHA1));
+	cl_git_pass(git_object_lookup(&obj, g_repo, &oid, GIT_OBJECT_ANY));
+	git_object_free(obj);
+	cl_assert_equal_sz(0, git_cache_size(&g_repo->objects));
+}
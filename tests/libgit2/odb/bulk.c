@@ -0,0 +1,265 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "futils.h"
+
+static git_repository *repo;
+static git_odb *odb;
+
+#define BLOB_COUNT 50
+
+void test_odb_bulk__initialize(void)
+{
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_repository_odb(&odb, repo));
+}
+
+void test_odb_bulk__cleanup(void)
+{
+	git_odb_free(odb);
+	cl_git_sandbox_cleanup();
+}
+
+static void write_blobs(git_odb *db, git_oid *ids)
+{
+	git_str content = GIT_STR_INIT;
+	size_t i;
+
+	for (i = 0; i < BLOB_COUNT; i++) {
+		git_str_clear(&content);
+		cl_git_pass(git_str_printf(&content, "bulk blob %d\n", (int)i));
+
+		cl_git_pass(git_odb_write(&ids[i], db, content.ptr, content.size, GIT_OBJECT_BLOB));
+	}
+
+	git_str_dispose(&content);
+}
+
+static void assert_blobs(git_odb *db, git_oid *ids)
+{
+	git_odb_object *obj;
+	char expected[32];
+	size_t i;
+
+	for (i = 0; i < BLOB_COUNT; i++) {
+		p_snprintf(expected, sizeof(expected), "bulk blob %d\n", (int)i);
+
+		cl_git_pass(git_odb_read(&obj, db, &ids[i]));
+		cl_assert_equal_i(GIT_OBJECT_BLOB, git_odb_object_type(obj));
+		cl_assert_equal_sz(strlen(expected), git_odb_object_size(obj));
+		cl_assert(memcmp(expected, git_odb_object_data(obj), strlen(expected)) == 0);
+		git_odb_object_free(obj);
+	}
+}
+
+static bool is_loose(const git_oid *id)
+{
+	git_str path = GIT_STR_INIT;
+	char hex[GIT_OID_SHA1_HEXSIZE + 1];
+	bool exists;
+
+	git_oid_tostr(hex, sizeof(hex), id);
+	cl_git_pass(git_str_printf(&path, "testrepo.git/objects/%.2s/%s", hex, hex + 2));
+	exists = git_fs_path_exists(path.ptr);
+	git_str_dispose(&path);
+
+	return exists;
+}
+
+static int count_files(void *payload, git_str *path)
+{
+	size_t *count = payload;
+
+	GIT_UNUSED(path);
+
+	(*count)++;
+	return 0;
+}
+
+static size_t pack_dir_entries(void)
+{
+	git_str path = GIT_STR_INIT;
+	size_t count = 0;
+
+	cl_git_pass(git_str_sets(&path, "testrepo.git/objects/pack"));
+	cl_git_pass(git_fs_path_direach(&path, 0, count_files, &count));
+	git_str_dispose(&path);
+
+	return count;
+}
+
+void test_odb_bulk__read_before_and_after_commit(void)
+{
+	git_odb_bulk *bulk;
+	git_odb *other;
+	git_oid ids[BLOB_COUNT];
+	size_t i, before = pack_dir_entries();
+
+	cl_git_pass(git_odb_bulk_new(&bulk, odb));
+	write_blobs(odb, ids);
+
+	/* Nothing was written as a loose object */
+	for (i = 0; i < BLOB_COUNT; i++)
+		cl_assert(!is_loose(&ids[i]));
+
+	/* The objects are readable while the transaction is open */
+	assert_blobs(odb, ids);
+
+	cl_git_pass(git_odb_bulk_commit(bulk));
+	git_odb_bulk_free(bulk);
+
+	/* There's a new packfile and its index (and nothing else) */
+	cl_assert_equal_sz(before + 2, pack_dir_entries());
+
+	assert_blobs(odb, ids);
+
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	assert_blobs(other, ids);
+	git_odb_free(other);
+}
+
+void test_odb_bulk__free_discards(void)
+{
+	git_odb_bulk *bulk;
+	git_odb *other;
+	git_oid ids[BLOB_COUNT];
+	size_t i, before = pack_dir_entries();
+
+	cl_git_pass(git_odb_bulk_new(&bulk, odb));
+	write_blobs(odb, ids);
+	cl_assert_equal_sz(before + 1, pack_dir_entries());
+	git_odb_bulk_free(bulk);
+
+	cl_assert_equal_sz(before, pack_dir_entries());
+
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	for (i = 0; i < BLOB_COUNT; i++)
+		cl_assert(!git_odb_exists(other, &ids[i]));
+	git_odb_free(other);
+}
+
+void test_odb_bulk__one_at_a_time(void)
+{
+	git_odb_bulk *bulk, *second;
+
+	cl_git_pass(git_odb_bulk_new(&bulk, odb));
+	cl_git_fail_with(GIT_ELOCKED, git_odb_bulk_new(&second, odb));
+	git_odb_bulk_free(bulk);
+
+	cl_git_pass(git_odb_bulk_new(&bulk, odb));
+	git_odb_bulk_free(bulk);
+}
+
+void test_odb_bulk__writes_go_to_loose_after_commit(void)
+{
+	git_odb_bulk *bulk;
+	git_oid id;
+	size_t before = pack_dir_entries();
+
+	cl_git_pass(git_odb_bulk_new(&bulk, odb));
+	cl_git_pass(git_odb_bulk_commit(bulk));
+
+	/* An empty transaction leaves nothing behind */
+	cl_assert_equal_sz(before, pack_dir_entries());
+
+	cl_git_pass(git_odb_write(&id, odb, "loose\n", 6, GIT_OBJECT_BLOB));
+	cl_assert(is_loose(&id));
+
+	git_odb_bulk_free(bulk);
+	cl_assert_equal_sz(before, pack_dir_entries());
+}
+
+static int collect_indexes(void *payload, git_str *path)
+{
+	git_vector *indexes = payload;
+	char *name;
+
+	if (git__suffixcmp(path->ptr, ".idx") != 0)
+		return 0;
+
+	name = git__strdup(path->ptr);
+	GIT_ERROR_CHECK_ALLOC(name);
+
+	return git_vector_insert(indexes, name);
+}
+
+static void list_indexes(git_vector *indexes)
+{
+	git_str path = GIT_STR_INIT;
+
+	cl_git_pass(git_vector_init(indexes, 8, git__strcmp_cb));
+	cl_git_pass(git_str_sets(&path, "testrepo.git/objects/pack"));
+	cl_git_pass(git_fs_path_direach(&path, 0, collect_indexes, indexes));
+	git_vector_sort(indexes);
+	git_str_dispose(&path);
+}
+
+static void free_indexes(git_vector *indexes)
+{
+	char *name;
+	size_t i;
+
+	git_vector_foreach(indexes, i, name)
+		git__free(name);
+	git_vector_free(indexes);
+}
+
+void test_odb_bulk__index_failure_leaves_transaction_open(void)
+{
+	git_odb_bulk *bulk;
+	git_odb *other;
+	git_vector before, after;
+	git_str pack = GIT_STR_INIT;
+	git_oid ids[BLOB_COUNT];
+	const char *index = NULL, *name;
+	size_t i, count;
+
+	/* Find out what the packfile will be called */
+	list_indexes(&before);
+
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	cl_git_pass(git_odb_bulk_new(&bulk, other));
+	write_blobs(other, ids);
+	cl_git_pass(git_odb_bulk_commit(bulk));
+	git_odb_bulk_free(bulk);
+	git_odb_free(other);
+
+	list_indexes(&after);
+	git_vector_foreach(&after, i, name) {
+		if (git_vector_search(NULL, &before, name) == GIT_ENOTFOUND)
+			index = name;
+	}
+	cl_assert(index != NULL);
+
+	cl_git_pass(git_str_set(&pack, index, strlen(index) - strlen(".idx")));
+	cl_git_pass(git_str_puts(&pack, ".pack"));
+	cl_git_pass(p_unlink(index));
+	cl_git_pass(p_unlink(pack.ptr));
+
+	/* Then write the same pack again, with its index in the way */
+	cl_git_pass(p_mkdir(index, 0777));
+	count = pack_dir_entries();
+
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	cl_git_pass(git_odb_bulk_new(&bulk, other));
+	write_blobs(other, ids);
+	cl_git_fail(git_odb_bulk_commit(bulk));
+
+	/* The packfile went back to being the transaction's temporary file */
+	cl_assert(!git_fs_path_exists(pack.ptr));
+	cl_assert_equal_sz(count + 1, pack_dir_entries());
+	assert_blobs(other, ids);
+
+	/* Once the way is clear, the commit can be retried */
+	cl_git_pass(p_rmdir(index));
+	cl_git_pass(git_odb_bulk_commit(bulk));
+	git_odb_bulk_free(bulk);
+
+	cl_assert(git_fs_path_exists(pack.ptr));
+	cl_assert(git_fs_path_exists(index));
+	assert_blobs(other, ids);
+	git_odb_free(other);
+
+	git_str_dispose(&pack);
+	free_indexes(&after);
+	free_indexes(&before);
+}
@@ -130,6 +130,7 @@ void test_odb_loose__initialize(void)
 void test_odb_loose__cleanup(void)
 {
 	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 0));
 	cl_fixture_cleanup("test-objects");
 }
 
@@ -391,3 +392,72 @@ void test_odb_loose__fsync_obeys_repo_setting(void)
 	cl_assert(p_fsync__cnt > 0);
 	git_repository_free(repo);
 }
+
+void test_odb_loose__cache_exists(void)
+{
+	git_oid id, id2;
+	git_odb *odb;
+	git_odb_object *obj;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 1));
+
+	write_object_files(&one);
+	cl_git_pass(git_odb__open(&odb, "test-objects", NULL));
+
+	cl_git_pass(git_oid__fromstr(&id, one.id, GIT_OID_SHA1));
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_git_pass(git_oid__fromstrp(&id, "8b137891", GIT_OID_SHA1));
+	cl_git_pass(git_odb_exists_prefix(&id2, odb, &id, 8));
+	cl_assert_equal_i(0, git_oid_streq(&id2, one.id));
+
+	cl_git_pass(git_oid__fromstr(&id, "8b137891791fe96927ad78e64b0aad7bded08baa", GIT_OID_SHA1));
+	cl_assert(!git_odb_exists(odb, &id));
+
+	cl_git_pass(git_oid__fromstrp(&id, "8b13789a", GIT_OID_SHA1));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_odb_exists_prefix(&id2, odb, &id, 8));
+
+	/* Objects written through the odb are added to the listing */
+	cl_git_pass(git_odb_write(&id, odb, "Test data\n", 10, GIT_OBJECT_BLOB));
+	cl_assert(git_odb_exists_ext(odb, &id, GIT_ODB_LOOKUP_NO_REFRESH));
+
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert_equal_sz(10, git_odb_object_size(obj));
+	git_odb_object_free(obj);
+
+	git_odb_free(odb);
+}
+
+void test_odb_loose__cache_refresh(void)
+{
+	git_oid id, id2;
+	git_odb *odb;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 1));
+
+	write_object_files(&one);
+	cl_git_pass(git_odb__open(&odb, "test-objects", NULL));
+
+	cl_git_pass(git_oid__fromstr(&id, one.id, GIT_OID_SHA1));
+	cl_assert(git_odb_exists_ext(odb, &id, GIT_ODB_LOOKUP_NO_REFRESH));
+
+	/* Objects written behind our back are only seen after a refresh */
+	cl_git_pass(git_oid__fromstr(&id, two.id, GIT_OID_SHA1));
+	cl_assert(!git_odb_exists_ext(odb, &id, GIT_ODB_LOOKUP_NO_REFRESH));
+
+	write_object_files(&two);
+	cl_assert(!git_odb_exists_ext(odb, &id, GIT_ODB_LOOKUP_NO_REFRESH));
+
+	cl_git_pass(git_odb_refresh(odb));
+	cl_assert(git_odb_exists_ext(odb, &id, GIT_ODB_LOOKUP_NO_REFRESH));
+
+	/* Two objects that share a prefix are ambiguous */
+	cl_git_pass(git_futils_cp(one.file,
+		"test-objects/8b/137891791fe96927ad78e64b0aad7bded08baa", 0666));
+	cl_git_pass(git_odb_refresh(odb));
+
+	cl_git_pass(git_oid__fromstrp(&id, "8b137891", GIT_OID_SHA1));
+	cl_assert_equal_i(GIT_EAMBIGUOUS, git_odb_exists_prefix(&id2, odb, &id, 8));
+
+	git_odb_free(odb);
+}
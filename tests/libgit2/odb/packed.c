@@ -77,3 +77,181 @@ void test_odb_packed__read_header_1(void)
 	}
 }
 
+
+struct read_many_data {
+	git_oid *ids;
+	size_t count;
+	size_t *seen;
+	size_t stop_after;
+};
+
+static int read_many_cb(git_odb_object *obj, void *payload)
+{
+	struct read_many_data *data = payload;
+	git_oid hashed;
+	size_t i;
+
+	cl_git_pass(git_odb__hash(&hashed, git_odb_object_data(obj),
+		git_odb_object_size(obj), git_odb_object_type(obj), GIT_OID_SHA1));
+	cl_assert_equal_oid(git_odb_object_id(obj), &hashed);
+
+	for (i = 0; i < data->count; i++) {
+		if (git_oid_equal(&data->ids[i], &hashed)) {
+			data->seen[i]++;
+			break;
+		}
+	}
+
+	cl_assert(i < data->count);
+
+	if (data->stop_after && --data->stop_after == 0)
+		return 42;
+
+	return 0;
+}
+
+static void read_many_setup(struct read_many_data *data)
+{
+	size_t i;
+
+	data->count = ARRAY_SIZE(packed_objects) + ARRAY_SIZE(loose_objects);
+	data->ids = git__calloc(data->count, sizeof(git_oid));
+	data->seen = git__calloc(data->count, sizeof(size_t));
+	data->stop_after = 0;
+	cl_assert(data->ids && data->seen);
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); i++)
+		cl_git_pass(git_oid__fromstr(&data->ids[i], packed_objects[i], GIT_OID_SHA1));
+	for (i = 0; i < ARRAY_SIZE(loose_objects); i++)
+		cl_git_pass(git_oid__fromstr(&data->ids[ARRAY_SIZE(packed_objects) + i], loose_objects[i], GIT_OID_SHA1));
+}
+
+static void read_many_teardown(struct read_many_data *data)
+{
+	git__free(data->ids);
+	git__free(data->seen);
+}
+
+void test_odb_packed__read_many(void)
+{
+	struct read_many_data data;
+	git_odb_object *obj;
+	size_t i;
+
+	read_many_setup(&data);
+
+	/* Have some of the objects already in the cache */
+	cl_git_pass(git_odb_read(&obj, _odb, &data.ids[3]));
+	git_odb_object_free(obj);
+
+	cl_git_pass(git_odb_read_many(_odb, data.ids, data.count, read_many_cb, &data));
+
+	for (i = 0; i < data.count; i++)
+		cl_assert_equal_sz(1, data.seen[i]);
+
+	read_many_teardown(&data);
+}
+
+void test_odb_packed__read_many_missing(void)
+{
+	struct read_many_data data;
+	size_t i;
+
+	read_many_setup(&data);
+	cl_git_pass(git_oid__fromstr(&data.ids[5], "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef", GIT_OID_SHA1));
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_odb_read_many(_odb, data.ids, data.count, read_many_cb, &data));
+
+	/* Everything else is still delivered */
+	for (i = 0; i < data.count; i++)
+		cl_assert_equal_sz(i == 5 ? 0 : 1, data.seen[i]);
+
+	read_many_teardown(&data);
+}
+
+void test_odb_packed__read_many_stop(void)
+{
+	struct read_many_data data;
+	size_t i, total = 0;
+
+	read_many_setup(&data);
+	data.stop_after = 10;
+
+	cl_git_fail_with(42,
+		git_odb_read_many(_odb, data.ids, data.count, read_many_cb, &data));
+
+	for (i = 0; i < data.count; i++)
+		total += data.seen[i];
+	cl_assert_equal_sz(10, total);
+
+	read_many_teardown(&data);
+}
+
+static void readstream_all(size_t blocksize)
+{
+	git_odb *odb;
+	git_odb_backend *backend;
+	unsigned int i;
+
+	/* Only use the packfile backend, so that nothing is read loose */
+	cl_git_pass(git_odb_new(&odb));
+	cl_git_pass(git_odb_backend_pack(&backend, cl_fixture("testrepo.git/objects")));
+	cl_git_pass(git_odb_add_backend(odb, backend, 1));
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_odb_stream *stream;
+		git_odb_object *obj;
+		git_object_t type;
+		git_hash_ctx hash;
+		git_oid id, hashed;
+		char hdr[64], *buf;
+		size_t len, hdr_len, total = 0;
+		int ret;
+
+		cl_git_pass(git_oid__fromstr(&id, packed_objects[i], GIT_OID_SHA1));
+		cl_git_pass(git_odb_open_rstream(&stream, &len, &type, odb, &id));
+
+		cl_git_pass(git_odb_read(&obj, odb, &id));
+		cl_assert_equal_sz(git_odb_object_size(obj), len);
+		cl_assert_equal_i(git_odb_object_type(obj), type);
+
+		cl_git_pass(git_hash_ctx_init(&hash, GIT_HASH_ALGORITHM_SHA1));
+		cl_git_pass(git_odb__format_object_header(&hdr_len, hdr, sizeof(hdr), len, type));
+		cl_git_pass(git_hash_update(&hash, hdr, hdr_len));
+
+		buf = git__malloc(blocksize);
+		cl_assert(buf);
+
+		while ((ret = git_odb_stream_read(stream, buf, blocksize)) > 0) {
+			cl_assert(total + ret <= len);
+			cl_assert(memcmp(buf, (const char *)git_odb_object_data(obj) + total, ret) == 0);
+
+			cl_git_pass(git_hash_update(&hash, buf, ret));
+			total += ret;
+		}
+
+		cl_git_pass(ret);
+		cl_assert_equal_sz(len, total);
+
+		cl_git_pass(git_hash_final(hashed.id, &hash));
+		cl_assert_equal_oid(&id, &hashed);
+
+		git__free(buf);
+		git_hash_ctx_cleanup(&hash);
+		git_odb_object_free(obj);
+		git_odb_stream_free(stream);
+	}
+
+	git_odb_free(odb);
+}
+
+void test_odb_packed__readstream(void)
+{
+	readstream_all(4096);
+}
+
+void test_odb_packed__readstream_small_reads(void)
+{
+	readstream_all(7);
+}
@@ -0,0 +1,158 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+
+static git_repository *repo;
+static git_odb *odb;
+
+#define MISSING_ONE "1111111111111111111111111111111111111111"
+#define MISSING_TWO "2222222222222222222222222222222222222222"
+
+void test_odb_refresh__initialize(void)
+{
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_repository_odb(&odb, repo));
+}
+
+void test_odb_refresh__cleanup(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_ODB_REFRESH_INTERVAL, 0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 0));
+
+	git_odb_free(odb);
+	cl_git_sandbox_cleanup();
+}
+
+static void get_stats(size_t *refreshes, size_t *hits, size_t *rate_limited)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_ODB_REFRESH_STATS,
+		refreshes, hits, rate_limited));
+}
+
+void test_odb_refresh__missing_object_refreshes_once(void)
+{
+	size_t refreshes, hits, new_refreshes, new_hits;
+	git_odb_object *obj;
+	git_oid id;
+
+	cl_git_pass(git_oid__fromstr(&id, MISSING_ONE, GIT_OID_SHA1));
+	get_stats(&refreshes, &hits, NULL);
+
+	cl_assert(!git_odb_exists(odb, &id));
+	get_stats(&new_refreshes, &new_hits, NULL);
+	cl_assert_equal_sz(refreshes + 1, new_refreshes);
+	cl_assert_equal_sz(hits, new_hits);
+
+	/* Now it is known to be missing, whichever way we look */
+	cl_assert(!git_odb_exists(odb, &id));
+	cl_git_fail_with(GIT_ENOTFOUND, git_odb_read(&obj, odb, &id));
+	get_stats(&new_refreshes, &new_hits, NULL);
+	cl_assert_equal_sz(refreshes + 1, new_refreshes);
+	cl_assert_equal_sz(hits + 2, new_hits);
+
+	/* An explicit refresh forgets it */
+	cl_git_pass(git_odb_refresh(odb));
+	cl_assert(!git_odb_exists(odb, &id));
+	get_stats(&new_refreshes, &new_hits, NULL);
+	cl_assert_equal_sz(refreshes + 3, new_refreshes);
+	cl_assert_equal_sz(hits + 2, new_hits);
+}
+
+void test_odb_refresh__new_pack_is_found(void)
+{
+	git_odb *other;
+	git_odb_bulk *bulk;
+	git_oid id;
+
+	/* Find out the id of the blob, and that it is missing */
+	cl_git_pass(git_odb_hash(&id, "not yet\n", 8, GIT_OBJECT_BLOB));
+	cl_assert(!git_odb_exists(odb, &id));
+	cl_assert(!git_odb_exists(odb, &id));
+
+	/* Another writer adds it in a new packfile */
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	cl_git_pass(git_odb_bulk_new(&bulk, other));
+	cl_git_pass(git_odb_write(&id, other, "not yet\n", 8, GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_bulk_commit(bulk));
+	git_odb_bulk_free(bulk);
+	git_odb_free(other);
+
+	cl_assert(git_odb_exists(odb, &id));
+}
+
+void test_odb_refresh__new_pack_in_alternate_is_found(void)
+{
+	git_odb *db, *other;
+	git_odb_bulk *bulk;
+	git_str alternate = GIT_STR_INIT;
+	git_oid id;
+
+	cl_git_pass(git_futils_mkdir("alternate/objects/pack", 0777, GIT_MKDIR_PATH));
+	cl_git_pass(git_fs_path_prettify_dir(&alternate, "alternate/objects", NULL));
+	cl_git_pass(git_str_putc(&alternate, '\n'));
+	cl_git_rewritefile("testrepo.git/objects/info/alternates", alternate.ptr);
+
+	cl_git_pass(git_odb__open(&db, "testrepo.git/objects", NULL));
+
+	cl_git_pass(git_odb_hash(&id, "not yet\n", 8, GIT_OBJECT_BLOB));
+	cl_assert(!git_odb_exists(db, &id));
+	cl_assert(!git_odb_exists(db, &id));
+
+	/* Another writer adds it in a new packfile of the alternate */
+	cl_git_pass(git_odb__open(&other, "alternate/objects", NULL));
+	cl_git_pass(git_odb_bulk_new(&bulk, other));
+	cl_git_pass(git_odb_write(&id, other, "not yet\n", 8, GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_bulk_commit(bulk));
+	git_odb_bulk_free(bulk);
+	git_odb_free(other);
+
+	cl_assert(git_odb_exists(db, &id));
+
+	git_odb_free(db);
+	git_str_dispose(&alternate);
+	cl_git_pass(git_futils_rmdir_r("alternate", NULL, GIT_RMDIR_REMOVE_FILES));
+}
+
+void test_odb_refresh__new_loose_object_is_found(void)
+{
+	git_odb *db, *other;
+	git_oid id;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 1));
+	cl_git_pass(git_odb__open(&db, "testrepo.git/objects", NULL));
+
+	cl_git_pass(git_odb_hash(&id, "not yet\n", 8, GIT_OBJECT_BLOB));
+	cl_assert(!git_odb_exists(db, &id));
+	cl_assert(!git_odb_exists(db, &id));
+
+	/* Another writer adds it as a loose object; no pack changes */
+	cl_git_pass(git_odb__open(&other, "testrepo.git/objects", NULL));
+	cl_git_pass(git_odb_write(&id, other, "not yet\n", 8, GIT_OBJECT_BLOB));
+	git_odb_free(other);
+
+	cl_assert(git_odb_exists(db, &id));
+
+	git_odb_free(db);
+}
+
+void test_odb_refresh__rate_limit(void)
+{
+	size_t refreshes, limited, new_refreshes, new_limited;
+	git_oid one, two;
+
+	cl_git_pass(git_oid__fromstr(&one, MISSING_ONE, GIT_OID_SHA1));
+	cl_git_pass(git_oid__fromstr(&two, MISSING_TWO, GIT_OID_SHA1));
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_ODB_REFRESH_INTERVAL, 60 * 1000));
+	get_stats(&refreshes, NULL, &limited);
+
+	cl_assert(!git_odb_exists(odb, &one));
+	cl_assert(!git_odb_exists(odb, &two));
+
+	get_stats(&new_refreshes, NULL, &new_limited);
+	cl_assert_equal_sz(refreshes + 1, new_refreshes);
+	cl_assert_equal_sz(limited + 1, new_limited);
+
+	/* Objects that exist are still found */
+	cl_git_pass(git_oid__fromstr(&one, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1));
+	cl_assert(git_odb_exists(odb, &one));
+}
@@ -0,0 +1,273 @@
+#include "clar_libgit2.h"
+
+#include "ewah.h"
+#include "pack_bitmap.h"
+#include "pack-objects.h"
+
+static git_repository *_repo;
+
+void test_pack_bitmap__initialize(void)
+{
+	cl_git_pass(git_repository_open(&_repo, cl_fixture("testrepo-bitmap.git")));
+}
+
+void test_pack_bitmap__cleanup(void)
+{
+	git_repository_free(_repo);
+	_repo = NULL;
+}
+
+void test_pack_bitmap__open(void)
+{
+	git_pack_bitmap *bitmap;
+
+	cl_git_pass(git_pack_bitmap_find(&bitmap, _repo));
+	cl_assert_equal_sz(50, git_pack_bitmap_objects(bitmap));
+	cl_assert(bitmap->hashes != NULL);
+	cl_assert(bitmap->entries_count > 0);
+
+	git_pack_bitmap_free(bitmap);
+}
+
+void test_pack_bitmap__not_found(void)
+{
+	git_repository *repo;
+	git_pack_bitmap *bitmap;
+
+	cl_git_pass(git_repository_open(&repo, cl_fixture("testrepo.git")));
+	cl_git_fail_with(GIT_ENOTFOUND, git_pack_bitmap_find(&bitmap, repo));
+	git_repository_free(repo);
+}
+
+void test_pack_bitmap__find_ignores_other_bitmaps(void)
+{
+	git_pack_bitmap *bitmap;
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	/* Neither has a pack, and both sort before the real bitmap */
+	cl_git_mkfile("testrepo-bitmap.git/objects/pack/multi-pack-index-0000000000000000000000000000000000000000.bitmap", "XXXX");
+	cl_git_mkfile("testrepo-bitmap.git/objects/pack/pack-0000000000000000000000000000000000000000.bitmap", "XXXX");
+
+	cl_git_pass(git_pack_bitmap_find(&bitmap, _repo));
+	cl_assert_equal_sz(50, git_pack_bitmap_objects(bitmap));
+	git_pack_bitmap_free(bitmap);
+
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
+
+void test_pack_bitmap__lookup(void)
+{
+	git_pack_bitmap *bitmap;
+	git_bitmap set = GIT_BITMAP_INIT;
+	git_oid id;
+	size_t i;
+
+	cl_git_pass(git_pack_bitmap_find(&bitmap, _repo));
+
+	/* Every stored bitmap includes at least its own commit */
+	for (i = 0; i < bitmap->entries_count; i++) {
+		cl_git_pass(git_pack_bitmap_lookup(&set, bitmap, &bitmap->entries[i].commit));
+		cl_assert(git_bitmap_popcount(&set) > 0);
+	}
+
+	cl_git_pass(git_oid__fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1));
+	cl_git_pass(git_pack_bitmap_lookup(&set, bitmap, &id));
+	cl_assert_equal_sz(20, git_bitmap_popcount(&set));
+
+	git_bitmap_dispose(&set);
+	git_pack_bitmap_free(bitmap);
+}
+
+void test_pack_bitmap__reachable(void)
+{
+	git_pack_bitmap *bitmap;
+	git_bitmap want = GIT_BITMAP_INIT, have = GIT_BITMAP_INIT;
+	git_oid tips[2];
+
+	cl_git_pass(git_pack_bitmap_find(&bitmap, _repo));
+
+	/* master and master~2 */
+	cl_git_pass(git_oid__fromstr(&tips[0], "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1));
+	cl_git_pass(git_oid__fromstr(&tips[1], "9fd738e8f7967c078dceed8190330fc8648ee56a", GIT_OID_SHA1));
+
+	cl_git_pass(git_pack_bitmap_reachable(&want, bitmap, _repo, &tips[0], 1, false));
+	cl_assert_equal_sz(20, git_bitmap_popcount(&want));
+
+	cl_git_pass(git_pack_bitmap_reachable(&have, bitmap, _repo, &tips[1], 1, false));
+	git_bitmap_and_not(&want, &have);
+	cl_assert_equal_sz(8, git_bitmap_popcount(&want));
+
+	git_bitmap_dispose(&want);
+	git_bitmap_dispose(&have);
+	git_pack_bitmap_free(bitmap);
+}
+
+static int count_objects(
+	const git_oid *id,
+	git_object_t type,
+	struct git_pack_file *pack,
+	off64_t offset,
+	uint32_t name_hash,
+	void *payload)
+{
+	size_t *count = payload;
+
+	GIT_UNUSED(id);
+	GIT_UNUSED(type);
+	GIT_UNUSED(pack);
+	GIT_UNUSED(offset);
+	GIT_UNUSED(name_hash);
+
+	(*count)++;
+	return 0;
+}
+
+void test_pack_bitmap__reachable_all(void)
+{
+	git_pack_bitmap *bitmap;
+	git_bitmap set = GIT_BITMAP_INIT;
+	git_strarray refs;
+	git_oid *tips;
+	size_t i, count = 0;
+
+	cl_git_pass(git_pack_bitmap_find(&bitmap, _repo));
+	cl_git_pass(git_reference_list(&refs, _repo));
+
+	tips = git__calloc(refs.count, sizeof(git_oid));
+	cl_assert(tips);
+
+	for (i = 0; i < refs.count; i++)
+		cl_git_pass(git_reference_name_to_id(&tips[i], _repo, refs.strings[i]));
+
+	cl_git_pass(git_pack_bitmap_reachable(&set, bitmap, _repo, tips, refs.count, false));
+	cl_assert_equal_sz(50, git_bitmap_popcount(&set));
+
+	cl_git_pass(git_pack_bitmap_foreach(bitmap, &set, GIT_OBJECT_ANY, count_objects, &count));
+	cl_assert_equal_sz(50, count);
+
+	count = 0;
+	cl_git_pass(git_pack_bitmap_foreach(bitmap, &set, GIT_OBJECT_COMMIT, count_objects, &count));
+	cl_assert(count > 0 && count < 50);
+
+	git__free(tips);
+	git_strarray_dispose(&refs);
+	git_bitmap_dispose(&set);
+	git_pack_bitmap_free(bitmap);
+}
+
+static void packbuilder_walk(size_t *count_out, bool use_bitmaps)
+{
+	git_config *config;
+	git_packbuilder *pb;
+	git_revwalk *walk;
+	git_oid id;
+
+	cl_git_pass(git_repository_config(&config, _repo));
+	cl_git_pass(git_config_set_bool(config, "pack.useBitmaps", use_bitmaps));
+	git_config_free(config);
+
+	cl_git_pass(git_packbuilder_new(&pb, _repo));
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+
+	cl_git_pass(git_revwalk_push_ref(walk, "refs/heads/master"));
+	cl_git_pass(git_oid__fromstr(&id, "9fd738e8f7967c078dceed8190330fc8648ee56a", GIT_OID_SHA1));
+	cl_git_pass(git_revwalk_hide(walk, &id));
+
+	cl_git_pass(git_packbuilder_insert_walk(pb, walk));
+	*count_out = git_packbuilder_object_count(pb);
+
+	git_revwalk_free(walk);
+	git_packbuilder_free(pb);
+}
+
+void test_pack_bitmap__packbuilder(void)
+{
+	size_t with_bitmaps, without_bitmaps;
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	packbuilder_walk(&with_bitmaps, true);
+	packbuilder_walk(&without_bitmaps, false);
+
+	/*
+	 * Bitmaps exclude everything that is reachable from the hidden
+	 * commit, whereas the walk only excludes the trees at the edge.
+	 */
+	cl_assert_equal_sz(8, with_bitmaps);
+	cl_assert(without_bitmaps >= with_bitmaps);
+
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
+
+void test_pack_bitmap__packbuilder_corrupt_bitmap(void)
+{
+	size_t with_bitmaps, without_bitmaps;
+	int fd;
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	cl_assert((fd = p_open("testrepo-bitmap.git/objects/pack/pack-58601678ed5ff63e5693b5b0212c742cb0502821.bitmap", O_WRONLY)) >= 0);
+	cl_must_pass(p_write(fd, "XXXX", 4));
+	cl_must_pass(p_close(fd));
+
+	/* The bitmap is only a cache; the graph is walked instead */
+	packbuilder_walk(&with_bitmaps, true);
+	packbuilder_walk(&without_bitmaps, false);
+	cl_assert_equal_sz(without_bitmaps, with_bitmaps);
+
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
+
+void test_pack_bitmap__packbuilder_write(void)
+{
+	git_packbuilder *pb;
+	git_revwalk *walk;
+	git_pack_bitmap *bitmap;
+	git_bitmap set = GIT_BITMAP_INIT;
+	git_str path = GIT_STR_INIT;
+	git_oid id;
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	cl_git_pass(git_packbuilder_new(&pb, _repo));
+	cl_git_pass(git_packbuilder_set_write_bitmap(pb, 1));
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "refs/*"));
+	cl_git_pass(git_packbuilder_insert_walk(pb, walk));
+
+	cl_git_pass(p_mkdir("bitmap-pack", 0777));
+	cl_git_pass(git_packbuilder_write(pb, "bitmap-pack", 0, NULL, NULL));
+
+	cl_git_pass(git_str_printf(&path, "bitmap-pack/pack-%s.bitmap", git_packbuilder_name(pb)));
+	cl_git_pass(git_pack_bitmap_open(&bitmap, path.ptr, GIT_OID_SHA1));
+
+	cl_assert_equal_sz(git_packbuilder_object_count(pb), git_pack_bitmap_objects(bitmap));
+	cl_assert(bitmap->entries_count > 0);
+
+	cl_git_pass(git_oid__fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1));
+	cl_git_pass(git_pack_bitmap_lookup(&set, bitmap, &id));
+	cl_assert_equal_sz(20, git_bitmap_popcount(&set));
+
+	git_bitmap_clear(&set);
+	cl_git_pass(git_oid__fromstr(&id, "9fd738e8f7967c078dceed8190330fc8648ee56a", GIT_OID_SHA1));
+	cl_git_pass(git_pack_bitmap_reachable(&set, bitmap, _repo, &id, 1, false));
+	cl_assert_equal_sz(12, git_bitmap_popcount(&set));
+
+	git_bitmap_dispose(&set);
+	git_pack_bitmap_free(bitmap);
+	git_revwalk_free(walk);
+	git_packbuilder_free(pb);
+	git_str_dispose(&path);
+
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
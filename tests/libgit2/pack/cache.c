@@ -0,0 +1,103 @@
+#include "clar_libgit2.h"
+
+#include "pack.h"
+
+static size_t _old_limit;
+static struct git_pack_file *_pack;
+static git_array_t(off64_t) _offsets;
+
+static int collect_offset(const git_oid *id, off64_t offset, void *payload)
+{
+	off64_t *o;
+
+	GIT_UNUSED(id);
+	GIT_UNUSED(payload);
+
+	o = git_array_alloc(_offsets);
+	GIT_ERROR_CHECK_ALLOC(o);
+
+	*o = offset;
+	return 0;
+}
+
+void test_pack_cache__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_SIZE, &_old_limit));
+
+	cl_git_pass(git_packfile_alloc(&_pack,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"),
+		GIT_OID_SHA1));
+	cl_git_pass(git_pack_foreach_entry_offset(_pack, collect_offset, NULL));
+	cl_assert(git_array_size(_offsets) > 0);
+}
+
+void test_pack_cache__cleanup(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_PACK_CACHE_SIZE, _old_limit));
+
+	git_packfile_free(_pack, false);
+	_pack = NULL;
+
+	git_array_clear(_offsets);
+}
+
+static void unpack_all(void)
+{
+	git_rawobj obj;
+	off64_t *o, offset;
+	size_t i, limit;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_SIZE, &limit));
+
+	git_array_foreach(_offsets, i, o) {
+		offset = *o;
+		cl_git_pass(git_packfile_unpack(&obj, _pack, &offset));
+		git__free(obj.data);
+
+		cl_assert(_pack->bases.memory_used <= limit);
+	}
+}
+
+void test_pack_cache__size(void)
+{
+	size_t limit;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_PACK_CACHE_SIZE, (size_t)1234));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_SIZE, &limit));
+	cl_assert_equal_sz(1234, limit);
+}
+
+void test_pack_cache__lru(void)
+{
+	size_t hits, misses, evictions, new_hits, new_misses, new_evictions;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_PACK_CACHE_SIZE, (size_t)(16 * 1024)));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_STATS, &hits, &misses, &evictions));
+
+	unpack_all();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_STATS, &new_hits, &new_misses, &new_evictions));
+	cl_assert(new_hits > hits);
+	cl_assert(new_misses > misses);
+	cl_assert(new_evictions > evictions);
+
+	/* What remains is still linked from most to least recently used */
+	cl_assert(_pack->bases.lru_head != NULL);
+	cl_assert(_pack->bases.lru_head->lru_prev == NULL);
+	cl_assert(_pack->bases.lru_tail->lru_next == NULL);
+}
+
+void test_pack_cache__disabled(void)
+{
+	size_t hits, new_hits;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_PACK_CACHE_SIZE, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_STATS, &hits, NULL, NULL));
+
+	unpack_all();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_PACK_CACHE_STATS, &new_hits, NULL, NULL));
+	cl_assert_equal_sz(hits, new_hits);
+	cl_assert_equal_sz(0, _pack->bases.memory_used);
+	cl_assert(_pack->bases.lru_head == NULL);
+}
@@ -3,6 +3,7 @@
 #include "futils.h"
 #include "hash.h"
 #include "iterator.h"
+#include "pack.h"
 #include "vector.h"
 #include "posix.h"
 
@@ -322,6 +323,243 @@ void test_pack_indexer__out_of_order_with_connectivity_checks(void)
 	git_indexer_free(idx);
 }
 
+static void check_pack_order(struct git_pack_file *p, bool expect_rev_file)
+{
+	off64_t offset, last_offset = 0;
+	uint32_t i, index_pos, pack_pos;
+
+	/* Loads the index (and the reverse index) */
+	cl_git_pass(git_pack_pos_to_index(&index_pos, p, 0));
+	cl_assert(p->num_objects > 0);
+
+	for (i = 0; i < p->num_objects; i++) {
+		cl_git_pass(git_pack_pos_to_index(&index_pos, p, i));
+		cl_git_pass(git_pack_nth_entry(NULL, &offset, p, index_pos));
+		cl_assert(offset > last_offset);
+
+		cl_git_pass(git_pack_offset_to_pack_pos(&pack_pos, p, offset));
+		cl_assert_equal_i(i, pack_pos);
+
+		last_offset = offset;
+	}
+
+	cl_assert_equal_b(expect_rev_file, p->rev_map.data != NULL);
+}
+
+void test_pack_indexer__reverse_index(void)
+{
+	git_indexer *idx = NULL;
+	git_indexer_progress stats = { 0 };
+	struct git_pack_file *p;
+	git_str pack = GIT_STR_INIT, name = GIT_STR_INIT;
+
+	cl_git_pass(git_futils_readbuffer(&pack,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack")));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&idx, ".", GIT_OID_SHA1, NULL));
+#else
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, NULL));
+#endif
+	cl_git_pass(git_indexer_append(idx, pack.ptr, pack.size, &stats));
+	cl_git_pass(git_indexer_commit(idx, &stats));
+	cl_git_pass(git_str_printf(&name, "pack-%s", git_indexer_name(idx)));
+	git_indexer_free(idx);
+
+	cl_git_pass(git_str_puts(&name, ".rev"));
+	cl_assert(git_fs_path_exists(name.ptr));
+	git_str_truncate(&name, name.size - strlen(".rev"));
+	cl_git_pass(git_str_puts(&name, ".idx"));
+
+	/* The reverse index is read from the .rev file */
+	cl_git_pass(git_packfile_alloc(&p, name.ptr, GIT_OID_SHA1));
+	check_pack_order(p, true);
+	git_packfile_free(p, false);
+
+	/* ... and computed in memory without it */
+	git_str_truncate(&name, name.size - strlen(".idx"));
+	cl_git_pass(git_str_puts(&name, ".rev"));
+	cl_git_pass(p_unlink(name.ptr));
+	git_str_truncate(&name, name.size - strlen(".rev"));
+	cl_git_pass(git_str_puts(&name, ".idx"));
+
+	cl_git_pass(git_packfile_alloc(&p, name.ptr, GIT_OID_SHA1));
+	check_pack_order(p, false);
+	git_packfile_free(p, false);
+
+	/* ... or with one that cannot be used */
+	git_str_truncate(&name, name.size - strlen(".idx"));
+	cl_git_pass(git_str_puts(&name, ".rev"));
+	cl_git_mkfile(name.ptr, "RIDX");
+	git_str_truncate(&name, name.size - strlen(".rev"));
+	cl_git_pass(git_str_puts(&name, ".idx"));
+
+	cl_git_pass(git_packfile_alloc(&p, name.ptr, GIT_OID_SHA1));
+	check_pack_order(p, false);
+	git_packfile_free(p, false);
+
+	git_str_dispose(&name);
+	git_str_dispose(&pack);
+}
+
+static void index_testrepo_pack(
+	git_str *idx_out,
+	git_indexer_progress *stats,
+	unsigned int threads,
+	unsigned char verify)
+{
+	git_indexer *idx = NULL;
+	git_indexer_options opts = GIT_INDEXER_OPTIONS_INIT;
+	git_str pack = GIT_STR_INIT, name = GIT_STR_INIT;
+
+	opts.threads = threads;
+	opts.verify = verify;
+
+	cl_git_pass(git_futils_readbuffer(&pack,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack")));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&idx, ".", GIT_OID_SHA1, &opts));
+#else
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, &opts));
+#endif
+	cl_git_pass(git_indexer_append(idx, pack.ptr, pack.size, stats));
+	cl_git_pass(git_indexer_commit(idx, stats));
+
+	cl_git_pass(git_str_printf(&name, "pack-%s.idx", git_indexer_name(idx)));
+	cl_git_pass(git_futils_readbuffer(idx_out, name.ptr));
+
+	git_indexer_free(idx);
+	git_str_dispose(&name);
+	git_str_dispose(&pack);
+}
+
+void test_pack_indexer__matches_git(void)
+{
+	git_indexer_progress stats = { 0 };
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+
+	/* The index must be sorted exactly like git sorts it */
+	cl_git_pass(git_futils_readbuffer(&expected,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx")));
+	index_testrepo_pack(&actual, &stats, 0, 0);
+
+	cl_assert_equal_sz(expected.size, actual.size);
+	cl_assert(memcmp(expected.ptr, actual.ptr, expected.size) == 0);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+void test_pack_indexer__threaded(void)
+{
+	git_indexer_progress stats = { 0 }, threaded_stats = { 0 };
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+
+	index_testrepo_pack(&expected, &stats, 1, 0);
+	cl_assert(stats.indexed_deltas > 0);
+
+	index_testrepo_pack(&actual, &threaded_stats, 4, 0);
+	cl_assert_equal_i(stats.indexed_objects, threaded_stats.indexed_objects);
+	cl_assert_equal_i(stats.indexed_deltas, threaded_stats.indexed_deltas);
+	cl_assert_equal_sz(expected.size, actual.size);
+	cl_assert(memcmp(expected.ptr, actual.ptr, expected.size) == 0);
+
+	/* Connectivity checks keep the resolved data around for longer */
+	memset(&threaded_stats, 0, sizeof(threaded_stats));
+	git_str_clear(&actual);
+
+	index_testrepo_pack(&actual, &threaded_stats, 3, 1);
+	cl_assert_equal_i(stats.indexed_objects, threaded_stats.indexed_objects);
+	cl_assert_equal_sz(expected.size, actual.size);
+	cl_assert(memcmp(expected.ptr, actual.ptr, expected.size) == 0);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+static int count_progress(const git_indexer_progress *stats, void *payload)
+{
+	GIT_UNUSED(stats);
+	(*(size_t *)payload)++;
+	return 0;
+}
+
+void test_pack_indexer__pipeline(void)
+{
+	git_indexer *idx = NULL;
+	git_indexer_options opts = GIT_INDEXER_OPTIONS_INIT;
+	git_indexer_progress stats = { 0 }, expected_stats = { 0 };
+	git_str pack = GIT_STR_INIT, name = GIT_STR_INIT;
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+	size_t progress_calls = 0, pos;
+
+	index_testrepo_pack(&expected, &expected_stats, 1, 0);
+
+	opts.pipeline = 1;
+	opts.progress_cb = count_progress;
+	opts.progress_cb_payload = &progress_calls;
+
+	cl_git_pass(git_futils_readbuffer(&pack,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack")));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&idx, ".", GIT_OID_SHA1, &opts));
+#else
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, &opts));
+#endif
+
+	/* The received bytes are counted by the caller, as a transport does */
+	for (pos = 0; pos < pack.size; pos += 1000) {
+		stats.received_bytes += min(1000, pack.size - pos);
+		cl_git_pass(git_indexer_append(idx, pack.ptr + pos, min(1000, pack.size - pos), &stats));
+	}
+
+	cl_git_pass(git_indexer_commit(idx, &stats));
+
+	cl_assert_equal_i(expected_stats.total_objects, stats.total_objects);
+	cl_assert_equal_i(expected_stats.received_objects, stats.received_objects);
+	cl_assert_equal_i(expected_stats.indexed_objects, stats.indexed_objects);
+	cl_assert_equal_sz(pack.size, stats.received_bytes);
+	cl_assert(progress_calls > 0);
+
+	cl_git_pass(git_str_printf(&name, "pack-%s.idx", git_indexer_name(idx)));
+	cl_git_pass(git_futils_readbuffer(&actual, name.ptr));
+	cl_assert_equal_sz(expected.size, actual.size);
+	cl_assert(memcmp(expected.ptr, actual.ptr, expected.size) == 0);
+
+	git_indexer_free(idx);
+	git_str_dispose(&name);
+	git_str_dispose(&pack);
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+void test_pack_indexer__pipeline_error(void)
+{
+	git_indexer *idx = NULL;
+	git_indexer_options opts = GIT_INDEXER_OPTIONS_INIT;
+	git_indexer_progress stats;
+	const char garbage[] = "this is not a packfile";
+
+	opts.pipeline = 1;
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&idx, ".", GIT_OID_SHA1, &opts));
+#else
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, &opts));
+#endif
+
+	/* The error is reported by a later call, at the latest on commit */
+	cl_git_pass(git_indexer_append(idx, garbage, sizeof(garbage), &stats));
+	cl_git_fail(git_indexer_commit(idx, &stats));
+
+	cl_assert(git_error_last() != NULL);
+	cl_assert_equal_s("wrong pack signature", git_error_last()->message);
+
+	git_indexer_free(idx);
+}
+
 static int find_tmp_file_recurs(void *opaque, git_str *path)
 {
 	int error = 0;
@@ -0,0 +1,163 @@
+#include "clar_libgit2.h"
+
+#include "pack.h"
+
+#define TABLE_SIZE 1000
+
+static unsigned char _table[TABLE_SIZE * GIT_OID_SHA1_SIZE];
+static uint32_t _seed;
+
+static uint32_t next_random(void)
+{
+	_seed = _seed * 1103515245 + 12345;
+	return _seed >> 8;
+}
+
+static int id_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, GIT_OID_SHA1_SIZE);
+}
+
+/* The position a linear scan would give, to check the search against */
+static int expected_position(const unsigned char *id)
+{
+	int i;
+
+	for (i = 0; i < TABLE_SIZE; i++) {
+		int cmp = memcmp(_table + i * GIT_OID_SHA1_SIZE, id, GIT_OID_SHA1_SIZE);
+
+		if (cmp == 0)
+			return i;
+		else if (cmp > 0)
+			break;
+	}
+
+	return -i - 1;
+}
+
+static void assert_lookups(void)
+{
+	unsigned char id[GIT_OID_SHA1_SIZE];
+	size_t i, j;
+
+	qsort(_table, TABLE_SIZE, GIT_OID_SHA1_SIZE, id_cmp);
+
+	/* Every id that is there is found where it is... */
+	for (i = 0; i < TABLE_SIZE; i++)
+		cl_assert_equal_i((int)i, git_pack__lookup_id(_table,
+			GIT_OID_SHA1_SIZE, 0, TABLE_SIZE,
+			_table + i * GIT_OID_SHA1_SIZE, GIT_OID_SHA1));
+
+	/* ... and those that aren't give the right place to insert them */
+	for (i = 0; i < TABLE_SIZE; i++) {
+		for (j = 0; j < GIT_OID_SHA1_SIZE; j++)
+			id[j] = (unsigned char)next_random();
+
+		if (i % 2)
+			memcpy(id, _table + i * GIT_OID_SHA1_SIZE, 4);
+
+		cl_assert_equal_i(expected_position(id),
+			git_pack__lookup_id(_table, GIT_OID_SHA1_SIZE,
+				0, TABLE_SIZE, id, GIT_OID_SHA1));
+	}
+}
+
+void test_pack_lookup__initialize(void)
+{
+	_seed = 42;
+}
+
+void test_pack_lookup__uniform(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(_table); i++)
+		_table[i] = (unsigned char)next_random();
+
+	assert_lookups();
+}
+
+void test_pack_lookup__skewed(void)
+{
+	size_t i, j;
+
+	/* Most ids are bunched together, with a few at either end */
+	for (i = 0; i < TABLE_SIZE; i++) {
+		unsigned char *id = _table + i * GIT_OID_SHA1_SIZE;
+
+		for (j = 0; j < GIT_OID_SHA1_SIZE; j++)
+			id[j] = (unsigned char)next_random();
+
+		if (i % 10 == 0)
+			id[0] = 0x00;
+		else if (i % 10 == 1)
+			id[0] = 0xff;
+		else
+			memcpy(id, "\x7f\x7f\x7f", 3);
+	}
+
+	assert_lookups();
+}
+
+void test_pack_lookup__shared_key(void)
+{
+	size_t i, j;
+
+	/* Every id has the same first four bytes */
+	for (i = 0; i < TABLE_SIZE; i++) {
+		unsigned char *id = _table + i * GIT_OID_SHA1_SIZE;
+
+		memcpy(id, "\xab\xcd\xef\x01", 4);
+
+		for (j = 4; j < GIT_OID_SHA1_SIZE; j++)
+			id[j] = (unsigned char)next_random();
+	}
+
+	assert_lookups();
+}
+
+static int find_entry(const git_oid *id, void *payload)
+{
+	struct git_pack_file *p = payload;
+	struct git_pack_entry e;
+
+	cl_git_pass(git_pack_index_prefetch(p, id, 1));
+	cl_git_pass(git_pack_entry_find(&e, p, id, GIT_OID_SHA1_HEXSIZE));
+	cl_assert_equal_oid(id, &e.id);
+
+	return 0;
+}
+
+void test_pack_lookup__packfile(void)
+{
+	struct git_pack_file *p;
+	struct git_pack_entry e;
+	git_oid id;
+
+	cl_git_pass(git_packfile_alloc(&p,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"),
+		GIT_OID_SHA1));
+
+	cl_git_pass(git_pack_foreach_entry(p, find_entry, p));
+
+	cl_git_pass(git_oid__fromstr(&id, "1111111111111111111111111111111111111111", GIT_OID_SHA1));
+	cl_git_fail_with(GIT_ENOTFOUND, git_pack_entry_find(&e, p, &id, GIT_OID_SHA1_HEXSIZE));
+
+	git_packfile_free(p, false);
+}
+
+void test_pack_lookup__readahead(void)
+{
+	struct git_pack_file *p;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_PACK_INDEX_READAHEAD, 1));
+
+	cl_git_pass(git_packfile_alloc(&p,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"),
+		GIT_OID_SHA1));
+	cl_git_pass(git_pack_foreach_entry(p, find_entry, p));
+
+	git_packfile_free(p, false);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_PACK_INDEX_READAHEAD, 0));
+}
@@ -5,6 +5,8 @@
 
 #include "futils.h"
 #include "midx.h"
+#include "pack.h"
+#include "pack_bitmap.h"
 
 void test_pack_midx__parse(void)
 {
@@ -114,3 +116,363 @@ void test_pack_midx__odb_create(void)
 
 	cl_git_pass(git_futils_rmdir_r("./clone.git", NULL, GIT_RMDIR_REMOVE_FILES));
 }
+
+void test_pack_midx__writer_bitmap(void)
+{
+	git_repository *repo;
+	git_midx_writer *w = NULL;
+	git_str path = GIT_STR_INIT, midx = GIT_STR_INIT, bitmap = GIT_STR_INIT;
+	char checksum_hex[GIT_OID_SHA1_HEXSIZE + 1];
+	unsigned char *checksum;
+
+	repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/pack"));
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path)));
+#endif
+	cl_git_pass(git_midx_writer_add(w, "pack-58601678ed5ff63e5693b5b0212c742cb0502821.idx"));
+	cl_git_pass(git_midx_writer_set_write_bitmap(w, 1));
+	cl_git_pass(git_midx_writer_commit(w));
+
+	cl_git_pass(git_str_joinpath(&path, git_str_cstr(&path), "multi-pack-index"));
+	cl_git_pass(git_futils_readbuffer(&midx, git_str_cstr(&path)));
+	cl_assert(midx.size > GIT_OID_SHA1_SIZE);
+	checksum = (unsigned char *)midx.ptr + midx.size - GIT_OID_SHA1_SIZE;
+
+	git_hash_fmt(checksum_hex, checksum, GIT_OID_SHA1_SIZE);
+	cl_git_pass(git_str_printf(&path, "-%s.bitmap", checksum_hex));
+	cl_git_pass(git_futils_readbuffer(&bitmap, git_str_cstr(&path)));
+
+	/* The bitmap index describes the multi-pack-index it was written with */
+	cl_assert(bitmap.size > 12 + GIT_OID_SHA1_SIZE);
+	cl_assert_equal_strn("BITM", bitmap.ptr, 4);
+	cl_assert(memcmp(bitmap.ptr + 12, checksum, GIT_OID_SHA1_SIZE) == 0);
+
+	/* Along with the reverse index that it needs, in both forms */
+	git_str_truncate(&path, git_str_len(&path) - strlen(".bitmap"));
+	cl_git_pass(git_str_puts(&path, ".rev"));
+	cl_assert(git_fs_path_exists(git_str_cstr(&path)));
+
+	git_str_dispose(&bitmap);
+	git_str_dispose(&midx);
+	git_str_dispose(&path);
+	git_midx_writer_free(w);
+	cl_git_sandbox_cleanup();
+}
+
+/* Pack a commit on top of HEAD that adds a file, and return its id */
+static void pack_new_commit(git_oid *out, git_repository *repo, git_str *idx_name)
+{
+	git_packbuilder *pb;
+	git_treebuilder *tb;
+	git_signature *sig;
+	git_commit *head;
+	git_tree *tree;
+	git_oid blob_id, tree_id;
+
+	cl_git_pass(git_revparse_single((git_object **)&head, repo, "HEAD"));
+	cl_git_pass(git_commit_tree(&tree, head));
+
+	cl_git_pass(git_blob_create_from_buffer(&blob_id, repo, "in a new pack\n", 14));
+	cl_git_pass(git_treebuilder_new(&tb, repo, tree));
+	cl_git_pass(git_treebuilder_insert(NULL, tb, "midx.txt", &blob_id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&tree_id, tb));
+	git_treebuilder_free(tb);
+	git_tree_free(tree);
+
+	cl_git_pass(git_tree_lookup(&tree, repo, &tree_id));
+	cl_git_pass(git_signature_new(&sig, "A U Thor", "author@example.com", 1234567890, 0));
+	cl_git_pass(git_commit_create(out, repo, "refs/heads/midx", sig, sig,
+		NULL, "Add a file in a new pack\n", tree, 1, &head));
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_commit_free(head);
+
+	cl_git_pass(git_packbuilder_new(&pb, repo));
+	cl_git_pass(git_packbuilder_insert(pb, out, NULL));
+	cl_git_pass(git_packbuilder_insert(pb, &tree_id, NULL));
+	cl_git_pass(git_packbuilder_insert(pb, &blob_id, NULL));
+	cl_git_pass(git_packbuilder_write(pb, NULL, 0, NULL, NULL));
+	cl_git_pass(git_str_printf(idx_name, "pack-%s.idx", git_packbuilder_name(pb)));
+	git_packbuilder_free(pb);
+}
+
+static int check_bitmap_object(
+	const git_oid *id,
+	git_object_t type,
+	struct git_pack_file *pack,
+	off64_t offset,
+	uint32_t name_hash,
+	void *payload)
+{
+	git_object_t pack_type;
+	git_oid pack_id;
+	uint32_t pack_pos, index_pos;
+	size_t *count = payload, size;
+
+	GIT_UNUSED(name_hash);
+
+	/* The object is where the multi-pack-index says it is */
+	cl_git_pass(git_packfile_resolve_header(&size, &pack_type, pack, offset));
+	cl_assert_equal_i(type, pack_type);
+	cl_git_pass(git_pack_offset_to_pack_pos(&pack_pos, pack, offset));
+	cl_git_pass(git_pack_pos_to_index(&index_pos, pack, pack_pos));
+	cl_git_pass(git_pack_nth_entry(&pack_id, NULL, pack, index_pos));
+	cl_assert_equal_oid(id, &pack_id);
+
+	(*count)++;
+	return 0;
+}
+
+void test_pack_midx__bitmap_roundtrip(void)
+{
+	git_repository *repo;
+	git_midx_writer *w = NULL;
+	git_pack_bitmap *pack_bitmap, *bitmap;
+	git_bitmap set = GIT_BITMAP_INIT, stored = GIT_BITMAP_INIT;
+	git_str path = GIT_STR_INIT, idx_name = GIT_STR_INIT;
+	git_oid head, commit;
+	size_t count = 0, head_count;
+
+	repo = cl_git_sandbox_init("testrepo-bitmap.git");
+	cl_git_pass(git_reference_name_to_id(&head, repo, "HEAD"));
+	pack_new_commit(&commit, repo, &idx_name);
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/pack"));
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path)));
+#endif
+	cl_git_pass(git_midx_writer_add(w, "pack-58601678ed5ff63e5693b5b0212c742cb0502821.idx"));
+	cl_git_pass(git_midx_writer_add(w, git_str_cstr(&idx_name)));
+	cl_git_pass(git_midx_writer_set_write_bitmap(w, 1));
+	cl_git_pass(git_midx_writer_commit(w));
+	git_midx_writer_free(w);
+
+	cl_git_pass(git_str_joinpath(&path, git_str_cstr(&path), "multi-pack-index"));
+	cl_git_pass(git_pack_bitmap_open_midx(&bitmap, git_str_cstr(&path), GIT_OID_SHA1));
+	cl_assert_equal_sz(53, git_pack_bitmap_objects(bitmap));
+
+	/* The midx bitmap agrees with that of the pack about the old history */
+	git_str_truncate(&path, git_str_len(&path) - strlen("multi-pack-index"));
+	cl_git_pass(git_str_puts(&path, "pack-58601678ed5ff63e5693b5b0212c742cb0502821.bitmap"));
+	cl_git_pass(git_pack_bitmap_open(&pack_bitmap, git_str_cstr(&path), GIT_OID_SHA1));
+	cl_git_pass(git_pack_bitmap_reachable(&set, pack_bitmap, repo, &head, 1, false));
+	head_count = git_bitmap_popcount(&set);
+	git_pack_bitmap_free(pack_bitmap);
+
+	git_bitmap_clear(&set);
+	cl_git_pass(git_pack_bitmap_reachable(&set, bitmap, repo, &head, 1, false));
+	cl_assert_equal_sz(head_count, git_bitmap_popcount(&set));
+
+	/* The new commit has a bitmap, with a commit, tree and blob more */
+	cl_git_pass(git_pack_bitmap_lookup(&stored, bitmap, &commit));
+	cl_assert_equal_sz(head_count + 3, git_bitmap_popcount(&stored));
+
+	git_bitmap_clear(&set);
+	cl_git_pass(git_pack_bitmap_reachable(&set, bitmap, repo, &commit, 1, false));
+	cl_assert_equal_sz(head_count + 3, git_bitmap_popcount(&set));
+
+	cl_git_pass(git_pack_bitmap_foreach(bitmap, &set, GIT_OBJECT_ANY, check_bitmap_object, &count));
+	cl_assert_equal_sz(head_count + 3, count);
+	git_pack_bitmap_free(bitmap);
+
+	/* ... and is the one that is used for the repository */
+	cl_git_pass(git_pack_bitmap_find(&bitmap, repo));
+	cl_assert(bitmap->midx != NULL);
+	git_pack_bitmap_free(bitmap);
+
+	git_bitmap_dispose(&stored);
+	git_bitmap_dispose(&set);
+	git_str_dispose(&idx_name);
+	git_str_dispose(&path);
+	cl_git_sandbox_cleanup();
+}
+
+void test_pack_midx__reverse_index(void)
+{
+	git_repository *repo;
+	git_midx_writer *w = NULL;
+	struct git_midx_file *idx;
+	struct git_midx_entry e;
+	git_str path = GIT_STR_INIT, midx_path = GIT_STR_INIT, rev_path = GIT_STR_INIT;
+	char checksum_hex[GIT_OID_SHA1_HEXSIZE + 1];
+	git_oid id;
+	uint32_t i, index_pos;
+	off64_t last_offset = 0;
+
+	repo = cl_git_sandbox_init("testrepo-bitmap.git");
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/pack"));
+	cl_git_pass(git_str_joinpath(&midx_path, git_str_cstr(&path), "multi-pack-index"));
+
+	/* A multi-pack-index without a bitmap has no reverse index */
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path)));
+#endif
+	cl_git_pass(git_midx_writer_add(w, "pack-58601678ed5ff63e5693b5b0212c742cb0502821.idx"));
+	cl_git_pass(git_midx_writer_commit(w));
+
+	cl_git_pass(git_midx_open(&idx, git_str_cstr(&midx_path), GIT_OID_SHA1));
+	cl_git_fail_with(GIT_ENOTFOUND, git_midx_pos_to_index(&index_pos, idx, 0));
+	git_midx_free(idx);
+
+	/* Nor does one whose `.rev` file cannot be read */
+	cl_git_pass(git_midx_open(&idx, git_str_cstr(&midx_path), GIT_OID_SHA1));
+	git_hash_fmt(checksum_hex, idx->checksum, GIT_OID_SHA1_SIZE);
+	cl_git_pass(git_str_printf(&rev_path, "%s-%s.rev", git_str_cstr(&midx_path), checksum_hex));
+	git_midx_free(idx);
+
+	cl_git_mkfile(git_str_cstr(&rev_path), "RIDX");
+	cl_git_pass(git_midx_open(&idx, git_str_cstr(&midx_path), GIT_OID_SHA1));
+	cl_git_fail_with(GIT_ENOTFOUND, git_midx_pos_to_index(&index_pos, idx, 0));
+	git_midx_free(idx);
+	cl_must_pass(p_unlink(git_str_cstr(&rev_path)));
+	git_str_clear(&rev_path);
+
+	cl_git_pass(git_midx_writer_set_write_bitmap(w, 1));
+	cl_git_pass(git_midx_writer_commit(w));
+	git_midx_writer_free(w);
+
+	/* With a single pack, pseudo-pack order is pack order */
+	cl_git_pass(git_midx_open(&idx, git_str_cstr(&midx_path), GIT_OID_SHA1));
+	cl_assert(idx->revindex != NULL);
+	cl_assert(idx->rev_map.data == NULL);
+
+	for (i = 0; i < idx->num_objects; i++) {
+		cl_git_pass(git_midx_pos_to_index(&index_pos, idx, i));
+		cl_git_pass(git_oid__fromraw(&id, idx->oid_lookup + index_pos * GIT_OID_SHA1_SIZE, GIT_OID_SHA1));
+		cl_git_pass(git_midx_entry_find(&e, idx, &id, GIT_OID_SHA1_HEXSIZE));
+		cl_assert(e.offset > last_offset);
+		last_offset = e.offset;
+	}
+	cl_git_fail(git_midx_pos_to_index(&index_pos, idx, idx->num_objects));
+
+	git_hash_fmt(checksum_hex, idx->checksum, GIT_OID_SHA1_SIZE);
+	cl_git_pass(git_str_printf(&rev_path, "%s-%s.rev", git_str_cstr(&midx_path), checksum_hex));
+	cl_assert(git_fs_path_exists(git_str_cstr(&rev_path)));
+	git_midx_free(idx);
+
+	git_str_dispose(&rev_path);
+	git_str_dispose(&midx_path);
+	git_str_dispose(&path);
+	cl_git_sandbox_cleanup();
+}
+
+static size_t chain_length(const char *pack_dir)
+{
+	git_str path = GIT_STR_INIT, chain = GIT_STR_INIT;
+	size_t i, lines = 0;
+
+	cl_git_pass(git_str_joinpath(&path, pack_dir, GIT_MIDX_CHAIN_FILE));
+	cl_git_pass(git_futils_readbuffer(&chain, git_str_cstr(&path)));
+
+	for (i = 0; i < git_str_len(&chain); i++)
+		lines += (chain.ptr[i] == '\n');
+
+	git_str_dispose(&chain);
+	git_str_dispose(&path);
+	return lines;
+}
+
+static void assert_pack_index(git_midx_file *idx, const char *hex, uint32_t pack_index)
+{
+	struct git_midx_entry e;
+	git_oid id;
+
+	cl_git_pass(git_oid__fromstr(&id, hex, GIT_OID_SHA1));
+	cl_git_pass(git_midx_entry_find(&e, idx, &id, GIT_OID_SHA1_HEXSIZE));
+	cl_assert_equal_oid(&id, &e.sha1);
+	cl_assert_equal_i(pack_index, e.pack_index);
+}
+
+void test_pack_midx__incremental(void)
+{
+	git_repository *repo;
+	git_midx_writer *w = NULL;
+	struct git_midx_file *idx;
+	git_odb *odb;
+	git_commit *commit;
+	git_oid id;
+	git_str path = GIT_STR_INIT, chain_path = GIT_STR_INIT;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(repo), "objects/pack"));
+	cl_git_pass(git_str_joinpath(&chain_path, git_str_cstr(&path), GIT_MIDX_CHAIN_FILE));
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path)));
+#endif
+	cl_git_pass(git_midx_writer_set_incremental(w, 1));
+
+	/* The first layer replaces the multi-pack-index */
+	cl_git_pass(git_midx_writer_add(w, "pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"));
+	cl_git_pass(git_midx_writer_commit(w));
+	cl_assert_equal_sz(1, chain_length(git_str_cstr(&path)));
+	cl_assert(!git_fs_path_exists("testrepo.git/objects/pack/multi-pack-index"));
+
+	/* A small pack goes in a layer of its own... */
+	cl_git_pass(git_midx_writer_add(w, "pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5.idx"));
+	cl_git_pass(git_midx_writer_commit(w));
+	cl_assert_equal_sz(2, chain_length(git_str_cstr(&path)));
+
+	/* ... and is merged with the next one that is not much smaller */
+	cl_git_pass(git_midx_writer_add(w, "pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a.idx"));
+	cl_git_pass(git_midx_writer_commit(w));
+	cl_assert_equal_sz(2, chain_length(git_str_cstr(&path)));
+
+	git_midx_writer_free(w);
+
+	cl_git_pass(git_midx_open_chain(&idx, git_str_cstr(&chain_path), GIT_OID_SHA1));
+	cl_assert(!git_midx_chain_needs_refresh(idx, git_str_cstr(&chain_path)));
+	cl_assert_equal_i(2, git_vector_length(&idx->packfile_names));
+	cl_assert_equal_i(12, idx->num_objects);
+	cl_assert(idx->base != NULL && idx->base->base == NULL);
+	cl_assert_equal_i(idx->base->num_objects, idx->num_objects_in_base);
+	cl_assert_equal_i(1, idx->num_packs_in_base);
+
+	/* Packfiles are numbered across the chain */
+	assert_pack_index(idx, "001d938dbe69b6251f4a03cf374235c72fd0a0d2", 0);
+	assert_pack_index(idx, "5001298e0c09ad9c34e4249bc5801c75e9754fa5", 1);
+	assert_pack_index(idx, "e90810b8df3e80c413d903f631643c716887138d", 2);
+	git_midx_free(idx);
+
+	/* The object database reads the chain, and adds to it */
+	cl_git_pass(git_oid__fromstr(&id, "5001298e0c09ad9c34e4249bc5801c75e9754fa5", GIT_OID_SHA1));
+	cl_git_pass(git_commit_lookup(&commit, repo, &id));
+	cl_assert_equal_s(git_commit_message(commit), "packed commit one\n");
+	git_commit_free(commit);
+
+	cl_git_pass(git_repository_odb(&odb, repo));
+	cl_git_pass(git_oid__fromstr(&id, "e90810b8df3e80c413d903f631643c716887138d", GIT_OID_SHA1));
+	cl_assert(git_odb_exists(odb, &id));
+	cl_git_pass(git_odb_write_multi_pack_index(odb));
+	cl_assert_equal_sz(2, chain_length(git_str_cstr(&path)));
+	git_odb_free(odb);
+
+	/* A whole multi-pack-index replaces the chain */
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path), GIT_OID_SHA1));
+#else
+	cl_git_pass(git_midx_writer_new(&w, git_str_cstr(&path)));
+#endif
+	cl_git_pass(git_midx_writer_add(w, "pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"));
+	cl_git_pass(git_midx_writer_commit(w));
+	git_midx_writer_free(w);
+
+	cl_assert(git_fs_path_exists("testrepo.git/objects/pack/multi-pack-index"));
+	cl_assert(!git_fs_path_exists("testrepo.git/objects/pack/multi-pack-index.d"));
+
+	git_str_dispose(&chain_path);
+	git_str_dispose(&path);
+	cl_git_sandbox_cleanup();
+}
@@ -1,8 +1,10 @@
 #include "clar_libgit2.h"
 #include "futils.h"
 #include "pack.h"
+#include "pack-objects.h"
 #include "hash.h"
 #include "iterator.h"
+#include "zstream.h"
 #include "vector.h"
 #include "posix.h"
 #include "hash.h"
@@ -163,6 +165,381 @@ void test_pack_packbuilder__write_default_path(void)
 	git_str_dispose(&pack);
 }
 
+static void index_packbuilder(git_indexer_progress *stats)
+{
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&_indexer, ".", GIT_OID_SHA1, NULL));
+#else
+	cl_git_pass(git_indexer_new(&_indexer, ".", 0, NULL, NULL));
+#endif
+
+	cl_git_pass(git_packbuilder_foreach(_packbuilder, feed_indexer, stats));
+	cl_git_pass(git_indexer_commit(_indexer, stats));
+}
+
+/*
+ * The objects in the sandbox are loose; pack them up into the object
+ * directory so that the next packbuilder can reuse them.
+ */
+static void repack(git_str *idx_path)
+{
+	git_odb *odb;
+
+	seed_packbuilder();
+	cl_git_pass(git_packbuilder_write(_packbuilder, NULL, 0, NULL, NULL));
+
+	git_str_puts(idx_path, "objects/pack/");
+	get_index_path(idx_path, _packbuilder);
+
+	git_packbuilder_free(_packbuilder);
+	cl_git_pass(git_packbuilder_new(&_packbuilder, _repo));
+
+	cl_git_pass(git_repository_odb(&odb, _repo));
+	cl_git_pass(git_odb_refresh(odb));
+	git_odb_free(odb);
+}
+
+void test_pack_packbuilder__reuse(void)
+{
+	git_indexer_progress stats;
+	struct git_pack_file *pack;
+	git_str idx = GIT_STR_INIT;
+
+	repack(&idx);
+
+	seed_packbuilder();
+	index_packbuilder(&stats);
+
+	/* The indexer has checked every object, including the copied ones */
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), stats.indexed_objects);
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), _packbuilder->nr_reused);
+	cl_assert(stats.indexed_deltas > 0);
+
+	/* The pack that they were copied from is held open, besides by the odb */
+	cl_assert_equal_sz(1, _packbuilder->reuse_packs.length);
+	pack = git_vector_get(&_packbuilder->reuse_packs, 0);
+	cl_assert(git__suffixcmp(pack->pack_name, ".pack") == 0);
+	cl_assert(git_atomic32_get(&pack->refcount) >= 2);
+
+	git_str_dispose(&idx);
+}
+
+static void corrupt_index_crcs(const char *path)
+{
+	git_str buf = GIT_STR_INIT;
+	unsigned char *data;
+	size_t nr, crcs, i;
+
+	cl_git_pass(git_futils_readbuffer(&buf, path));
+	data = (unsigned char *)buf.ptr;
+
+	/* A version 2 index: header, fanout, object ids and then the CRCs */
+	cl_assert(buf.size > 8 + 4 * 256);
+	cl_assert(memcmp(data, "\377tOc\0\0\0\2", 8) == 0);
+
+	nr = ntohl(*(uint32_t *)(data + 8 + 4 * 255));
+	crcs = 8 + 4 * 256 + GIT_OID_SHA1_SIZE * nr;
+	cl_assert(buf.size > crcs + 4 * nr);
+
+	for (i = 0; i < 4 * nr; i++)
+		data[crcs + i] ^= 0xff;
+
+	cl_git_pass(p_chmod(path, 0644));
+	cl_git_pass(git_futils_writebuffer(&buf, path, 0, 0644));
+
+	git_str_dispose(&buf);
+}
+
+void test_pack_packbuilder__reuse_crc_mismatch(void)
+{
+	git_indexer_progress stats;
+	git_str idx = GIT_STR_INIT;
+
+	repack(&idx);
+	corrupt_index_crcs(idx.ptr);
+
+	/* Nothing can be copied, so everything is packed from scratch */
+	seed_packbuilder();
+	index_packbuilder(&stats);
+
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), stats.indexed_objects);
+	cl_assert_equal_i(0, _packbuilder->nr_reused);
+
+	git_str_dispose(&idx);
+}
+
+struct delta_types {
+	size_t ofs;
+	size_t ref;
+};
+
+static int collect_offset(const git_oid *id, off64_t offset, void *payload)
+{
+	git_array_t(off64_t) *offsets = payload;
+	off64_t *o;
+
+	GIT_UNUSED(id);
+
+	o = git_array_alloc(*offsets);
+	GIT_ERROR_CHECK_ALLOC(o);
+
+	*o = offset;
+	return 0;
+}
+
+static void put_object_header(git_str *pack, git_object_t type, size_t size)
+{
+	unsigned char c = (unsigned char)((type << 4) | (size & 15));
+
+	for (size >>= 4; size; size >>= 7) {
+		git_str_putc(pack, (char)(c | 0x80));
+		c = size & 0x7f;
+	}
+
+	git_str_putc(pack, (char)c);
+}
+
+static void put_varint(git_str *buf, size_t n)
+{
+	for (; n >= 0x80; n >>= 7)
+		git_str_putc(buf, (char)((n & 0x7f) | 0x80));
+
+	git_str_putc(buf, (char)n);
+}
+
+/*
+ * Write a pack of `count` blobs, each of which is stored as a delta
+ * against the one before it, and index it into the object directory.
+ */
+static void write_delta_chain_pack(git_oid *ids, size_t count)
+{
+	git_indexer *idx;
+	git_indexer_progress stats = { 0 };
+	git_str pack = GIT_STR_INIT, blob = GIT_STR_INIT,
+		delta = GIT_STR_INIT, zbuf = GIT_STR_INIT;
+	unsigned char checksum[GIT_HASH_SHA1_SIZE];
+	uint32_t word;
+	size_t i;
+
+	git_str_puts(&pack, "PACK");
+	word = htonl(2);
+	git_str_put(&pack, (char *)&word, 4);
+	word = htonl((uint32_t)count);
+	git_str_put(&pack, (char *)&word, 4);
+
+	git_str_puts(&blob, "A blob that changes by one byte in every version of it\n");
+
+	for (i = 0; i < count; i++) {
+		if (i == 0) {
+			put_object_header(&pack, GIT_OBJECT_BLOB, blob.size);
+			cl_git_pass(git_zstream_deflatebuf(&zbuf, blob.ptr, blob.size));
+		} else {
+			/* Copy all of the previous version, then add a byte */
+			git_str_clear(&delta);
+			put_varint(&delta, blob.size);
+			put_varint(&delta, blob.size + 1);
+			git_str_putc(&delta, (char)0x90);
+			git_str_putc(&delta, (char)blob.size);
+			git_str_putc(&delta, 1);
+			git_str_putc(&delta, 'x');
+			cl_git_pass(git_str_oom(&delta) ? -1 : 0);
+
+			put_object_header(&pack, GIT_OBJECT_REF_DELTA, delta.size);
+			git_str_put(&pack, (char *)ids[i - 1].id, GIT_OID_SHA1_SIZE);
+			cl_git_pass(git_zstream_deflatebuf(&zbuf, delta.ptr, delta.size));
+
+			git_str_putc(&blob, 'x');
+		}
+
+		git_str_put(&pack, zbuf.ptr, zbuf.size);
+		git_str_clear(&zbuf);
+
+		cl_git_pass(git_odb_hash(&ids[i], blob.ptr, blob.size, GIT_OBJECT_BLOB));
+	}
+
+	cl_git_pass(git_hash_buf(checksum, pack.ptr, pack.size, GIT_HASH_ALGORITHM_SHA1));
+	git_str_put(&pack, (char *)checksum, GIT_HASH_SHA1_SIZE);
+	cl_git_pass(git_str_oom(&pack) ? -1 : 0);
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&idx, "objects/pack", GIT_OID_SHA1, NULL));
+#else
+	cl_git_pass(git_indexer_new(&idx, "objects/pack", 0, NULL, NULL));
+#endif
+	cl_git_pass(git_indexer_append(idx, pack.ptr, pack.size, &stats));
+	cl_git_pass(git_indexer_commit(idx, &stats));
+	cl_assert_equal_i(count, stats.indexed_objects);
+	git_indexer_free(idx);
+
+	git_str_dispose(&zbuf);
+	git_str_dispose(&delta);
+	git_str_dispose(&blob);
+	git_str_dispose(&pack);
+}
+
+static size_t delta_depth(struct git_pack_file *pack, off64_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	git_object_t type;
+	off64_t curpos, base_offset;
+	size_t size, depth = 0;
+
+	for (;;) {
+		curpos = offset;
+		cl_git_pass(git_packfile_unpack_header(&size, &type, pack, &w_curs, &curpos));
+
+		if (type != GIT_OBJECT_OFS_DELTA && type != GIT_OBJECT_REF_DELTA)
+			break;
+
+		cl_git_pass(get_delta_base(&base_offset, pack, &w_curs, &curpos, type, offset));
+		offset = base_offset;
+		depth++;
+	}
+
+	git_mwindow_close(&w_curs);
+	return depth;
+}
+
+void test_pack_packbuilder__reuse_deep_delta_chain(void)
+{
+	git_array_t(off64_t) offsets = GIT_ARRAY_INIT;
+	git_oid ids[GIT_PACK_DEPTH * 2];
+	git_indexer_progress stats;
+	git_str path = GIT_STR_INIT;
+	struct git_pack_file *pack;
+	git_odb *odb;
+	size_t i, depth, max_depth = 0;
+	off64_t *o;
+
+	write_delta_chain_pack(ids, ARRAY_SIZE(ids));
+
+	cl_git_pass(git_repository_odb(&odb, _repo));
+	cl_git_pass(git_odb_refresh(odb));
+	git_odb_free(odb);
+
+	for (i = 0; i < ARRAY_SIZE(ids); i++)
+		cl_git_pass(git_packbuilder_insert(_packbuilder, &ids[i], NULL));
+
+	index_packbuilder(&stats);
+	cl_assert(_packbuilder->nr_reused > 0);
+
+	/* The stored chain is deeper than we allow, so it has been cut */
+	git_str_printf(&path, "pack-%s.idx", git_indexer_name(_indexer));
+	cl_git_pass(git_packfile_alloc(&pack, path.ptr, GIT_OID_SHA1));
+	cl_git_pass(git_pack_foreach_entry_offset(pack, collect_offset, &offsets));
+	cl_assert_equal_sz(ARRAY_SIZE(ids), offsets.size);
+
+	git_array_foreach(offsets, i, o) {
+		if ((depth = delta_depth(pack, *o)) > max_depth)
+			max_depth = depth;
+	}
+
+	cl_assert(max_depth > 0);
+	cl_assert(max_depth <= GIT_PACK_DEPTH);
+
+	git_packfile_free(pack, false);
+	git_array_clear(offsets);
+	git_str_dispose(&path);
+}
+
+static void write_and_count_deltas(struct delta_types *types, off64_t *pack_size, int ofs_delta)
+{
+	git_array_t(off64_t) offsets = GIT_ARRAY_INIT;
+	git_indexer_progress stats;
+	git_str path = GIT_STR_INIT;
+	struct git_pack_file *pack;
+	git_mwindow *w_curs = NULL;
+	git_object_t type;
+	off64_t *o, offset;
+	size_t i, size;
+
+	memset(types, 0, sizeof(*types));
+
+	seed_packbuilder();
+	cl_git_pass(git_packbuilder_set_ofs_delta(_packbuilder, ofs_delta));
+	index_packbuilder(&stats);
+
+	git_str_printf(&path, "pack-%s.idx", git_indexer_name(_indexer));
+	cl_git_pass(git_packfile_alloc(&pack, path.ptr, GIT_OID_SHA1));
+	cl_git_pass(git_pack_foreach_entry_offset(pack, collect_offset, &offsets));
+
+	git_array_foreach(offsets, i, o) {
+		offset = *o;
+		cl_git_pass(git_packfile_unpack_header(&size, &type, pack, &w_curs, &offset));
+		git_mwindow_close(&w_curs);
+
+		if (type == GIT_OBJECT_OFS_DELTA)
+			types->ofs++;
+		else if (type == GIT_OBJECT_REF_DELTA)
+			types->ref++;
+	}
+
+	*pack_size = pack->mwf.size;
+
+	git_packfile_free(pack, false);
+	git_array_clear(offsets);
+	git_indexer_free(_indexer);
+	_indexer = NULL;
+	git_str_dispose(&path);
+}
+
+void test_pack_packbuilder__ofs_delta(void)
+{
+	struct delta_types ofs, ref;
+	off64_t ofs_size, ref_size;
+
+	write_and_count_deltas(&ref, &ref_size, 0);
+	cl_assert(ref.ref > 0);
+	cl_assert_equal_sz(0, ref.ofs);
+
+	git_packbuilder_free(_packbuilder);
+	cl_git_pass(git_packbuilder_new(&_packbuilder, _repo));
+
+	/* The indexer would have failed on a delta that precedes its base */
+	write_and_count_deltas(&ofs, &ofs_size, 1);
+	cl_assert_equal_sz(ref.ref, ofs.ofs);
+	cl_assert_equal_sz(0, ofs.ref);
+	cl_assert(ofs_size < ref_size);
+}
+
+static void write_with_threads(git_str *out, unsigned int threads, size_t memory_limit)
+{
+	git_packbuilder_free(_packbuilder);
+	cl_git_pass(git_packbuilder_new(&_packbuilder, _repo));
+
+	seed_packbuilder();
+
+	/* Search for deltas on a single thread, so that they are the same */
+	cl_git_pass(git_packbuilder__prepare(_packbuilder));
+
+	git_packbuilder_set_threads(_packbuilder, threads);
+	_packbuilder->write_memory_limit = memory_limit;
+
+	cl_git_pass(git_packbuilder__write_buf(out, _packbuilder));
+}
+
+void test_pack_packbuilder__threaded_write(void)
+{
+	git_str serial = GIT_STR_INIT, threaded = GIT_STR_INIT,
+		limited = GIT_STR_INIT;
+
+	write_with_threads(&serial, 1, GIT_PACK_WRITE_MEMORY);
+	write_with_threads(&threaded, 4, GIT_PACK_WRITE_MEMORY);
+
+	/* Hardly let any compressed data wait to be written */
+	write_with_threads(&limited, 4, 1);
+
+	cl_assert(serial.size > 0);
+	cl_assert_equal_sz(serial.size, threaded.size);
+	cl_assert(memcmp(serial.ptr, threaded.ptr, serial.size) == 0);
+	cl_assert_equal_sz(serial.size, limited.size);
+	cl_assert(memcmp(serial.ptr, limited.ptr, serial.size) == 0);
+
+	git_str_dispose(&serial);
+	git_str_dispose(&threaded);
+	git_str_dispose(&limited);
+}
+
 static void test_write_pack_permission(mode_t given, mode_t expected)
 {
 	struct stat statbuf;
@@ -220,13 +597,13 @@ void test_pack_packbuilder__does_not_fsync_by_default(void)
 	cl_assert_equal_sz(0, p_fsync__cnt);
 }
 
-/* We fsync the packfile and index.  On non-Windows, we also fsync
- * the parent directories.
+/* We fsync the packfile, index and reverse index.  On non-Windows,
+ * we also fsync the parent directories.
  */
 #ifdef GIT_WIN32
-static int expected_fsyncs = 2;
+static int expected_fsyncs = 3;
 #else
-static int expected_fsyncs = 4;
+static int expected_fsyncs = 6;
 #endif
 
 void test_pack_packbuilder__fsync_global_setting(void)
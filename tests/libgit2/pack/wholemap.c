@@ -0,0 +1,85 @@
+#include "clar_libgit2.h"
+#include "mwindow.h"
+#include "pack.h"
+
+#define PACK_FIXTURE "testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"
+
+static struct git_pack_file *_pack;
+
+void test_pack_wholemap__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE, 1));
+	cl_git_pass(git_packfile_alloc(&_pack, cl_fixture(PACK_FIXTURE), GIT_OID_SHA1));
+}
+
+void test_pack_wholemap__cleanup(void)
+{
+	git_packfile_free(_pack, false);
+	_pack = NULL;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE, 0));
+}
+
+static int read_entry(const git_oid *id, void *payload)
+{
+	struct git_pack_entry e;
+	git_rawobj obj;
+	git_oid actual;
+
+	GIT_UNUSED(payload);
+
+	cl_git_pass(git_pack_entry_find(&e, _pack, id, GIT_OID_SHA1_HEXSIZE));
+	cl_git_pass(git_packfile_unpack(&obj, _pack, &e.offset));
+	cl_git_pass(git_odb__hashobj(&actual, &obj, GIT_OID_SHA1));
+	cl_assert_equal_oid(id, &actual);
+
+	git__free(obj.data);
+	return 0;
+}
+
+void test_pack_wholemap__reads_from_one_window(void)
+{
+	cl_git_pass(git_pack_foreach_entry(_pack, read_entry, NULL));
+
+	cl_assert(_pack->mwf.whole != NULL);
+	cl_assert(_pack->mwf.windows == NULL);
+	cl_assert_equal_i(0, _pack->mwf.whole->offset);
+	cl_assert_equal_sz((size_t)_pack->mwf.size, _pack->mwf.whole->window_map.len);
+}
+
+void test_pack_wholemap__disabled(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_MWINDOW_MAP_WHOLE, 0));
+	cl_git_pass(git_pack_foreach_entry(_pack, read_entry, NULL));
+
+	cl_assert(_pack->mwf.whole == NULL);
+	cl_assert(_pack->mwf.windows != NULL);
+}
+
+#ifdef GIT_THREADS
+static void *read_entries(void *arg)
+{
+	GIT_UNUSED(arg);
+
+	cl_git_pass(git_pack_foreach_entry(_pack, read_entry, NULL));
+	return NULL;
+}
+#endif
+
+void test_pack_wholemap__threads(void)
+{
+#ifdef GIT_THREADS
+	git_thread threads[8];
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(threads); i++)
+		cl_git_pass(git_thread_create(&threads[i], read_entries, NULL));
+	for (i = 0; i < ARRAY_SIZE(threads); i++)
+		cl_git_pass(git_thread_join(&threads[i], NULL));
+
+	cl_assert(_pack->mwf.whole != NULL);
+	cl_assert(_pack->mwf.windows == NULL);
+#else
+	cl_skip();
+#endif
+}
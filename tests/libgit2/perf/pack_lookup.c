@@ -0,0 +1,115 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+
+#include "pack.h"
+
+/*
+ * Lookups of the ids in a pack index, one at a time and in batches
+ * whose index pages are prefetched first.  The fixtures' indexes are
+ * tiny and stay in the cache; set GITTEST_PERF_IDX to the path of the
+ * `.idx` file of a large packfile for meaningful numbers.
+ */
+#define PERF_IDX_FIXTURE "testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"
+#define PERF_LOOKUPS (1000 * 1000)
+#define PERF_BATCH 16
+
+static struct git_pack_file *_pack;
+static git_array_t(git_oid) _ids;
+
+static int collect_id(const git_oid *id, void *payload)
+{
+	git_oid *out;
+
+	GIT_UNUSED(payload);
+
+	out = git_array_alloc(_ids);
+	GIT_ERROR_CHECK_ALLOC(out);
+
+	git_oid_cpy(out, id);
+	return 0;
+}
+
+void test_perf_pack_lookup__initialize(void)
+{
+	char *path = cl_getenv("GITTEST_PERF_IDX");
+	git_oid *ids;
+	size_t i, count;
+
+	cl_git_pass(git_packfile_alloc(&_pack,
+		path ? path : cl_fixture(PERF_IDX_FIXTURE), GIT_OID_SHA1));
+	cl_git_pass(git_pack_foreach_entry(_pack, collect_id, NULL));
+
+	git__free(path);
+
+	/* Look the ids up in a scattered order rather than sorted */
+	ids = _ids.ptr;
+	count = git_array_size(_ids);
+
+	for (i = count - 1; i > 0; i--) {
+		size_t j = (i * 2654435761u) % (i + 1);
+		git_oid tmp = ids[i];
+
+		ids[i] = ids[j];
+		ids[j] = tmp;
+	}
+}
+
+void test_perf_pack_lookup__cleanup(void)
+{
+	git_packfile_free(_pack, false);
+	_pack = NULL;
+
+	git_array_clear(_ids);
+}
+
+static void report(perf_timer *t, uint64_t started, const char *what, size_t lookups)
+{
+	double seconds = (double)(git_time_monotonic() - started) / 1000;
+
+	perf__timer__report(t, "%s: %" PRIuZ " lookups in %" PRIuZ " ids, %.0f lookups/s",
+		what, lookups, git_array_size(_ids),
+		seconds > 0 ? lookups / seconds : 0);
+}
+
+void test_perf_pack_lookup__single(void)
+{
+	perf_timer t = PERF_TIMER_INIT;
+	uint64_t started;
+	struct git_pack_entry e;
+	size_t i, count = git_array_size(_ids);
+
+	started = git_time_monotonic();
+	perf__timer__start(&t);
+
+	for (i = 0; i < PERF_LOOKUPS; i++)
+		cl_git_pass(git_pack_entry_find(&e, _pack,
+			git_array_get(_ids, i % count), GIT_OID_SHA1_HEXSIZE));
+
+	perf__timer__stop(&t);
+	report(&t, started, "single", PERF_LOOKUPS);
+}
+
+void test_perf_pack_lookup__batched(void)
+{
+	perf_timer t = PERF_TIMER_INIT;
+	uint64_t started;
+	struct git_pack_entry e;
+	size_t i, j, batch, count = git_array_size(_ids);
+
+	started = git_time_monotonic();
+	perf__timer__start(&t);
+
+	for (i = 0; i < PERF_LOOKUPS; i += batch) {
+		size_t start = i % count;
+
+		batch = min(min(PERF_BATCH, count - start), PERF_LOOKUPS - i);
+		cl_git_pass(git_pack_index_prefetch(_pack, git_array_get(_ids, start), batch));
+
+		for (j = 0; j < batch; j++)
+			cl_git_pass(git_pack_entry_find(&e, _pack,
+				git_array_get(_ids, start + j), GIT_OID_SHA1_HEXSIZE));
+	}
+
+	perf__timer__stop(&t);
+	report(&t, started, "batched", PERF_LOOKUPS);
+}
@@ -0,0 +1,154 @@
+#include "clar_libgit2.h"
+#include "ewah.h"
+
+static void set_some_bits(git_bitmap *bitmap, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; ++i) {
+		if (i % 3 == 0 || i % 7 == 0)
+			cl_git_pass(git_bitmap_set(bitmap, i));
+	}
+}
+
+static void roundtrip(const git_bitmap *bitmap)
+{
+	git_ewah ewah = GIT_EWAH_INIT, parsed = GIT_EWAH_INIT;
+	git_bitmap out = GIT_BITMAP_INIT;
+	git_str buf = GIT_STR_INIT;
+	size_t consumed;
+
+	cl_git_pass(git_ewah_from_bitmap(&ewah, bitmap));
+	cl_git_pass(git_ewah_serialize(&buf, &ewah));
+
+	cl_git_pass(git_ewah_parse(&parsed, &consumed, (unsigned char *)buf.ptr, buf.size));
+	cl_assert_equal_sz(buf.size, consumed);
+
+	cl_git_pass(git_ewah_to_bitmap(&out, &parsed));
+	cl_assert(git_bitmap_equal(bitmap, &out));
+	cl_assert_equal_sz(git_bitmap_popcount(bitmap), git_bitmap_popcount(&out));
+
+	git_bitmap_dispose(&out);
+	git_ewah_dispose(&parsed);
+	git_ewah_dispose(&ewah);
+	git_str_dispose(&buf);
+}
+
+void test_ewah__bitmap_operations(void)
+{
+	git_bitmap a = GIT_BITMAP_INIT, b = GIT_BITMAP_INIT;
+	size_t pos, count = 0;
+
+	cl_git_pass(git_bitmap_init(&a, 0));
+	cl_git_pass(git_bitmap_set(&a, 1));
+	cl_git_pass(git_bitmap_set(&a, 64));
+	cl_git_pass(git_bitmap_set(&a, 1000));
+
+	cl_git_pass(git_bitmap_init(&b, 128));
+	cl_git_pass(git_bitmap_set(&b, 64));
+	cl_git_pass(git_bitmap_set(&b, 65));
+
+	cl_assert(git_bitmap_get(&a, 1000));
+	cl_assert(!git_bitmap_get(&a, 999));
+	cl_assert(!git_bitmap_get(&b, 1000000));
+
+	cl_git_pass(git_bitmap_or(&b, &a));
+	cl_assert_equal_sz(4, git_bitmap_popcount(&b));
+
+	git_bitmap_and_not(&b, &a);
+	cl_assert_equal_sz(1, git_bitmap_popcount(&b));
+	cl_assert(git_bitmap_get(&b, 65));
+
+	git_bitmap_foreach(&a, pos) {
+		cl_assert(pos == 1 || pos == 64 || pos == 1000);
+		count++;
+	}
+	cl_assert_equal_sz(3, count);
+
+	git_bitmap_dispose(&a);
+	git_bitmap_dispose(&b);
+}
+
+void test_ewah__roundtrip(void)
+{
+	git_bitmap bitmap = GIT_BITMAP_INIT;
+	size_t i;
+
+	/* empty */
+	roundtrip(&bitmap);
+
+	/* literal words only */
+	set_some_bits(&bitmap, 500);
+	roundtrip(&bitmap);
+
+	/* a long run of zeros and then ones */
+	git_bitmap_clear(&bitmap);
+	for (i = 64 * 100; i < 64 * 300; i++)
+		cl_git_pass(git_bitmap_set(&bitmap, i));
+	cl_git_pass(git_bitmap_set(&bitmap, 64 * 400 + 3));
+	roundtrip(&bitmap);
+
+	git_bitmap_dispose(&bitmap);
+}
+
+void test_ewah__xor(void)
+{
+	git_bitmap a = GIT_BITMAP_INIT, b = GIT_BITMAP_INIT, out = GIT_BITMAP_INIT;
+	git_ewah ewah = GIT_EWAH_INIT;
+	size_t i;
+
+	for (i = 0; i < 64 * 10; i++)
+		cl_git_pass(git_bitmap_set(&a, i));
+	set_some_bits(&b, 64 * 12);
+
+	cl_git_pass(git_ewah_from_bitmap(&ewah, &b));
+	cl_git_pass(git_bitmap_dup(&out, &a));
+	cl_git_pass(git_ewah_xor_into(&out, &ewah));
+
+	cl_git_pass(git_bitmap_xor(&a, &b));
+	cl_assert(git_bitmap_equal(&a, &out));
+
+	git_ewah_dispose(&ewah);
+	git_bitmap_dispose(&a);
+	git_bitmap_dispose(&b);
+	git_bitmap_dispose(&out);
+}
+
+void test_ewah__parse_truncated(void)
+{
+	const unsigned char data[] = { 0, 0, 0, 64, 0, 0, 0, 2, 0, 0, 0, 0 };
+	git_ewah ewah;
+	size_t consumed;
+
+	cl_git_fail(git_ewah_parse(&ewah, &consumed, data, 4));
+	cl_git_fail(git_ewah_parse(&ewah, &consumed, data, sizeof(data)));
+}
+
+void test_ewah__run_beyond_size(void)
+{
+	/* 64 bits, with a run of one word of ones, and then of 2^31 words */
+	const unsigned char one_word[] = {
+		0, 0, 0, 64, 0, 0, 0, 1,
+		0, 0, 0, 0, 0, 0, 0, 3,
+		0, 0, 0, 0
+	};
+	const unsigned char huge_run[] = {
+		0, 0, 0, 64, 0, 0, 0, 1,
+		0, 0, 0, 1, 0, 0, 0, 1,
+		0, 0, 0, 0
+	};
+	git_ewah ewah;
+	git_bitmap out = GIT_BITMAP_INIT;
+	size_t consumed;
+
+	cl_git_pass(git_ewah_parse(&ewah, &consumed, one_word, sizeof(one_word)));
+	cl_git_pass(git_ewah_to_bitmap(&out, &ewah));
+	cl_assert_equal_sz(64, git_bitmap_popcount(&out));
+	git_ewah_dispose(&ewah);
+
+	cl_git_pass(git_ewah_parse(&ewah, &consumed, huge_run, sizeof(huge_run)));
+	cl_git_fail(git_ewah_to_bitmap(&out, &ewah));
+	git_ewah_dispose(&ewah);
+
+	git_bitmap_dispose(&out);
+}
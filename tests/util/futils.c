@@ -113,3 +113,30 @@ void test_futils__mktmp_umask(void)
 	git_str_dispose(&path);
 #endif
 }
+
+void test_futils__mmap_advise(void)
+{
+	git_str contents = GIT_STR_INIT;
+	git_map map;
+	size_t i;
+
+	for (i = 0; i < 3 * 4096; i++)
+		git_str_putc(&contents, (char)('a' + (i % 26)));
+
+	cl_git_pass(git_futils_writebuffer(&contents, "futils/mapped", O_RDWR|O_CREAT, 0666));
+	cl_git_pass(git_futils_mmap_ro_file(&map, "futils/mapped"));
+
+	/* Hints for ranges that do not start on a page, or go past the end */
+	cl_git_pass(p_madvise(&map, 0, map.len, GIT_MAP_ADVICE_SEQUENTIAL));
+	cl_git_pass(p_madvise(&map, 100, 5000, GIT_MAP_ADVICE_RANDOM));
+	cl_git_pass(p_madvise(&map, 4097, SIZE_MAX, GIT_MAP_ADVICE_WILLNEED));
+	cl_git_pass(p_madvise(&map, map.len + 1, 1, GIT_MAP_ADVICE_NORMAL));
+
+	/* The data is still there when the system has let go of it */
+	cl_git_pass(p_madvise(&map, 0, map.len, GIT_MAP_ADVICE_DONTNEED));
+	cl_assert_equal_sz(contents.size, map.len);
+	cl_assert(memcmp(contents.ptr, map.data, map.len) == 0);
+
+	git_futils_mmap_free(&map);
+	git_str_dispose(&contents);
+}
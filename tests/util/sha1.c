@@ -7,12 +7,16 @@
 static git_hash_win32_provider_t orig_provider;
 #endif
 
+static git_hash_acceleration_t orig_acceleration;
+
 void test_sha1__initialize(void)
 {
 #ifdef GIT_SHA1_WIN32
 	orig_provider = git_hash_win32_provider();
 #endif
 
+	orig_acceleration = git_hash_acceleration();
+
 	cl_fixture_sandbox(FIXTURE_DIR);
 }
 
@@ -22,10 +26,15 @@ void test_sha1__cleanup(void)
 	git_hash_win32_set_provider(orig_provider);
 #endif
 
+	git_hash_set_acceleration(orig_acceleration);
+
 	cl_fixture_cleanup(FIXTURE_DIR);
 }
 
-static int sha1_file(unsigned char *out, const char *filename)
+static int hash_file(
+	unsigned char *out,
+	const char *filename,
+	git_hash_algorithm_t algorithm)
 {
 	git_hash_ctx ctx;
 	char buf[2048];
@@ -35,7 +44,7 @@ static int sha1_file(unsigned char *out, const char *filename)
 	fd = p_open(filename, O_RDONLY);
 	cl_assert(fd >= 0);
 
-	cl_git_pass(git_hash_ctx_init(&ctx, GIT_HASH_ALGORITHM_SHA1));
+	cl_git_pass(git_hash_ctx_init(&ctx, algorithm));
 
 	while ((read_len = p_read(fd, buf, 2048)) > 0)
 		cl_git_pass(git_hash_update(&ctx, buf, (size_t)read_len));
@@ -49,6 +58,11 @@ static int sha1_file(unsigned char *out, const char *filename)
 	return ret;
 }
 
+static int sha1_file(unsigned char *out, const char *filename)
+{
+	return hash_file(out, filename, GIT_HASH_ALGORITHM_SHA1);
+}
+
 void test_sha1__sum(void)
 {
 	unsigned char expected[GIT_HASH_SHA1_SIZE] = {
@@ -98,3 +112,73 @@ void test_sha1__win32_providers(void)
 	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
 #endif
 }
+
+/* checksums do not detect collision attacks, but are otherwise the same */
+void test_sha1__unsafe(void)
+{
+	unsigned char expected[GIT_HASH_SHA1_SIZE] = {
+		0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+		0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a
+	};
+	unsigned char actual[GIT_HASH_SHA1_SIZE];
+
+	cl_git_pass(hash_file(actual, FIXTURE_DIR "/shattered-1.pdf", GIT_HASH_ALGORITHM_SHA1_UNSAFE));
+	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+
+	cl_git_pass(git_hash_set_acceleration(GIT_HASH_ACCELERATION_NONE));
+	cl_git_pass(hash_file(actual, FIXTURE_DIR "/shattered-1.pdf", GIT_HASH_ALGORITHM_SHA1_UNSAFE));
+	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+}
+
+void test_sha1__unsafe_lengths(void)
+{
+	unsigned char data[300], expected[GIT_HASH_SHA1_SIZE], actual[GIT_HASH_SHA1_SIZE];
+	git_hash_ctx ctx;
+	size_t len, i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 7);
+
+	/* every length of the last block, in one go and in odd pieces */
+	for (len = 0; len <= sizeof(data); len++) {
+		cl_git_pass(git_hash_buf(expected, data, len, GIT_HASH_ALGORITHM_SHA1));
+
+		cl_git_pass(git_hash_buf(actual, data, len, GIT_HASH_ALGORITHM_SHA1_UNSAFE));
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+
+		cl_git_pass(git_hash_ctx_init(&ctx, GIT_HASH_ALGORITHM_SHA1_UNSAFE));
+		for (i = 0; i < len; i += 13)
+			cl_git_pass(git_hash_update(&ctx, data + i, min(13, len - i)));
+		cl_git_pass(git_hash_final(actual, &ctx));
+		git_hash_ctx_cleanup(&ctx);
+
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+	}
+}
+
+void test_sha1__batch(void)
+{
+	unsigned char data[300], expected[GIT_HASH_SHA1_SIZE], out[10][GIT_HASH_SHA1_SIZE];
+	git_str_vec vecs[10];
+	git_hash_batch_entry entries[10];
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 7);
+
+	for (i = 0; i < ARRAY_SIZE(entries); i++) {
+		vecs[i].data = data + i;
+		vecs[i].len = i * 29;
+
+		entries[i].vec = &vecs[i];
+		entries[i].vec_len = 1;
+		entries[i].out = out[i];
+	}
+
+	cl_git_pass(git_hash_batch(entries, ARRAY_SIZE(entries), GIT_HASH_ALGORITHM_SHA1));
+
+	for (i = 0; i < ARRAY_SIZE(entries); i++) {
+		cl_git_pass(git_hash_buf(expected, vecs[i].data, vecs[i].len, GIT_HASH_ALGORITHM_SHA1));
+		cl_assert_equal_i(0, memcmp(expected, out[i], GIT_HASH_SHA1_SIZE));
+	}
+}
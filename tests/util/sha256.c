@@ -7,12 +7,16 @@
 static git_hash_win32_provider_t orig_provider;
 #endif
 
+static git_hash_acceleration_t orig_acceleration;
+
 void test_sha256__initialize(void)
 {
 #ifdef GIT_SHA256_WIN32
 	orig_provider = git_hash_win32_provider();
 #endif
 
+	orig_acceleration = git_hash_acceleration();
+
 	cl_fixture_sandbox(FIXTURE_DIR);
 }
 
@@ -22,6 +26,8 @@ void test_sha256__cleanup(void)
 	git_hash_win32_set_provider(orig_provider);
 #endif
 
+	git_hash_set_acceleration(orig_acceleration);
+
 	cl_fixture_cleanup(FIXTURE_DIR);
 }
 
@@ -111,3 +117,111 @@ void test_sha256__win32_providers(void)
 	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA256_SIZE));
 #endif
 }
+
+void test_sha256__accelerated(void)
+{
+	unsigned char data[300], expected[GIT_HASH_SHA256_SIZE], actual[GIT_HASH_SHA256_SIZE];
+	git_hash_accelerated_ctx ctx;
+	size_t len, i;
+
+	if (!(orig_acceleration & (GIT_HASH_ACCELERATION_X86_SHA | GIT_HASH_ACCELERATION_ARMV8_SHA)))
+		cl_skip();
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 7);
+
+	/* every length of the last block, in one go and in odd pieces */
+	for (len = 0; len <= sizeof(data); len++) {
+		cl_git_pass(git_hash_set_acceleration(GIT_HASH_ACCELERATION_NONE));
+		cl_git_pass(git_hash_buf(expected, data, len, GIT_HASH_ALGORITHM_SHA256));
+		cl_git_pass(git_hash_set_acceleration(orig_acceleration));
+
+		cl_git_pass(git_hash_sha256_accelerated_init(&ctx));
+		git_hash_accelerated_update(&ctx, data, len);
+		git_hash_accelerated_final(actual, GIT_HASH_SHA256_SIZE, &ctx);
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA256_SIZE));
+
+		cl_git_pass(git_hash_sha256_accelerated_init(&ctx));
+		for (i = 0; i < len; i += 13)
+			git_hash_accelerated_update(&ctx, data + i, min(13, len - i));
+		git_hash_accelerated_final(actual, GIT_HASH_SHA256_SIZE, &ctx);
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA256_SIZE));
+	}
+}
+
+#define BATCH_COUNT 300
+
+static unsigned char batch_data[8192];
+static git_str_vec batch_vecs[BATCH_COUNT][3];
+static git_hash_batch_entry batch_entries[BATCH_COUNT];
+static unsigned char batch_out[BATCH_COUNT][GIT_HASH_SHA256_SIZE];
+
+/*
+ * Messages of every length up to a few blocks, in pieces (some of
+ * them empty), and now and again one that is too long to be hashed
+ * in lanes.
+ */
+static void setup_batch(void)
+{
+	size_t i, len, offset;
+
+	for (i = 0; i < sizeof(batch_data); i++)
+		batch_data[i] = (unsigned char)(i * 7 + (i >> 8));
+
+	for (i = 0; i < BATCH_COUNT; i++) {
+		len = (i % 50 == 49) ? 5000 + i : i;
+		offset = i % 7;
+
+		batch_vecs[i][0].data = batch_data + offset;
+		batch_vecs[i][0].len = len / 3;
+		batch_vecs[i][1].data = batch_data + offset + len / 3;
+		batch_vecs[i][1].len = (i % 2) ? 0 : len / 3;
+		batch_vecs[i][2].data = batch_data + offset + len / 3 + batch_vecs[i][1].len;
+		batch_vecs[i][2].len = len - len / 3 - batch_vecs[i][1].len;
+
+		batch_entries[i].vec = batch_vecs[i];
+		batch_entries[i].vec_len = 3;
+		batch_entries[i].out = batch_out[i];
+	}
+}
+
+static void assert_batch(size_t count)
+{
+	unsigned char expected[GIT_HASH_SHA256_SIZE];
+	size_t i;
+
+	memset(batch_out, 0, sizeof(batch_out));
+	cl_git_pass(git_hash_batch(batch_entries, count, GIT_HASH_ALGORITHM_SHA256));
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_hash_vec(expected, batch_vecs[i], 3, GIT_HASH_ALGORITHM_SHA256));
+		cl_assert_equal_i(0, memcmp(expected, batch_out[i], GIT_HASH_SHA256_SIZE));
+	}
+}
+
+void test_sha256__batch(void)
+{
+	git_hash_acceleration_t accelerations[] = {
+		GIT_HASH_ACCELERATION_NONE,
+		GIT_HASH_ACCELERATION_X86_AVX2,
+		GIT_HASH_ACCELERATION_X86_AVX512,
+		GIT_HASH_ACCELERATION_NONE
+	};
+	size_t i;
+
+	/* and whatever the processor has, all together */
+	accelerations[3] = orig_acceleration;
+
+	setup_batch();
+
+	for (i = 0; i < ARRAY_SIZE(accelerations); i++) {
+		if (git_hash_set_acceleration(accelerations[i]) < 0) {
+			git_error_clear();
+			continue;
+		}
+
+		assert_batch(1);
+		assert_batch(5);
+		assert_batch(BATCH_COUNT);
+	}
+}
@@ -165,3 +165,45 @@ void test_zstream__big_data(void)
 
 	git_str_dispose(&in);
 }
+
+void test_zstream__inflate_known(void)
+{
+	git_str deflated = GIT_STR_INIT;
+	size_t len = strlen(data), used;
+	char out[128];
+
+	cl_git_pass(git_zstream_deflatebuf(&deflated, data, len));
+
+	/* The whole stream, of exactly the expected size */
+	cl_git_pass(git_zstream_inflate_known(&used, out, len, deflated.ptr, deflated.size));
+	cl_assert_equal_sz(deflated.size, used);
+	cl_assert(memcmp(out, data, len) == 0);
+
+	/* Anything after the stream is left alone */
+	git_str_puts(&deflated, "trailing");
+	cl_git_pass(git_zstream_inflate_known(&used, out, len, deflated.ptr, deflated.size));
+	cl_assert_equal_sz(deflated.size - 8, used);
+	cl_assert(memcmp(out, data, len) == 0);
+
+	/* A stream that is cut short might only need more input */
+	cl_git_fail_with(GIT_EBUFS, git_zstream_inflate_known(&used, out, len, deflated.ptr, 4));
+
+	/* But the wrong size is an error */
+	cl_git_fail(git_zstream_inflate_known(&used, out, len - 1, deflated.ptr, deflated.size));
+	cl_git_fail(git_zstream_inflate_known(&used, out, len + 1, deflated.ptr, deflated.size));
+
+	git_str_dispose(&deflated);
+}
+
+void test_zstream__inflate_known_empty(void)
+{
+	git_str deflated = GIT_STR_INIT;
+	size_t used;
+	char out[1];
+
+	cl_git_pass(git_zstream_deflatebuf(&deflated, "", 0));
+	cl_git_pass(git_zstream_inflate_known(&used, out, 0, deflated.ptr, deflated.size));
+	cl_assert_equal_sz(deflated.size, used);
+
+	git_str_dispose(&deflated);
+}